@@ -0,0 +1,38 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Host stand-in, see prof_test.c. */
+
+#ifndef HOST_CORTEX_H
+#define HOST_CORTEX_H
+
+#include <stdint.h>
+
+extern uint32_t sim_primask;
+extern unsigned sim_masks;	/* times interrupts were masked */
+
+static inline uint32_t cm_mask_interrupts(uint32_t mask)
+{
+	uint32_t old = sim_primask;
+
+	if (mask)
+		sim_masks++;
+	sim_primask = mask;
+	return old;
+}
+
+#endif
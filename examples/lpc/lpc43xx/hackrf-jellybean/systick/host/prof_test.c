@@ -0,0 +1,308 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Host test for prof.c.  The DWT cycle counter is simulated: each read
+ * costs a fixed number of cycles plus the work the test says was done
+ * since the last one, and with jitter on every fourth read costs more, as
+ * an interrupt or a bus stall would.  The counter starts close to the
+ * 32 bit wrap and is moved back there now and then.
+ *
+ * Checks:
+ *  - prof_init() measures the cost of an empty probe, however large, and
+ *    ignores the slow calibration runs,
+ *  - prof_end() records exactly the work done, 0 if a sample is cheaper
+ *    than the overhead, and prof_record() stores counts as they are,
+ *  - count, min, max and the 64 bit total match a reference, also for
+ *    totals past 32 bits,
+ *  - probes are found by name, the table fills up at PROF_MAX_PROBES and
+ *    ids out of range are ignored; prof_reset() keeps the probes and
+ *    prof_init() drops them,
+ *  - updates and the dump mask interrupts and leave the mask as it was,
+ *  - the dump has the overhead in its header and a line per probe with
+ *    count, min, mean and max, apart even at 10 digits, and no line
+ *    overflows its buffer.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "prof.h"
+
+static int failures;
+
+#define CHECK(cond, ...) do {						\
+	if (!(cond)) {							\
+		if (failures++ < 10) {					\
+			printf("FAIL %s:%d: ", __FILE__, __LINE__);	\
+			printf(__VA_ARGS__);				\
+			printf("\n");					\
+		}							\
+	}								\
+} while (0)
+
+static uint32_t rng_state = 1;
+
+static uint32_t rnd(void)
+{
+	rng_state ^= rng_state << 13;
+	rng_state ^= rng_state >> 17;
+	rng_state ^= rng_state << 5;
+	return rng_state;
+}
+
+/* --- The cycle counter and interrupt mask --- */
+
+uint32_t sim_primask;
+unsigned sim_masks;
+
+static uint32_t cycles = 0xfffff000;
+static uint32_t read_cost = 7, work, jitter;
+static unsigned reads;
+
+uint32_t sim_cycles(void)
+{
+	cycles += read_cost + work;
+	if (jitter && ++reads % 4 == 0)
+		cycles += jitter;
+	work = 0;
+	return cycles;
+}
+
+/* A probe around w cycles of work. */
+static void timed(int id, uint32_t w)
+{
+	uint32_t start = prof_begin();
+
+	work = w;
+	prof_end(id, start);
+}
+
+/* --- Tests --- */
+
+static void test_overhead(void)
+{
+	static const uint32_t costs[] = { 7, 1, 40, 100000 };
+	unsigned i;
+
+	for (i = 0; i < sizeof(costs) / sizeof(costs[0]); i++) {
+		read_cost = costs[i];
+		jitter = 1000;
+		prof_init();
+		CHECK(prof_overhead() == costs[i], "overhead %u, not %u",
+		      prof_overhead(), costs[i]);
+		CHECK(prof_get(0) == NULL, "probe left over from calibration");
+		CHECK(sim_primask == 0, "interrupts left masked");
+	}
+	read_cost = 7;
+	jitter = 0;
+}
+
+static void test_stats(void)
+{
+	uint32_t w, min = UINT32_MAX, max = 0;
+	uint64_t total = 0;
+	const struct prof_stats *p;
+	int id, raw;
+	unsigned i;
+
+	prof_init();
+	id = prof_probe("work");
+	raw = prof_probe("raw");
+
+	for (i = 0; i < 2000; i++) {
+		if (rnd() % 8 == 0)
+			cycles = -(rnd() % 1000);	/* wraps in the probe */
+		w = rnd() % 4 ? rnd() % 100000 : rnd() % 10;
+		timed(id, w);
+		total += w;
+		if (w < min)
+			min = w;
+		if (w > max)
+			max = w;
+	}
+	p = prof_get(id);
+	CHECK(p && p->count == 2000 && p->min == min && p->max == max &&
+	      p->total == total, "stats %u %u %u %llu, not 2000 %u %u %llu",
+	      p->count, p->min, p->max, (unsigned long long)p->total, min,
+	      max, (unsigned long long)total);
+
+	/* Cheaper than the overhead: clamped, not wrapped. */
+	read_cost = 3;
+	timed(id, 0);
+	read_cost = 7;
+	CHECK(p->count == 2001 && p->min == 0 && p->max == max,
+	      "short sample: min %u max %u", p->min, p->max);
+
+	/* Raw counts, with a total past 32 bits. */
+	for (i = 0; i < 5; i++)
+		prof_record(raw, 3000000000u + i);
+	prof_record(raw, 5);
+	p = prof_get(raw);
+	CHECK(p && p->count == 6 && p->min == 5 && p->max == 3000000004u &&
+	      p->total == 15000000015ull, "raw stats %u %u %u %llu",
+	      p->count, p->min, p->max, (unsigned long long)p->total);
+}
+
+static void test_probes(void)
+{
+	char names[PROF_MAX_PROBES][8], again[8];
+	const struct prof_stats *p;
+	int i, id;
+
+	prof_init();
+	for (i = 0; i < PROF_MAX_PROBES; i++) {
+		sprintf(names[i], "p%d", i);
+		CHECK(prof_probe(names[i]) == i, "probe %d", i);
+		CHECK(i == PROF_MAX_PROBES - 1 || prof_get(i + 1) == NULL,
+		      "probe %d there before it was added", i + 1);
+	}
+	strcpy(again, "p3");
+	CHECK(prof_probe(again) == 3, "lookup by name");
+	CHECK(prof_probe("full") == -1, "probe added to a full table");
+
+	for (i = 0; i < PROF_MAX_PROBES; i++)
+		timed(i, i);
+	prof_end(-1, prof_begin());
+	prof_end(PROF_MAX_PROBES, prof_begin());
+	prof_record(-1, 1);
+	prof_record(PROF_MAX_PROBES, 1);
+	CHECK(prof_get(-1) == NULL && prof_get(PROF_MAX_PROBES) == NULL,
+	      "stats for ids out of range");
+	for (i = 0; i < PROF_MAX_PROBES; i++) {
+		p = prof_get(i);
+		CHECK(p && p->count == 1 && p->total == (uint64_t)i &&
+		      !strcmp(p->name, names[i]), "probe %d disturbed", i);
+	}
+
+	prof_reset();
+	for (i = 0; i < PROF_MAX_PROBES; i++) {
+		p = prof_get(i);
+		CHECK(p && p->count == 0 && p->min == UINT32_MAX &&
+		      p->max == 0 && p->total == 0 &&
+		      !strcmp(p->name, names[i]), "probe %d after reset", i);
+	}
+	CHECK(prof_probe("p5") == 5, "lookup after reset");
+
+	prof_init();
+	CHECK(prof_get(0) == NULL, "probes kept over prof_init()");
+	id = prof_probe("p5");
+	CHECK(id == 0, "first probe after prof_init() is %d", id);
+}
+
+static void test_masking(void)
+{
+	unsigned masks;
+	int id;
+
+	prof_init();
+	id = prof_probe("isr");
+
+	masks = sim_masks;
+	timed(id, 10);
+	prof_record(id, 10);
+	CHECK(sim_masks == masks + 2 && sim_primask == 0,
+	      "%u masked updates, mask %u", sim_masks - masks, sim_primask);
+
+	/* From an ISR or a critical section, the mask stays on. */
+	sim_primask = 1;
+	timed(id, 10);
+	prof_record(id, 10);
+	CHECK(sim_primask == 1, "interrupts unmasked inside a critical section");
+	sim_primask = 0;
+}
+
+static char dump[PROF_MAX_PROBES + 1][128];
+static int dump_lines;
+
+static void dump_line(const char *s)
+{
+	/* prof_dump() builds lines in a 96 byte buffer. */
+	CHECK(strlen(s) < 96, "dump line of %zu characters", strlen(s));
+	if (dump_lines <= PROF_MAX_PROBES)
+		snprintf(dump[dump_lines], sizeof(dump[0]), "%s", s);
+	dump_lines++;
+}
+
+static void test_dump(void)
+{
+	const struct prof_stats *p;
+	unsigned masks;
+	char want[128];
+	int i;
+
+	read_cost = 4000000000u;	/* the widest overhead */
+	prof_init();
+	read_cost = 7;
+	prof_probe("a probe with a long name");
+	prof_probe("idle");
+	prof_probe("big");
+	for (i = 0; i < 100; i++)
+		prof_record(0, 1000 + i);
+	prof_record(2, UINT32_MAX);
+	prof_record(2, UINT32_MAX - 2);
+
+	dump_lines = 0;
+	masks = sim_masks;
+	prof_dump(dump_line);
+	CHECK(dump_lines == 4, "%d dump lines", dump_lines);
+	CHECK(sim_masks == masks + 3 && sim_primask == 0,
+	      "%u masked reads, mask %u", sim_masks - masks, sim_primask);
+
+	snprintf(want, sizeof(want), "%-15s%12s%12s%12s%12s  overhead %u\r\n",
+		 "probe", "count", "min", "avg", "max", prof_overhead());
+	CHECK(!strcmp(dump[0], want), "header %s", dump[0]);
+
+	for (i = 0; i < 3 && i + 1 < dump_lines; i++) {
+		p = prof_get(i);
+		if (p->count)
+			snprintf(want, sizeof(want),
+				 "%-15.15s%12u%12u%12u%12u\r\n", p->name,
+				 p->count, p->min,
+				 (unsigned)(p->total / p->count), p->max);
+		else
+			snprintf(want, sizeof(want), "%-15.15s%12u\r\n",
+				 p->name, p->count);
+		CHECK(!strcmp(dump[i + 1], want), "probe %d: %s", i,
+		      dump[i + 1]);
+	}
+	for (i = 0; i < dump_lines && i <= PROF_MAX_PROBES; i++)
+		printf("%s", dump[i]);
+
+	/* Dumped from a critical section, the mask stays on. */
+	sim_primask = 1;
+	prof_dump(dump_line);
+	CHECK(sim_primask == 1, "interrupts unmasked by the dump");
+	sim_primask = 0;
+}
+
+int main(void)
+{
+	test_overhead();
+	test_stats();
+	test_probes();
+	test_masking();
+	test_dump();
+
+	if (failures) {
+		printf("%d failures\n", failures);
+		return EXIT_FAILURE;
+	}
+	printf("all passed\n");
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,190 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include <libopencm3/cm3/cortex.h>
+
+#include "prof.h"
+
+/* Empty begin/end pairs timed by prof_init(); the fastest one counts. */
+#define PROF_CALIBRATE		16
+
+static struct prof_stats probes[PROF_MAX_PROBES];
+static int nprobes;
+static uint32_t overhead;
+
+static void clear(struct prof_stats *p)
+{
+	p->count = 0;
+	p->min = UINT32_MAX;
+	p->max = 0;
+	p->total = 0;
+}
+
+/* Probes may be shared between an ISR and the main loop. */
+static void record(struct prof_stats *p, uint32_t cycles)
+{
+	uint32_t masked = cm_mask_interrupts(1);
+
+	p->count++;
+	p->total += cycles;
+	if (cycles < p->min)
+		p->min = cycles;
+	if (cycles > p->max)
+		p->max = cycles;
+
+	cm_mask_interrupts(masked);
+}
+
+void prof_init(void)
+{
+	int i;
+
+	/*
+	 * Run the calibration through prof_end() itself, on the last slot
+	 * with no overhead to take off yet, so call and masking costs are
+	 * counted exactly as they will be.
+	 */
+	overhead = 0;
+	nprobes = PROF_MAX_PROBES;
+	clear(&probes[PROF_MAX_PROBES - 1]);
+	for (i = 0; i < PROF_CALIBRATE; i++)
+		prof_end(PROF_MAX_PROBES - 1, prof_begin());
+	overhead = probes[PROF_MAX_PROBES - 1].min;
+
+	nprobes = 0;
+	memset(probes, 0, sizeof(probes));
+}
+
+void prof_reset(void)
+{
+	int i;
+
+	for (i = 0; i < nprobes; i++)
+		clear(&probes[i]);
+}
+
+/* Returns the id of the probe called name, adding it if needed, or -1. */
+int prof_probe(const char *name)
+{
+	int i;
+
+	for (i = 0; i < nprobes; i++)
+		if (!strcmp(probes[i].name, name))
+			return i;
+
+	if (nprobes == PROF_MAX_PROBES)
+		return -1;
+
+	probes[nprobes].name = name;
+	clear(&probes[nprobes]);
+	return nprobes++;
+}
+
+void prof_end(int id, uint32_t start)
+{
+	uint32_t cycles = prof_cycles() - start;
+
+	if (id < 0 || id >= nprobes)
+		return;
+
+	record(&probes[id], cycles > overhead ? cycles - overhead : 0);
+}
+
+void prof_record(int id, uint32_t cycles)
+{
+	if (id < 0 || id >= nprobes)
+		return;
+
+	record(&probes[id], cycles);
+}
+
+uint32_t prof_overhead(void)
+{
+	return overhead;
+}
+
+const struct prof_stats *prof_get(int id)
+{
+	if (id < 0 || id >= nprobes)
+		return NULL;
+
+	return &probes[id];
+}
+
+/* Right aligned decimal, no printf needed. */
+static char *put_u32(char *s, uint32_t v, int width)
+{
+	char buf[10];
+	int n = 0;
+
+	do {
+		buf[n++] = '0' + v % 10;
+		v /= 10;
+	} while (v);
+
+	while (width-- > n)
+		*s++ = ' ';
+	while (n)
+		*s++ = buf[--n];
+
+	return s;
+}
+
+static char *put_str(char *s, const char *str, int width)
+{
+	while (*str && width) {
+		*s++ = *str++;
+		width--;
+	}
+	while (width-- > 0)
+		*s++ = ' ';
+
+	return s;
+}
+
+void prof_dump(void (*out)(const char *s))
+{
+	struct prof_stats p;
+	char line[96], *s;
+	int i;
+
+	/* Columns are 12 wide, so full 32 bit values stay apart. */
+	s = put_str(line, "probe", 15);
+	s = put_str(s, "       count         min         avg         max", 48);
+	s = put_str(s, "  overhead ", 11);
+	s = put_u32(s, overhead, 0);
+	strcpy(s, "\r\n");
+	out(line);
+
+	for (i = 0; i < nprobes; i++) {
+		uint32_t masked = cm_mask_interrupts(1);
+
+		p = probes[i];
+		cm_mask_interrupts(masked);
+
+		s = put_str(line, p.name, 15);
+		s = put_u32(s, p.count, 12);
+		if (p.count) {
+			s = put_u32(s, p.min, 12);
+			s = put_u32(s, p.total / p.count, 12);
+			s = put_u32(s, p.max, 12);
+		}
+		strcpy(s, "\r\n");
+		out(line);
+	}
+}
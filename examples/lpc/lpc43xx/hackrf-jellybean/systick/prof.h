@@ -0,0 +1,79 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PROF_H
+#define PROF_H
+
+#include <stdint.h>
+
+/*
+ * Cycle accurate profiling on the DWT cycle counter.
+ *
+ * A probe is a named slot in a static table collecting the count, min, max
+ * and total of the cycles recorded into it:
+ *
+ *	static int probe;
+ *	uint32_t start;
+ *
+ *	probe = prof_probe("fft");
+ *	...
+ *	start = prof_begin();
+ *	fft();
+ *	prof_end(probe, start);
+ *
+ * prof_end() takes the cost of an empty begin/end pair, measured by
+ * prof_init(), off every sample.  prof_record() stores a cycle count as it
+ * is, e.g. an interrupt latency.
+ *
+ * The cycle counter has to be running before prof_init().  Build with
+ * -D'prof_cycles()=...' to run this on another cycle source.
+ */
+
+#ifndef prof_cycles
+#include <libopencm3/cm3/scs.h>
+#define prof_cycles()		SCS_DWT_CYCCNT
+#endif
+
+#define PROF_MAX_PROBES		16
+
+struct prof_stats {
+	const char *name;
+	uint32_t count;
+	uint32_t min;
+	uint32_t max;
+	uint64_t total;
+};
+
+void prof_init(void);
+void prof_reset(void);
+int prof_probe(const char *name);
+
+static inline uint32_t prof_begin(void)
+{
+	return prof_cycles();
+}
+
+void prof_end(int id, uint32_t start);
+void prof_record(int id, uint32_t cycles);
+
+uint32_t prof_overhead(void);
+const struct prof_stats *prof_get(int id);
+
+/* Print the table a line at a time. */
+void prof_dump(void (*out)(const char *s));
+
+#endif /* !PROF_H */
@@ -23,12 +23,18 @@
 #include <libopencm3/cm3/nvic.h>
 #include <libopencm3/cm3/systick.h>
 #include <libopencm3/cm3/scs.h>
+#include <libopencm3/cm3/itm.h>
 
 #include "../jellybean_conf.h"
+#include "prof.h"
 
 /* Global counter incremented by SysTick Interrupt each millisecond */
 volatile uint32_t g_ulSysTickCount;
 uint32_t g_NbCyclePerSecond;
+static uint32_t g_CycleStart;
+
+static int probe_tick = -1, probe_latency = -1;
+static int probe_led = -1, probe_wait = -1;
 
 static void gpio_setup(void)
 {
@@ -106,6 +112,19 @@ static void scs_dwt_cycle_counter_enabled(void)
 	SCS_DWT_CTRL  |= SCS_DWT_CTRL_CYCCNTENA;
 }
 
+/* Profile dump on ITM stimulus port 0; the debugger sets up ITM and SWO. */
+static void swo_puts(const char *s)
+{
+	if (!(ITM_TCR & ITM_TCR_ITMENA) || !(ITM_TER[0] & 1))
+		return;
+
+	while (*s) {
+		while (!(ITM_STIM8(0) & ITM_STIM_FIFOREADY))
+			;
+		ITM_STIM8(0) = *s++;
+	}
+}
+
 static uint32_t sys_tick_get_time_ms(void)
 {
     return g_ulSysTickCount;
@@ -144,24 +163,37 @@ static void sys_tick_wait_time_ms(uint32_t wait_ms)
 /* Called each 1ms/1000Hz by interrupt
  1) Count the number of cycle per second.
  2) Increment g_ulSysTickCount counter.
+ 3) Profile its own latency and run time.
 */
 void sys_tick_handler(void)
 {
+	uint32_t start = prof_begin();
+
+	/*
+	 * SysTick runs on the processor clock and reloads when it hits zero,
+	 * so the cycles it has counted down since are the entry latency.
+	 */
+	prof_record(probe_latency, STK_RVR - STK_CVR);
+
 	if(g_ulSysTickCount==0)
 	{
-		/* Clear Cycle Counter*/
-		SCS_DWT_CYCCNT = 0;
+		/* Cycle Counter is shared with the profiler, don't clear it */
+		g_CycleStart = SCS_DWT_CYCCNT;
 	}else if(g_ulSysTickCount==1000)
 	{
 		/* Capture number of cycle elapsed during 1 second */
-		g_NbCyclePerSecond = SCS_DWT_CYCCNT;
+		g_NbCyclePerSecond = SCS_DWT_CYCCNT - g_CycleStart;
 	}
 
 	g_ulSysTickCount++;
+
+	prof_end(probe_tick, start);
 }
 
 int main(void)
 {
+	uint32_t start, seconds = 0;
+
 	systick_setup();
 
 	gpio_setup();
@@ -169,15 +201,30 @@ int main(void)
 	/* SCS & Cycle Counter enabled (used to count number of cycles executed per second see g_NbCyclePerSecond */
 	scs_dwt_cycle_counter_enabled();
 
+	/* Profiler needs the Cycle Counter running */
+	prof_init();
+	probe_tick = prof_probe("systick");
+	probe_latency = prof_probe("systick latency");
+	probe_led = prof_probe("led toggle");
+	probe_wait = prof_probe("wait 500ms");
+
 	while (1)
 	{
+		start = prof_begin();
 		gpio_set(PORT_LED1_3, (PIN_LED1|PIN_LED2|PIN_LED3)); /* LEDs on */
+		prof_end(probe_led, start);
 
+		start = prof_begin();
 		sys_tick_wait_time_ms(500);
+		prof_end(probe_wait, start);
 
 		gpio_clear(PORT_LED1_3, (PIN_LED1|PIN_LED2|PIN_LED3)); /* LED off */
 
 		sys_tick_wait_time_ms(500);
+
+		/* Dump the profile every 10s */
+		if (++seconds % 10 == 0)
+			prof_dump(swo_puts);
 	}
 
 	return 0;
@@ -26,28 +26,24 @@
 #include <libopencm3/stm32/flash.h>
 #include <libopencm3/stm32/rcc.h>
 
-struct can_tx_msg {
-	uint32_t std_id;
-	uint32_t ext_id;
-	uint8_t ide;
-	uint8_t rtr;
-	uint8_t dlc;
-	uint8_t data[8];
-};
+#include "candrv.h"
 
-struct can_rx_msg {
-	uint32_t std_id;
-	uint32_t ext_id;
-	uint8_t ide;
-	uint8_t rtr;
-	uint8_t dlc;
-	uint8_t data[8];
-	uint8_t fmi;
+/*
+ * Frames with standard ids 0x000-0x00f go to FIFO 0, data frames with
+ * the ids 0x100 and 0x101 and the extended id 0x1234567 to FIFO 1.  The
+ * last filter is already covered by the first and gets dropped.
+ */
+static const struct candrv_filter filters[] = {
+	{ .id = 0x000, .mask = 0x7f0, .ext = false, .fifo = 0 },
+	{ .id = 0x100, .mask = 0x7ff, .ext = false,
+	  .rtr = CANDRV_RTR_DATA, .fifo = 1 },
+	{ .id = 0x101, .mask = 0x7ff, .ext = false,
+	  .rtr = CANDRV_RTR_DATA, .fifo = 1 },
+	{ .id = 0x1234567, .mask = 0x1fffffff, .ext = true,
+	  .rtr = CANDRV_RTR_DATA, .fifo = 1 },
+	{ .id = 0x005, .mask = 0x7ff, .ext = false, .fifo = 0 },
 };
 
-struct can_tx_msg can_tx_msg;
-struct can_rx_msg can_rx_msg;
-
 static void gpio_setup(void)
 {
         /* Enable Alternate Function clock. */
@@ -119,10 +115,6 @@ static void can_setup(void)
 	gpio_set_mode(GPIO_BANK_CAN1_PB_TX, GPIO_MODE_OUTPUT_50_MHZ,
 		      GPIO_CNF_OUTPUT_ALTFN_PUSHPULL, GPIO_CAN1_PB_TX);
 
-	/* NVIC setup. */
-	nvic_enable_irq(NVIC_USB_LP_CAN_RX0_IRQ);
-	nvic_set_priority(NVIC_USB_LP_CAN_RX0_IRQ, 1);
-
 	/* Reset CAN. */
 	can_reset(CAN1);
 
@@ -133,7 +125,7 @@ static void can_setup(void)
 		     false,           /* AWUM: Automatic wakeup mode? */
 		     false,           /* NART: No automatic retransmission? */
 		     false,           /* RFLM: Receive FIFO locked mode? */
-		     false,           /* TXFP: Transmit FIFO priority? */
+		     true,            /* TXFP: Transmit FIFO priority? */
 		     CAN_BTR_SJW_1TQ,
 		     CAN_BTR_TS1_3TQ,
 		     CAN_BTR_TS2_4TQ,
@@ -152,22 +144,32 @@ static void can_setup(void)
 			__asm__("nop");
 	}
 
-	/* CAN filter 0 init. */
-	can_filter_id_mask_32bit_init(
-				0,     /* Filter ID */
-				0,     /* CAN ID */
-				0,     /* CAN ID mask */
-				0,     /* FIFO assignment (here: FIFO0) */
-				true); /* Enable the filter. */
+	/* CAN filter setup. */
+	if (candrv_set_filters(filters,
+			       sizeof(filters) / sizeof(filters[0])) < 0)
+	{
+		gpio_set(GPIOA, GPIO8);		/* LED0 off */
+		gpio_set(GPIOB, GPIO4);		/* LED1 off */
+		gpio_set(GPIOC, GPIO15);       	/* LED2 off */
+		gpio_clear(GPIOC, GPIO2);       /* LED3 on */
+		gpio_set(GPIOC, GPIO5);	        /* LED4 off */
+
+		/* Die, the filters don't fit the banks. */
+		while (1)
+			__asm__("nop");
+	}
 
-	/* Enable CAN RX interrupt. */
-	can_enable_irq(CAN1, CAN_IER_FMPIE0);
+	/* Interrupt driven transmit and receive. */
+	candrv_init();
 }
 
 void sys_tick_handler(void)
 {
 	static int temp32 = 0;
-	static uint8_t data[8] = {0, 1, 2, 0, 0, 0, 0, 0};
+	static struct can_frame frame = {
+		.id = 0, .ext = false, .rtr = false, .len = 8,
+		.data = {0, 1, 2, 0, 0, 0, 0, 0},
+	};
 
 	/* We call this handler every 1ms so 100ms = 1s
 	 * Resulting in 100Hz message frequency.
@@ -177,14 +179,9 @@ void sys_tick_handler(void)
 
 	temp32 = 0;
 
-	/* Transmit CAN frame. */
-	data[0]++;
-	if (can_transmit(CAN1,
-			 0,     /* (EX/ST)ID: CAN ID */
-			 false, /* IDE: CAN ID extended? */
-			 false, /* RTR: Request transmit? */
-			 8,     /* DLC: Data length */
-			 data) == -1)
+	/* Queue CAN frame, the TX interrupt sends it. */
+	frame.data[0]++;
+	if (!candrv_send(&frame, CANDRV_PRIO_NORMAL))
 	{
 		gpio_set(GPIOA, GPIO8);		/* LED0 off */
 		gpio_set(GPIOB, GPIO4);		/* LED1 off */
@@ -194,35 +191,29 @@ void sys_tick_handler(void)
 	}
 }
 
-void usb_lp_can_rx0_isr(void)
+static void can_frame_received(const struct can_frame *frame)
 {
-	uint32_t id;
-	bool ext, rtr;
-	uint8_t fmi, length, data[8];
+	uint8_t data0 = frame->data[0];
 
-	can_receive(CAN1, 0, false, &id, &ext, &rtr, &fmi, &length, data, NULL);
-
-	if (data[0] & 1)
+	if (data0 & 1)
 		gpio_clear(GPIOA, GPIO8);
 	else
 		gpio_set(GPIOA, GPIO8);
 
-	if (data[0] & 2)
+	if (data0 & 2)
 		gpio_clear(GPIOB, GPIO4);
 	else
 		gpio_set(GPIOB, GPIO4);
 
-	if (data[0] & 4)
+	if (data0 & 4)
 		gpio_clear(GPIOC, GPIO15);
 	else
 		gpio_set(GPIOC, GPIO15);
 
-	if (data[0] & 8)
+	if (data0 & 8)
 		gpio_clear(GPIOC, GPIO2);
 	else
 		gpio_set(GPIOC, GPIO2);
-
-	can_fifo_release(CAN1, 0);
 }
 
 int main(void)
@@ -232,7 +223,12 @@ int main(void)
 	can_setup();
 	systick_setup();
 
-	while (1); /* Halt. */
+	while (1) {
+		struct can_frame frame;
+
+		if (candrv_recv(&frame))
+			can_frame_received(&frame);
+	}
 
 	return 0;
 }
@@ -0,0 +1,342 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <libopencm3/stm32/rcc.h>
+#include <libopencm3/stm32/flash.h>
+#include <libopencm3/stm32/gpio.h>
+#include <libopencm3/stm32/adc.h>
+#include <libopencm3/stm32/usart.h>
+#include <libopencm3/stm32/timer.h>
+#include <libopencm3/stm32/dma.h>
+#include <libopencm3/cm3/nvic.h>
+
+/*
+ * Acquisition parameters.  A frame is one scan of all channels.  The DMA
+ * buffer holds two blocks of ADC_BLOCK_FRAMES frames; ADC_BLOCK_FRAMES
+ * must be a multiple of ADC_DECIMATE.
+ *
+ * With 28.5 cycle sampling at the 12MHz ADC clock a frame of four
+ * channels takes 4 * 41 cycles, about 14us, which bounds the frame rate
+ * at roughly 70kHz.
+ */
+#define ADC_CHANNELS		4
+#define ADC_FRAME_RATE		1000	/* frames per second */
+#define ADC_BLOCK_FRAMES	64
+#define ADC_DECIMATE		16	/* frames averaged together, 1 = off */
+
+#define ADC_OUT_FRAMES		(ADC_BLOCK_FRAMES / ADC_DECIMATE)
+#define ADC_HALF_ITEMS		(ADC_BLOCK_FRAMES * ADC_CHANNELS)
+
+/*
+ * Averaging costs a few cycles per sample, while a frame takes at least
+ * 41 ADC cycles, 246 CPU cycles, per channel: the DMA stores about one
+ * frame for every 60 averaged.  A block is only averaged if the DMA is
+ * more than ADC_GUARD_FRAMES away from writing into it.
+ */
+#define ADC_GUARD_FRAMES	(ADC_BLOCK_FRAMES / 32 + 1)
+
+/* 16=temperature_sensor, 17=Vrefint, 13=ADC1, 10=ADC2 */
+static uint8_t channel_array[ADC_CHANNELS] = { 16, 17, 13, 10 };
+
+static uint16_t adc_dma_buf[2][ADC_BLOCK_FRAMES][ADC_CHANNELS];
+static uint16_t adc_out[ADC_OUT_FRAMES][ADC_CHANNELS];
+
+/*
+ * Called from the DMA interrupt with the decimated frames of the block
+ * that just completed.  The DMA is filling the other half meanwhile, so
+ * this has one block time to return.
+ */
+typedef void (*adc_block_cb_t)(const uint16_t (*frames)[ADC_CHANNELS],
+			       int count);
+static adc_block_cb_t adc_block_cb;
+
+volatile uint32_t adc_blocks;		/* blocks delivered */
+volatile uint32_t adc_overruns;		/* blocks lost to a late interrupt */
+
+static void usart_setup(void)
+{
+	/* Enable clocks for GPIO port A (for GPIO_USART2_TX) and USART2. */
+	rcc_periph_clock_enable(RCC_GPIOA);
+	rcc_periph_clock_enable(RCC_USART2);
+
+	/* Setup GPIO pin GPIO_USART2_TX on GPIO port A for transmit. */
+	gpio_set_mode(GPIOA, GPIO_MODE_OUTPUT_50_MHZ,
+		      GPIO_CNF_OUTPUT_ALTFN_PUSHPULL, GPIO_USART2_TX);
+
+	/* Setup UART parameters. */
+	usart_set_baudrate(USART2, 115200);
+	usart_set_databits(USART2, 8);
+	usart_set_stopbits(USART2, USART_STOPBITS_1);
+	usart_set_mode(USART2, USART_MODE_TX_RX);
+	usart_set_parity(USART2, USART_PARITY_NONE);
+	usart_set_flow_control(USART2, USART_FLOWCONTROL_NONE);
+
+	/* Finally enable the USART. */
+	usart_enable(USART2);
+}
+
+static void gpio_setup(void)
+{
+	/* Enable GPIO clocks. */
+	rcc_periph_clock_enable(RCC_GPIOA);
+	rcc_periph_clock_enable(RCC_GPIOC);
+
+	/* Setup the LEDs. */
+	gpio_set_mode(GPIOA, GPIO_MODE_OUTPUT_2_MHZ,
+		      GPIO_CNF_OUTPUT_PUSHPULL, GPIO8);
+	gpio_set_mode(GPIOC, GPIO_MODE_OUTPUT_2_MHZ,
+		      GPIO_CNF_OUTPUT_PUSHPULL, GPIO15);
+
+	/* Setup Lisa/M v2 ADC1,2 on ANALOG1 connector */
+	gpio_set_mode(GPIOC, GPIO_MODE_INPUT, GPIO_CNF_INPUT_ANALOG,
+		      GPIO3 | GPIO0);
+}
+
+static void timer_setup(uint32_t rate)
+{
+	/* TIM3 runs from the doubled 36MHz APB1 clock. */
+	uint32_t ticks = 72000000 / rate;
+	uint32_t prescaler = (ticks - 1) / 65536 + 1;
+
+	rcc_periph_clock_enable(RCC_TIM3);
+	rcc_periph_reset_pulse(RST_TIM3);
+
+	timer_set_mode(TIM3, TIM_CR1_CKD_CK_INT,
+		       TIM_CR1_CMS_EDGE, TIM_CR1_DIR_UP);
+	timer_set_prescaler(TIM3, prescaler - 1);
+	timer_set_period(TIM3, ticks / prescaler - 1);
+	/* Generate TRGO on every update, each one starts a scan. */
+	timer_set_master_mode(TIM3, TIM_CR2_MMS_UPDATE);
+}
+
+static void dma_setup(void)
+{
+	rcc_periph_clock_enable(RCC_DMA1);
+
+	/*
+	 * Using channel 1 for ADC1.  The buffer is circular and interrupts
+	 * at both the half way point and the end, one per block.
+	 */
+	dma_channel_reset(DMA1, DMA_CHANNEL1);
+
+	dma_set_peripheral_address(DMA1, DMA_CHANNEL1, (uint32_t)&ADC_DR(ADC1));
+	dma_set_memory_address(DMA1, DMA_CHANNEL1, (uint32_t)adc_dma_buf);
+	dma_set_number_of_data(DMA1, DMA_CHANNEL1,
+			       sizeof(adc_dma_buf) / sizeof(uint16_t));
+	dma_set_read_from_peripheral(DMA1, DMA_CHANNEL1);
+	dma_enable_memory_increment_mode(DMA1, DMA_CHANNEL1);
+	dma_enable_circular_mode(DMA1, DMA_CHANNEL1);
+	dma_set_peripheral_size(DMA1, DMA_CHANNEL1, DMA_CCR_PSIZE_16BIT);
+	dma_set_memory_size(DMA1, DMA_CHANNEL1, DMA_CCR_MSIZE_16BIT);
+	dma_set_priority(DMA1, DMA_CHANNEL1, DMA_CCR_PL_VERY_HIGH);
+
+	dma_enable_half_transfer_interrupt(DMA1, DMA_CHANNEL1);
+	dma_enable_transfer_complete_interrupt(DMA1, DMA_CHANNEL1);
+
+	dma_enable_channel(DMA1, DMA_CHANNEL1);
+
+	nvic_set_priority(NVIC_DMA1_CHANNEL1_IRQ, 0);
+	nvic_enable_irq(NVIC_DMA1_CHANNEL1_IRQ);
+}
+
+static void adc_setup(void)
+{
+	int i;
+
+	rcc_periph_clock_enable(RCC_ADC1);
+
+	/* Make sure the ADC doesn't run during config. */
+	adc_power_off(ADC1);
+
+	/*
+	 * Each TIM3 TRGO converts the whole regular sequence once, and the
+	 * DMA picks up every result as it lands in the data register.
+	 */
+	adc_enable_scan_mode(ADC1);
+	adc_set_single_conversion_mode(ADC1);
+	adc_enable_external_trigger_regular(ADC1, ADC_CR2_EXTSEL_TIM3_TRGO);
+	adc_set_right_aligned(ADC1);
+	/* We want to read the temperature sensor, so we have to enable it. */
+	adc_enable_temperature_sensor();
+	adc_set_sample_time_on_all_channels(ADC1, ADC_SMPR_SMP_28DOT5CYC);
+	adc_set_regular_sequence(ADC1, ADC_CHANNELS, channel_array);
+	adc_enable_dma(ADC1);
+
+	adc_power_on(ADC1);
+
+	/* Wait for ADC starting up. */
+	for (i = 0; i < 800000; i++)    /* Wait a bit. */
+		__asm__("nop");
+
+	adc_reset_calibration(ADC1);
+	adc_calibrate(ADC1);
+}
+
+static void adc_scan_start(adc_block_cb_t cb)
+{
+	adc_block_cb = cb;
+	dma_setup();
+	timer_enable_counter(TIM3);
+}
+
+/* Average groups of ADC_DECIMATE frames of a block into adc_out. */
+static void adc_block_done(const uint16_t (*block)[ADC_CHANNELS])
+{
+	uint32_t sum[ADC_CHANNELS];
+	int i, j, c;
+
+	for (i = 0; i < ADC_OUT_FRAMES; i++) {
+		for (c = 0; c < ADC_CHANNELS; c++)
+			sum[c] = 0;
+		for (j = 0; j < ADC_DECIMATE; j++, block++)
+			for (c = 0; c < ADC_CHANNELS; c++)
+				sum[c] += (*block)[c];
+		for (c = 0; c < ADC_CHANNELS; c++)
+			adc_out[i][c] = sum[c] / ADC_DECIMATE;
+	}
+
+	adc_blocks++;
+	if (adc_block_cb)
+		adc_block_cb((const uint16_t (*)[ADC_CHANNELS])adc_out,
+			     ADC_OUT_FRAMES);
+}
+
+void dma1_channel1_isr(void)
+{
+	uint32_t isr = DMA1_ISR & (DMA_ISR_HTIF1 | DMA_ISR_TCIF1);
+	uint32_t left = DMA_CNDTR(DMA1, DMA_CHANNEL1);
+	int half;
+
+	if (isr & DMA_ISR_HTIF1)
+		DMA1_IFCR = DMA_IFCR_CHTIF1;
+	if (isr & DMA_ISR_TCIF1)
+		DMA1_IFCR = DMA_IFCR_CTCIF1;
+
+	if (isr == (DMA_ISR_HTIF1 | DMA_ISR_TCIF1)) {
+		/*
+		 * The DMA crossed another half before we got here and is
+		 * already overwriting the older block.  Deliver the half
+		 * it is not writing to and count the lost one.
+		 */
+		adc_overruns++;
+		half = left > ADC_HALF_ITEMS;
+	} else if (isr == DMA_ISR_HTIF1) {
+		half = 0;
+	} else if (isr == DMA_ISR_TCIF1) {
+		half = 1;
+	} else {
+		return;
+	}
+
+	/*
+	 * The DMA is filling the other half and moves on into this one
+	 * after `left' more items.  Too close, and it would overwrite the
+	 * block while it is being averaged, so it is counted as lost.
+	 */
+	if (half)
+		left -= ADC_HALF_ITEMS;
+	if (left <= ADC_GUARD_FRAMES * ADC_CHANNELS) {
+		adc_overruns++;
+		return;
+	}
+
+	adc_block_done((const uint16_t (*)[ADC_CHANNELS])adc_dma_buf[half]);
+}
+
+/* Latest averaged frame, with a sequence count to detect torn reads. */
+static volatile uint16_t latest[ADC_CHANNELS];
+static volatile uint32_t latest_seq;
+
+static void print_block(const uint16_t (*frames)[ADC_CHANNELS], int count)
+{
+	int c;
+
+	latest_seq++;
+	for (c = 0; c < ADC_CHANNELS; c++)
+		latest[c] = frames[count - 1][c];
+	latest_seq++;
+}
+
+static void my_usart_print_int(uint32_t usart, int value)
+{
+	int8_t i;
+	uint8_t nr_digits = 0;
+	char buffer[25];
+
+	if (value < 0) {
+		usart_send_blocking(usart, '-');
+		value = value * -1;
+	}
+
+	do {
+		buffer[nr_digits++] = "0123456789"[value % 10];
+		value /= 10;
+	} while (value > 0);
+
+	for (i = (nr_digits - 1); i >= 0; i--) {
+		usart_send_blocking(usart, buffer[i]);
+	}
+}
+
+int main(void)
+{
+	uint16_t frame[ADC_CHANNELS];
+	uint32_t seq, printed = 0;
+	int c;
+
+	rcc_clock_setup_pll(&rcc_hse_configs[RCC_CLOCK_HSE12_72MHZ]);
+	gpio_setup();
+	usart_setup();
+	timer_setup(ADC_FRAME_RATE);
+	adc_setup();
+
+	gpio_set(GPIOA, GPIO8);	                /* LED1 off */
+	gpio_set(GPIOC, GPIO15);		/* LED5 off */
+
+	/* Send a message on USART2. */
+	usart_send_blocking(USART2, 's');
+	usart_send_blocking(USART2, 't');
+	usart_send_blocking(USART2, 'm');
+	usart_send_blocking(USART2, '\r');
+	usart_send_blocking(USART2, '\n');
+
+	adc_scan_start(print_block);
+
+	while (1) {
+		/* Wait for a new block, then take a consistent copy. */
+		do {
+			seq = latest_seq;
+			for (c = 0; c < ADC_CHANNELS; c++)
+				frame[c] = latest[c];
+		} while ((seq & 1) || seq == printed || seq != latest_seq);
+		printed = seq;
+
+		for (c = 0; c < ADC_CHANNELS; c++) {
+			my_usart_print_int(USART2, frame[c]);
+			usart_send_blocking(USART2, ' ');
+		}
+		my_usart_print_int(USART2, adc_blocks);
+		usart_send_blocking(USART2, ' ');
+		my_usart_print_int(USART2, adc_overruns);
+		usart_send_blocking(USART2, '\r');
+		usart_send_blocking(USART2, '\n');
+
+		gpio_toggle(GPIOA, GPIO8); /* LED2 on */
+	}
+
+	return 0;
+}
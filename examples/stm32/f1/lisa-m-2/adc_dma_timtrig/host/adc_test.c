@@ -0,0 +1,697 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Host simulation of the block flow in adc_dma_timtrig.c.
+ *
+ * Time is counted in 72MHz CPU cycles.  TIM3 updates every
+ * (PSC + 1) * (ARR + 1) cycles as set by timer_setup(), and each update
+ * starts a scan of the regular sequence unless the previous scan is still
+ * running, in which case the trigger is lost, as on the F1.  A conversion
+ * takes the sample time plus 12.5 ADC cycles at 12MHz, 6 CPU cycles each.
+ * DMA channel 1 stores every result at once and counts CNDTR down,
+ * setting the half and full flags and reloading in circular mode.
+ *
+ * The interrupt is taken 12 to 24 cycles after its flag, or later when
+ * the CPU is busy in another handler at the same priority.  Handlers do
+ * not preempt each other.  Running dma1_channel1_isr() is charged
+ * ISR_BASE_CYCLES, plus ISR_SAMPLE_CYCLES per sample and ISR_OUT_CYCLES
+ * per averaged value when it delivers a block; the DMA keeps writing
+ * meanwhile, and a block it writes into before the handler is done is
+ * counted as torn.
+ *
+ * Each sample is a function of its frame and channel, so every delivered
+ * block is checked against the averages of the newest complete block.
+ * Runs sweep the frame rate with the CPU otherwise idle and with another
+ * handler taking up to 1ms at random, and report the highest rate that
+ * loses no trigger and no block, the CPU time spent in the handler and
+ * the delay from a block's completion to its callback.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Only the acquisition is run, main() is kept out of the way. */
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wold-style-declaration"
+#define main static __attribute__((unused)) adc_dma_timtrig_main
+#include "adc_dma_timtrig.c"
+#undef main
+#pragma GCC diagnostic pop
+
+static int failures;
+
+#define CHECK(cond, ...) do {						\
+	if (!(cond)) {							\
+		if (failures++ < 10) {					\
+			printf("FAIL %s:%d: ", __FILE__, __LINE__);	\
+			printf(__VA_ARGS__);				\
+			printf("\n");					\
+		}							\
+	}								\
+} while (0)
+
+static uint32_t rng_state = 1;
+
+static uint32_t rnd(void)
+{
+	rng_state ^= rng_state << 13;
+	rng_state ^= rng_state >> 17;
+	rng_state ^= rng_state << 5;
+	return rng_state;
+}
+
+#define CPU_HZ			72000000
+#define ISR_BASE_CYCLES		60
+#define ISR_SAMPLE_CYCLES	3
+#define ISR_OUT_CYCLES		14
+
+#define BUF_ITEMS		(sizeof(adc_dma_buf) / sizeof(uint16_t))
+#define RUN_BLOCKS		400
+
+static uint64_t now;
+
+/* --- TIM3 and ADC1 --- */
+
+static struct {
+	uint32_t psc, arr, mms;
+	int running;
+	uint64_t next_update;
+
+	int powered, scan, dma, temp;
+	uint32_t extsel, smp;
+	uint8_t seq[16];
+	uint8_t seq_len;
+
+	int converting;
+	unsigned rank;
+	uint64_t conv_end;
+	uint32_t frames;		/* scans completed */
+	uint32_t missed;		/* triggers lost to a running scan */
+} sim;
+
+volatile uint32_t sim_adc_dr;
+
+/* Half ADC cycles of sampling for each SMPR code. */
+static const uint16_t smp_half_cycles[8] = {
+	3, 15, 27, 57, 83, 111, 143, 479,
+};
+
+static uint64_t conv_cycles(void)
+{
+	return (smp_half_cycles[sim.smp] + 25) * 3;
+}
+
+static uint16_t sample(uint32_t frame, uint8_t channel)
+{
+	return (frame * 3 + channel * 97 + (frame % 5) * 11) & 0xfff;
+}
+
+void timer_set_mode(uint32_t timer_peripheral, uint32_t clock_div,
+		    uint32_t alignment, uint32_t direction)
+{
+	(void)timer_peripheral;
+	CHECK(clock_div == TIM_CR1_CKD_CK_INT && alignment == TIM_CR1_CMS_EDGE &&
+	      direction == TIM_CR1_DIR_UP, "TIM3 not an edge aligned up counter");
+}
+
+void timer_set_prescaler(uint32_t timer_peripheral, uint32_t value)
+{
+	(void)timer_peripheral;
+	CHECK(value <= 0xffff, "PSC %u", value);
+	sim.psc = value & 0xffff;
+}
+
+void timer_set_period(uint32_t timer_peripheral, uint32_t period)
+{
+	(void)timer_peripheral;
+	CHECK(period <= 0xffff, "ARR %u", period);
+	sim.arr = period & 0xffff;
+}
+
+void timer_set_master_mode(uint32_t timer_peripheral, uint32_t mode)
+{
+	(void)timer_peripheral;
+	sim.mms = mode;
+}
+
+void timer_enable_counter(uint32_t timer_peripheral)
+{
+	(void)timer_peripheral;
+	sim.running = 1;
+	sim.next_update = now + (uint64_t)(sim.psc + 1) * (sim.arr + 1);
+}
+
+void adc_power_off(uint32_t adc)
+{
+	(void)adc;
+	sim.powered = 0;
+}
+
+void adc_power_on(uint32_t adc)
+{
+	(void)adc;
+	sim.powered = 1;
+}
+
+void adc_enable_scan_mode(uint32_t adc)
+{
+	(void)adc;
+	sim.scan = 1;
+}
+
+void adc_set_single_conversion_mode(uint32_t adc)
+{
+	(void)adc;
+}
+
+void adc_enable_external_trigger_regular(uint32_t adc, uint32_t trigger)
+{
+	(void)adc;
+	sim.extsel = trigger;
+}
+
+void adc_set_right_aligned(uint32_t adc)
+{
+	(void)adc;
+}
+
+void adc_enable_temperature_sensor(void)
+{
+	sim.temp = 1;
+}
+
+void adc_set_sample_time_on_all_channels(uint32_t adc, uint8_t time)
+{
+	(void)adc;
+	sim.smp = time & 7;
+}
+
+void adc_set_regular_sequence(uint32_t adc, uint8_t length, uint8_t channel[])
+{
+	(void)adc;
+	CHECK(length >= 1 && length <= 16, "sequence of %u", length);
+	sim.seq_len = length;
+	memcpy(sim.seq, channel, length);
+}
+
+void adc_enable_dma(uint32_t adc)
+{
+	(void)adc;
+	sim.dma = 1;
+}
+
+void adc_reset_calibration(uint32_t adc)
+{
+	(void)adc;
+}
+
+void adc_calibrate(uint32_t adc)
+{
+	(void)adc;
+	CHECK(sim.powered, "calibrated while powered off");
+}
+
+/* --- DMA1 channel 1 --- */
+
+struct sim_dma_channel sim_dma[8];
+uint32_t sim_dma_isr;
+static uint32_t ifcr_writes[8];
+static unsigned ifcr_count;
+
+uint32_t *sim_dma_ifcr_write(void)
+{
+	return &ifcr_writes[ifcr_count++ % 8];
+}
+
+void dma_channel_reset(uint32_t dma, uint8_t channel)
+{
+	(void)dma;
+	memset(&sim_dma[channel], 0, sizeof(sim_dma[channel]));
+	sim_dma_isr &= ~DMA_FLAGS(channel, 0xf);
+}
+
+void dma_set_peripheral_address(uint32_t dma, uint8_t channel,
+				uint32_t address)
+{
+	(void)dma;
+	(void)channel;
+	(void)address;
+}
+
+void dma_set_memory_address(uint32_t dma, uint8_t channel, uint32_t address)
+{
+	(void)dma;
+	(void)channel;
+	(void)address;
+}
+
+void dma_set_number_of_data(uint32_t dma, uint8_t channel, uint16_t number)
+{
+	(void)dma;
+	CHECK(!sim_dma[channel].enabled, "CNDTR written while enabled");
+	sim_dma[channel].cndtr = sim_dma[channel].reload = number;
+}
+
+void dma_set_read_from_peripheral(uint32_t dma, uint8_t channel)
+{
+	(void)dma;
+	sim_dma[channel].from_memory = 0;
+}
+
+void dma_enable_memory_increment_mode(uint32_t dma, uint8_t channel)
+{
+	(void)dma;
+	sim_dma[channel].minc = 1;
+}
+
+void dma_enable_circular_mode(uint32_t dma, uint8_t channel)
+{
+	(void)dma;
+	sim_dma[channel].circular = 1;
+}
+
+void dma_set_peripheral_size(uint32_t dma, uint8_t channel,
+			     uint32_t peripheral_size)
+{
+	(void)dma;
+	sim_dma[channel].psize = peripheral_size;
+}
+
+void dma_set_memory_size(uint32_t dma, uint8_t channel, uint32_t mem_size)
+{
+	(void)dma;
+	sim_dma[channel].msize = mem_size;
+}
+
+void dma_set_priority(uint32_t dma, uint8_t channel, uint32_t prio)
+{
+	(void)dma;
+	(void)channel;
+	(void)prio;
+}
+
+void dma_enable_half_transfer_interrupt(uint32_t dma, uint8_t channel)
+{
+	(void)dma;
+	sim_dma[channel].htie = 1;
+}
+
+void dma_enable_transfer_complete_interrupt(uint32_t dma, uint8_t channel)
+{
+	(void)dma;
+	sim_dma[channel].tcie = 1;
+}
+
+void dma_enable_channel(uint32_t dma, uint8_t channel)
+{
+	(void)dma;
+	sim_dma[channel].enabled = 1;
+}
+
+uint8_t sim_nvic[64];
+
+/* --- Blocks and the handler --- */
+
+static struct {
+	uint32_t done;			/* blocks the DMA completed */
+	uint64_t done_at[4];		/* completion time, by block % 4 */
+	uint32_t delivered, lost, torn, wrong;
+	int64_t last;			/* block last delivered, -1 none */
+
+	int pending;			/* interrupt pending */
+	uint64_t take_at;		/* when it will be taken */
+	int running;			/* handler running */
+	uint64_t end;
+	int writing_half;		/* half the handler reads, -1 none */
+	int callback;			/* callback ran in this handler */
+	uint64_t cycles;		/* spent in the handler */
+
+	uint64_t delay_min, delay_max, delay_sum;
+
+	uint64_t busy_max;		/* other handler's length, 0 none */
+	uint64_t busy_from, busy_to;	/* next one */
+} blk;
+
+static void next_busy(void)
+{
+	if (!blk.busy_max)
+		return;
+	blk.busy_from = blk.busy_to + rnd() % (5 * blk.busy_max);
+	blk.busy_to = blk.busy_from + blk.busy_max;
+}
+
+static void block_cb(const uint16_t (*frames)[ADC_CHANNELS], int count)
+{
+	uint32_t b = blk.done - 1, sum, f;
+	uint64_t d;
+	int i, c, ok = 1;
+
+	CHECK(count == ADC_OUT_FRAMES, "callback with %d frames", count);
+	for (i = 0; i < count && i < ADC_OUT_FRAMES; i++) {
+		for (c = 0; c < ADC_CHANNELS; c++) {
+			sum = 0;
+			for (f = 0; f < ADC_DECIMATE; f++)
+				sum += sample(b * ADC_BLOCK_FRAMES +
+					      i * ADC_DECIMATE + f,
+					      sim.seq[c]);
+			ok &= frames[i][c] == sum / ADC_DECIMATE;
+		}
+	}
+	if (!ok)
+		blk.wrong++;
+	CHECK((int64_t)b > blk.last, "block %u delivered after %lld", b,
+	      (long long)blk.last);
+
+	blk.lost += b - (uint32_t)(blk.last + 1);
+	blk.last = b;
+	blk.delivered++;
+	blk.callback = 1;
+	blk.writing_half = b % 2;
+
+	d = now - blk.done_at[b % 4];
+	if (d < blk.delay_min)
+		blk.delay_min = d;
+	if (d > blk.delay_max)
+		blk.delay_max = d;
+	blk.delay_sum += d;
+}
+
+static int irq_flagged(void)
+{
+	struct sim_dma_channel *ch = &sim_dma[1];
+
+	return (sim_nvic[NVIC_DMA1_CHANNEL1_IRQ] & 0x80) &&
+	       (((sim_dma_isr & DMA_ISR_HTIF1) && ch->htie) ||
+		((sim_dma_isr & DMA_ISR_TCIF1) && ch->tcie));
+}
+
+static void handler_start(void)
+{
+	unsigned i;
+
+	blk.pending = 0;
+	blk.callback = 0;
+	blk.writing_half = -1;
+	ifcr_count = 0;
+	dma1_channel1_isr();
+	for (i = 0; i < ifcr_count && i < 8; i++)
+		sim_dma_isr &= ~ifcr_writes[i];
+
+	blk.running = 1;
+	blk.end = now + ISR_BASE_CYCLES;
+	if (blk.callback)
+		blk.end += ISR_SAMPLE_CYCLES * ADC_BLOCK_FRAMES * ADC_CHANNELS +
+			   ISR_OUT_CYCLES * ADC_OUT_FRAMES * ADC_CHANNELS;
+	blk.cycles += blk.end - now;
+}
+
+static void dma_store(uint16_t value)
+{
+	struct sim_dma_channel *ch = &sim_dma[1];
+	uint32_t i;
+
+	if (!sim.dma || !ch->enabled || !ch->cndtr)
+		return;
+
+	i = ch->reload - ch->cndtr;
+	if (i < BUF_ITEMS)
+		((uint16_t *)adc_dma_buf)[i] = value;
+	if (blk.running && blk.writing_half == (int)(i >= ch->reload / 2))
+		blk.torn++;
+
+	if (--ch->cndtr == ch->reload / 2) {
+		sim_dma_isr |= DMA_FLAGS(1, DMA_HTIF | DMA_GIF);
+		blk.done_at[blk.done++ % 4] = now;
+	}
+	if (ch->cndtr == 0) {
+		sim_dma_isr |= DMA_FLAGS(1, DMA_TCIF | DMA_GIF);
+		blk.done_at[blk.done++ % 4] = now;
+		if (ch->circular)
+			ch->cndtr = ch->reload;
+	}
+}
+
+static void conversion_done(void)
+{
+	sim_adc_dr = sample(sim.frames, sim.seq[sim.rank]);
+	dma_store(sim_adc_dr);
+	if (++sim.rank < (sim.scan ? sim.seq_len : 1)) {
+		sim.conv_end = now + conv_cycles();
+		return;
+	}
+	sim.converting = 0;
+	sim.frames++;
+}
+
+static void timer_update(void)
+{
+	sim.next_update += (uint64_t)(sim.psc + 1) * (sim.arr + 1);
+	if (sim.mms != TIM_CR2_MMS_UPDATE ||
+	    sim.extsel != ADC_CR2_EXTSEL_TIM3_TRGO || !sim.powered)
+		return;
+	if (sim.converting) {
+		sim.missed++;
+		return;
+	}
+	sim.converting = 1;
+	sim.rank = 0;
+	sim.conv_end = now + conv_cycles();
+}
+
+static void simulate(uint64_t until, uint32_t blocks)
+{
+	uint64_t t;
+
+	while (now < until && blk.done < blocks) {
+		if (!blk.running && !blk.pending && irq_flagged()) {
+			blk.pending = 1;
+			blk.take_at = now + 12 + rnd() % 13;
+		}
+		/* Another handler holds the interrupt off until it ends. */
+		if (blk.pending && blk.take_at >= blk.busy_from &&
+		    blk.take_at < blk.busy_to)
+			blk.take_at = blk.busy_to;
+
+		t = until;
+		if (sim.running && sim.next_update < t)
+			t = sim.next_update;
+		if (sim.converting && sim.conv_end < t)
+			t = sim.conv_end;
+		if (blk.pending && blk.take_at < t)
+			t = blk.take_at;
+		if (blk.running && blk.end < t)
+			t = blk.end;
+		now = t;
+
+		if (sim.converting && sim.conv_end == now)
+			conversion_done();
+		if (sim.running && sim.next_update == now)
+			timer_update();
+		if (blk.running && blk.end == now) {
+			blk.running = 0;
+			blk.writing_half = -1;
+		}
+		if (blk.pending && !blk.running && blk.take_at == now)
+			handler_start();
+		if (blk.busy_max && now >= blk.busy_to)
+			next_busy();
+		/* It can't start inside this handler either. */
+		if (blk.running && blk.busy_from < blk.end &&
+		    blk.busy_to > now) {
+			blk.busy_to += blk.end - blk.busy_from;
+			blk.busy_from = blk.end;
+		}
+	}
+}
+
+struct result {
+	uint32_t rate, frames, missed, blocks, delivered, lost, torn;
+	double cpu, delay_avg, delay_max, jitter;
+};
+
+static void run(uint32_t rate, uint64_t busy_max, struct result *r)
+{
+	uint64_t frame, limit;
+
+	memset(&sim, 0, sizeof(sim));
+	memset(&blk, 0, sizeof(blk));
+	memset(sim_dma, 0, sizeof(sim_dma));
+	memset(sim_nvic, 0, sizeof(sim_nvic));
+	sim_dma_isr = 0;
+	now = 0;
+	adc_blocks = adc_overruns = 0;
+	blk.last = -1;
+	blk.delay_min = ~0ULL;
+	blk.busy_max = busy_max;
+	rng_state = rate;
+	next_busy();
+
+	timer_setup(rate);
+	adc_setup();
+	adc_scan_start(block_cb);
+
+	frame = (uint64_t)(sim.psc + 1) * (sim.arr + 1);
+	limit = 2 * (RUN_BLOCKS + 2) * ADC_BLOCK_FRAMES * frame;
+	simulate(limit, RUN_BLOCKS);
+	/* Let the handler for the last block finish. */
+	simulate(now + frame * ADC_BLOCK_FRAMES / 2, ~0u);
+
+	r->rate = rate;
+	r->frames = sim.frames;
+	r->missed = sim.missed;
+	r->blocks = blk.done;
+	r->delivered = blk.delivered;
+	r->lost = blk.lost;
+	r->torn = blk.torn;
+	r->cpu = 100.0 * blk.cycles / now;
+	r->delay_avg = blk.delivered ?
+		       blk.delay_sum * 1e6 / CPU_HZ / blk.delivered : 0;
+	r->delay_max = blk.delay_max * 1e6 / CPU_HZ;
+	r->jitter = blk.delivered ?
+		    (blk.delay_max - blk.delay_min) * 1e6 / CPU_HZ : 0;
+
+	CHECK(blk.done >= RUN_BLOCKS, "%u frames/s: only %u blocks", rate,
+	      blk.done);
+	CHECK(!blk.wrong, "%u frames/s: %u blocks with the wrong samples",
+	      rate, blk.wrong);
+	CHECK(!blk.torn, "%u frames/s: %u samples stored into a block being "
+	      "averaged", rate, blk.torn);
+	CHECK(adc_blocks == blk.delivered, "%u frames/s: %u blocks counted, "
+	      "%u delivered", rate, adc_blocks, blk.delivered);
+	CHECK(adc_overruns == blk.lost, "%u frames/s: %u overruns counted, "
+	      "%u blocks lost", rate, adc_overruns, blk.lost);
+	CHECK(blk.delivered + blk.lost + 1 >= blk.done, "%u frames/s: %u of "
+	      "%u blocks unaccounted for", rate,
+	      blk.done - blk.delivered - blk.lost, blk.done);
+}
+
+static int clean(const struct result *r)
+{
+	return !r->missed && !r->lost && !r->torn;
+}
+
+/* Highest rate in [lo, hi] that runs clean, lo assumed to. */
+static uint32_t sustainable(uint32_t lo, uint32_t hi, uint64_t busy_max)
+{
+	struct result r;
+	uint32_t mid;
+
+	while (lo < hi) {
+		mid = lo + (hi - lo + 1) / 2;
+		run(mid, busy_max, &r);
+		if (clean(&r))
+			lo = mid;
+		else
+			hi = mid - 1;
+	}
+	return lo;
+}
+
+static void print(const char *load, const struct result *r)
+{
+	printf("%-6s %6u %7u %8u  %5.2f%% %6u %4u %4u   %6.1f %7.1f %7.1f\n",
+	       load, r->rate, r->rate * ADC_CHANNELS, r->delivered, r->cpu,
+	       r->missed, r->lost, r->torn, r->delay_avg, r->delay_max,
+	       r->jitter);
+}
+
+/*
+ * timer_setup() gives the asked for rate across the range of TIM3, to
+ * within one prescaled tick.
+ */
+static void check_timer(void)
+{
+	static const uint32_t rates[] = {
+		2, 7, 50, 1000, 1099, 4000, 33333, 70000, 100000,
+	};
+	double ticks, ideal;
+	unsigned i;
+
+	for (i = 0; i < sizeof(rates) / sizeof(rates[0]); i++) {
+		memset(&sim, 0, sizeof(sim));
+		timer_setup(rates[i]);
+		ticks = (double)(sim.psc + 1) * (sim.arr + 1);
+		ideal = (double)CPU_HZ / rates[i];
+		CHECK(ticks > ideal - (sim.psc + 1) &&
+		      ticks < ideal + (sim.psc + 1),
+		      "%u Hz comes out %.3f Hz", rates[i], CPU_HZ / ticks);
+	}
+}
+
+int main(void)
+{
+	static const uint32_t rates[] = {
+		ADC_FRAME_RATE, 10000, 40000, 70000, 73170, 73171, 80000,
+	};
+	struct result r;
+	uint32_t quiet, busy, scan_limit;
+	unsigned i;
+
+	check_timer();
+
+	run(ADC_FRAME_RATE, 0, &r);
+	CHECK(sim.scan && sim.dma && sim.temp && sim.seq_len == ADC_CHANNELS,
+	      "ADC not set up to scan %d channels into the DMA", ADC_CHANNELS);
+	CHECK(sim_dma[1].reload == BUF_ITEMS && sim_dma[1].circular &&
+	      sim_dma[1].minc && sim_dma[1].htie && sim_dma[1].tcie,
+	      "DMA not set up for %u items, circular, both interrupts",
+	      (unsigned)BUF_ITEMS);
+
+	/* A scan has to end before the next update, rounded to TIM3 ticks. */
+	scan_limit = (uint32_t)((uint64_t)CPU_HZ /
+				(ADC_CHANNELS * conv_cycles()));
+
+	printf("%d channels, %d frame blocks averaged by %d, %.2fus per "
+	       "scan\n", ADC_CHANNELS, ADC_BLOCK_FRAMES, ADC_DECIMATE,
+	       ADC_CHANNELS * conv_cycles() * 1e6 / CPU_HZ);
+	printf("load   frames samples   blocks   CPU   missed lost torn"
+	       "   callback delay us\n");
+	printf("          /s      /s                                    "
+	       "avg     max  jitter\n");
+	for (i = 0; i < sizeof(rates) / sizeof(rates[0]); i++) {
+		run(rates[i], 0, &r);
+		print("idle", &r);
+		if (rates[i] <= scan_limit)
+			CHECK(clean(&r) && r.delivered >= RUN_BLOCKS,
+			      "%u frames/s idle: %u missed, %u lost, %u torn",
+			      rates[i], r.missed, r.lost, r.torn);
+		else
+			CHECK(r.missed, "%u frames/s: no triggers lost",
+			      rates[i]);
+	}
+	for (i = 0; i < sizeof(rates) / sizeof(rates[0]); i++) {
+		run(rates[i], CPU_HZ / 1000, &r);
+		print("busy", &r);
+	}
+
+	quiet = sustainable(ADC_FRAME_RATE, 100000, 0);
+	busy = sustainable(ADC_FRAME_RATE, 100000, CPU_HZ / 1000);
+	printf("sustainable: %u frames/s (%u samples/s) idle, %u frames/s "
+	       "(%u samples/s) with 1ms handlers\n", quiet,
+	       quiet * ADC_CHANNELS, busy, busy * ADC_CHANNELS);
+	CHECK(quiet == scan_limit, "sustainable %u, scans allow %u", quiet,
+	      scan_limit);
+
+	if (failures) {
+		printf("%d failures\n", failures);
+		return EXIT_FAILURE;
+	}
+	printf("all passed\n");
+	return EXIT_SUCCESS;
+}
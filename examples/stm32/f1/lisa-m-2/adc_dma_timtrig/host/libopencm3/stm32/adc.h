@@ -0,0 +1,58 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Host stand-in for the ADC setup adc_dma_timtrig.c does; the settings
+ * are recorded by adc_test.c, which runs the conversions.
+ */
+
+#ifndef HOST_ADC_H
+#define HOST_ADC_H
+
+#include <stdint.h>
+
+#define ADC1				1
+
+extern volatile uint32_t sim_adc_dr;
+
+#define ADC_DR(adc)			(sim_adc_dr)
+
+#define ADC_CR2_EXTSEL_TIM3_TRGO	(4 << 17)
+
+#define ADC_SMPR_SMP_1DOT5CYC		0
+#define ADC_SMPR_SMP_7DOT5CYC		1
+#define ADC_SMPR_SMP_13DOT5CYC		2
+#define ADC_SMPR_SMP_28DOT5CYC		3
+#define ADC_SMPR_SMP_41DOT5CYC		4
+#define ADC_SMPR_SMP_55DOT5CYC		5
+#define ADC_SMPR_SMP_71DOT5CYC		6
+#define ADC_SMPR_SMP_239DOT5CYC		7
+
+void adc_power_off(uint32_t adc);
+void adc_power_on(uint32_t adc);
+void adc_enable_scan_mode(uint32_t adc);
+void adc_set_single_conversion_mode(uint32_t adc);
+void adc_enable_external_trigger_regular(uint32_t adc, uint32_t trigger);
+void adc_set_right_aligned(uint32_t adc);
+void adc_enable_temperature_sensor(void);
+void adc_set_sample_time_on_all_channels(uint32_t adc, uint8_t time);
+void adc_set_regular_sequence(uint32_t adc, uint8_t length, uint8_t channel[]);
+void adc_enable_dma(uint32_t adc);
+void adc_reset_calibration(uint32_t adc);
+void adc_calibrate(uint32_t adc);
+
+#endif
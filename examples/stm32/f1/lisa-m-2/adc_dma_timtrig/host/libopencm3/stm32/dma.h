@@ -0,0 +1,78 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Host stand-in for the DMA parts adc_dma_timtrig.c uses; the channel is
+ * simulated in adc_test.c.
+ */
+
+#ifndef HOST_DMA_H
+#define HOST_DMA_H
+
+#include <stdint.h>
+
+#define DMA1			1
+#define DMA_CHANNEL1		1
+
+/* Four flags per channel, channel 1 in the lowest bits */
+#define DMA_FLAGS(ch, f)	((uint32_t)(f) << (((ch) - 1) * 4))
+#define DMA_GIF			1
+#define DMA_TCIF		2
+#define DMA_HTIF		4
+
+#define DMA_ISR_TCIF1		DMA_FLAGS(1, DMA_TCIF)
+#define DMA_ISR_HTIF1		DMA_FLAGS(1, DMA_HTIF)
+#define DMA_IFCR_CTCIF1		DMA_ISR_TCIF1
+#define DMA_IFCR_CHTIF1		DMA_ISR_HTIF1
+
+#define DMA_CCR_PSIZE_16BIT	(1 << 8)
+#define DMA_CCR_MSIZE_16BIT	(1 << 10)
+#define DMA_CCR_PL_VERY_HIGH	3
+
+struct sim_dma_channel {
+	int enabled, circular, minc, from_memory, htie, tcie;
+	uint32_t psize, msize;
+	uint32_t cndtr, reload;
+};
+
+extern struct sim_dma_channel sim_dma[8];
+extern uint32_t sim_dma_isr;
+
+/* Each IFCR write gets its own slot, applied when the handler returns. */
+uint32_t *sim_dma_ifcr_write(void);
+
+#define DMA1_ISR		(sim_dma_isr)
+#define DMA1_IFCR		(*sim_dma_ifcr_write())
+#define DMA_CNDTR(dma, ch)	(sim_dma[ch].cndtr)
+
+void dma_channel_reset(uint32_t dma, uint8_t channel);
+void dma_set_peripheral_address(uint32_t dma, uint8_t channel,
+				uint32_t address);
+void dma_set_memory_address(uint32_t dma, uint8_t channel, uint32_t address);
+void dma_set_number_of_data(uint32_t dma, uint8_t channel, uint16_t number);
+void dma_set_read_from_peripheral(uint32_t dma, uint8_t channel);
+void dma_enable_memory_increment_mode(uint32_t dma, uint8_t channel);
+void dma_enable_circular_mode(uint32_t dma, uint8_t channel);
+void dma_set_peripheral_size(uint32_t dma, uint8_t channel,
+			     uint32_t peripheral_size);
+void dma_set_memory_size(uint32_t dma, uint8_t channel, uint32_t mem_size);
+void dma_set_priority(uint32_t dma, uint8_t channel, uint32_t prio);
+void dma_enable_half_transfer_interrupt(uint32_t dma, uint8_t channel);
+void dma_enable_transfer_complete_interrupt(uint32_t dma, uint8_t channel);
+void dma_enable_channel(uint32_t dma, uint8_t channel);
+
+#endif
@@ -0,0 +1,79 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Host stand-in, see adc_test.c.  Only main() uses it, never run. */
+
+#ifndef HOST_USART_H
+#define HOST_USART_H
+
+#include <stdint.h>
+
+#define USART2			2
+
+#define USART_STOPBITS_1	0
+#define USART_MODE_TX_RX	0x0c
+#define USART_PARITY_NONE	0
+#define USART_FLOWCONTROL_NONE	0
+
+static inline void usart_set_baudrate(uint32_t usart, uint32_t baud)
+{
+	(void)usart;
+	(void)baud;
+}
+
+static inline void usart_set_databits(uint32_t usart, uint32_t bits)
+{
+	(void)usart;
+	(void)bits;
+}
+
+static inline void usart_set_stopbits(uint32_t usart, uint32_t stopbits)
+{
+	(void)usart;
+	(void)stopbits;
+}
+
+static inline void usart_set_mode(uint32_t usart, uint32_t mode)
+{
+	(void)usart;
+	(void)mode;
+}
+
+static inline void usart_set_parity(uint32_t usart, uint32_t parity)
+{
+	(void)usart;
+	(void)parity;
+}
+
+static inline void usart_set_flow_control(uint32_t usart, uint32_t flowcontrol)
+{
+	(void)usart;
+	(void)flowcontrol;
+}
+
+static inline void usart_enable(uint32_t usart)
+{
+	(void)usart;
+}
+
+static inline void usart_send_blocking(uint32_t usart, uint16_t data)
+{
+	(void)usart;
+	(void)data;
+}
+
+#endif
@@ -0,0 +1,387 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stddef.h>
+#include <libopencm3/cm3/cortex.h>
+#include <libopencm3/cm3/nvic.h>
+#include <libopencm3/stm32/can.h>
+
+#include "candrv.h"
+
+struct tx_queue {
+	struct can_frame frames[CANDRV_TX_QUEUE_LEN];
+	uint32_t head;
+	uint32_t tail;
+};
+
+static struct tx_queue tx_queues[CANDRV_PRIOS];
+
+static struct can_frame rx_ring[CANDRV_RX_RING_LEN];
+static volatile uint32_t rx_head;	/* written by the RX interrupts */
+static volatile uint32_t rx_tail;	/* written by candrv_recv() */
+
+volatile struct candrv_stats candrv_stats;
+
+/*
+ * Fill empty mailboxes from the queues, highest priority first.  Called
+ * with the TX interrupt unable to run, either from it or with interrupts
+ * masked.
+ */
+static void tx_kick(void)
+{
+	struct tx_queue *q;
+	struct can_frame *f;
+	int prio;
+
+	for (prio = 0; prio < CANDRV_PRIOS; prio++) {
+		q = &tx_queues[prio];
+		while (q->head != q->tail) {
+			f = &q->frames[q->tail & (CANDRV_TX_QUEUE_LEN - 1)];
+			if (can_transmit(CAN1, f->id, f->ext, f->rtr,
+					 f->len, f->data) == -1)
+				return;		/* all mailboxes busy */
+			q->tail++;
+		}
+	}
+}
+
+bool candrv_send(const struct can_frame *frame, enum candrv_prio prio)
+{
+	struct tx_queue *q = &tx_queues[prio];
+	bool ok = false;
+	uint32_t masked;
+
+	masked = cm_mask_interrupts(1);
+	if (q->head - q->tail < CANDRV_TX_QUEUE_LEN) {
+		q->frames[q->head & (CANDRV_TX_QUEUE_LEN - 1)] = *frame;
+		q->head++;
+		ok = true;
+		tx_kick();
+	} else {
+		candrv_stats.tx_dropped++;
+	}
+	cm_mask_interrupts(masked);
+
+	return ok;
+}
+
+bool candrv_recv(struct can_frame *frame)
+{
+	uint32_t tail = rx_tail;
+
+	if (tail == rx_head)
+		return false;
+	*frame = rx_ring[tail & (CANDRV_RX_RING_LEN - 1)];
+	rx_tail = tail + 1;
+
+	return true;
+}
+
+static void rx_drain(uint8_t fifo)
+{
+	volatile uint32_t *rfr = fifo ? &CAN_RF1R(CAN1) : &CAN_RF0R(CAN1);
+	uint32_t head = rx_head;
+	struct can_frame *f;
+	uint32_t id;
+	bool ext, rtr;
+	uint8_t fmi, len, data[8];
+
+	/* The masks of FMP0 and FMP1, and FOVR0 and FOVR1, are the same. */
+	while (*rfr & CAN_RF0R_FMP0_MASK) {
+		if (head - rx_tail < CANDRV_RX_RING_LEN) {
+			f = &rx_ring[head & (CANDRV_RX_RING_LEN - 1)];
+			can_receive(CAN1, fifo, true, &f->id, &f->ext,
+				    &f->rtr, &f->fmi, &f->len, f->data, NULL);
+			head++;
+		} else {
+			/* Still release the mailbox, or we'd spin. */
+			can_receive(CAN1, fifo, true, &id, &ext, &rtr,
+				    &fmi, &len, data, NULL);
+			candrv_stats.rx_dropped++;
+		}
+	}
+	rx_head = head;
+
+	if (*rfr & CAN_RF0R_FOVR0) {
+		*rfr = CAN_RF0R_FOVR0;
+		candrv_stats.rx_overruns++;
+	}
+}
+
+void usb_hp_can_tx_isr(void)
+{
+	/* Acknowledge the finished mailboxes, then refill them. */
+	CAN_TSR(CAN1) = CAN_TSR_RQCP0 | CAN_TSR_RQCP1 | CAN_TSR_RQCP2;
+	tx_kick();
+}
+
+void usb_lp_can_rx0_isr(void)
+{
+	rx_drain(0);
+}
+
+void can_rx1_isr(void)
+{
+	rx_drain(1);
+}
+
+void candrv_init(void)
+{
+	int i;
+
+	for (i = 0; i < CANDRV_PRIOS; i++)
+		tx_queues[i].head = tx_queues[i].tail = 0;
+	rx_head = rx_tail = 0;
+
+	/*
+	 * Both RX interrupts write rx_ring; at the same priority they can't
+	 * preempt each other.
+	 */
+	nvic_set_priority(NVIC_USB_HP_CAN_TX_IRQ, 1);
+	nvic_set_priority(NVIC_USB_LP_CAN_RX0_IRQ, 1);
+	nvic_set_priority(NVIC_CAN_RX1_IRQ, 1);
+	nvic_enable_irq(NVIC_USB_HP_CAN_TX_IRQ);
+	nvic_enable_irq(NVIC_USB_LP_CAN_RX0_IRQ);
+	nvic_enable_irq(NVIC_CAN_RX1_IRQ);
+
+	can_enable_irq(CAN1, CAN_IER_TMEIE | CAN_IER_FMPIE0 | CAN_IER_FMPIE1);
+}
+
+/*
+ * Filter banks.
+ *
+ * A bank holds, in order of capacity, four standard ids (16 bit list),
+ * two standard id/mask pairs (16 bit mask), two ids of either kind
+ * (32 bit list) or one id/mask pair of either kind (32 bit mask).  For
+ * each FIFO, filters covered by another one are dropped, then the rest
+ * are packed into the densest bank that can hold them:
+ *
+ *  - each extended mask takes a 32 bit mask bank,
+ *  - standard masks go two to a 16 bit mask bank, an odd one sharing
+ *    with a standard id if there is one,
+ *  - extended ids go two to a 32 bit list bank, an odd one sharing with
+ *    a standard id if that saves a 16 bit list bank,
+ *  - the remaining standard ids go four to a 16 bit list bank.
+ *
+ * Unused slots repeat an entry of their bank.  Bank register layouts:
+ * 32 bit is STID[10:0] EXID[17:0] IDE RTR 0, 16 bit is STID[10:0] RTR
+ * IDE EXID[17:15].  Masks always compare IDE.
+ *
+ * List entries always compare RTR, so only a filter for one kind of
+ * frame can be an id; one for both goes in as a mask that leaves RTR
+ * out, whatever its mask.  That keeps the RTR policy independent of
+ * where a filter is packed.
+ *
+ * The whole layout is planned before any bank is written.
+ */
+#define STD_MASK		0x7ff
+#define EXT_MASK		0x1fffffff
+#define FILTER32_IDE		(1 << 2)
+#define FILTER32_RTR		(1 << 1)
+#define FILTER16_RTR		(1 << 4)
+#define FILTER16_IDE		(1 << 3)
+/* More than this can't fit even as four standard ids per bank. */
+#define MAX_FILTERS		(CANDRV_FILTER_BANKS * 4)
+
+struct filter_bank {
+	bool scale_32bit;
+	bool id_list;
+	uint32_t fr1, fr2;
+	uint8_t fifo;
+};
+
+struct filter_layout {
+	struct filter_bank banks[CANDRV_FILTER_BANKS];
+	int n;
+};
+
+static uint32_t fr32(const struct candrv_filter *f)
+{
+	uint32_t r = f->ext ? (f->id << 3) | FILTER32_IDE : f->id << 21;
+
+	return f->rtr == CANDRV_RTR_REMOTE ? r | FILTER32_RTR : r;
+}
+
+static uint32_t fr32_mask(const struct candrv_filter *f)
+{
+	uint32_t r = (f->ext ? f->mask << 3 : f->mask << 21) | FILTER32_IDE;
+
+	return f->rtr != CANDRV_RTR_ANY ? r | FILTER32_RTR : r;
+}
+
+static uint16_t fr16(const struct candrv_filter *f)
+{
+	uint16_t r = f->id << 5;
+
+	return f->rtr == CANDRV_RTR_REMOTE ? r | FILTER16_RTR : r;
+}
+
+static uint16_t fr16_mask(const struct candrv_filter *f)
+{
+	uint16_t r = (f->mask << 5) | FILTER16_IDE;
+
+	return f->rtr != CANDRV_RTR_ANY ? r | FILTER16_RTR : r;
+}
+
+static bool filter_covers(const struct candrv_filter *a,
+			  const struct candrv_filter *b)
+{
+	return a->ext == b->ext && a->fifo == b->fifo &&
+	       (a->rtr == CANDRV_RTR_ANY || a->rtr == b->rtr) &&
+	       (b->mask & a->mask) == a->mask &&
+	       ((b->id ^ a->id) & a->mask) == 0;
+}
+
+/* An exact id for one kind of frame, which can be a list entry. */
+static bool filter_exact(const struct candrv_filter *f)
+{
+	return f->mask == (f->ext ? EXT_MASK : STD_MASK) &&
+	       f->rtr != CANDRV_RTR_ANY;
+}
+
+static bool add_bank(struct filter_layout *l, bool scale_32bit, bool id_list,
+		     uint32_t fr1, uint32_t fr2, uint8_t fifo)
+{
+	struct filter_bank *b = &l->banks[l->n];
+
+	if (l->n == CANDRV_FILTER_BANKS)
+		return false;
+	b->scale_32bit = scale_32bit;
+	b->id_list = id_list;
+	b->fr1 = fr1;
+	b->fr2 = fr2;
+	b->fifo = fifo;
+	l->n++;
+	return true;
+}
+
+/* In 16 bit mode each register holds two entries, first in the low half. */
+static uint32_t fr16_pair(uint16_t first, uint16_t second)
+{
+	return (uint32_t)second << 16 | first;
+}
+
+static bool plan_fifo(struct filter_layout *l, const struct candrv_filter *norm,
+		      int count, uint8_t fifo)
+{
+	const struct candrv_filter *std_id[MAX_FILTERS];
+	const struct candrv_filter *std_mask[MAX_FILTERS];
+	const struct candrv_filter *ext_id[MAX_FILTERS];
+	const struct candrv_filter *ext_mask[MAX_FILTERS];
+	int nsi = 0, nsm = 0, nei = 0, nem = 0;
+	int i, j;
+
+	for (i = 0; i < count; i++) {
+		const struct candrv_filter *f = &norm[i];
+
+		if (f->fifo != fifo)
+			continue;
+		/* Skip f if another filter accepts all it does. */
+		for (j = 0; j < count; j++)
+			if (j != i && filter_covers(&norm[j], f) &&
+			    (!filter_covers(f, &norm[j]) || j < i))
+				break;
+		if (j < count)
+			continue;
+
+		if (f->ext && filter_exact(f))
+			ext_id[nei++] = f;
+		else if (f->ext)
+			ext_mask[nem++] = f;
+		else if (filter_exact(f))
+			std_id[nsi++] = f;
+		else
+			std_mask[nsm++] = f;
+	}
+
+	for (i = 0; i < nem; i++)
+		if (!add_bank(l, true, false, fr32(ext_mask[i]),
+			      fr32_mask(ext_mask[i]), fifo))
+			return false;
+
+	for (i = 0; i < nsm; i += 2) {
+		const struct candrv_filter *a = std_mask[i];
+		uint16_t id = fr16(a), mask = fr16_mask(a);
+
+		if (i + 1 < nsm) {
+			id = fr16(std_mask[i + 1]);
+			mask = fr16_mask(std_mask[i + 1]);
+		} else if (nsi) {
+			/* An exact id as a mask: compare every bit. */
+			id = fr16(std_id[--nsi]);
+			mask = (STD_MASK << 5) | FILTER16_RTR | FILTER16_IDE;
+		}
+		if (!add_bank(l, false, false, fr16_pair(fr16(a), fr16_mask(a)),
+			      fr16_pair(id, mask), fifo))
+			return false;
+	}
+
+	for (i = 0; i < nei; i += 2) {
+		const struct candrv_filter *a = ext_id[i];
+		const struct candrv_filter *b = a;
+
+		if (i + 1 < nei)
+			b = ext_id[i + 1];
+		else if (nsi % 4 == 1)
+			b = std_id[--nsi];
+		if (!add_bank(l, true, true, fr32(a), fr32(b), fifo))
+			return false;
+	}
+
+	for (i = 0; i < nsi; i += 4) {
+		uint16_t id[4];
+
+		for (j = 0; j < 4; j++)
+			id[j] = fr16(std_id[i + j < nsi ? i + j : i]);
+		if (!add_bank(l, false, true, fr16_pair(id[0], id[1]),
+			      fr16_pair(id[2], id[3]), fifo))
+			return false;
+	}
+
+	return true;
+}
+
+int candrv_set_filters(const struct candrv_filter *filters, int count)
+{
+	struct candrv_filter norm[MAX_FILTERS];
+	struct filter_layout l;
+	struct filter_bank *b;
+	int i;
+
+	if (count > MAX_FILTERS)
+		return -1;
+
+	for (i = 0; i < count; i++) {
+		norm[i] = filters[i];
+		norm[i].mask &= norm[i].ext ? EXT_MASK : STD_MASK;
+		norm[i].id &= norm[i].mask;
+	}
+
+	l.n = 0;
+	if (!plan_fifo(&l, norm, count, 0) || !plan_fifo(&l, norm, count, 1))
+		return -1;
+
+	for (i = 0; i < l.n; i++) {
+		b = &l.banks[i];
+		can_filter_init(i, b->scale_32bit, b->id_list, b->fr1, b->fr2,
+				b->fifo, true);
+	}
+	for (; i < CANDRV_FILTER_BANKS; i++)
+		can_filter_init(i, false, false, 0, 0, 0, false);
+
+	return l.n;
+}
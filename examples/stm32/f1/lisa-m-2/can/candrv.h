@@ -0,0 +1,98 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CANDRV_H
+#define CANDRV_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Interrupt driven CAN1 frame queues.
+ *
+ * Frames to send wait in one software queue per priority and are moved
+ * into the three transmit mailboxes from the TX interrupt, highest
+ * priority queue first.  Both receive FIFOs are drained from their
+ * interrupts into one ring that the application reads with
+ * candrv_recv().
+ *
+ * can_init() must be called with TXFP set, so the mailboxes go out in
+ * the order they were loaded, before candrv_init().  A frame queued at a
+ * higher priority still waits for the (at most three) frames already in
+ * the mailboxes.
+ */
+
+#define CANDRV_TX_QUEUE_LEN	8	/* per priority, must be a power of 2 */
+#define CANDRV_RX_RING_LEN	32	/* must be a power of 2 */
+#define CANDRV_FILTER_BANKS	14
+
+enum candrv_prio {
+	CANDRV_PRIO_HIGH,
+	CANDRV_PRIO_NORMAL,
+	CANDRV_PRIO_LOW,
+	CANDRV_PRIOS
+};
+
+struct can_frame {
+	uint32_t id;
+	bool ext;
+	bool rtr;
+	uint8_t len;
+	uint8_t fmi;		/* filter match index, receive only */
+	uint8_t data[8];
+};
+
+/* Which frames with a matching id a filter accepts. */
+enum candrv_rtr {
+	CANDRV_RTR_ANY,		/* data and remote frames */
+	CANDRV_RTR_DATA,
+	CANDRV_RTR_REMOTE,
+};
+
+/* Accept frames whose id matches `id' in all bits set in `mask'. */
+struct candrv_filter {
+	uint32_t id;
+	uint32_t mask;
+	bool ext;
+	uint8_t rtr;		/* enum candrv_rtr */
+	uint8_t fifo;
+};
+
+struct candrv_stats {
+	uint32_t tx_dropped;	/* software queue full */
+	uint32_t rx_dropped;	/* receive ring full */
+	uint32_t rx_overruns;	/* hardware FIFO overrun */
+};
+
+void candrv_init(void);
+
+/* Returns false if the queue for `prio' is full. */
+bool candrv_send(const struct can_frame *frame, enum candrv_prio prio);
+
+/* Returns false if no frame is waiting. */
+bool candrv_recv(struct can_frame *frame);
+
+/*
+ * Program the filter banks from a list of filters and return the number
+ * of banks used, or -1 if the list doesn't fit; the banks are left as
+ * they were then.
+ */
+int candrv_set_filters(const struct candrv_filter *filters, int count);
+
+extern volatile struct candrv_stats candrv_stats;
+
+#endif /* !CANDRV_H */
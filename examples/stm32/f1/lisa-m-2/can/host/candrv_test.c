@@ -0,0 +1,708 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Host test for candrv.c against a simulated bxCAN.
+ *
+ * The filter banks candrv_set_filters() programs are matched the way
+ * the hardware does it, register bits, priorities and filter numbers
+ * included, and compared with the filter list itself over random lists
+ * that mix standard and extended ids and masks, both FIFOs and all
+ * three RTR policies.  A list that doesn't fit must leave the banks
+ * untouched.
+ *
+ * The queues are then run on a simulated 1 Mbit/s bus at full load:
+ * other nodes always have a frame waiting, frames win arbitration by
+ * id, received frames go through the banks into three-deep FIFOs that
+ * overwrite their last frame when full, and the interrupts run after
+ * every frame.  No accepted frame may be lost, duplicated or reordered,
+ * and the transmit queues must go out in priority and queue order.  Two
+ * more runs hold off the interrupts and the reader to check that
+ * overruns and a full ring are counted.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <libopencm3/cm3/nvic.h>
+#include <libopencm3/stm32/can.h>
+
+#include "candrv.h"
+
+#define FILTER_LISTS	20000
+#define BUS_FRAMES	200000
+#define BIT_RATE	1000000
+
+#define STD_MASK	0x7ff
+#define EXT_MASK	0x1fffffff
+
+/* Set in the RFxR copies, cleared when candrv.c writes them. */
+#define RFR_UNTOUCHED	(1u << 31)
+
+static int failures;
+
+#define CHECK(cond, ...) do {						\
+	if (!(cond)) {							\
+		if (failures++ < 10) {					\
+			printf("FAIL %s:%d: ", __FILE__, __LINE__);	\
+			printf(__VA_ARGS__);				\
+			printf("\n");					\
+		}							\
+	}								\
+} while (0)
+
+static uint32_t rng_state = 1;
+
+static uint32_t rnd(void)
+{
+	rng_state ^= rng_state << 13;
+	rng_state ^= rng_state >> 17;
+	rng_state ^= rng_state << 5;
+	return rng_state;
+}
+
+/* --- The simulated bxCAN --- */
+
+struct bank {
+	bool active;
+	bool scale_32bit;
+	bool id_list;
+	uint32_t fr1, fr2;
+	uint8_t fifo;
+};
+
+static struct bank banks[CANDRV_FILTER_BANKS];
+static int bank_writes;
+
+struct rx_fifo {
+	struct can_frame frames[3];
+	int count;
+	bool overrun;
+};
+
+static struct rx_fifo rx_fifos[2];
+volatile uint32_t sim_rfr[2], sim_tsr;
+
+struct mailbox {
+	bool busy;
+	struct can_frame frame;
+	uint32_t loaded;	/* load order, for TXFP */
+};
+
+static struct mailbox mailboxes[3];
+static uint32_t mailbox_loads;
+
+/* Called from can_transmit(), see the bus simulation. */
+static void tx_loaded(const struct can_frame *frame);
+
+void can_filter_init(uint32_t nr, bool scale_32bit, bool id_list_mode,
+		     uint32_t fr1, uint32_t fr2, uint32_t fifo, bool enable)
+{
+	struct bank *b = &banks[nr];
+
+	CHECK(nr < CANDRV_FILTER_BANKS, "bank %u", (unsigned)nr);
+	b->active = enable;
+	b->scale_32bit = scale_32bit;
+	b->id_list = id_list_mode;
+	b->fr1 = fr1;
+	b->fr2 = fr2;
+	b->fifo = fifo;
+	bank_writes++;
+}
+
+void can_enable_irq(uint32_t canport, uint32_t irq)
+{
+	(void)canport;
+	(void)irq;
+}
+
+int can_transmit(uint32_t canport, uint32_t id, bool ext, bool rtr,
+		 uint8_t length, uint8_t *data)
+{
+	struct mailbox *m;
+	int i;
+
+	(void)canport;
+	for (i = 0; i < 3; i++) {
+		m = &mailboxes[i];
+		if (m->busy)
+			continue;
+		m->busy = true;
+		m->loaded = mailbox_loads++;
+		m->frame.id = id;
+		m->frame.ext = ext;
+		m->frame.rtr = rtr;
+		m->frame.len = length;
+		memcpy(m->frame.data, data, length);
+		tx_loaded(&m->frame);
+		return i;
+	}
+	return -1;
+}
+
+static void sync_rfr(int fifo)
+{
+	struct rx_fifo *q = &rx_fifos[fifo];
+
+	sim_rfr[fifo] = q->count | (q->overrun ? CAN_RF0R_FOVR0 : 0) |
+			RFR_UNTOUCHED;
+}
+
+void can_receive(uint32_t canport, uint8_t fifo, bool release, uint32_t *id,
+		 bool *ext, bool *rtr, uint8_t *fmi, uint8_t *length,
+		 uint8_t *data, uint16_t *timestamp)
+{
+	struct rx_fifo *q = &rx_fifos[fifo];
+	struct can_frame *f = &q->frames[0];
+
+	(void)canport;
+	CHECK(q->count > 0, "can_receive() on an empty FIFO");
+	CHECK(release, "can_receive() without release");
+	CHECK(timestamp == NULL, "timestamp asked for");
+	*id = f->id;
+	*ext = f->ext;
+	*rtr = f->rtr;
+	*fmi = f->fmi;
+	*length = f->len;
+	memcpy(data, f->data, f->len);
+	memmove(&q->frames[0], &q->frames[1], sizeof(q->frames[0]) * 2);
+	q->count--;
+	sync_rfr(fifo);
+}
+
+/* Identifier registers as the filters see them. */
+static uint32_t frame_r32(uint32_t id, bool ext, bool rtr)
+{
+	uint32_t r = ext ? (id << 3) | (1 << 2) : id << 21;
+
+	return rtr ? r | (1 << 1) : r;
+}
+
+static uint16_t frame_r16(uint32_t id, bool ext, bool rtr)
+{
+	uint16_t r = ext ? ((id >> 18) << 5) | (1 << 3) | ((id >> 15) & 7) :
+			   id << 5;
+
+	return rtr ? r | (1 << 4) : r;
+}
+
+/*
+ * Match a frame against the banks like the hardware: a 32 bit filter
+ * wins over a 16 bit one, then a list over a mask, then the lower
+ * filter number.  Filter numbers count per FIFO, inactive banks
+ * included.
+ */
+static bool hw_match(uint32_t id, bool ext, bool rtr, uint8_t *fifo,
+		     uint8_t *fmi)
+{
+	uint32_t r32 = frame_r32(id, ext, rtr);
+	uint16_t r16 = frame_r16(id, ext, rtr);
+	int number[2] = { 0, 0 };
+	int best = 4, i, j;
+
+	for (i = 0; i < CANDRV_FILTER_BANKS; i++) {
+		const struct bank *b = &banks[i];
+		int first = number[b->fifo];
+		int rank = (b->scale_32bit ? 0 : 2) + (b->id_list ? 0 : 1);
+		int hit = -1;
+
+		if (b->scale_32bit && b->id_list) {
+			number[b->fifo] += 2;
+			if (r32 == (b->fr1 & ~1u))
+				hit = 0;
+			else if (r32 == (b->fr2 & ~1u))
+				hit = 1;
+		} else if (b->scale_32bit) {
+			number[b->fifo] += 1;
+			if (((r32 ^ b->fr1) & b->fr2 & ~1u) == 0)
+				hit = 0;
+		} else if (b->id_list) {
+			uint16_t e[4] = { b->fr1, b->fr1 >> 16,
+					  b->fr2, b->fr2 >> 16 };
+
+			number[b->fifo] += 4;
+			for (j = 0; j < 4 && hit < 0; j++)
+				if (r16 == e[j])
+					hit = j;
+		} else {
+			number[b->fifo] += 2;
+			if (((r16 ^ b->fr1) & (b->fr1 >> 16)) == 0)
+				hit = 0;
+			else if (((r16 ^ b->fr2) & (b->fr2 >> 16)) == 0)
+				hit = 1;
+		}
+		if (!b->active || hit < 0 || rank >= best)
+			continue;
+		best = rank;
+		*fifo = b->fifo;
+		*fmi = first + hit;
+	}
+
+	return best < 4;
+}
+
+/* --- The reference: what the filter list says --- */
+
+static bool ref_accepts(const struct candrv_filter *f, uint32_t id, bool ext,
+			bool rtr)
+{
+	uint32_t mask = f->mask & (f->ext ? EXT_MASK : STD_MASK);
+
+	if (f->ext != ext || ((id ^ f->id) & mask) != 0)
+		return false;
+	return f->rtr == CANDRV_RTR_ANY ||
+	       (f->rtr == CANDRV_RTR_REMOTE) == rtr;
+}
+
+/* Bit n set: some filter for FIFO n accepts the frame. */
+static int ref_match(const struct candrv_filter *filters, int count,
+		     uint32_t id, bool ext, bool rtr)
+{
+	int fifos = 0, i;
+
+	for (i = 0; i < count; i++)
+		if (ref_accepts(&filters[i], id, ext, rtr))
+			fifos |= 1 << filters[i].fifo;
+	return fifos;
+}
+
+/* --- Filter programming --- */
+
+static uint32_t random_id(bool ext)
+{
+	/* Few distinct ids, so filters overlap and cover each other. */
+	static const uint32_t std_ids[] = { 0x000, 0x005, 0x100, 0x101, 0x3f0 };
+	static const uint32_t ext_ids[] = { 0x1234567, 0x0000100, 0x1fffff00 };
+	uint32_t id;
+
+	if (ext) {
+		id = ext_ids[rnd() % 3];
+		if (rnd() % 2)
+			id ^= 1u << (rnd() % 29);
+		return id & EXT_MASK;
+	}
+	id = std_ids[rnd() % 5];
+	if (rnd() % 2)
+		id ^= 1u << (rnd() % 11);
+	return id & STD_MASK;
+}
+
+static void random_filter(struct candrv_filter *f)
+{
+	uint32_t full;
+
+	f->ext = rnd() % 10 < 3;
+	full = f->ext ? EXT_MASK : STD_MASK;
+	f->id = random_id(f->ext);
+	switch (rnd() % 4) {
+	case 0:
+	case 1:
+		f->mask = full;
+		break;
+	case 2:
+		/* Low bits don't care. */
+		f->mask = full & ~((1u << (rnd() % 8 + 1)) - 1);
+		break;
+	default:
+		/* Anything, garbage above the id bits included. */
+		f->mask = rnd();
+		break;
+	}
+	f->rtr = rnd() % 3;
+	f->fifo = rnd() % 2;
+	/* id bits outside the mask are don't care too. */
+	if (rnd() % 4 == 0)
+		f->id |= rnd() & ~f->mask & full;
+}
+
+/* Frames near the filters, where packing mistakes show. */
+static void probe_frame(const struct candrv_filter *filters, int count,
+			uint32_t *id, bool *ext, bool *rtr)
+{
+	const struct candrv_filter *f = &filters[rnd() % count];
+
+	*ext = f->ext;
+	if (rnd() % 8 == 0)
+		*ext = !*ext;
+	*id = (f->id & ~f->mask) | (rnd() & ~f->mask);
+	*id = (f->id & f->mask) | (*id & ~f->mask);
+	if (rnd() % 3 == 0)
+		*id ^= 1u << (rnd() % (*ext ? 29 : 11));
+	*id &= *ext ? EXT_MASK : STD_MASK;
+	*rtr = rnd() % 2;
+}
+
+static void test_filters(void)
+{
+	struct candrv_filter filters[24];
+	int lists, count, n, i, fits = 0, banks_used = 0, frames = 0;
+	int mismatches = 0, rtr_mismatches = 0;
+
+	for (lists = 0; lists < FILTER_LISTS; lists++) {
+		count = 1 + rnd() % 24;
+		for (i = 0; i < count; i++)
+			random_filter(&filters[i]);
+
+		/* Garbage in the banks to catch ones left unprogrammed. */
+		for (i = 0; i < CANDRV_FILTER_BANKS; i++) {
+			banks[i].active = true;
+			banks[i].scale_32bit = rnd() % 2;
+			banks[i].id_list = rnd() % 2;
+			banks[i].fr1 = rnd();
+			banks[i].fr2 = rnd();
+			banks[i].fifo = rnd() % 2;
+		}
+		bank_writes = 0;
+
+		n = candrv_set_filters(filters, count);
+		if (n < 0) {
+			CHECK(bank_writes == 0,
+			      "list of %d didn't fit but wrote %d banks",
+			      count, bank_writes);
+			continue;
+		}
+		CHECK(n <= CANDRV_FILTER_BANKS, "%d banks", n);
+		CHECK(bank_writes == CANDRV_FILTER_BANKS,
+		      "%d banks written", bank_writes);
+		fits++;
+		banks_used += n;
+
+		for (i = 0; i < 64; i++) {
+			uint32_t id;
+			bool ext, rtr, hit;
+			uint8_t fifo = 0, fmi = 0;
+			int want;
+
+			probe_frame(filters, count, &id, &ext, &rtr);
+			hit = hw_match(id, ext, rtr, &fifo, &fmi);
+			want = ref_match(filters, count, id, ext, rtr);
+			frames++;
+			if (hit == (want != 0) &&
+			    (!hit || (want & (1 << fifo))))
+				continue;
+			mismatches++;
+			if (want != ref_match(filters, count, id, ext, !rtr))
+				rtr_mismatches++;
+			CHECK(false, "%s id 0x%x %s: banks %s FIFO %d, list %d",
+			      ext ? "ext" : "std", (unsigned)id,
+			      rtr ? "remote" : "data",
+			      hit ? "accept to" : "reject", hit ? fifo : -1,
+			      want);
+		}
+	}
+
+	printf("filters: %d lists, %d fit in %.1f banks on average, "
+	       "%d frames, %d mismatches (%d on RTR)\n",
+	       FILTER_LISTS, fits, fits ? (double)banks_used / fits : 0.0,
+	       frames, mismatches, rtr_mismatches);
+}
+
+/* --- The bus --- */
+
+#define TX_ID_BASE	0x080	/* our ids, one per priority */
+
+struct bus_run {
+	const char *name;
+	int isr_every;		/* run the interrupts every n frames */
+	int reads_every;	/* the reader takes a frame every n frames */
+	bool expect_loss;
+};
+
+/* Frames from the other nodes: mostly accepted, some not. */
+static const struct candrv_filter bus_filters[] = {
+	{ .id = 0x000, .mask = 0x7f0, .ext = false, .fifo = 0 },
+	{ .id = 0x100, .mask = 0x7ff, .ext = false,
+	  .rtr = CANDRV_RTR_DATA, .fifo = 1 },
+	{ .id = 0x101, .mask = 0x7ff, .ext = false,
+	  .rtr = CANDRV_RTR_DATA, .fifo = 1 },
+	{ .id = 0x1234567, .mask = 0x1fffffff, .ext = true,
+	  .rtr = CANDRV_RTR_DATA, .fifo = 1 },
+};
+
+static const struct can_frame bus_traffic[] = {
+	{ .id = 0x003, .len = 8 },
+	{ .id = 0x00f, .len = 2 },
+	{ .id = 0x00a, .rtr = true, .len = 0 },
+	{ .id = 0x100, .len = 8 },
+	{ .id = 0x101, .len = 4 },
+	{ .id = 0x100, .rtr = true, .len = 0 },	/* rejected */
+	{ .id = 0x200, .len = 8 },		/* rejected */
+	{ .id = 0x1234567, .ext = true, .len = 8 },
+	{ .id = 0x1234566, .ext = true, .len = 8 },	/* rejected */
+};
+
+static uint32_t tx_queued[CANDRV_PRIOS];	/* sequence numbers */
+static uint32_t tx_loaded_seq[CANDRV_PRIOS];
+static uint32_t tx_sent_seq[CANDRV_PRIOS];
+
+static uint32_t seq_get(const uint8_t *data)
+{
+	return data[0] | data[1] << 8 | data[2] << 16 | (uint32_t)data[3] << 24;
+}
+
+static void seq_put(uint8_t *data, uint32_t seq)
+{
+	data[0] = seq;
+	data[1] = seq >> 8;
+	data[2] = seq >> 16;
+	data[3] = seq >> 24;
+}
+
+static void tx_loaded(const struct can_frame *frame)
+{
+	int prio = frame->id - TX_ID_BASE, p;
+
+	/* Queue order within a priority, higher priorities first. */
+	CHECK(seq_get(frame->data) == tx_loaded_seq[prio],
+	      "prio %d loaded %u, expected %u", prio,
+	      (unsigned)seq_get(frame->data), (unsigned)tx_loaded_seq[prio]);
+	tx_loaded_seq[prio] = seq_get(frame->data) + 1;
+	for (p = 0; p < prio; p++)
+		CHECK(tx_loaded_seq[p] == tx_queued[p],
+		      "prio %d loaded with prio %d waiting", prio, p);
+}
+
+/* Remote frames carry no sequence number, only their id tells them apart. */
+static bool same_frame(const struct can_frame *a, const struct can_frame *b)
+{
+	return a->id == b->id && a->ext == b->ext && a->rtr == b->rtr &&
+	       a->len == b->len &&
+	       (a->rtr || memcmp(a->data, b->data, a->len) == 0);
+}
+
+/* Bits on the wire, stuffing left out: the most frames per second. */
+static int frame_bits(const struct can_frame *f)
+{
+	return (f->ext ? 64 : 44) + (f->rtr ? 0 : 8 * f->len) + 3;
+}
+
+/* Lower wins arbitration; a standard id beats an extended one. */
+static uint32_t arbitration(const struct can_frame *f)
+{
+	uint32_t key = f->ext ? f->id : f->id << 18;
+
+	return key << 1 | (f->ext ? 1 : 0);
+}
+
+static void run_isrs(void)
+{
+	static void (*const rx_isr[2])(void) = {
+		usb_lp_can_rx0_isr, can_rx1_isr,
+	};
+	int fifo;
+
+	if (sim_tsr) {
+		usb_hp_can_tx_isr();
+		sim_tsr = 0;
+	}
+	for (fifo = 0; fifo < 2; fifo++) {
+		if (!rx_fifos[fifo].count)
+			continue;
+		sync_rfr(fifo);
+		rx_isr[fifo]();
+		if (!(sim_rfr[fifo] & RFR_UNTOUCHED) &&
+		    (sim_rfr[fifo] & CAN_RF0R_FOVR0))
+			rx_fifos[fifo].overrun = false;
+	}
+}
+
+static void run_bus(const struct bus_run *run)
+{
+	const int ntraffic = sizeof(bus_traffic) / sizeof(bus_traffic[0]);
+	struct can_frame next, frame, got;
+	/* Accepted frames, in bus order and per FIFO. */
+	static struct can_frame want_all[BUS_FRAMES], want[2][BUS_FRAMES];
+	uint32_t nwant[2] = { 0, 0 }, next_want[2] = { 0, 0 };
+	uint32_t rx_seq = 0, accepted = 0, delivered = 0;
+	uint32_t sent = 0, refused = 0, overwritten = 0;
+	uint64_t bits = 0;
+	int i, p, fifo_mask;
+	clock_t start;
+	double cpu;
+
+	memset(rx_fifos, 0, sizeof(rx_fifos));
+	memset(mailboxes, 0, sizeof(mailboxes));
+	memset(tx_queued, 0, sizeof(tx_queued));
+	memset(tx_loaded_seq, 0, sizeof(tx_loaded_seq));
+	memset(tx_sent_seq, 0, sizeof(tx_sent_seq));
+	memset((void *)&candrv_stats, 0, sizeof(candrv_stats));
+	sim_tsr = 0;
+	CHECK(candrv_set_filters(bus_filters, sizeof(bus_filters) /
+				 sizeof(bus_filters[0])) > 0, "bus filters");
+	candrv_init();
+
+	next = bus_traffic[0];
+	seq_put(next.data, rx_seq++);
+	start = clock();
+
+	for (i = 0; i < BUS_FRAMES; i++) {
+		struct mailbox *m = NULL;
+		uint8_t fifo = 0, fmi = 0;
+
+		/* Now and then the application queues a frame. */
+		if (rnd() % 4 == 0) {
+			memset(&frame, 0, sizeof(frame));
+			p = rnd() % CANDRV_PRIOS;
+			frame.id = TX_ID_BASE + p;
+			frame.len = 8;
+			seq_put(frame.data, tx_queued[p]++);
+			if (!candrv_send(&frame, p)) {
+				tx_queued[p]--;
+				refused++;
+			}
+		}
+
+		/* The oldest mailbox against the next frame of the others. */
+		for (p = 0; p < 3; p++)
+			if (mailboxes[p].busy &&
+			    (!m || mailboxes[p].loaded < m->loaded))
+				m = &mailboxes[p];
+		if (m && arbitration(&m->frame) < arbitration(&next)) {
+			frame = m->frame;
+			p = frame.id - TX_ID_BASE;
+			CHECK(seq_get(frame.data) == tx_sent_seq[p],
+			      "prio %d sent %u, expected %u", p,
+			      (unsigned)seq_get(frame.data),
+			      (unsigned)tx_sent_seq[p]);
+			tx_sent_seq[p] = seq_get(frame.data) + 1;
+			m->busy = false;
+			sim_tsr |= CAN_TSR_RQCP0 << (8 * (m - mailboxes));
+			bits += frame_bits(&frame);
+			sent++;
+		} else {
+			frame = next;
+			bits += frame_bits(&frame);
+			next = bus_traffic[rnd() % ntraffic];
+			seq_put(next.data, rx_seq++);
+
+			fifo_mask = ref_match(bus_filters, sizeof(bus_filters) /
+					      sizeof(bus_filters[0]),
+					      frame.id, frame.ext, frame.rtr);
+			CHECK(hw_match(frame.id, frame.ext, frame.rtr,
+				       &fifo, &fmi) == (fifo_mask != 0),
+			      "bus frame 0x%x", (unsigned)frame.id);
+			if (fifo_mask) {
+				struct rx_fifo *q = &rx_fifos[fifo];
+
+				want_all[accepted++] = frame;
+				want[fifo][nwant[fifo]++] = frame;
+				frame.fmi = fmi;
+				if (q->count == 3) {
+					q->frames[2] = frame;
+					q->overrun = true;
+					overwritten++;
+				} else {
+					q->frames[q->count++] = frame;
+				}
+			}
+		}
+
+		if ((i + 1) % run->isr_every == 0)
+			run_isrs();
+
+		/* The application reads what has arrived. */
+		while ((i + 1) % run->reads_every == 0 && candrv_recv(&got)) {
+			const struct can_frame *q;
+			uint32_t w;
+
+			/*
+			 * Without losses the ring has the bus order too, with
+			 * them only each FIFO's order holds: skip to the frame
+			 * that did arrive.
+			 */
+			fifo = 0;
+			if (run->expect_loss)
+				hw_match(got.id, got.ext, got.rtr, &fifo, &fmi);
+			q = run->expect_loss ? want[fifo] : want_all;
+			w = next_want[fifo];
+			while (run->expect_loss && w < nwant[fifo] &&
+			       !same_frame(&q[w], &got))
+				w++;
+			CHECK(w < (run->expect_loss ? nwant[fifo] : accepted) &&
+			      same_frame(&q[w], &got),
+			      "got 0x%x %s, expected 0x%x",
+			      (unsigned)got.id, got.rtr ? "remote" : "data",
+			      (unsigned)q[next_want[fifo]].id);
+			next_want[fifo] = w + 1;
+			delivered++;
+			if (run->reads_every > 1)
+				break;
+		}
+	}
+	cpu = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+	/* Whatever is still in the FIFOs and the ring. */
+	run_isrs();
+	while (candrv_recv(&got))
+		delivered++;
+	for (p = 0; p < 2; p++)
+		delivered += rx_fifos[p].count;
+
+	if (run->expect_loss) {
+		CHECK(candrv_stats.rx_overruns || candrv_stats.rx_dropped,
+		      "nothing counted as lost");
+		CHECK(delivered + overwritten + candrv_stats.rx_dropped ==
+		      accepted, "%u delivered, %u overwritten, %u dropped "
+		      "of %u", (unsigned)delivered, (unsigned)overwritten,
+		      (unsigned)candrv_stats.rx_dropped, (unsigned)accepted);
+		CHECK((overwritten != 0) == (candrv_stats.rx_overruns != 0),
+		      "%u overwritten, %u overruns", (unsigned)overwritten,
+		      (unsigned)candrv_stats.rx_overruns);
+	} else {
+		CHECK(candrv_stats.rx_overruns == 0 &&
+		      candrv_stats.rx_dropped == 0 && overwritten == 0,
+		      "%u overruns, %u dropped",
+		      (unsigned)candrv_stats.rx_overruns,
+		      (unsigned)candrv_stats.rx_dropped);
+		CHECK(delivered == accepted, "%u of %u delivered",
+		      (unsigned)delivered, (unsigned)accepted);
+	}
+	CHECK(refused == candrv_stats.tx_dropped, "%u refused, %u counted",
+	      (unsigned)refused, (unsigned)candrv_stats.tx_dropped);
+
+	printf("bus, %s: %.0f frames/s (%.0f received, %.0f sent), "
+	       "%u overruns, %u dropped, %u refused, %.2f us host CPU "
+	       "per frame\n", run->name,
+	       (double)BUS_FRAMES * BIT_RATE / bits,
+	       (double)accepted * BIT_RATE / bits,
+	       (double)sent * BIT_RATE / bits,
+	       (unsigned)candrv_stats.rx_overruns,
+	       (unsigned)candrv_stats.rx_dropped, (unsigned)refused,
+	       cpu * 1e6 / BUS_FRAMES);
+}
+
+int main(void)
+{
+	static const struct bus_run runs[] = {
+		{ "full load", 1, 1, false },
+		{ "interrupts late", 5, 1, true },
+		{ "slow reader", 1, 2, true },
+	};
+	unsigned int i;
+
+	test_filters();
+	for (i = 0; i < sizeof(runs) / sizeof(runs[0]); i++)
+		run_bus(&runs[i]);
+
+	if (failures) {
+		printf("%d failures\n", failures);
+		return EXIT_FAILURE;
+	}
+	printf("all passed\n");
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,44 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Host stand-in, see candrv_test.c. */
+
+#ifndef HOST_NVIC_H
+#define HOST_NVIC_H
+
+#include <stdint.h>
+
+#define NVIC_USB_HP_CAN_TX_IRQ	19
+#define NVIC_USB_LP_CAN_RX0_IRQ	20
+#define NVIC_CAN_RX1_IRQ	21
+
+static inline void nvic_set_priority(uint8_t irq, uint8_t prio)
+{
+	(void)irq;
+	(void)prio;
+}
+
+static inline void nvic_enable_irq(uint8_t irq)
+{
+	(void)irq;
+}
+
+void usb_hp_can_tx_isr(void);
+void usb_lp_can_rx0_isr(void);
+void can_rx1_isr(void);
+
+#endif
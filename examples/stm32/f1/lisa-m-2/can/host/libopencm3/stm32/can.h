@@ -0,0 +1,54 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Host stand-in for the bxCAN parts candrv.c uses; the registers and
+ * functions are implemented by the simulation in candrv_test.c.
+ */
+
+#ifndef HOST_CAN_H
+#define HOST_CAN_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define CAN1			0
+
+extern volatile uint32_t sim_rfr[2], sim_tsr;
+
+#define CAN_RF0R(can)		(sim_rfr[0])
+#define CAN_RF1R(can)		(sim_rfr[1])
+#define CAN_RF0R_FMP0_MASK	(3 << 0)
+#define CAN_RF0R_FOVR0		(1 << 4)
+#define CAN_TSR(can)		(sim_tsr)
+#define CAN_TSR_RQCP0		(1 << 0)
+#define CAN_TSR_RQCP1		(1 << 8)
+#define CAN_TSR_RQCP2		(1 << 16)
+#define CAN_IER_TMEIE		(1 << 0)
+#define CAN_IER_FMPIE0		(1 << 1)
+#define CAN_IER_FMPIE1		(1 << 4)
+
+int can_transmit(uint32_t canport, uint32_t id, bool ext, bool rtr,
+		 uint8_t length, uint8_t *data);
+void can_receive(uint32_t canport, uint8_t fifo, bool release, uint32_t *id,
+		 bool *ext, bool *rtr, uint8_t *fmi, uint8_t *length,
+		 uint8_t *data, uint16_t *timestamp);
+void can_enable_irq(uint32_t canport, uint32_t irq);
+void can_filter_init(uint32_t nr, bool scale_32bit, bool id_list_mode,
+		     uint32_t fr1, uint32_t fr2, uint32_t fifo, bool enable);
+
+#endif
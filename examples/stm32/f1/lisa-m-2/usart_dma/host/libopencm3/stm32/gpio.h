@@ -0,0 +1,52 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Host stand-in, see usart_dma_test.c. */
+
+#ifndef HOST_GPIO_H
+#define HOST_GPIO_H
+
+#include <stdint.h>
+
+#define GPIOA				0
+#define GPIO8				(1 << 8)
+#define GPIO_USART2_TX			(1 << 2)
+#define GPIO_USART2_RX			(1 << 3)
+
+#define GPIO_MODE_INPUT			0
+#define GPIO_MODE_OUTPUT_2_MHZ		2
+#define GPIO_MODE_OUTPUT_50_MHZ		3
+#define GPIO_CNF_INPUT_FLOAT		1
+#define GPIO_CNF_OUTPUT_PUSHPULL	0
+#define GPIO_CNF_OUTPUT_ALTFN_PUSHPULL	2
+
+static inline void gpio_set_mode(uint32_t gpioport, uint8_t mode, uint8_t cnf,
+				 uint16_t gpios)
+{
+	(void)gpioport;
+	(void)mode;
+	(void)cnf;
+	(void)gpios;
+}
+
+static inline void gpio_toggle(uint32_t gpioport, uint16_t gpios)
+{
+	(void)gpioport;
+	(void)gpios;
+}
+
+#endif
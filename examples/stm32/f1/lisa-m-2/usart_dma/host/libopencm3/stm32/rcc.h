@@ -0,0 +1,49 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Host stand-in, see usart_dma_test.c. */
+
+#ifndef HOST_RCC_H
+#define HOST_RCC_H
+
+#include <stdint.h>
+
+enum rcc_periph_clken {
+	RCC_GPIOA, RCC_GPIOB, RCC_GPIOC, RCC_USART2, RCC_DMA1,
+};
+
+struct rcc_clock_scale {
+	uint32_t ahb_frequency;
+};
+
+#define RCC_CLOCK_HSE12_72MHZ	0
+
+static const struct rcc_clock_scale rcc_hse_configs[] = {
+	{ 72000000 },
+};
+
+static inline void rcc_clock_setup_pll(const struct rcc_clock_scale *clock)
+{
+	(void)clock;
+}
+
+static inline void rcc_periph_clock_enable(enum rcc_periph_clken clken)
+{
+	(void)clken;
+}
+
+#endif
@@ -0,0 +1,64 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Host stand-in for the USART parts usart_dma.c uses; the receiver is
+ * simulated in usart_dma_test.c.  Reading SR and DR goes through
+ * functions so the simulation sees the SR-then-DR sequence that clears
+ * IDLE, and a DR read that takes a byte from under the DMA.
+ */
+
+#ifndef HOST_USART_H
+#define HOST_USART_H
+
+#include <stdint.h>
+
+#define USART2			2
+
+#define USART_SR_ORE		(1 << 3)
+#define USART_SR_IDLE		(1 << 4)
+#define USART_SR_RXNE		(1 << 5)
+#define USART_CR1_IDLEIE	(1 << 4)
+
+#define USART_STOPBITS_1	0
+#define USART_MODE_TX_RX	0x0c
+#define USART_PARITY_NONE	0
+#define USART_FLOWCONTROL_NONE	0
+
+extern uint32_t sim_usart_sr, sim_usart_cr1, sim_usart_dr;
+extern int sim_usart_rx_dma, sim_usart_tx_dma;
+
+uint32_t *sim_usart_sr_read(void);
+uint32_t *sim_usart_dr_read(void);
+
+#define USART_SR(usart)		(*sim_usart_sr_read())
+#define USART_DR(usart)		(*sim_usart_dr_read())
+#define USART_CR1(usart)	(sim_usart_cr1)
+#define USART2_DR		(sim_usart_dr)
+
+void usart_set_baudrate(uint32_t usart, uint32_t baud);
+void usart_set_databits(uint32_t usart, uint32_t bits);
+void usart_set_stopbits(uint32_t usart, uint32_t stopbits);
+void usart_set_mode(uint32_t usart, uint32_t mode);
+void usart_set_parity(uint32_t usart, uint32_t parity);
+void usart_set_flow_control(uint32_t usart, uint32_t flowcontrol);
+void usart_enable(uint32_t usart);
+void usart_enable_rx_dma(uint32_t usart);
+void usart_enable_tx_dma(uint32_t usart);
+void usart_disable_tx_dma(uint32_t usart);
+
+#endif
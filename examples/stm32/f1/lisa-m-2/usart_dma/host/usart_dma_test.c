@@ -0,0 +1,519 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/*
+ * Host test for the circular DMA receive in usart_dma.c.
+ *
+ * The simulation runs in steps of one character time.  Each step the
+ * line either completes a byte, which sets RXNE, or stays idle; the first
+ * idle character after a byte sets IDLE.  DMA channel 6 moves a waiting
+ * byte into rx_dma_buf and counts CNDTR down, raising the half and full
+ * flags and reloading in circular mode.  Within a step the DMA and the
+ * interrupts run in random order, so a handler can find a byte in DR
+ * the DMA has not taken yet.  Each interrupt is taken a random number of
+ * steps after it becomes pending, up to a chosen worst case latency.
+ *
+ * The main loop reads rx_ring with dma_read() at random and checks the
+ * bytes against what was sent, in frames of random length and gaps.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Only the receive side is run, main() is kept out of the way. */
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wold-style-declaration"
+#define main static __attribute__((unused)) usart_dma_main
+#include "usart_dma.c"
+#undef main
+#pragma GCC diagnostic pop
+
+static int failures;
+
+#define CHECK(cond, ...) do {						\
+	if (!(cond)) {							\
+		if (failures++ < 10) {					\
+			printf("FAIL %s:%d: ", __FILE__, __LINE__);	\
+			printf(__VA_ARGS__);				\
+			printf("\n");					\
+		}							\
+	}								\
+} while (0)
+
+static uint32_t rng_state = 1;
+
+static uint32_t rnd(void)
+{
+	rng_state ^= rng_state << 13;
+	rng_state ^= rng_state >> 17;
+	rng_state ^= rng_state << 5;
+	return rng_state;
+}
+
+/* Byte number i of the stream */
+static uint8_t seq(uint32_t i)
+{
+	return (i * 2654435761u) >> 24;
+}
+
+/* --- Simulated DMA --- */
+
+struct sim_dma_channel sim_dma[8];
+uint32_t sim_dma_isr, sim_dma_ifcr;
+
+void dma_channel_reset(uint32_t dma, uint8_t channel)
+{
+	(void)dma;
+	memset(&sim_dma[channel], 0, sizeof(sim_dma[channel]));
+	sim_dma_isr &= ~DMA_FLAGS(channel, 0xf);
+}
+
+void dma_set_peripheral_address(uint32_t dma, uint8_t channel,
+				uint32_t address)
+{
+	(void)dma;
+	sim_dma[channel].cpar = address;
+}
+
+void dma_set_memory_address(uint32_t dma, uint8_t channel, uint32_t address)
+{
+	(void)dma;
+	sim_dma[channel].cmar = address;
+}
+
+void dma_set_number_of_data(uint32_t dma, uint8_t channel, uint16_t number)
+{
+	(void)dma;
+	CHECK(!sim_dma[channel].enabled, "CNDTR written while enabled");
+	sim_dma[channel].cndtr = sim_dma[channel].reload = number;
+}
+
+void dma_set_read_from_memory(uint32_t dma, uint8_t channel)
+{
+	(void)dma;
+	sim_dma[channel].from_memory = 1;
+}
+
+void dma_set_read_from_peripheral(uint32_t dma, uint8_t channel)
+{
+	(void)dma;
+	sim_dma[channel].from_memory = 0;
+}
+
+void dma_enable_memory_increment_mode(uint32_t dma, uint8_t channel)
+{
+	(void)dma;
+	sim_dma[channel].minc = 1;
+}
+
+void dma_enable_circular_mode(uint32_t dma, uint8_t channel)
+{
+	(void)dma;
+	sim_dma[channel].circular = 1;
+}
+
+void dma_set_peripheral_size(uint32_t dma, uint8_t channel,
+			     uint32_t peripheral_size)
+{
+	(void)dma;
+	sim_dma[channel].psize = peripheral_size;
+}
+
+void dma_set_memory_size(uint32_t dma, uint8_t channel, uint32_t mem_size)
+{
+	(void)dma;
+	sim_dma[channel].msize = mem_size;
+}
+
+void dma_set_priority(uint32_t dma, uint8_t channel, uint32_t prio)
+{
+	(void)dma;
+	(void)channel;
+	(void)prio;
+}
+
+void dma_enable_half_transfer_interrupt(uint32_t dma, uint8_t channel)
+{
+	(void)dma;
+	sim_dma[channel].htie = 1;
+}
+
+void dma_enable_transfer_complete_interrupt(uint32_t dma, uint8_t channel)
+{
+	(void)dma;
+	sim_dma[channel].tcie = 1;
+}
+
+void dma_disable_transfer_complete_interrupt(uint32_t dma, uint8_t channel)
+{
+	(void)dma;
+	sim_dma[channel].tcie = 0;
+}
+
+void dma_enable_channel(uint32_t dma, uint8_t channel)
+{
+	(void)dma;
+	sim_dma[channel].enabled = 1;
+}
+
+void dma_disable_channel(uint32_t dma, uint8_t channel)
+{
+	(void)dma;
+	sim_dma[channel].enabled = 0;
+}
+
+/* Move a byte from DR to memory if one is waiting. */
+static void dma_step(void)
+{
+	struct sim_dma_channel *ch = &sim_dma[6];
+
+	if (!(sim_usart_sr & USART_SR_RXNE) || !sim_usart_rx_dma ||
+	    !ch->enabled || ch->cndtr == 0)
+		return;
+
+	rx_dma_buf[ch->reload - ch->cndtr] = sim_usart_dr;
+	sim_usart_sr &= ~USART_SR_RXNE;
+
+	if (--ch->cndtr == ch->reload / 2)
+		sim_dma_isr |= DMA_FLAGS(6, DMA_HTIF | DMA_GIF);
+	if (ch->cndtr == 0) {
+		sim_dma_isr |= DMA_FLAGS(6, DMA_TCIF | DMA_GIF);
+		if (ch->circular)
+			ch->cndtr = ch->reload;
+	}
+}
+
+/* --- Simulated USART receiver --- */
+
+uint32_t sim_usart_sr, sim_usart_cr1, sim_usart_dr;
+int sim_usart_rx_dma, sim_usart_tx_dma;
+
+static uint32_t sr_value;
+static int sr_read;		/* SR read, a DR read now clears IDLE */
+static uint32_t cpu_took;	/* bytes the CPU read from under the DMA */
+static uint32_t overruns;
+
+uint32_t *sim_usart_sr_read(void)
+{
+	sr_value = sim_usart_sr;
+	sr_read = 1;
+	return &sr_value;
+}
+
+uint32_t *sim_usart_dr_read(void)
+{
+	static uint32_t dr;
+
+	if (sr_read)
+		sim_usart_sr &= ~(USART_SR_IDLE | USART_SR_ORE);
+	sr_read = 0;
+	if (sim_usart_sr & USART_SR_RXNE) {
+		sim_usart_sr &= ~USART_SR_RXNE;
+		cpu_took++;
+	}
+	dr = sim_usart_dr;
+	return &dr;
+}
+
+void usart_set_baudrate(uint32_t usart, uint32_t baud)
+{
+	(void)usart;
+	(void)baud;
+}
+
+void usart_set_databits(uint32_t usart, uint32_t bits)
+{
+	(void)usart;
+	(void)bits;
+}
+
+void usart_set_stopbits(uint32_t usart, uint32_t stopbits)
+{
+	(void)usart;
+	(void)stopbits;
+}
+
+void usart_set_mode(uint32_t usart, uint32_t mode)
+{
+	(void)usart;
+	(void)mode;
+}
+
+void usart_set_parity(uint32_t usart, uint32_t parity)
+{
+	(void)usart;
+	(void)parity;
+}
+
+void usart_set_flow_control(uint32_t usart, uint32_t flowcontrol)
+{
+	(void)usart;
+	(void)flowcontrol;
+}
+
+void usart_enable(uint32_t usart)
+{
+	(void)usart;
+}
+
+void usart_enable_rx_dma(uint32_t usart)
+{
+	(void)usart;
+	sim_usart_rx_dma = 1;
+}
+
+void usart_enable_tx_dma(uint32_t usart)
+{
+	(void)usart;
+	sim_usart_tx_dma = 1;
+}
+
+void usart_disable_tx_dma(uint32_t usart)
+{
+	(void)usart;
+	sim_usart_tx_dma = 0;
+}
+
+/* A byte completes on the line. */
+static void line_byte(uint8_t b)
+{
+	if (sim_usart_sr & USART_SR_RXNE) {
+		sim_usart_sr |= USART_SR_ORE;
+		overruns++;
+		return;
+	}
+	sim_usart_dr = b;
+	sim_usart_sr |= USART_SR_RXNE;
+}
+
+/* --- Interrupts --- */
+
+uint8_t sim_nvic[64];
+
+struct irq {
+	int pending;
+	uint32_t delay;		/* steps until it is taken */
+};
+
+static struct irq dma_irq, usart_irq;
+static uint32_t max_latency, interrupts;
+
+static int dma_irq_pending(void)
+{
+	struct sim_dma_channel *ch = &sim_dma[6];
+
+	return (sim_nvic[NVIC_DMA1_CHANNEL6_IRQ] & 0x80) &&
+	       (((sim_dma_isr & DMA_ISR_HTIF6) && ch->htie) ||
+		((sim_dma_isr & DMA_ISR_TCIF6) && ch->tcie));
+}
+
+static int usart_irq_pending(void)
+{
+	return (sim_nvic[NVIC_USART2_IRQ] & 0x80) &&
+	       (sim_usart_sr & USART_SR_IDLE) &&
+	       (sim_usart_cr1 & USART_CR1_IDLEIE);
+}
+
+/* Take the interrupt once its latency has passed. */
+static void irq_step(struct irq *irq, int pending, void (*isr)(void))
+{
+	if (!pending) {
+		irq->pending = 0;
+		return;
+	}
+	if (!irq->pending) {
+		irq->pending = 1;
+		irq->delay = rnd() % (max_latency + 1);
+	}
+	if (irq->delay) {
+		irq->delay--;
+		return;
+	}
+
+	isr();
+	interrupts++;
+	sim_dma_isr &= ~sim_dma_ifcr;
+	sim_dma_ifcr = 0;
+	irq->pending = 0;
+}
+
+/* Both have priority 0, the lower number goes first. */
+static void interrupts_step(void)
+{
+	irq_step(&dma_irq, dma_irq_pending(), dma1_channel6_isr);
+	irq_step(&usart_irq, usart_irq_pending(), usart2_isr);
+}
+
+/* --- The runs --- */
+
+struct run {
+	uint32_t sent, received, wrong, late;
+};
+
+static void receive(struct run *r, uint32_t max)
+{
+	char buf[64];
+	int i, n = dma_read(buf, rnd() % max + 1);
+
+	for (i = 0; i < n; i++)
+		r->wrong += (uint8_t)buf[i] != seq(r->received + i);
+	r->received += n;
+}
+
+/*
+ * Send `bytes' in frames, with the main loop reading every `read_every'
+ * steps on average.
+ */
+static void run(struct run *r, uint32_t bytes, uint32_t latency,
+		uint32_t read_every)
+{
+	uint32_t frame = 0, gap = 0, idle = 0;
+
+	memset(r, 0, sizeof(*r));
+	memset(&sim_dma, 0, sizeof(sim_dma));
+	sim_dma_isr = sim_dma_ifcr = 0;
+	sim_usart_sr = sim_usart_cr1 = 0;
+	sim_usart_rx_dma = 0;
+	dma_irq.pending = usart_irq.pending = 0;
+	sr_read = 0;
+	cpu_took = overruns = interrupts = 0;
+	rx_dropped = 0;
+	max_latency = latency;
+
+	usart_setup();
+	dma_read_start();
+	/* Let the ring indices wrap too */
+	rx_ring.begin = rx_ring.end = 0u - bytes / 2;
+
+	while (r->sent < bytes || idle < latency + 2) {
+		if (frame == 0 && gap == 0 && r->sent < bytes) {
+			frame = rnd() % 200 + 1;
+			gap = rnd() % 4 ? rnd() % (latency + 4) + 1 : 0;
+		}
+
+		if (frame && r->sent < bytes) {
+			line_byte(seq(r->sent++));
+			frame--;
+			idle = 0;
+		} else {
+			if (gap)
+				gap--;
+			/* IDLE follows one idle character after a frame */
+			if (idle++ == 0)
+				sim_usart_sr |= USART_SR_IDLE;
+		}
+
+		if (rnd() % 2) {
+			dma_step();
+			interrupts_step();
+		} else {
+			interrupts_step();
+			dma_step();
+		}
+
+		/*
+		 * Within the latency after the idle character, the whole
+		 * frame has to be readable.
+		 */
+		if (idle == latency + 1 &&
+		    r->received + ring_used(&rx_ring) + rx_dropped != r->sent)
+			r->late++;
+
+		if (rnd() % read_every == 0)
+			receive(r, 64);
+	}
+
+	while (ring_used(&rx_ring))
+		receive(r, 64);
+}
+
+/*
+ * Interrupts taken up to half the DMA buffer late lose nothing; find
+ * the latency where bytes start to go missing.
+ */
+static void latency_runs(void)
+{
+	struct run r;
+	uint32_t latency;
+
+	for (latency = 0; latency < RX_DMA_SIZE; latency++) {
+		run(&r, 100000, latency, 2);
+		if (r.wrong || r.received != r.sent)
+			break;
+		CHECK(!r.late, "latency %u: %u frames not readable in time",
+		      latency, r.late);
+		CHECK(!overruns && !cpu_took && !rx_dropped,
+		      "latency %u: %u overruns, %u taken from the DMA, "
+		      "%u dropped", latency, overruns, cpu_took, rx_dropped);
+		if (latency == 0)
+			printf("latency 0: %u bytes in %u interrupts, "
+			       "%.1f bytes per interrupt\n", r.sent,
+			       interrupts, (double)r.sent / interrupts);
+	}
+
+	printf("no bytes lost up to %u steps of interrupt latency\n",
+	       latency - 1);
+	CHECK(latency >= RX_DMA_SIZE / 2, "bytes lost at latency %u",
+	      latency);
+	CHECK(latency < RX_DMA_SIZE, "no loss even at %u, the test can't "
+	      "see lost bytes", latency);
+}
+
+/* A slow main loop loses bytes to the full ring, and counts them. */
+static void slow_reader(void)
+{
+	struct run r;
+
+	run(&r, 100000, 8, 200);
+	CHECK(rx_dropped && r.received + rx_dropped == r.sent,
+	      "slow reader: %u sent, %u received, %u dropped", r.sent,
+	      r.received, rx_dropped);
+	CHECK(!overruns && !cpu_took, "slow reader: %u overruns, %u taken",
+	      overruns, cpu_took);
+}
+
+static void setup(void)
+{
+	struct sim_dma_channel *ch = &sim_dma[6];
+	struct run r;
+
+	run(&r, 1, 0, 1);
+	CHECK(ch->cpar == (uint32_t)(uintptr_t)&USART2_DR &&
+	      ch->cmar == (uint32_t)(uintptr_t)rx_dma_buf &&
+	      ch->reload == RX_DMA_SIZE && ch->circular && ch->minc &&
+	      !ch->from_memory && ch->htie && ch->tcie,
+	      "channel 6 set up wrong");
+	CHECK(sim_nvic[NVIC_DMA1_CHANNEL6_IRQ] == sim_nvic[NVIC_USART2_IRQ] &&
+	      (sim_nvic[NVIC_USART2_IRQ] & 0x80),
+	      "receive interrupts not enabled at the same priority");
+}
+
+int main(void)
+{
+	setup();
+	latency_runs();
+	slow_reader();
+
+	if (failures) {
+		printf("%d failures\n", failures);
+		return EXIT_FAILURE;
+	}
+	printf("all passed\n");
+	return EXIT_SUCCESS;
+}
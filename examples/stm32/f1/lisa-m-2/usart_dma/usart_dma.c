@@ -22,6 +22,7 @@
 #include <libopencm3/stm32/usart.h>
 #include <libopencm3/stm32/dma.h>
 #include <libopencm3/cm3/nvic.h>
+#include "ring.h"
 
 static void clock_setup(void)
 {
@@ -61,9 +62,15 @@ static void usart_setup(void)
 	nvic_set_priority(NVIC_DMA1_CHANNEL7_IRQ, 0);
 	nvic_enable_irq(NVIC_DMA1_CHANNEL7_IRQ);
 
+	/*
+	 * Both receive interrupts feed rx_ring, they must have the same
+	 * priority so they never preempt each other.
+	 */
 	nvic_set_priority(NVIC_DMA1_CHANNEL6_IRQ, 0);
 	nvic_enable_irq(NVIC_DMA1_CHANNEL6_IRQ);
 
+	nvic_set_priority(NVIC_USART2_IRQ, 0);
+	nvic_enable_irq(NVIC_USART2_IRQ);
 }
 
 static void dma_write(char *data, int size)
@@ -108,46 +115,122 @@ void dma1_channel7_isr(void)
 	dma_disable_channel(DMA1, DMA_CHANNEL7);
 }
 
-static void dma_read(char *data, int size)
+/*
+ * Reception runs continuously: DMA channel 6 fills rx_dma_buf in
+ * circular mode and whenever it is half full, full, or the line goes
+ * idle after a frame, the new bytes are moved into rx_ring. The idle
+ * interrupt fires one character time after the last byte, so short
+ * frames show up in rx_ring without waiting for the buffer to fill
+ * and without an interrupt per byte. rx_dma_buf only has to hold
+ * what arrives in the worst case interrupt latency.
+ */
+#define RX_DMA_SIZE	64
+#define RX_RING_SIZE	256		/* Must be a power of 2 */
+
+static uint8_t rx_dma_buf[RX_DMA_SIZE];
+static uint32_t rx_dma_pos;		/* Next byte to move out */
+static uint8_t rx_ring_buf[RX_RING_SIZE];
+static struct ring rx_ring;
+volatile uint32_t rx_dropped;		/* Bytes lost to a full rx_ring */
+
+static void dma_read_start(void)
 {
 	/*
 	 * Using channel 6 for USART2_RX
 	 */
 
+	ring_init(&rx_ring, rx_ring_buf, RX_RING_SIZE);
+	rx_dma_pos = 0;
+
 	/* Reset DMA channel*/
 	dma_channel_reset(DMA1, DMA_CHANNEL6);
 
 	dma_set_peripheral_address(DMA1, DMA_CHANNEL6, (uint32_t)&USART2_DR);
-	dma_set_memory_address(DMA1, DMA_CHANNEL6, (uint32_t)data);
-	dma_set_number_of_data(DMA1, DMA_CHANNEL6, size);
+	dma_set_memory_address(DMA1, DMA_CHANNEL6, (uint32_t)rx_dma_buf);
+	dma_set_number_of_data(DMA1, DMA_CHANNEL6, RX_DMA_SIZE);
 	dma_set_read_from_peripheral(DMA1, DMA_CHANNEL6);
 	dma_enable_memory_increment_mode(DMA1, DMA_CHANNEL6);
+	dma_enable_circular_mode(DMA1, DMA_CHANNEL6);
 	dma_set_peripheral_size(DMA1, DMA_CHANNEL6, DMA_CCR_PSIZE_8BIT);
 	dma_set_memory_size(DMA1, DMA_CHANNEL6, DMA_CCR_MSIZE_8BIT);
 	dma_set_priority(DMA1, DMA_CHANNEL6, DMA_CCR_PL_HIGH);
 
+	dma_enable_half_transfer_interrupt(DMA1, DMA_CHANNEL6);
 	dma_enable_transfer_complete_interrupt(DMA1, DMA_CHANNEL6);
 
 	dma_enable_channel(DMA1, DMA_CHANNEL6);
 
-        usart_enable_rx_dma(USART2);
-}
+	usart_enable_rx_dma(USART2);
 
-volatile int received = 0;
+	/* Interrupt when the line goes idle after a frame */
+	USART_CR1(USART2) |= USART_CR1_IDLEIE;
+}
 
-void dma1_channel6_isr(void)
+/*
+ * Move everything the DMA has written since the last call into
+ * rx_ring. Only called from the receive interrupts.
+ */
+static void dma_read_poll(void)
 {
-	if ((DMA1_ISR &DMA_ISR_TCIF6) != 0) {
-		DMA1_IFCR |= DMA_IFCR_CTCIF6;
+	uint32_t pos, n;
 
-		received = 1;
+	pos = RX_DMA_SIZE - DMA_CNDTR(DMA1, DMA_CHANNEL6);
+	if (pos == RX_DMA_SIZE) {
+		pos = 0;
 	}
+	if (pos < rx_dma_pos) {
+		/* wrapped, first take the end of the buffer */
+		n = RX_DMA_SIZE - rx_dma_pos;
+		rx_dropped += n - ring_write(&rx_ring,
+					     &rx_dma_buf[rx_dma_pos], n);
+		rx_dma_pos = 0;
+	}
+	n = pos - rx_dma_pos;
+	rx_dropped += n - ring_write(&rx_ring, &rx_dma_buf[rx_dma_pos], n);
+	rx_dma_pos = pos;
+}
 
-	dma_disable_transfer_complete_interrupt(DMA1, DMA_CHANNEL6);
+/*
+ * Copy up to 'size' received bytes into 'data', returns the
+ * number of bytes copied.
+ */
+static int dma_read(char *data, int size)
+{
+	return ring_read(&rx_ring, (uint8_t *)data, size);
+}
 
-	usart_disable_rx_dma(USART2);
+void dma1_channel6_isr(void)
+{
+	if ((DMA1_ISR & DMA_ISR_HTIF6) != 0) {
+		DMA1_IFCR = DMA_IFCR_CHTIF6;
+	}
+	if ((DMA1_ISR & DMA_ISR_TCIF6) != 0) {
+		DMA1_IFCR = DMA_IFCR_CTCIF6;
+	}
+	dma_read_poll();
+}
 
-	dma_disable_channel(DMA1, DMA_CHANNEL6);
+void usart2_isr(void)
+{
+	uint32_t sr = USART_SR(USART2);
+
+	if ((sr & USART_SR_IDLE) != 0) {
+		/*
+		 * IDLE is cleared by reading SR followed by DR, but DR
+		 * belongs to the DMA: reading it with RXNE set would take
+		 * a byte away from it. So only read DR when SR showed no
+		 * byte waiting, otherwise leave IDLE set and come back
+		 * once the DMA has had it.
+		 *
+		 * This leaves a race: a byte completing between the SR and
+		 * DR reads is still lost. The window is a couple of
+		 * instructions, right after the line was idle for a frame.
+		 */
+		if ((sr & USART_SR_RXNE) == 0) {
+			(void)USART_DR(USART2);
+		}
+		dma_read_poll();
+	}
 }
 
 static void gpio_setup(void)
@@ -159,39 +242,30 @@ static void gpio_setup(void)
 
 int main(void)
 {
-	char tx[10] = "abcdefg\r\n";
-	int tx_len = 10;
-	char rx[7] = "bcdefg";
-	int rx_len = 6;
+	char tx[64];
+	int tx_len;
 
 	clock_setup();
 	gpio_setup();
 	usart_setup();
 
-	transfered = 0;
-	dma_write(tx, tx_len);
-	received = 0;
-	dma_read(rx, rx_len);
+	transfered = 1;
+	dma_read_start();
 
-	/* Blink the LED (PA8) on the board with every transmitted byte. */
+	/*
+	 * Echo whatever arrives, as soon as the previous echo is out.
+	 * Blink the LED (PA8) on the board with every echoed frame.
+	 */
 	while (1) {
-		gpio_toggle(GPIOA, GPIO8);	/* LED on/off */
-		while ( transfered != 1) {
-			if (received == 1) {
-				tx[1] = rx[0];
-				tx[2] = rx[1];
-				tx[3] = rx[2];
-				tx[4] = rx[3];
-				tx[5] = rx[4];
-				tx[6] = rx[5];
-				received = 0;
-				dma_read(rx, rx_len);
-			}
+		if (transfered != 1) {
+			continue;
+		}
+		tx_len = dma_read(tx, sizeof(tx));
+		if (tx_len) {
+			gpio_toggle(GPIOA, GPIO8);	/* LED on/off */
+			transfered = 0;
+			dma_write(tx, tx_len);
 		}
-		tx[0]++;
-		if (tx[0] > 'z') tx[0] = 'a';
-		transfered = 0;
-		dma_write(tx, tx_len);
 	}
 
 	return 0;
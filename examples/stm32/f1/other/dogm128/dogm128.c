@@ -23,26 +23,82 @@ uint8_t dogm128_ram[1024];
 uint8_t dogm128_cursor_x;
 uint8_t dogm128_cursor_y;
 
-void dogm128_send_command(uint8_t command)
+/*
+ * Columns changed since the last update, per page.  A page is clean when
+ * first > last.
+ */
+static uint8_t dirty_first[8];
+static uint8_t dirty_last[8];
+
+static void dogm128_mark_dirty(uint8_t page, uint8_t column)
 {
-	uint32_t i;
+	if (column < dirty_first[page])
+		dirty_first[page] = column;
+	if (column > dirty_last[page])
+		dirty_last[page] = column;
+}
 
-	gpio_clear(DOGM128_A0_PORT, DOGM128_A0_PIN); /* A0 low for commands */
-	spi_send(DOGM128_SPI, command);
+void dogm128_invalidate(void)
+{
+	uint8_t page;
+
+	for (page = 0; page <= 7; page++) {
+		dirty_first[page] = 0;
+		dirty_last[page] = 127;
+	}
+}
 
-	for (i = 0; i <= 500; i++) /* Wait a bit. */
+/* Wait until the last byte has left the shift register. */
+static void dogm128_wait_idle(void)
+{
+	while (!(SPI_SR(DOGM128_SPI) & SPI_SR_TXE))
+		;
+	while (SPI_SR(DOGM128_SPI) & SPI_SR_BSY)
 		;
 }
 
-void dogm128_send_data(uint8_t data)
+void dogm128_send_command(uint8_t command)
 {
-	uint32_t i;
+	dogm128_wait_idle();
+	gpio_clear(DOGM128_A0_PORT, DOGM128_A0_PIN); /* A0 low for commands */
+	spi_send(DOGM128_SPI, command);
+}
 
+void dogm128_send_data(uint8_t data)
+{
+	dogm128_wait_idle();
 	gpio_set(DOGM128_A0_PORT, DOGM128_A0_PIN); /* A0 high for data */
 	spi_send(DOGM128_SPI, data);
+}
 
-	for (i = 0; i <= 500; i++) /* Wait a bit. */
+/* Send a run of display data, fed to the SPI by DMA. */
+static void dogm128_send_data_dma(const uint8_t *data, uint16_t len)
+{
+	dogm128_wait_idle();
+	gpio_set(DOGM128_A0_PORT, DOGM128_A0_PIN); /* A0 high for data */
+
+	dma_channel_reset(DOGM128_DMA, DOGM128_DMA_CHANNEL);
+	dma_set_peripheral_address(DOGM128_DMA, DOGM128_DMA_CHANNEL,
+				   (uint32_t)&SPI_DR(DOGM128_SPI));
+	dma_set_memory_address(DOGM128_DMA, DOGM128_DMA_CHANNEL,
+			       (uint32_t)data);
+	dma_set_number_of_data(DOGM128_DMA, DOGM128_DMA_CHANNEL, len);
+	dma_set_read_from_memory(DOGM128_DMA, DOGM128_DMA_CHANNEL);
+	dma_enable_memory_increment_mode(DOGM128_DMA, DOGM128_DMA_CHANNEL);
+	dma_set_peripheral_size(DOGM128_DMA, DOGM128_DMA_CHANNEL,
+				DMA_CCR_PSIZE_8BIT);
+	dma_set_memory_size(DOGM128_DMA, DOGM128_DMA_CHANNEL,
+			    DMA_CCR_MSIZE_8BIT);
+	dma_set_priority(DOGM128_DMA, DOGM128_DMA_CHANNEL, DMA_CCR_PL_MEDIUM);
+	dma_enable_channel(DOGM128_DMA, DOGM128_DMA_CHANNEL);
+
+	spi_enable_tx_dma(DOGM128_SPI);
+	while (!dma_get_interrupt_flag(DOGM128_DMA, DOGM128_DMA_CHANNEL,
+				       DMA_TCIF))
 		;
+	dma_clear_interrupt_flags(DOGM128_DMA, DOGM128_DMA_CHANNEL, DMA_TCIF);
+	spi_disable_tx_dma(DOGM128_SPI);
+	dma_disable_channel(DOGM128_DMA, DOGM128_DMA_CHANNEL);
 }
 
 void dogm128_init(void)
@@ -81,7 +137,11 @@ void dogm128_init(void)
 	dogm128_send_command(DOGM128_DISPLAY_ON);
 
 	/* End transfer. */
+	dogm128_wait_idle();
 	spi_set_nss_high(DOGM128_SPI);
+
+	/* Nothing of the display RAM is known yet. */
+	dogm128_invalidate();
 }
 
 void dogm128_print_char(uint8_t data)
@@ -101,6 +161,9 @@ void dogm128_print_char(uint8_t data)
 		if ((xcoord + i) > 127)
 			return;
 		dogm128_cursor_x++;
+		dogm128_mark_dirty(page, xcoord + i);
+		if ((shift > 0) && (page > 0))
+			dogm128_mark_dirty(page - 1, xcoord + i);
 
 		/* 0xAA = end of character - no dots in this line. */
 		if (dogm128_font[data - 0x20][i] == 0xAA) {
@@ -144,32 +207,49 @@ void dogm128_print_string(char *s)
 
 void dogm128_set_dot(uint8_t xcoord, uint8_t ycoord)
 {
+	dogm128_mark_dirty((63 - ycoord) / 8, xcoord);
 	dogm128_ram[(((63 - ycoord) / 8) * 128) + xcoord] |=
 		(1 << ((63 - ycoord) % 8));
 }
 
 void dogm128_clear_dot(uint8_t xcoord, uint8_t ycoord)
 {
+	dogm128_mark_dirty((63 - ycoord) / 8, xcoord);
 	dogm128_ram[(((63 - ycoord) / 8) * 128) + xcoord] &=
 		~(1 << ((63 - ycoord) % 8));
 }
 
+/*
+ * Write the changed columns of each page to the display.  Each page that
+ * changed costs three command bytes plus the span from its first to its
+ * last changed column.
+ */
 void dogm128_update_display(void)
 {
-	uint8_t page, column;
+	uint8_t page, first, last;
 
 	/* Tell the display that we want to start. */
 	spi_set_nss_low(DOGM128_SPI);
 
 	for (page = 0; page <= 7; page++) {
-		dogm128_send_command(0xB0 + page); /* Set page. */
-		dogm128_send_command(0x10); /* Set column upper address to 0. */
-		dogm128_send_command(0x00); /* Set column lower address to 0. */
+		first = dirty_first[page];
+		last = dirty_last[page];
+		if (first > last)
+			continue;
+
+		dogm128_send_command(DOGM128_PAGE_BASE + page); /* Set page. */
+		/* Set column upper and lower address. */
+		dogm128_send_command(0x10 | (first >> 4));
+		dogm128_send_command(0x00 | (first & 0x0F));
+
+		dogm128_send_data_dma(&dogm128_ram[(page * 128) + first],
+				      last - first + 1);
 
-		for (column = 0; column <= 127; column++)
-			dogm128_send_data(dogm128_ram[(page * 128) + column]);
+		dirty_first[page] = 128;
+		dirty_last[page] = 0;
 	}
 
+	dogm128_wait_idle();
 	spi_set_nss_high(DOGM128_SPI);
 }
 
@@ -180,6 +260,7 @@ void dogm128_clear(void)
 	for (i = 0; i <= 1023; i++)
 		dogm128_ram[i] = 0;
 
+	dogm128_invalidate();
 	dogm128_update_display();
 }
 
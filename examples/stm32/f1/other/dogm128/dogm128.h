@@ -23,6 +23,7 @@
 #include <libopencm3/cm3/common.h>
 #include <libopencm3/stm32/gpio.h>
 #include <libopencm3/stm32/spi.h>
+#include <libopencm3/stm32/dma.h>
 
 /*
  * PB10 GPIO       - ~RESET
@@ -37,6 +38,9 @@
 #define DOGM128_RESET_PORT			GPIOB
 #define DOGM128_A0_PIN				GPIO14
 #define DOGM128_A0_PORT				GPIOB
+/* SPI2_TX is served by DMA1 channel 5. */
+#define DOGM128_DMA				DMA1
+#define DOGM128_DMA_CHANNEL			DMA_CHANNEL5
 
 /* DOGM128 display commands */
 #define DOGM128_PAGE_BASE			0xB0
@@ -83,6 +87,8 @@ void dogm128_clear_dot(uint8_t xcoord, uint8_t ycoord);
 void dogm128_send_data(uint8_t data);
 void dogm128_init(void);
 void dogm128_update_display(void);
+/* Call after writing dogm128_ram directly, so it's all sent again. */
+void dogm128_invalidate(void);
 void dogm128_clear(void);
 
 #endif
@@ -0,0 +1,585 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Host simulation of the display updates in dogm128.c.
+ *
+ * SPI2 runs at PCLK1 / 256 as main.c sets it up, so a byte takes about
+ * 57us to shift out.  The SPI has a transmit register and a shift
+ * register: TXE is set while the transmit register is empty, BSY while
+ * either holds a byte.  When the DMA request is on, DMA1 channel 5 moves
+ * the next byte into the transmit register as soon as it empties and sets
+ * its transfer complete flag after the last one.  Time only passes while
+ * the driver polls SPI_SR or the DMA flag, 100ns a poll, so the times
+ * reported are about what the SPI link takes.  Polls of the DMA flag
+ * skip ahead to the end of the byte being sent.
+ *
+ * Behind it is the display controller, which takes a byte with the level
+ * A0 has when its last bit is shifted in, and ignores bytes while CS is
+ * high.  It decodes the page and column address commands and the two
+ * byte commands of the init sequence, and writes data at the column
+ * address, which counts up.  After every update its RAM has to match
+ * dogm128_ram.
+ *
+ * Random runs of dots and characters check that, and a set of text and
+ * graphics workloads reports the bytes and time per update against the
+ * full screen rewrite dogm128_update_display() used to do.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dogm128.c"
+
+static int failures;
+
+#define CHECK(cond, ...) do {						\
+	if (!(cond)) {							\
+		if (failures++ < 10) {					\
+			printf("FAIL %s:%d: ", __FILE__, __LINE__);	\
+			printf(__VA_ARGS__);				\
+			printf("\n");					\
+		}							\
+	}								\
+} while (0)
+
+static uint32_t rng_state = 1;
+
+static uint32_t rnd(void)
+{
+	rng_state ^= rng_state << 13;
+	rng_state ^= rng_state >> 17;
+	rng_state ^= rng_state << 5;
+	return rng_state;
+}
+
+#define PCLK1_HZ		36000000
+#define SPI_HZ			(PCLK1_HZ / 256)
+#define BYTE_NS			(8ULL * 1000000000 / SPI_HZ)
+#define POLL_NS			100
+
+/* What the old update sent every time: 8 pages of 3 commands + 128 bytes */
+#define FULL_BYTES		(8 * (3 + 128))
+
+static uint64_t now;
+
+/* --- The display controller --- */
+
+static struct {
+	int cs, a0, on;
+	uint8_t ram[8][132];
+	uint8_t page, column;
+	int param;			/* next command byte is a parameter */
+
+	unsigned cmds, data;		/* bytes taken */
+	unsigned cs_high;		/* bytes sent with CS high */
+	unsigned a0_early;		/* A0 changed while a byte was sent */
+} lcd;
+
+static void lcd_take(uint8_t byte)
+{
+	if (lcd.cs) {
+		lcd.cs_high++;
+		return;
+	}
+
+	if (lcd.a0) {
+		if (lcd.page < 8 && lcd.column < 132)
+			lcd.ram[lcd.page][lcd.column] = byte;
+		lcd.column++;
+		lcd.data++;
+		return;
+	}
+
+	lcd.cmds++;
+	if (lcd.param)
+		lcd.param = 0;
+	else if ((byte & 0xF0) == 0xB0)
+		lcd.page = byte & 0x0F;
+	else if ((byte & 0xF0) == 0x10)
+		lcd.column = (lcd.column & 0x0F) | (byte & 0x0F) << 4;
+	else if ((byte & 0xF0) == 0x00)
+		lcd.column = (lcd.column & 0xF0) | (byte & 0x0F);
+	else if (byte == DOGM128_ELECTRONIC_VOLUME_MODE_SET ||
+		 byte == DOGM128_BOOSTER_RATIO_SET ||
+		 byte == DOGM128_STATIC_INDICATOR_OFF ||
+		 byte == DOGM128_STATIC_INDICATOR_ON)
+		lcd.param = 1;
+	else if (byte == DOGM128_DISPLAY_ON)
+		lcd.on = 1;
+}
+
+/* --- SPI2 and DMA1 channel 5 --- */
+
+volatile uint32_t sim_spi_dr;
+struct sim_dma_channel sim_dma[8];
+
+static struct {
+	int tx_dma;
+	int tdr_full;
+	uint8_t tdr;
+	int shifting;
+	uint8_t shift;
+	uint64_t shift_end;
+	uint32_t sr;
+
+	const uint8_t *dma_src;
+	unsigned bad_dma;
+} spi;
+
+static void spi_load(void)
+{
+	struct sim_dma_channel *ch = &sim_dma[DMA_CHANNEL5];
+
+	if (!spi.tdr_full && spi.tx_dma && ch->enabled && ch->cndtr) {
+		spi.tdr = *spi.dma_src;
+		spi.dma_src += ch->minc;
+		spi.tdr_full = 1;
+		if (--ch->cndtr == 0)
+			ch->flags |= DMA_TCIF;
+	}
+	if (!spi.shifting && spi.tdr_full) {
+		spi.shift = spi.tdr;
+		spi.tdr_full = 0;
+		spi.shifting = 1;
+		spi.shift_end = now + BYTE_NS;
+		spi_load();
+	}
+}
+
+/* Let the SPI run up to the given time. */
+static void spi_run(uint64_t until)
+{
+	spi_load();
+	while (spi.shifting && spi.shift_end <= until) {
+		now = spi.shift_end;
+		spi.shifting = 0;
+		lcd_take(spi.shift);
+		spi_load();
+	}
+	if (until > now)
+		now = until;
+}
+
+static uint64_t update_start;
+
+/*
+ * Each poll takes POLL_NS.  An update that takes longer than a second is
+ * stuck waiting for something that never happens.
+ */
+static void poll(void)
+{
+	spi_run(now + POLL_NS);
+	if (now - update_start > 1000000000) {
+		printf("FAIL: update still waiting after a second\n");
+		exit(EXIT_FAILURE);
+	}
+}
+
+uint32_t *sim_spi_sr_read(void)
+{
+	spi_run(now);
+	spi.sr = (spi.tdr_full ? 0 : SPI_SR_TXE) |
+		 (spi.tdr_full || spi.shifting ? SPI_SR_BSY : 0);
+	poll();
+	return &spi.sr;
+}
+
+void spi_send(uint32_t spi_dev, uint16_t data)
+{
+	(void)spi_dev;
+	spi_run(now);
+	while (spi.tdr_full)
+		poll();
+	spi.tdr = data;
+	spi.tdr_full = 1;
+	spi_load();
+}
+
+void spi_set_nss_low(uint32_t spi_dev)
+{
+	(void)spi_dev;
+	spi_run(now);
+	lcd.cs = 0;
+}
+
+void spi_set_nss_high(uint32_t spi_dev)
+{
+	(void)spi_dev;
+	spi_run(now);
+	lcd.cs = 1;
+}
+
+void spi_enable_tx_dma(uint32_t spi_dev)
+{
+	(void)spi_dev;
+	spi.tx_dma = 1;
+	spi_load();
+}
+
+void spi_disable_tx_dma(uint32_t spi_dev)
+{
+	(void)spi_dev;
+	spi.tx_dma = 0;
+}
+
+static void a0_write(int level)
+{
+	spi_run(now);
+	if (level != lcd.a0 && spi.shifting)
+		lcd.a0_early++;
+	lcd.a0 = level;
+}
+
+void gpio_set(uint32_t gpioport, uint16_t gpios)
+{
+	if (gpioport == DOGM128_A0_PORT && (gpios & DOGM128_A0_PIN))
+		a0_write(1);
+}
+
+void gpio_clear(uint32_t gpioport, uint16_t gpios)
+{
+	if (gpioport == DOGM128_A0_PORT && (gpios & DOGM128_A0_PIN))
+		a0_write(0);
+}
+
+void dma_channel_reset(uint32_t dma, uint8_t channel)
+{
+	(void)dma;
+	memset(&sim_dma[channel], 0, sizeof(sim_dma[channel]));
+}
+
+void dma_set_peripheral_address(uint32_t dma, uint8_t channel,
+				uint32_t address)
+{
+	(void)dma;
+	sim_dma[channel].cpar = address;
+}
+
+void dma_set_memory_address(uint32_t dma, uint8_t channel, uint32_t address)
+{
+	(void)dma;
+	sim_dma[channel].cmar = address;
+}
+
+void dma_set_number_of_data(uint32_t dma, uint8_t channel, uint16_t number)
+{
+	(void)dma;
+	sim_dma[channel].cndtr = number;
+}
+
+void dma_set_read_from_memory(uint32_t dma, uint8_t channel)
+{
+	(void)dma;
+	sim_dma[channel].from_memory = 1;
+}
+
+void dma_enable_memory_increment_mode(uint32_t dma, uint8_t channel)
+{
+	(void)dma;
+	sim_dma[channel].minc = 1;
+}
+
+void dma_set_peripheral_size(uint32_t dma, uint8_t channel,
+			     uint32_t peripheral_size)
+{
+	(void)dma;
+	sim_dma[channel].psize = peripheral_size;
+}
+
+void dma_set_memory_size(uint32_t dma, uint8_t channel, uint32_t mem_size)
+{
+	(void)dma;
+	sim_dma[channel].msize = mem_size;
+}
+
+void dma_set_priority(uint32_t dma, uint8_t channel, uint32_t prio)
+{
+	(void)dma;
+	sim_dma[channel].prio = prio;
+}
+
+void dma_enable_channel(uint32_t dma, uint8_t channel)
+{
+	struct sim_dma_channel *ch = &sim_dma[channel];
+	uint32_t offset = ch->cmar - (uint32_t)(uintptr_t)dogm128_ram;
+
+	(void)dma;
+
+	/* Only 32 bit addresses reach the DMA, it has to be dogm128_ram. */
+	if (channel != DMA_CHANNEL5 ||
+	    ch->cpar != (uint32_t)(uintptr_t)&sim_spi_dr ||
+	    offset + ch->cndtr > sizeof(dogm128_ram) || !ch->from_memory ||
+	    ch->psize != DMA_CCR_PSIZE_8BIT ||
+	    ch->msize != DMA_CCR_MSIZE_8BIT) {
+		spi.bad_dma++;
+		return;
+	}
+
+	spi.dma_src = dogm128_ram + offset;
+	ch->enabled = 1;
+	spi_load();
+}
+
+void dma_disable_channel(uint32_t dma, uint8_t channel)
+{
+	(void)dma;
+	sim_dma[channel].enabled = 0;
+}
+
+int dma_get_interrupt_flag(uint32_t dma, uint8_t channel, uint32_t interrupts)
+{
+	int set;
+
+	(void)dma;
+	spi_run(now);
+	set = (sim_dma[channel].flags & interrupts) != 0;
+	/* Nothing changes before the next byte is done. */
+	if (!set && spi.shifting && spi.shift_end > now + POLL_NS)
+		spi_run(spi.shift_end - POLL_NS);
+	poll();
+	return set;
+}
+
+void dma_clear_interrupt_flags(uint32_t dma, uint8_t channel,
+			       uint32_t interrupts)
+{
+	(void)dma;
+	sim_dma[channel].flags &= ~interrupts;
+}
+
+/* --- Checks --- */
+
+struct cost {
+	unsigned cmds, data;
+	uint64_t ns;
+};
+
+static struct cost update(void)
+{
+	struct cost c;
+	unsigned cmds = lcd.cmds, data = lcd.data;
+	int page, col, bad = 0;
+
+	update_start = now;
+	dogm128_update_display();
+
+	c.cmds = lcd.cmds - cmds;
+	c.data = lcd.data - data;
+	c.ns = now - update_start;
+
+	for (page = 0; page < 8; page++)
+		for (col = 0; col < 128; col++)
+			bad += lcd.ram[page][col] !=
+			       dogm128_ram[page * 128 + col];
+	CHECK(!bad, "%d bytes of the display differ after an update", bad);
+	CHECK(!spi.shifting && !spi.tdr_full && lcd.cs,
+	      "update returned before the SPI was done");
+	return c;
+}
+
+static void check_init(void)
+{
+	int page, col;
+
+	/* Whatever the display powers up with. */
+	for (page = 0; page < 8; page++)
+		for (col = 0; col < 132; col++)
+			lcd.ram[page][col] = rnd();
+	lcd.cs = 1;
+
+	update_start = now;
+	dogm128_init();
+	CHECK(lcd.on && lcd.cmds == 14 && !lcd.data,
+	      "init sent %u commands and %u data bytes", lcd.cmds, lcd.data);
+	dogm128_clear();
+	CHECK(lcd.cmds == 14 + 24 && lcd.data == 1024,
+	      "clear sent %u commands and %u data bytes", lcd.cmds - 14,
+	      lcd.data);
+	update();
+}
+
+static void random_text(char *s, int len)
+{
+	int i;
+
+	for (i = 0; i < len; i++)
+		s[i] = 0x20 + rnd() % 96;
+	s[len] = 0;
+}
+
+static void check_random(void)
+{
+	struct cost c;
+	char s[24];
+	int run, op, ops;
+
+	for (run = 0; run < 2000; run++) {
+		ops = rnd() % 40;
+		for (op = 0; op < ops; op++) {
+			switch (rnd() % 8) {
+			case 0:
+			case 1:
+			case 2:
+				dogm128_set_dot(rnd() % 128, rnd() % 64);
+				break;
+			case 3:
+			case 4:
+				dogm128_clear_dot(rnd() % 128, rnd() % 64);
+				break;
+			case 5:
+			case 6:
+				dogm128_set_cursor(rnd() % 128, rnd() % 64);
+				random_text(s, rnd() % 6);
+				dogm128_print_string(s);
+				break;
+			default:
+				if (rnd() % 8 == 0) {
+					dogm128_ram[rnd() % 1024] = rnd();
+					dogm128_invalidate();
+				}
+				if (rnd() % 16 == 0) {
+					update_start = now;
+					dogm128_clear();
+				}
+				break;
+			}
+		}
+		update();
+
+		c = update();
+		CHECK(!c.cmds && !c.data,
+		      "update with nothing changed sent %u commands and %u "
+		      "data bytes", c.cmds, c.data);
+	}
+
+	CHECK(!lcd.cs_high, "%u bytes sent with CS high", lcd.cs_high);
+	CHECK(!lcd.a0_early, "A0 changed %u times while a byte was sent",
+	      lcd.a0_early);
+	CHECK(!spi.bad_dma, "%u DMA transfers not from dogm128_ram to SPI2, "
+	      "8 bit", spi.bad_dma);
+}
+
+static void report(const char *name, struct cost c, int n)
+{
+	double ms = c.ns / 1e6 / n;
+
+	printf("%-26s %5.1f %6.1f %9.2f %7.1fx\n", name, (double)c.cmds / n,
+	       (double)c.data / n, ms, FULL_BYTES * BYTE_NS / 1e6 / ms);
+}
+
+static void add(struct cost *sum, struct cost c)
+{
+	sum->cmds += c.cmds;
+	sum->data += c.data;
+	sum->ns += c.ns;
+}
+
+static void bench(void)
+{
+	struct cost c, sum;
+	char s[32];
+	int i, x, y;
+
+	printf("%.1f kHz SPI, the old update sent %d bytes in %.2f ms\n",
+	       SPI_HZ / 1e3, FULL_BYTES, FULL_BYTES * BYTE_NS / 1e6);
+	printf("workload                    cmds   data  ms/update  faster\n");
+
+	dogm128_invalidate();
+	c = update();
+	report("full screen", c, 1);
+	CHECK(c.cmds == 24 && c.data == 1024, "full screen: %u + %u bytes",
+	      c.cmds, c.data);
+
+	dogm128_set_cursor(0, 56);
+	dogm128_print_string("ABCDEFGHIJKLMNOPQRSTUVWXYZ");
+	c = update();
+	report("text line, on a page", c, 1);
+	CHECK(c.cmds == 3 && c.data == dogm128_cursor_x,
+	      "text line: %u + %u bytes for %d columns", c.cmds, c.data,
+	      dogm128_cursor_x);
+
+	dogm128_set_cursor(0, 52);
+	dogm128_print_string("abcdefghijklmnopqrstuvwxyz");
+	c = update();
+	report("text line, across pages", c, 1);
+	CHECK(c.cmds == 6 && c.data == 2u * dogm128_cursor_x,
+	      "text line: %u + %u bytes for %d columns", c.cmds, c.data,
+	      dogm128_cursor_x);
+
+	memset(&sum, 0, sizeof(sum));
+	for (i = 0; i < 60; i++) {
+		snprintf(s, sizeof(s), "%02d:%02d:%02d", i / 3600,
+			 i / 60 % 60, i % 60);
+		dogm128_set_cursor(40, 24);
+		dogm128_print_string(s);
+		add(&sum, update());
+	}
+	report("clock, once a second", sum, 60);
+
+	dogm128_set_dot(64, 32);
+	c = update();
+	report("one dot", c, 1);
+	CHECK(c.cmds == 3 && c.data == 1, "one dot: %u + %u bytes", c.cmds,
+	      c.data);
+
+	memset(&sum, 0, sizeof(sum));
+	for (i = 0; i < 100; i++) {
+		for (x = 0; x < 128; x++) {
+			y = 32 + (x * (i % 32) / 64) % 32;
+			dogm128_set_dot(x, y);
+		}
+		add(&sum, update());
+	}
+	report("128 dot line", sum, 100);
+
+	memset(&sum, 0, sizeof(sum));
+	for (i = 0; i < 100; i++) {
+		for (x = 0; x < 10; x++)
+			dogm128_set_dot(rnd() % 128, rnd() % 64);
+		add(&sum, update());
+	}
+	report("10 random dots", sum, 100);
+
+	memset(&sum, 0, sizeof(sum));
+	for (i = 0; i < 100; i++) {
+		x = rnd() % 120;
+		y = rnd() % 56;
+		dogm128_set_dot(x, y);
+		dogm128_set_dot(x + 7, y);
+		dogm128_set_dot(x, y + 7);
+		dogm128_set_dot(x + 7, y + 7);
+		add(&sum, update());
+	}
+	report("8x8 sprite corners", sum, 100);
+}
+
+int main(void)
+{
+	check_init();
+	check_random();
+	if (!failures)
+		bench();
+
+	if (failures) {
+		printf("%d failures\n", failures);
+		return EXIT_FAILURE;
+	}
+	printf("all passed\n");
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,64 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Host stand-in for the DMA parts dogm128.c uses; the channel is
+ * simulated in dogm128_test.c.
+ */
+
+#ifndef HOST_DMA_H
+#define HOST_DMA_H
+
+#include <stdint.h>
+
+#define DMA1			1
+#define DMA_CHANNEL5		5
+
+#define DMA_TCIF		2
+
+#define DMA_CCR_PSIZE_8BIT	(0 << 8)
+#define DMA_CCR_MSIZE_8BIT	(0 << 10)
+#define DMA_CCR_PL_MEDIUM	1
+
+struct sim_dma_channel {
+	int enabled, minc, from_memory;
+	uint32_t psize, msize, prio;
+	uint32_t cpar, cmar, cndtr;
+	uint32_t flags;
+};
+
+extern struct sim_dma_channel sim_dma[8];
+
+void dma_channel_reset(uint32_t dma, uint8_t channel);
+void dma_set_peripheral_address(uint32_t dma, uint8_t channel,
+				uint32_t address);
+void dma_set_memory_address(uint32_t dma, uint8_t channel, uint32_t address);
+void dma_set_number_of_data(uint32_t dma, uint8_t channel, uint16_t number);
+void dma_set_read_from_memory(uint32_t dma, uint8_t channel);
+void dma_enable_memory_increment_mode(uint32_t dma, uint8_t channel);
+void dma_set_peripheral_size(uint32_t dma, uint8_t channel,
+			     uint32_t peripheral_size);
+void dma_set_memory_size(uint32_t dma, uint8_t channel, uint32_t mem_size);
+void dma_set_priority(uint32_t dma, uint8_t channel, uint32_t prio);
+void dma_enable_channel(uint32_t dma, uint8_t channel);
+void dma_disable_channel(uint32_t dma, uint8_t channel);
+/* Each call lets the simulated time run to the next SPI event. */
+int dma_get_interrupt_flag(uint32_t dma, uint8_t channel, uint32_t interrupts);
+void dma_clear_interrupt_flags(uint32_t dma, uint8_t channel,
+			       uint32_t interrupts);
+
+#endif
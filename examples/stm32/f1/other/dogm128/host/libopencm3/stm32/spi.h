@@ -0,0 +1,46 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Host stand-in for the SPI parts dogm128.c uses; the SPI and the display
+ * behind it are simulated in dogm128_test.c.
+ */
+
+#ifndef HOST_SPI_H
+#define HOST_SPI_H
+
+#include <stdint.h>
+
+#define SPI2				2
+
+extern volatile uint32_t sim_spi_dr;
+
+/* Each status read lets the simulated time run to the next SPI event. */
+uint32_t *sim_spi_sr_read(void);
+
+#define SPI_DR(spi)			(sim_spi_dr)
+#define SPI_SR(spi)			(*sim_spi_sr_read())
+#define SPI_SR_TXE			(1 << 1)
+#define SPI_SR_BSY			(1 << 7)
+
+void spi_send(uint32_t spi, uint16_t data);
+void spi_set_nss_low(uint32_t spi);
+void spi_set_nss_high(uint32_t spi);
+void spi_enable_tx_dma(uint32_t spi);
+void spi_disable_tx_dma(uint32_t spi);
+
+#endif
@@ -58,6 +58,8 @@ static void spi_setup(void)
 	/* The DOGM128 display is connected to SPI2, so initialise it. */
 
 	rcc_periph_clock_enable(RCC_SPI2);
+	/* Display data is sent by DMA. */
+	rcc_periph_clock_enable(RCC_DMA1);
 
 	spi_set_unidirectional_mode(DOGM128_SPI); /* We want to send only. */
 	spi_disable_crc(DOGM128_SPI); /* No CRC for this slave. */
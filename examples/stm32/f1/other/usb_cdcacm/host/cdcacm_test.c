@@ -0,0 +1,447 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Host replay for the buffered data path in cdcacm.c.
+ *
+ * The usbd functions are a mock driver with the endpoint behaviour of
+ * st_usbfs: an OUT endpoint NAKs once it holds a packet until it is
+ * read, and also while usbd_ep_nak_set() says so; an IN endpoint takes
+ * one packet and refuses more until the host has collected it.
+ * Callbacks run from usbd_poll(), as on the target.
+ *
+ * A full speed bus is modeled in time: a 64 byte bulk packet takes
+ * 52.6us (19 per frame), a NAKed token 3us, and one pass of the main
+ * loop 4us.  The host sends writes of random sizes and reads either
+ * at once or in bursts with pauses up to 20ms.  It checks that what
+ * comes back is the same stream in order, and that every transfer
+ * ends in a short packet.
+ *
+ * The old echo (read a packet, write it straight back) runs against
+ * the same host for comparison.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wold-style-declaration"
+#pragma GCC diagnostic ignored "-Wreturn-type"
+#define main static __attribute__((unused)) cdcacm_main
+#include "cdcacm.c"
+#undef main
+#pragma GCC diagnostic pop
+
+static int failures;
+
+#define CHECK(cond, ...) do {						\
+	if (!(cond)) {							\
+		if (failures++ < 10) {					\
+			printf("FAIL %s:%d: ", __FILE__, __LINE__);	\
+			printf(__VA_ARGS__);				\
+			printf("\n");					\
+		}							\
+	}								\
+} while (0)
+
+static uint32_t rng_state = 1;
+
+static uint32_t rnd(void)
+{
+	rng_state ^= rng_state << 13;
+	rng_state ^= rng_state >> 17;
+	rng_state ^= rng_state << 5;
+	return rng_state;
+}
+
+/* --- The mock driver --- */
+
+#define PACKET_NS	52632		/* 1ms / 19 */
+#define NAK_NS		3000
+#define LOOP_NS		4000
+#define MS		1000000ULL
+
+struct _usbd_device {
+	usbd_set_config_callback set_config;
+	int control_callbacks;
+};
+
+struct _usbd_driver {
+	int unused;
+};
+
+const struct _usbd_driver st_usbfs_v1_usb_driver;
+static struct _usbd_device mock;
+
+static struct {
+	usbd_endpoint_callback cb;
+	int valid;			/* accepts a packet */
+	int holding;			/* has one the firmware hasn't read */
+	int force_nak;
+	int slip;			/* packets still taken after a NAK */
+	int pending;			/* callback due */
+	uint8_t buf[64];
+	uint16_t len;
+	uint32_t overwritten;
+} out;
+
+static struct {
+	usbd_endpoint_callback cb;
+	int loaded;
+	int pending;
+	uint8_t buf[64];
+	uint16_t len;
+	uint32_t too_long;
+} in;
+
+static int late_naks;			/* how many packets slip past a NAK */
+
+usbd_device *usbd_init(const usbd_driver *driver,
+		       const struct usb_device_descriptor *device,
+		       const struct usb_config_descriptor *conf,
+		       const char **strings, int num_strings,
+		       uint8_t *control_buffer, uint16_t control_buffer_size)
+{
+	(void)driver;
+	(void)device;
+	(void)conf;
+	(void)strings;
+	(void)num_strings;
+	(void)control_buffer;
+	(void)control_buffer_size;
+	return &mock;
+}
+
+int usbd_register_control_callback(usbd_device *usbd_dev, uint8_t type,
+				   uint8_t type_mask,
+				   usbd_control_callback callback)
+{
+	(void)type;
+	(void)type_mask;
+	(void)callback;
+	usbd_dev->control_callbacks++;
+	return 0;
+}
+
+int usbd_register_set_config_callback(usbd_device *usbd_dev,
+				      usbd_set_config_callback callback)
+{
+	usbd_dev->set_config = callback;
+	return 0;
+}
+
+void usbd_ep_setup(usbd_device *usbd_dev, uint8_t addr, uint8_t type,
+		   uint16_t max_size, usbd_endpoint_callback callback)
+{
+	(void)usbd_dev;
+	(void)type;
+	(void)max_size;
+	if (addr == 0x01) {
+		memset(&out, 0, sizeof(out));
+		out.cb = callback;
+		out.valid = 1;
+	} else if (addr == 0x82) {
+		memset(&in, 0, sizeof(in));
+		in.cb = callback;
+	}
+}
+
+uint16_t usbd_ep_write_packet(usbd_device *usbd_dev, uint8_t addr,
+			      const void *buf, uint16_t len)
+{
+	(void)usbd_dev;
+	if (addr != 0x82 || in.loaded)
+		return 0;
+	if (len > sizeof(in.buf)) {
+		in.too_long++;
+		return 0;
+	}
+	memcpy(in.buf, buf, len);
+	in.len = len;
+	in.loaded = 1;
+	return len;
+}
+
+uint16_t usbd_ep_read_packet(usbd_device *usbd_dev, uint8_t addr,
+			     void *buf, uint16_t len)
+{
+	(void)usbd_dev;
+	if (addr != 0x01 || !out.holding)
+		return 0;
+	if (len > out.len)
+		len = out.len;
+	memcpy(buf, out.buf, len);
+	out.holding = 0;
+	if (!out.force_nak)
+		out.valid = 1;
+	return len;
+}
+
+void usbd_ep_nak_set(usbd_device *usbd_dev, uint8_t addr, uint8_t nak)
+{
+	(void)usbd_dev;
+	if (addr != 0x01)
+		return;
+	out.force_nak = nak;
+	out.valid = !nak;
+	out.slip = nak ? late_naks : 0;
+}
+
+void usbd_poll(usbd_device *usbd_dev)
+{
+	if (out.pending) {
+		out.pending = 0;
+		if (out.cb)
+			out.cb(usbd_dev, 0x01);
+	}
+	if (in.pending) {
+		in.pending = 0;
+		if (in.cb)
+			in.cb(usbd_dev, 0x82);
+	}
+}
+
+/* --- The host --- */
+
+#define STREAM_SIZE	(1 << 20)
+
+static uint8_t stream[STREAM_SIZE + 64];
+
+static struct {
+	int bursty;
+	uint64_t now, bus, toggle;	/* ns */
+	int reading;
+	uint32_t total;			/* bytes to send */
+	uint32_t sent, write_left;	/* bytes out, left in this write */
+	uint32_t received, last_len;
+	uint32_t packets, zlps, naks;
+	uint32_t wrong, hung;
+} host;
+
+/* The host's next OUT packet, 0 if it has nothing to send */
+static uint32_t host_packet(void)
+{
+	if (host.sent >= host.total)
+		return 0;
+	if (!host.write_left) {
+		host.write_left = 1 + rnd() % 4096;
+		if (host.write_left > host.total - host.sent)
+			host.write_left = host.total - host.sent;
+	}
+	return host.write_left < 64 ? host.write_left : 64;
+}
+
+static void host_in(void)
+{
+	uint32_t i;
+
+	if (!in.loaded) {
+		host.bus += NAK_NS;
+		host.naks++;
+		return;
+	}
+	for (i = 0; i < in.len; i++)
+		if (in.buf[i] != stream[host.received + i])
+			host.wrong++;
+	host.received += in.len;
+	host.last_len = in.len;
+	host.packets++;
+	if (!in.len)
+		host.zlps++;
+	in.loaded = 0;
+	in.pending = 1;
+	host.bus += in.len ? PACKET_NS : NAK_NS;
+}
+
+static void host_out(void)
+{
+	uint32_t n = host_packet();
+
+	if (!n)
+		return;
+	if (!out.valid && !out.slip) {
+		host.bus += NAK_NS;
+		host.naks++;
+		return;
+	}
+	if (!out.valid)
+		out.slip--;
+	if (out.holding)
+		out.overwritten++;
+	memcpy(out.buf, &stream[host.sent], n);
+	out.len = n;
+	out.holding = 1;
+	out.valid = 0;
+	out.pending = 1;
+	host.sent += n;
+	host.write_left -= n;
+	host.bus += PACKET_NS;
+}
+
+/* Run the bus up to the device's time */
+static void bus(void)
+{
+	while (host.bus < host.now) {
+		if (host.bursty && host.bus >= host.toggle) {
+			host.reading = !host.reading;
+			host.toggle = host.bus + (host.reading ?
+				      rnd() % (5 * MS) : rnd() % (20 * MS));
+		}
+		if (host.reading)
+			host_in();
+		host_out();
+		if (!host.reading && !host_packet())
+			host.bus += MS / 10;
+	}
+}
+
+/* --- The device applications --- */
+
+/* The echo cdcacm.c had before the buffering */
+static void old_rx_cb(usbd_device *usbd_dev, uint8_t ep)
+{
+	char buf[64];
+	int len = usbd_ep_read_packet(usbd_dev, 0x01, buf, 64);
+
+	(void)ep;
+	if (len)
+		usbd_ep_write_packet(usbd_dev, 0x82, buf, len);
+}
+
+static void old_set_config(usbd_device *usbd_dev, uint16_t wValue)
+{
+	(void)wValue;
+	usbd_ep_setup(usbd_dev, 0x01, USB_ENDPOINT_ATTR_BULK, 64, old_rx_cb);
+	usbd_ep_setup(usbd_dev, 0x82, USB_ENDPOINT_ATTR_BULK, 64, NULL);
+}
+
+enum app { OLD_ECHO, ECHO, STREAM };
+
+static uint32_t stream_pos;
+
+static void app_step(enum app app, usbd_device *usbd_dev, uint32_t total)
+{
+	uint32_t n;
+
+	switch (app) {
+	case OLD_ECHO:
+		break;
+	case ECHO:
+		cdcacm_echo(usbd_dev);
+		break;
+	case STREAM:
+		/* the streaming API, in odd sized pieces */
+		n = 1 + rnd() % 300;
+		if (n > total - stream_pos)
+			n = total - stream_pos;
+		/* once done, only the IN callback moves the rest */
+		if (!n)
+			break;
+		stream_pos += cdcacm_write(usbd_dev, &stream[stream_pos], n);
+		break;
+	}
+}
+
+static void run(const char *name, enum app app, int bursty, int late,
+		uint32_t total)
+{
+	usbd_device *usbd_dev;
+	uint64_t idle_since = 0;
+	uint32_t last = 0, echoed;
+
+	memset(&host, 0, sizeof(host));
+	host.bursty = bursty;
+	host.reading = !bursty;
+	host.total = app == STREAM ? 0 : total;
+	late_naks = late;
+	stream_pos = 0;
+	rx_dropped = 0;
+
+	usbd_dev = usbd_init(&st_usbfs_v1_usb_driver, &dev, &config,
+			     usb_strings, 3, usbd_control_buffer,
+			     sizeof(usbd_control_buffer));
+	usbd_register_set_config_callback(usbd_dev, app == OLD_ECHO ?
+					  old_set_config : cdcacm_set_config);
+	usbd_dev->set_config(usbd_dev, 1);
+
+	/* until everything is back, or nothing came for 100ms */
+	while (host.received < total && host.now - idle_since < 100 * MS) {
+		usbd_poll(usbd_dev);
+		app_step(app, usbd_dev, total);
+		host.now += LOOP_NS;
+		bus();
+		if (host.received != last) {
+			last = host.received;
+			idle_since = host.now;
+		}
+	}
+	/* let a final zero length packet come through */
+	host.reading = 1;
+	host.bursty = 0;
+	host.total = host.sent;
+	for (echoed = 0; echoed < 1000; echoed++) {
+		usbd_poll(usbd_dev);
+		app_step(app, usbd_dev, total);
+		host.now += LOOP_NS;
+		bus();
+	}
+	host.hung = host.last_len == 64;
+	echoed = host.received;
+
+	printf("%-38s %7.0f %9u %7u %6u\n", name,
+	       echoed / 1024.0 / (idle_since / 1e9), total - echoed,
+	       host.naks, host.zlps);
+
+	CHECK(!out.overwritten && !in.too_long, "%s: %u packets overwritten, "
+	      "%u written too long", name, out.overwritten, in.too_long);
+	/* the old echo drops packets, so the stream is off after one */
+	if (app == OLD_ECHO)
+		return;
+	CHECK(!host.wrong, "%s: %u bytes came back wrong", name, host.wrong);
+	CHECK(echoed == total && !rx_dropped, "%s: %u of %u bytes came back, "
+	      "%u dropped", name, echoed, total, rx_dropped);
+	CHECK(!host.hung, "%s: the last transfer ends with a full packet",
+	      name);
+}
+
+int main(void)
+{
+	uint32_t i;
+
+	for (i = 0; i < sizeof(stream); i++)
+		stream[i] = rnd();
+
+	printf("%-38s %7s %9s %7s %6s\n", "", "KB/s", "lost", "NAKs",
+	       "ZLPs");
+	run("old echo, host reads at once", OLD_ECHO, 0, 0, STREAM_SIZE);
+	run("old echo, bursty host", OLD_ECHO, 1, 0, STREAM_SIZE);
+	run("echo, host reads at once", ECHO, 0, 0, STREAM_SIZE);
+	run("echo, bursty host", ECHO, 1, 0, STREAM_SIZE);
+	run("echo, bursty host, late NAK", ECHO, 1, 1, STREAM_SIZE);
+	run("cdcacm_write(), host reads at once", STREAM, 0, 0, STREAM_SIZE);
+	run("cdcacm_write(), bursty host", STREAM, 1, 0, STREAM_SIZE);
+	run("cdcacm_write(), not a packet multiple", STREAM, 1, 0,
+	    STREAM_SIZE - 17);
+
+	if (failures) {
+		printf("%d failures\n", failures);
+		return EXIT_FAILURE;
+	}
+	printf("all passed\n");
+	return EXIT_SUCCESS;
+}
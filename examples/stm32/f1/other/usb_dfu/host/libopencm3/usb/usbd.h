@@ -0,0 +1,130 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Host stand-in, see rcc.h.  The descriptors are laid out as in usbstd.h. */
+
+#ifndef HOST_USBD_H
+#define HOST_USBD_H
+
+#include <stdint.h>
+
+#define USB_DT_DEVICE			1
+#define USB_DT_CONFIGURATION		2
+#define USB_DT_INTERFACE		4
+#define USB_DT_DEVICE_SIZE		18
+#define USB_DT_CONFIGURATION_SIZE	9
+#define USB_DT_INTERFACE_SIZE		9
+
+#define USB_REQ_TYPE_CLASS		0x20
+#define USB_REQ_TYPE_INTERFACE		0x01
+#define USB_REQ_TYPE_TYPE		0x60
+#define USB_REQ_TYPE_RECIPIENT		0x1f
+
+struct usb_setup_data {
+	uint8_t bmRequestType;
+	uint8_t bRequest;
+	uint16_t wValue;
+	uint16_t wIndex;
+	uint16_t wLength;
+} __attribute__((packed));
+
+struct usb_device_descriptor {
+	uint8_t bLength;
+	uint8_t bDescriptorType;
+	uint16_t bcdUSB;
+	uint8_t bDeviceClass;
+	uint8_t bDeviceSubClass;
+	uint8_t bDeviceProtocol;
+	uint8_t bMaxPacketSize0;
+	uint16_t idVendor;
+	uint16_t idProduct;
+	uint16_t bcdDevice;
+	uint8_t iManufacturer;
+	uint8_t iProduct;
+	uint8_t iSerialNumber;
+	uint8_t bNumConfigurations;
+} __attribute__((packed));
+
+struct usb_interface_descriptor {
+	uint8_t bLength;
+	uint8_t bDescriptorType;
+	uint8_t bInterfaceNumber;
+	uint8_t bAlternateSetting;
+	uint8_t bNumEndpoints;
+	uint8_t bInterfaceClass;
+	uint8_t bInterfaceSubClass;
+	uint8_t bInterfaceProtocol;
+	uint8_t iInterface;
+
+	const struct usb_endpoint_descriptor *endpoint;
+	const void *extra;
+	int extralen;
+} __attribute__((packed));
+
+struct usb_interface {
+	uint8_t *cur_altsetting;
+	uint8_t num_altsetting;
+	const struct usb_iface_assoc_descriptor *iface_assoc;
+	const struct usb_interface_descriptor *altsetting;
+};
+
+struct usb_config_descriptor {
+	uint8_t bLength;
+	uint8_t bDescriptorType;
+	uint16_t wTotalLength;
+	uint8_t bNumInterfaces;
+	uint8_t bConfigurationValue;
+	uint8_t iConfiguration;
+	uint8_t bmAttributes;
+	uint8_t bMaxPower;
+
+	const struct usb_interface *interface;
+} __attribute__((packed));
+
+enum usbd_request_return_codes {
+	USBD_REQ_NOTSUPP	= 0,
+	USBD_REQ_HANDLED	= 1,
+	USBD_REQ_NEXT_CALLBACK	= 2,
+};
+
+typedef struct _usbd_device usbd_device;
+typedef struct _usbd_driver usbd_driver;
+
+extern const usbd_driver st_usbfs_v1_usb_driver;
+extern const usbd_driver stm32f107_usb_driver;
+
+typedef enum usbd_request_return_codes (*usbd_control_callback)(
+		usbd_device *usbd_dev, struct usb_setup_data *req,
+		uint8_t **buf, uint16_t *len,
+		void (**complete)(usbd_device *usbd_dev,
+				  struct usb_setup_data *req));
+typedef void (*usbd_set_config_callback)(usbd_device *usbd_dev,
+					 uint16_t wValue);
+
+usbd_device *usbd_init(const usbd_driver *driver,
+		       const struct usb_device_descriptor *dev,
+		       const struct usb_config_descriptor *conf,
+		       const char **strings, int num_strings,
+		       uint8_t *control_buffer, uint16_t control_buffer_size);
+int usbd_register_control_callback(usbd_device *usbd_dev, uint8_t type,
+				   uint8_t type_mask,
+				   usbd_control_callback callback);
+int usbd_register_set_config_callback(usbd_device *usbd_dev,
+				      usbd_set_config_callback callback);
+void usbd_poll(usbd_device *usbd_dev);
+
+#endif
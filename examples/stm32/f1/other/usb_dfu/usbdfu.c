@@ -27,6 +27,19 @@
 
 #define APP_ADDRESS	0x08002000
 
+/* STM32F107VC: 128 pages of 2K. */
+#define DFU_PAGE_SIZE	2048
+#define DFU_FLASH_PAGES	128
+
+/*
+ * Typical flash timings from the datasheet, used for bwPollTimeout.  A host
+ * polling too early is simply told to wait again.
+ */
+#define PROG_US		53	/* per half-word */
+#define ERASE_MS	20	/* per page */
+/* Half-words programmed per main loop pass, so usbd_poll() keeps up. */
+#define PROG_CHUNK	32
+
 /* Commands sent with wBlockNum == 0 as per ST implementation. */
 #define CMD_SETADDR	0x21
 #define CMD_ERASE	0x41
@@ -35,13 +48,33 @@
 uint8_t usbd_control_buffer[1024];
 
 static enum dfu_state usbdfu_state = STATE_DFU_IDLE;
+static enum dfu_status usbdfu_status = DFU_STATUS_OK;
 
-static struct {
+/*
+ * Downloaded blocks wait here to be written from the main loop, so the
+ * host can send the next block while the flash is busy with this one.
+ */
+static struct dfu_block {
 	uint8_t buf[sizeof(usbd_control_buffer)];
 	uint16_t len;
+	uint16_t done;		/* bytes programmed so far */
 	uint32_t addr;
-	uint16_t blocknum;
-} prog;
+	uint8_t erase;		/* CMD_ERASE: erase the page at addr */
+} blocks[2];
+
+static uint8_t blocks_head;
+static uint8_t blocks_count;
+
+/*
+ * A DfuSe host sends commands as block 0, sets the address of the blocks
+ * that follow with CMD_SETADDR and numbers them from 2.  A plain DFU host
+ * numbers its blocks from 0 and the image goes to APP_ADDRESS.
+ */
+static bool dfuse;
+static uint32_t prog_addr = APP_ADDRESS;
+
+/* Pages erased in this download, any other page is erased before writing. */
+static uint32_t erased_pages[DFU_FLASH_PAGES / 32];
 
 const struct usb_device_descriptor dev = {
 	.bLength = USB_DT_DEVICE_SIZE,
@@ -110,65 +143,196 @@ static const char *usb_strings[] = {
 	"DFU Demo",
 	"DEMO",
 	/* This string is used by ST Microelectronics' DfuSe utility. */
-	"@Internal Flash   /0x08000000/8*001Ka,56*001Kg",
+	"@Internal Flash   /0x08000000/4*002Ka,124*002Kg",
 };
 
+static uint32_t page_of(uint32_t addr)
+{
+	return (addr - FLASH_BASE) / DFU_PAGE_SIZE;
+}
+
+static bool page_erased(uint32_t page)
+{
+	return erased_pages[page / 32] & (1u << (page % 32));
+}
+
+static void page_erase(uint32_t page)
+{
+	flash_erase_page(FLASH_BASE + page * DFU_PAGE_SIZE);
+	erased_pages[page / 32] |= 1u << (page % 32);
+}
+
+static void blocks_flush(void)
+{
+	blocks_head = 0;
+	blocks_count = 0;
+}
+
+/*
+ * Forget the last download, so the next one erases every page again
+ * before writing it.
+ */
+static void usbdfu_download_reset(void)
+{
+	blocks_flush();
+	memset(erased_pages, 0, sizeof(erased_pages));
+	dfuse = false;
+	prog_addr = APP_ADDRESS;
+}
+
+/* Milliseconds of flash work left in the first `count' queued blocks. */
+static uint32_t usbdfu_busy_ms(int count)
+{
+	struct dfu_block *b;
+	uint32_t us = 0, page;
+	int i;
+
+	for (i = 0; i < count; i++) {
+		b = &blocks[(blocks_head + i) % 2];
+		if (b->erase) {
+			us += ERASE_MS * 1000;
+			continue;
+		}
+		us += (b->len - b->done + 1) / 2 * PROG_US;
+		for (page = page_of(b->addr + b->done);
+		     page <= page_of(b->addr + b->len - 1); page++)
+			if (!page_erased(page))
+				us += ERASE_MS * 1000;
+	}
+
+	return (us + 999) / 1000;
+}
+
+/*
+ * Do a slice of the flash work: erase one page, or program up to
+ * PROG_CHUNK half-words of the oldest block.  The CPU stalls while the
+ * flash is busy, so this is kept short between calls to usbd_poll().
+ */
+static void usbdfu_flash_poll(void)
+{
+	struct dfu_block *b = &blocks[blocks_head];
+	uint32_t addr, page, end;
+	uint16_t data;
+
+	if (!blocks_count)
+		return;
+
+	flash_unlock();
+	if (b->erase) {
+		page_erase(page_of(b->addr));
+		b->done = b->len;
+	} else {
+		addr = b->addr + b->done;
+		page = page_of(addr);
+		if (!page_erased(page)) {
+			page_erase(page);
+		} else {
+			/* Stay within this page, the next may need erasing. */
+			end = FLASH_BASE + (page + 1) * DFU_PAGE_SIZE;
+			if (end > b->addr + b->len)
+				end = b->addr + b->len;
+			if (end > addr + PROG_CHUNK * 2)
+				end = addr + PROG_CHUNK * 2;
+			for (; addr < end; addr += 2, b->done += 2) {
+				data = b->buf[b->done] |
+				       (b->buf[b->done + 1] << 8);
+				flash_program_half_word(addr, data);
+				if (*(volatile uint16_t *)addr != data) {
+					usbdfu_status = DFU_STATUS_ERR_VERIFY;
+					usbdfu_state = STATE_DFU_ERROR;
+					blocks_flush();
+					break;
+				}
+			}
+		}
+	}
+	flash_lock();
+
+	if (blocks_count && b->done >= b->len) {
+		blocks_head = (blocks_head + 1) % 2;
+		blocks_count--;
+	}
+}
+
+static void usbdfu_queue(struct usb_setup_data *req, uint8_t *buf, uint16_t len)
+{
+	struct dfu_block *b = &blocks[(blocks_head + blocks_count) % 2];
+
+	b->done = 0;
+	b->erase = 0;
+
+	/* Commands are 1 or 5 bytes, a plain DFU block 0 is a full block. */
+	if (req->wValue == 0 && len <= 5) {
+		dfuse = true;
+		switch (buf[0]) {
+		case CMD_ERASE:
+			b->addr = *(uint32_t *)(buf + 1);
+			b->len = 1;
+			b->erase = 1;
+			break;
+		case CMD_SETADDR:
+			/* Only affects the blocks that follow; nothing to queue. */
+			prog_addr = *(uint32_t *)(buf + 1);
+			return;
+		default:
+			return;
+		}
+	} else {
+		b->addr = prog_addr + ((req->wValue - (dfuse ? 2 : 0)) *
+			  dfu_function.wTransferSize);
+		b->len = len;
+		memcpy(b->buf, buf, len);
+		if (len & 1)
+			b->buf[len] = 0xff;
+	}
+
+	if (b->addr < FLASH_BASE ||
+	    b->addr + b->len > FLASH_BASE + DFU_FLASH_PAGES * DFU_PAGE_SIZE) {
+		usbdfu_status = DFU_STATUS_ERR_ADDRESS;
+		return;
+	}
+	blocks_count++;
+}
+
 static uint8_t usbdfu_getstatus(uint32_t *bwPollTimeout)
 {
 	switch (usbdfu_state) {
 	case STATE_DFU_DNLOAD_SYNC:
-		usbdfu_state = STATE_DFU_DNBUSY;
-		*bwPollTimeout = 100;
-		return DFU_STATUS_OK;
+		if (usbdfu_status != DFU_STATUS_OK) {
+			usbdfu_state = STATE_DFU_ERROR;
+			blocks_flush();
+		} else if (blocks_count < 2) {
+			/* The block is queued and there is room for the next. */
+			usbdfu_state = STATE_DFU_DNLOAD_IDLE;
+		} else {
+			usbdfu_state = STATE_DFU_DNBUSY;
+			*bwPollTimeout = usbdfu_busy_ms(1);
+		}
+		return usbdfu_status;
 	case STATE_DFU_MANIFEST_SYNC:
 		/* Device will reset when read is complete. */
 		usbdfu_state = STATE_DFU_MANIFEST;
+		*bwPollTimeout = usbdfu_busy_ms(blocks_count);
 		return DFU_STATUS_OK;
 	default:
-		return DFU_STATUS_OK;
+		return usbdfu_status;
 	}
 }
 
 static void usbdfu_getstatus_complete(usbd_device *usbd_dev, struct usb_setup_data *req)
 {
-	int i;
 	(void)req;
 	(void)usbd_dev;
 
 	switch (usbdfu_state) {
 	case STATE_DFU_DNBUSY:
-		flash_unlock();
-		if (prog.blocknum == 0) {
-			switch (prog.buf[0]) {
-			case CMD_ERASE:
-				{
-					uint32_t *dat = (uint32_t *)(prog.buf + 1);
-					flash_erase_page(*dat);
-				}
-				break;
-			case CMD_SETADDR:
-				{
-					uint32_t *dat = (uint32_t *)(prog.buf + 1);
-					prog.addr = *dat;
-				}
-				break;
-			}
-		} else {
-			uint32_t baseaddr = prog.addr + ((prog.blocknum - 2) *
-				       dfu_function.wTransferSize);
-			for (i = 0; i < prog.len; i += 2) {
-				uint16_t *dat = (uint16_t *)(prog.buf + i);
-				flash_program_half_word(baseaddr + i,
-						*dat);
-			}
-		}
-		flash_lock();
-
-		/* Jump straight to dfuDNLOAD-IDLE, skipping dfuDNLOAD-SYNC. */
-		usbdfu_state = STATE_DFU_DNLOAD_IDLE;
+		/* The host waits bwPollTimeout and asks again. */
+		usbdfu_state = STATE_DFU_DNLOAD_SYNC;
 		return;
 	case STATE_DFU_MANIFEST:
-		/* USB device must detach, we just reset... */
+		/* Finish writing, then detach; we just reset... */
+		while (blocks_count)
+			usbdfu_flash_poll();
 		scb_reset_system();
 		return; /* Will never return. */
 	default:
@@ -186,24 +350,31 @@ static enum usbd_request_return_codes usbdfu_control_request(usbd_device *usbd_d
 
 	switch (req->bRequest) {
 	case DFU_DNLOAD:
+		/* Only after dfuDNLOAD-IDLE, which means a buffer is free. */
+		if (usbdfu_state == STATE_DFU_ERROR || blocks_count == 2)
+			return USBD_REQ_NOTSUPP;
+		if (usbdfu_state == STATE_DFU_IDLE)
+			usbdfu_download_reset();
 		if ((len == NULL) || (*len == 0)) {
 			usbdfu_state = STATE_DFU_MANIFEST_SYNC;
 		} else {
-			/* Copy download data for use on GET_STATUS. */
-			prog.blocknum = req->wValue;
-			prog.len = *len;
-			memcpy(prog.buf, *buf, *len);
+			/* Queue the block, it is written from the main loop. */
+			usbdfu_queue(req, *buf, *len);
 			usbdfu_state = STATE_DFU_DNLOAD_SYNC;
 		}
 		return USBD_REQ_HANDLED;
 	case DFU_CLRSTATUS:
 		/* Clear error and return to dfuIDLE. */
-		if (usbdfu_state == STATE_DFU_ERROR)
+		if (usbdfu_state == STATE_DFU_ERROR) {
 			usbdfu_state = STATE_DFU_IDLE;
+			usbdfu_status = DFU_STATUS_OK;
+			usbdfu_download_reset();
+		}
 		return USBD_REQ_HANDLED;
 	case DFU_ABORT:
-		/* Abort returns to dfuIDLE state. */
+		/* Abort returns to dfuIDLE state, dropping queued blocks. */
 		usbdfu_state = STATE_DFU_IDLE;
+		usbdfu_download_reset();
 		return USBD_REQ_HANDLED;
 	case DFU_UPLOAD:
 		/* Upload not supported for now. */
@@ -277,6 +448,8 @@ int main(void)
 	gpio_set_mode(GPIOA, GPIO_MODE_OUTPUT_2_MHZ,
 		      GPIO_CNF_OUTPUT_PUSHPULL, GPIO15);
 
-	while (1)
+	while (1) {
 		usbd_poll(usbd_dev);
+		usbdfu_flash_poll();
+	}
 }
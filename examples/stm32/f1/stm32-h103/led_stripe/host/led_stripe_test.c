@@ -0,0 +1,659 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Host checks for the SPI and DMA driven frame output in led_stripe.c.
+ *
+ * The reference is the bit-banged send_colors() the example used before,
+ * kept below as it was.  It runs against a gpio_set()/gpio_clear() that
+ * samples MOSI on each rising edge of SCLK, which gives the bit stream
+ * the strip saw.  encode_colors() has to produce that stream byte for
+ * byte, padded with zero bits to a whole byte, for any colors and LED
+ * count.
+ *
+ * The DMA channel is simulated with a SIGALRM timer that fires after the
+ * frame's time on the wire at the SPI clock spi_setup() sets, and runs
+ * dma1_channel5_isr() from the signal handler the way the interrupt
+ * would.  The bytes the channel sent are only read at the end of the
+ * transfer, so anything that writes into a frame buffer while it is
+ * being sent shows up on the wire.  Every frame is checked against the
+ * reference fed with the colors as they were when send_colors() was
+ * called, which the test overwrites as soon as it returns.
+ *
+ * Last, encode_colors() and the bit-banged reference are timed on this
+ * host for strips of up to a few thousand LEDs, next to the SPI time per
+ * frame and the frame rate it allows.
+ */
+
+#define _DEFAULT_SOURCE
+
+#include <math.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+
+/* Only the frame output is run, main() is kept out of the way. */
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wold-style-declaration"
+#define main static __attribute__((unused)) led_stripe_main
+#include "led_stripe.c"
+#undef main
+#pragma GCC diagnostic pop
+
+static int failures;
+
+#define CHECK(cond, ...) do {						\
+	if (!(cond)) {							\
+		if (failures++ < 10) {					\
+			printf("FAIL %s:%d: ", __FILE__, __LINE__);	\
+			printf(__VA_ARGS__);				\
+			printf("\n");					\
+		}							\
+	}								\
+} while (0)
+
+static uint32_t rng_state = 1;
+
+static uint32_t rnd(void)
+{
+	rng_state ^= rng_state << 13;
+	rng_state ^= rng_state >> 17;
+	rng_state ^= rng_state << 5;
+	return rng_state;
+}
+
+#define APB1_HZ			36000000
+#define MAX_LEDS		5000
+#define STREAM_FRAMES		200
+
+/* --- GPIO, for the reference --- */
+
+#define SPI_BANK GPIOB
+#define SCLK_PIN GPIO13
+#define MOSI_PIN GPIO15
+
+static struct {
+	int sclk, mosi;
+	int record;
+	uint8_t bits[FRAME_BYTES(MAX_LEDS)];
+	size_t nbits;
+	unsigned long writes;
+} pins;
+
+static struct {
+	uint8_t mode, cnf;
+} pin_mode[3][16];
+
+void gpio_set_mode(uint32_t gpioport, uint8_t mode, uint8_t cnf,
+		   uint16_t gpios)
+{
+	int i;
+
+	for (i = 0; i < 16; i++) {
+		if (gpios & (1 << i)) {
+			pin_mode[gpioport][i].mode = mode;
+			pin_mode[gpioport][i].cnf = cnf;
+		}
+	}
+}
+
+static void pins_write(uint32_t gpioport, uint16_t gpios, int level)
+{
+	pins.writes++;
+	if (gpioport != SPI_BANK)
+		return;
+	if (gpios & MOSI_PIN)
+		pins.mosi = level;
+	if (gpios & SCLK_PIN) {
+		if (level && !pins.sclk && pins.record) {
+			if (pins.mosi)
+				pins.bits[pins.nbits / 8] |=
+					0x80 >> (pins.nbits % 8);
+			pins.nbits++;
+		}
+		pins.sclk = level;
+	}
+}
+
+void gpio_set(uint32_t gpioport, uint16_t gpios)
+{
+	pins_write(gpioport, gpios, 1);
+}
+
+void gpio_clear(uint32_t gpioport, uint16_t gpios)
+{
+	pins_write(gpioport, gpios, 0);
+}
+
+/* --- The bit-banged send_colors() this example had before --- */
+
+#define SMALL_DELAY_VALUE 0
+
+#define SCLK(VAL)				\
+	if (VAL) {				\
+		gpio_set(SPI_BANK, SCLK_PIN);	\
+	} else {				\
+		gpio_clear(SPI_BANK, SCLK_PIN);	\
+	}
+
+#define MOSI(VAL)				\
+	if (VAL) {				\
+		gpio_set(SPI_BANK, MOSI_PIN);	\
+	} else {				\
+		gpio_clear(SPI_BANK, MOSI_PIN);	\
+	}
+
+#define SMALL_DELAY() {				\
+		int j;				\
+		for (j = 0; j < SMALL_DELAY_VALUE; j++)	\
+			__asm__("nop");		\
+	}
+
+static void bitbang_send_colors(struct color *colors, int count)
+{
+	int i, k;
+
+	/* Initialize SPI pins. */
+	SCLK(0);
+	MOSI(0);
+
+	/* Start frame */
+	for (i = 0; i < 32; i++) {
+		SCLK(1);
+		SMALL_DELAY();
+		SCLK(0);
+		SMALL_DELAY();
+	}
+
+	/* Color cell output */
+	for (k = 0; k < count; k++) {
+		/* Start bit */
+		MOSI(1);
+		SCLK(1);
+		SMALL_DELAY();
+		SCLK(0);
+		SMALL_DELAY();
+
+		/* Blue */
+		for (i = 0; i < 5; i++) {
+			MOSI(((colors[k].b & ((1 << 4) >> i)) != 0));
+			SCLK(1);
+			SMALL_DELAY();
+			SCLK(0);
+			SMALL_DELAY();
+		}
+		/* Red */
+		for (i = 0; i < 5; i++) {
+			MOSI(((colors[k].r & ((1 << 4) >> i)) != 0));
+			SCLK(1);
+			SMALL_DELAY();
+			SCLK(0);
+			SMALL_DELAY();
+		}
+		/* Green */
+		for (i = 0; i < 5; i++) {
+			MOSI(((colors[k].g & ((1 << 4) >> i)) != 0));
+			SCLK(1);
+			SMALL_DELAY();
+			SCLK(0);
+			SMALL_DELAY();
+		}
+	}
+
+	/* End frame */
+	MOSI(0);
+	for (k = 0; k < count; k++) {
+		SCLK(1);
+		SMALL_DELAY();
+		SCLK(0);
+		SMALL_DELAY();
+	}
+}
+
+/*
+ * The bytes the strip gets from the reference for these colors, each
+ * passed through lut[] first.  Returns the number of bits clocked out.
+ */
+static size_t reference_frame(uint8_t *out, const struct color *colors,
+			      int count, const uint8_t *lut)
+{
+	static struct color mapped[MAX_LEDS];
+	int k;
+
+	for (k = 0; k < count; k++) {
+		mapped[k].r = lut[colors[k].r & 0x1F];
+		mapped[k].g = lut[colors[k].g & 0x1F];
+		mapped[k].b = lut[colors[k].b & 0x1F];
+	}
+
+	memset(pins.bits, 0, FRAME_BYTES(count));
+	pins.nbits = 0;
+	pins.record = 1;
+	bitbang_send_colors(mapped, count);
+	pins.record = 0;
+
+	memcpy(out, pins.bits, FRAME_BYTES(count));
+	return pins.nbits;
+}
+
+static void random_colors(struct color *colors, int count)
+{
+	int k;
+
+	/* The upper bits are set too, both encoders have to ignore them. */
+	for (k = 0; k < count; k++) {
+		colors[k].r = rnd();
+		colors[k].g = rnd();
+		colors[k].b = rnd();
+	}
+}
+
+/* --- SPI2 and DMA1 channel 5 --- */
+
+volatile uint32_t sim_spi2_dr;
+struct sim_spi sim_spi2;
+struct sim_dma_channel sim_dma[8];
+volatile uint32_t sim_dma_isr, sim_dma_ifcr;
+uint8_t sim_nvic[64];
+
+static uint32_t spi_hz;
+
+static struct {
+	volatile int active;
+	const uint8_t *src;
+	uint8_t snap[FRAME_BYTES(COLOR_COUNT)];
+	unsigned restarted;		/* started while still sending */
+	unsigned bad_address;
+	volatile unsigned torn;		/* buffer written while sent */
+	volatile unsigned stuck;	/* flag left set by the handler */
+
+	volatile unsigned frames;
+	uint8_t wire[STREAM_FRAMES][FRAME_BYTES(COLOR_COUNT)];
+	uint16_t wire_len[STREAM_FRAMES];
+} xfer;
+
+static void fail_now(const char *msg)
+{
+	if (write(STDOUT_FILENO, msg, strlen(msg)) < 0)
+		_exit(2);
+	_exit(EXIT_FAILURE);
+}
+
+/* The end of a transfer, and the interrupt it raises. */
+static void dma_complete(int sig)
+{
+	struct sim_dma_channel *ch = &sim_dma[DMA_CHANNEL5];
+	unsigned f = xfer.frames;
+
+	(void)sig;
+	if (!xfer.active || !ch->enabled)
+		return;
+
+	if (memcmp(xfer.src, xfer.snap, ch->cndtr))
+		xfer.torn++;
+	if (f < STREAM_FRAMES) {
+		memcpy(xfer.wire[f], xfer.src, ch->cndtr);
+		xfer.wire_len[f] = ch->cndtr;
+	}
+	xfer.frames = f + 1;
+	ch->cndtr = 0;
+	xfer.active = 0;
+
+	sim_dma_isr |= DMA_FLAGS(DMA_CHANNEL5, DMA_GIF | DMA_TCIF);
+	if (ch->tcie && (sim_nvic[NVIC_DMA1_CHANNEL5_IRQ] & 0x80)) {
+		dma1_channel5_isr();
+		sim_dma_isr &= ~sim_dma_ifcr;
+		sim_dma_ifcr = 0;
+	}
+	if (sim_dma_isr & DMA_ISR_TCIF5)
+		xfer.stuck++;
+	if (frame_busy)
+		fail_now("FAIL: frame_busy still set after the DMA interrupt, "
+			 "send_colors() would wait forever\n");
+}
+
+void dma_channel_reset(uint32_t dma, uint8_t channel)
+{
+	(void)dma;
+	if (xfer.active)
+		xfer.restarted++;
+	memset(&sim_dma[channel], 0, sizeof(sim_dma[channel]));
+	sim_dma_isr &= ~DMA_FLAGS(channel, 0xF);
+}
+
+void dma_set_peripheral_address(uint32_t dma, uint8_t channel,
+				uint32_t address)
+{
+	(void)dma;
+	sim_dma[channel].cpar = address;
+}
+
+void dma_set_memory_address(uint32_t dma, uint8_t channel, uint32_t address)
+{
+	(void)dma;
+	sim_dma[channel].cmar = address;
+}
+
+void dma_set_number_of_data(uint32_t dma, uint8_t channel, uint16_t number)
+{
+	(void)dma;
+	sim_dma[channel].cndtr = number;
+}
+
+void dma_set_read_from_memory(uint32_t dma, uint8_t channel)
+{
+	(void)dma;
+	sim_dma[channel].from_memory = 1;
+}
+
+void dma_enable_memory_increment_mode(uint32_t dma, uint8_t channel)
+{
+	(void)dma;
+	sim_dma[channel].minc = 1;
+}
+
+void dma_set_peripheral_size(uint32_t dma, uint8_t channel,
+			     uint32_t peripheral_size)
+{
+	(void)dma;
+	sim_dma[channel].psize = peripheral_size;
+}
+
+void dma_set_memory_size(uint32_t dma, uint8_t channel, uint32_t mem_size)
+{
+	(void)dma;
+	sim_dma[channel].msize = mem_size;
+}
+
+void dma_set_priority(uint32_t dma, uint8_t channel, uint32_t prio)
+{
+	(void)dma;
+	sim_dma[channel].prio = prio;
+}
+
+void dma_enable_transfer_complete_interrupt(uint32_t dma, uint8_t channel)
+{
+	(void)dma;
+	sim_dma[channel].tcie = 1;
+}
+
+void dma_enable_channel(uint32_t dma, uint8_t channel)
+{
+	struct sim_dma_channel *ch = &sim_dma[channel];
+	struct itimerval t = { { 0, 0 }, { 0, 0 } };
+	int i;
+
+	(void)dma;
+	ch->enabled = 1;
+
+	/* Only 32 bit addresses reach the DMA, match them to a buffer. */
+	xfer.src = NULL;
+	for (i = 0; i < 2; i++)
+		if (ch->cmar == (uint32_t)(uintptr_t)frame_buf[i])
+			xfer.src = frame_buf[i];
+	if (channel != DMA_CHANNEL5 || !xfer.src ||
+	    ch->cpar != (uint32_t)(uintptr_t)&sim_spi2_dr ||
+	    ch->cndtr > sizeof(xfer.snap) || !ch->from_memory || !ch->minc ||
+	    ch->psize != DMA_CCR_PSIZE_8BIT ||
+	    ch->msize != DMA_CCR_MSIZE_8BIT) {
+		xfer.bad_address++;
+		return;
+	}
+
+	memcpy(xfer.snap, xfer.src, ch->cndtr);
+	xfer.active = 1;
+	t.it_value.tv_usec = (uint64_t)ch->cndtr * 8 * 1000000 / spi_hz + 1;
+	setitimer(ITIMER_REAL, &t, NULL);
+}
+
+void dma_disable_channel(uint32_t dma, uint8_t channel)
+{
+	(void)dma;
+	sim_dma[channel].enabled = 0;
+}
+
+/* --- Checks --- */
+
+/* Gamma 2.2 and the brightness scale, both rounded to the nearest step. */
+static void check_lut(void)
+{
+	int b, i;
+	double want;
+
+	for (b = 0; b < 256; b++) {
+		set_brightness(b);
+		for (i = 0; i < 32; i++) {
+			want = floor(31 * pow(i / 31.0, 2.2) + 0.5);
+			if (b == 255)
+				CHECK(color_lut[i] == want,
+				      "gamma[%d] is %d, not %.0f", i,
+				      color_lut[i], want);
+			want = want * b / 255;
+			CHECK(fabs(color_lut[i] - want) <= 0.5,
+			      "brightness %d: step %d gives %d, not %.2f",
+			      b, i, color_lut[i], want);
+			CHECK(i == 0 || color_lut[i] >= color_lut[i - 1],
+			      "brightness %d: step %d below step %d", b, i,
+			      i - 1);
+		}
+	}
+}
+
+/* encode_colors() against the reference, for strips of 0 to MAX_LEDS. */
+static void check_golden(void)
+{
+	static struct color colors[MAX_LEDS];
+	static uint8_t want[FRAME_BYTES(MAX_LEDS)], got[FRAME_BYTES(MAX_LEDS) + 1];
+	static const int sizes[] = { 0, 1, 2, 7, 8, 9, 15, 16, 17, 49, 50,
+				     63, 64, 65, 255, 1000, 2047, MAX_LEDS };
+	uint8_t lut[32];
+	size_t nbits;
+	unsigned s;
+	int i, n, run;
+
+	/* The reference had no table, the identity one has to match it. */
+	for (i = 0; i < 32; i++)
+		lut[i] = color_lut[i] = i;
+
+	for (run = 0; run < 400; run++) {
+		if (run < (int)(sizeof(sizes) / sizeof(sizes[0])))
+			n = sizes[run];
+		else
+			n = rnd() % (COLOR_COUNT * 4 + 1);
+		random_colors(colors, n);
+		if (run % 5 == 0)
+			memset(colors, run % 2 ? 0xFF : 0, n * sizeof(*colors));
+
+		nbits = reference_frame(want, colors, n, lut);
+		CHECK(nbits == 32 + 17 * (size_t)n &&
+		      (size_t)FRAME_BYTES(n) == (nbits + 7) / 8,
+		      "%d LEDs: reference sent %zu bits, frame is %d bytes",
+		      n, nbits, FRAME_BYTES(n));
+
+		memset(got, 0xA5, sizeof(got));
+		encode_colors(got, colors, n);
+		for (s = 0; s < (unsigned)FRAME_BYTES(n); s++) {
+			if (got[s] != want[s]) {
+				CHECK(0, "%d LEDs: byte %u is %02x, the "
+				      "bit-banged frame has %02x", n, s,
+				      got[s], want[s]);
+				break;
+			}
+		}
+		CHECK(got[FRAME_BYTES(n)] == 0xA5,
+		      "%d LEDs: encoded past the %d byte frame", n,
+		      FRAME_BYTES(n));
+	}
+}
+
+static void check_setup(void)
+{
+	gpio_setup();
+	spi_setup();
+
+	CHECK(pin_mode[GPIOB][13].cnf == GPIO_CNF_OUTPUT_ALTFN_PUSHPULL &&
+	      pin_mode[GPIOB][15].cnf == GPIO_CNF_OUTPUT_ALTFN_PUSHPULL &&
+	      pin_mode[GPIOB][13].mode == GPIO_MODE_OUTPUT_50_MHZ &&
+	      pin_mode[GPIOB][15].mode == GPIO_MODE_OUTPUT_50_MHZ,
+	      "PB13 and PB15 are not SPI2 outputs");
+
+	/* Same bits as the reference: MOSI set, then a rising SCLK. */
+	CHECK(sim_spi2.master && sim_spi2.enabled && sim_spi2.tx_dma &&
+	      sim_spi2.ssm && sim_spi2.ssi,
+	      "SPI2 not an enabled master with TX DMA");
+	CHECK(sim_spi2.cpol == SPI_CR1_CPOL_CLK_TO_0_WHEN_IDLE &&
+	      sim_spi2.cpha == SPI_CR1_CPHA_CLK_TRANSITION_1 &&
+	      sim_spi2.dff == SPI_CR1_DFF_8BIT &&
+	      sim_spi2.lsbfirst == SPI_CR1_MSBFIRST,
+	      "SPI2 not in mode 0, 8 bit, MSB first");
+	CHECK(sim_nvic[NVIC_DMA1_CHANNEL5_IRQ] & 0x80,
+	      "DMA1 channel 5 interrupt not enabled");
+
+	spi_hz = APB1_HZ >> ((sim_spi2.br >> 3) + 1);
+}
+
+/*
+ * Frames of random length and colors back to back, changing the colors
+ * and sometimes the brightness as soon as send_colors() returns.
+ */
+static void check_stream(void)
+{
+	static uint8_t want[STREAM_FRAMES][FRAME_BYTES(COLOR_COUNT)];
+	static int want_len[STREAM_FRAMES];
+	struct color colors[COLOR_COUNT];
+	struct sigaction sa;
+	struct timespec t0, t1;
+	uint8_t lut[32];
+	int f, n, overlapped = 0;
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = dma_complete;
+	sigaction(SIGALRM, &sa, NULL);
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (f = 0; f < STREAM_FRAMES; f++) {
+		if (f % 16 == 0)
+			set_brightness(f ? rnd() : 255);
+		memcpy(lut, color_lut, sizeof(lut));
+
+		n = 1 + rnd() % COLOR_COUNT;
+		random_colors(colors, n);
+		reference_frame(want[f], colors, n, lut);
+		want_len[f] = FRAME_BYTES(n);
+
+		overlapped += xfer.active;
+		send_colors(colors, n);
+		random_colors(colors, COLOR_COUNT);
+	}
+	while (frame_busy) {
+		clock_gettime(CLOCK_MONOTONIC, &t1);
+		if (t1.tv_sec - t0.tv_sec > 10)
+			break;
+	}
+
+	CHECK(!frame_busy && xfer.frames == STREAM_FRAMES,
+	      "%u of %d frames sent", xfer.frames, STREAM_FRAMES);
+	CHECK(!xfer.bad_address, "%u frames not set up for SPI2_DR from a "
+	      "frame buffer, 8 bit", xfer.bad_address);
+	CHECK(!xfer.restarted, "DMA restarted %u times during a frame",
+	      xfer.restarted);
+	CHECK(!xfer.torn, "%u frame buffers written while being sent",
+	      xfer.torn);
+	CHECK(!xfer.stuck, "transfer complete flag left set %u times",
+	      xfer.stuck);
+	CHECK(overlapped > STREAM_FRAMES / 2,
+	      "only %d frames encoded while the previous one was sent",
+	      overlapped);
+
+	for (f = 0; f < (int)xfer.frames && f < STREAM_FRAMES; f++) {
+		CHECK(xfer.wire_len[f] == want_len[f] &&
+		      !memcmp(xfer.wire[f], want[f], want_len[f]),
+		      "frame %d: wrong bytes on the wire", f);
+	}
+}
+
+static double seconds(const struct timespec *a, const struct timespec *b)
+{
+	return (b->tv_sec - a->tv_sec) + (b->tv_nsec - a->tv_nsec) * 1e-9;
+}
+
+static void bench(void)
+{
+	static struct color colors[MAX_LEDS];
+	static uint8_t buf[FRAME_BYTES(MAX_LEDS)];
+	static const int sizes[] = { COLOR_COUNT, 500, 2000, MAX_LEDS };
+	struct timespec t0, t1;
+	double enc, bb, wire;
+	unsigned long writes;
+	unsigned i;
+	int r, reps;
+
+	set_brightness(255);
+	random_colors(colors, MAX_LEDS);
+
+	printf("   LEDs  encode ns/LED  bit-bang ns/LED  GPIO writes/LED  "
+	       "SPI ms/frame  max fps\n");
+	for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+		reps = 2000000 / sizes[i];
+
+		clock_gettime(CLOCK_MONOTONIC, &t0);
+		for (r = 0; r < reps; r++) {
+			encode_colors(buf, colors, sizes[i]);
+			__asm__ volatile("" : : "r"(buf) : "memory");
+		}
+		clock_gettime(CLOCK_MONOTONIC, &t1);
+		enc = seconds(&t0, &t1) / reps / sizes[i];
+
+		pins.writes = 0;
+		clock_gettime(CLOCK_MONOTONIC, &t0);
+		for (r = 0; r < reps / 10 + 1; r++)
+			bitbang_send_colors(colors, sizes[i]);
+		clock_gettime(CLOCK_MONOTONIC, &t1);
+		bb = seconds(&t0, &t1) / (reps / 10 + 1) / sizes[i];
+		writes = pins.writes / (reps / 10 + 1);
+
+		wire = FRAME_BYTES(sizes[i]) * 8.0 / spi_hz;
+		printf("%7d  %13.2f  %15.2f  %15.1f  %12.2f  %7.1f\n",
+		       sizes[i], enc * 1e9, bb * 1e9,
+		       (double)writes / sizes[i], wire * 1e3, 1 / wire);
+	}
+
+	for (r = 1; FRAME_BYTES(r + 1) * 8.0 / spi_hz <= 1 / 60.0; r++)
+		;
+	printf("SPI at %.2f MHz: up to %d LEDs at 60 fps\n", spi_hz / 1e6, r);
+}
+
+int main(void)
+{
+	check_lut();
+	check_golden();
+	check_setup();
+	check_stream();
+	if (!failures)
+		bench();
+
+	if (failures) {
+		printf("%d failures\n", failures);
+		return EXIT_FAILURE;
+	}
+	printf("all passed\n");
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,42 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Host stand-in, see led_stripe_test.c. */
+
+#ifndef HOST_NVIC_H
+#define HOST_NVIC_H
+
+#include <stdint.h>
+
+#define NVIC_DMA1_CHANNEL5_IRQ	15
+
+/* The priority, with bit 7 set once the interrupt is enabled */
+extern uint8_t sim_nvic[64];
+
+static inline void nvic_set_priority(uint8_t irq, uint8_t prio)
+{
+	sim_nvic[irq] = (sim_nvic[irq] & 0x80) | prio;
+}
+
+static inline void nvic_enable_irq(uint8_t irq)
+{
+	sim_nvic[irq] |= 0x80;
+}
+
+void dma1_channel5_isr(void);
+
+#endif
@@ -0,0 +1,70 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Host stand-in for the DMA parts led_stripe.c uses; the channel is
+ * simulated in led_stripe_test.c.
+ */
+
+#ifndef HOST_DMA_H
+#define HOST_DMA_H
+
+#include <stdint.h>
+
+#define DMA1			1
+#define DMA_CHANNEL5		5
+
+/* Four flags per channel, channel 1 in the lowest bits */
+#define DMA_FLAGS(ch, f)	((uint32_t)(f) << (((ch) - 1) * 4))
+#define DMA_GIF			1
+#define DMA_TCIF		2
+
+#define DMA_ISR_TCIF5		DMA_FLAGS(5, DMA_TCIF)
+#define DMA_IFCR_CTCIF5		DMA_ISR_TCIF5
+
+#define DMA_CCR_PSIZE_8BIT	(0 << 8)
+#define DMA_CCR_MSIZE_8BIT	(0 << 10)
+#define DMA_CCR_PL_HIGH		2
+
+struct sim_dma_channel {
+	int enabled, minc, from_memory, tcie;
+	uint32_t psize, msize, prio;
+	uint32_t cpar, cmar, cndtr;
+};
+
+extern struct sim_dma_channel sim_dma[8];
+extern volatile uint32_t sim_dma_isr, sim_dma_ifcr;
+
+#define DMA1_ISR		(sim_dma_isr)
+#define DMA1_IFCR		(sim_dma_ifcr)
+
+void dma_channel_reset(uint32_t dma, uint8_t channel);
+void dma_set_peripheral_address(uint32_t dma, uint8_t channel,
+				uint32_t address);
+void dma_set_memory_address(uint32_t dma, uint8_t channel, uint32_t address);
+void dma_set_number_of_data(uint32_t dma, uint8_t channel, uint16_t number);
+void dma_set_read_from_memory(uint32_t dma, uint8_t channel);
+void dma_enable_memory_increment_mode(uint32_t dma, uint8_t channel);
+void dma_set_peripheral_size(uint32_t dma, uint8_t channel,
+			     uint32_t peripheral_size);
+void dma_set_memory_size(uint32_t dma, uint8_t channel, uint32_t mem_size);
+void dma_set_priority(uint32_t dma, uint8_t channel, uint32_t prio);
+void dma_enable_transfer_complete_interrupt(uint32_t dma, uint8_t channel);
+void dma_enable_channel(uint32_t dma, uint8_t channel);
+void dma_disable_channel(uint32_t dma, uint8_t channel);
+
+#endif
@@ -0,0 +1,51 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Host stand-in, see led_stripe_test.c.  gpio_set() and gpio_clear() are
+ * only used by the bit-banged reference there.
+ */
+
+#ifndef HOST_GPIO_H
+#define HOST_GPIO_H
+
+#include <stdint.h>
+
+#define GPIOB				1
+#define GPIOC				2
+#define GPIO12				(1 << 12)
+#define GPIO13				(1 << 13)
+#define GPIO15				(1 << 15)
+#define GPIO_SPI2_SCK			GPIO13
+#define GPIO_SPI2_MOSI			GPIO15
+
+#define GPIO_MODE_OUTPUT_50_MHZ		3
+#define GPIO_CNF_OUTPUT_PUSHPULL	0
+#define GPIO_CNF_OUTPUT_ALTFN_PUSHPULL	2
+
+void gpio_set_mode(uint32_t gpioport, uint8_t mode, uint8_t cnf,
+		   uint16_t gpios);
+void gpio_set(uint32_t gpioport, uint16_t gpios);
+void gpio_clear(uint32_t gpioport, uint16_t gpios);
+
+static inline void gpio_toggle(uint32_t gpioport, uint16_t gpios)
+{
+	(void)gpioport;
+	(void)gpios;
+}
+
+#endif
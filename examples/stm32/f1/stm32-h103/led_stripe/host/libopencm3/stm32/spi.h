@@ -0,0 +1,89 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Host stand-in, see led_stripe_test.c. */
+
+#ifndef HOST_SPI_H
+#define HOST_SPI_H
+
+#include <stdint.h>
+
+#define SPI2				2
+
+extern volatile uint32_t sim_spi2_dr;
+
+#define SPI2_DR				(sim_spi2_dr)
+
+#define SPI_CR1_BAUDRATE_FPCLK_DIV_16	(3 << 3)
+#define SPI_CR1_CPOL_CLK_TO_0_WHEN_IDLE	0
+#define SPI_CR1_CPHA_CLK_TRANSITION_1	0
+#define SPI_CR1_DFF_8BIT		0
+#define SPI_CR1_MSBFIRST		0
+#define SPI_CR1_LSBFIRST		(1 << 7)
+
+struct sim_spi {
+	int master, enabled, tx_dma, ssm, ssi;
+	uint32_t br, cpol, cpha, dff, lsbfirst;
+};
+
+extern struct sim_spi sim_spi2;
+
+static inline void spi_reset(uint32_t spi)
+{
+	(void)spi;
+	sim_spi2 = (struct sim_spi){ 0 };
+}
+
+static inline int spi_init_master(uint32_t spi, uint32_t br, uint32_t cpol,
+				  uint32_t cpha, uint32_t dff,
+				  uint32_t lsbfirst)
+{
+	(void)spi;
+	sim_spi2.master = 1;
+	sim_spi2.br = br;
+	sim_spi2.cpol = cpol;
+	sim_spi2.cpha = cpha;
+	sim_spi2.dff = dff;
+	sim_spi2.lsbfirst = lsbfirst;
+	return 0;
+}
+
+static inline void spi_enable_software_slave_management(uint32_t spi)
+{
+	(void)spi;
+	sim_spi2.ssm = 1;
+}
+
+static inline void spi_set_nss_high(uint32_t spi)
+{
+	(void)spi;
+	sim_spi2.ssi = 1;
+}
+
+static inline void spi_enable_tx_dma(uint32_t spi)
+{
+	(void)spi;
+	sim_spi2.tx_dma = 1;
+}
+
+static inline void spi_enable(uint32_t spi)
+{
+	(void)spi;
+	sim_spi2.enabled = 1;
+}
+
+#endif
@@ -27,34 +27,32 @@
 #include <stdlib.h>
 #include <libopencm3/stm32/rcc.h>
 #include <libopencm3/stm32/gpio.h>
-
-#define SPI_BANK GPIOB
-#define SCLK_PIN GPIO13
-#define MOSI_PIN GPIO15
-
-#define SMALL_DELAY_VALUE 0
+#include <libopencm3/stm32/spi.h>
+#include <libopencm3/stm32/dma.h>
+#include <libopencm3/cm3/nvic.h>
 
 #define COLOR_COUNT 50
 
-#define SCLK(VAL)				\
-	if (VAL) {				\
-		gpio_set(SPI_BANK, SCLK_PIN);	\
-	} else {				\
-		gpio_clear(SPI_BANK, SCLK_PIN);	\
-	}
+/*
+ * The strip is driven by SPI2 (SCLK on PB13, MOSI on PB15) with DMA1
+ * channel 5 feeding the transmit register, so a frame goes out in the
+ * background while the next one is computed.
+ *
+ * A frame is 32 zero bits, then 16 bits per LED (a one, then 5 bits each
+ * of blue, red and green), then one zero bit per LED to clock the data
+ * through the strip, padded to whole bytes.
+ */
+#define FRAME_BYTES(n)	(4 + 2 * (n) + ((n) + 7) / 8)
 
-#define MOSI(VAL)				\
-	if (VAL) {				\
-		gpio_set(SPI_BANK, MOSI_PIN);	\
-	} else {				\
-		gpio_clear(SPI_BANK, MOSI_PIN);	\
-	}
+static uint8_t frame_buf[2][FRAME_BYTES(COLOR_COUNT)];
+static int frame_next;			/* buffer to encode into next */
+static volatile int frame_busy;		/* DMA is sending a frame */
 
-#define SMALL_DELAY() {				\
-		int j;				\
-		for (j = 0; j < SMALL_DELAY_VALUE; j++)	\
-			__asm__("nop");		\
-	}
+/*
+ * Color values are 5 bit, as the LPD6803 takes them.  They are passed
+ * through this table while encoding; see set_brightness().
+ */
+static uint8_t color_lut[32];
 
 struct color {
 	uint8_t r;
@@ -78,73 +76,118 @@ static void gpio_setup(void)
 	gpio_set_mode(GPIOC, GPIO_MODE_OUTPUT_50_MHZ,
 		      GPIO_CNF_OUTPUT_PUSHPULL, GPIO12);
 
-	/* Set GPIO13 (in GPIO port B) to 'output push-pull'. */
+	/* SCLK and MOSI are driven by SPI2. */
 	gpio_set_mode(GPIOB, GPIO_MODE_OUTPUT_50_MHZ,
-		      GPIO_CNF_OUTPUT_PUSHPULL, GPIO13);
+		      GPIO_CNF_OUTPUT_ALTFN_PUSHPULL,
+		      GPIO_SPI2_SCK | GPIO_SPI2_MOSI);
+}
 
-	/* Set GPIO15 (in GPIO port B) to 'output push-pull'. */
-	gpio_set_mode(GPIOB, GPIO_MODE_OUTPUT_50_MHZ,
-		      GPIO_CNF_OUTPUT_PUSHPULL, GPIO15);
+static void spi_setup(void)
+{
+	rcc_periph_clock_enable(RCC_SPI2);
+	rcc_periph_clock_enable(RCC_DMA1);
+
+	spi_reset(SPI2);
+
+	/*
+	 * Data is sampled on the rising edge of an idle low clock, MSB
+	 * first.  36MHz / 16 gives 2.25MHz, about 130k LEDs per second.
+	 */
+	spi_init_master(SPI2, SPI_CR1_BAUDRATE_FPCLK_DIV_16,
+			SPI_CR1_CPOL_CLK_TO_0_WHEN_IDLE,
+			SPI_CR1_CPHA_CLK_TRANSITION_1,
+			SPI_CR1_DFF_8BIT, SPI_CR1_MSBFIRST);
+	spi_enable_software_slave_management(SPI2);
+	spi_set_nss_high(SPI2);
+	spi_enable_tx_dma(SPI2);
+	spi_enable(SPI2);
+
+	nvic_set_priority(NVIC_DMA1_CHANNEL5_IRQ, 0);
+	nvic_enable_irq(NVIC_DMA1_CHANNEL5_IRQ);
 }
 
-static void send_colors(struct color *colors, int count)
+/*
+ * Build the color table for a brightness of 0 to 255, with a gamma of
+ * 2.2 so that steps look even to the eye.
+ */
+static void set_brightness(uint8_t brightness)
 {
-	int i, k;
+	static const uint8_t gamma[32] = {
+		0, 0, 0, 0, 0, 1, 1, 1, 2, 2, 3, 3, 4, 5, 5, 6,
+		7, 8, 9, 11, 12, 13, 15, 16, 18, 19, 21, 23, 25, 27, 29, 31,
+	};
+	int i;
 
-	/* Initialize SPI pins. */
-	SCLK(0);
-	MOSI(0);
+	for (i = 0; i < 32; i++)
+		color_lut[i] = (gamma[i] * brightness + 127) / 255;
+}
+
+static void encode_colors(uint8_t *buf, const struct color *colors, int count)
+{
+	uint16_t cell;
+	int k;
 
 	/* Start frame */
-	for (i = 0; i < 32; i++) {
-		SCLK(1);
-		SMALL_DELAY();
-		SCLK(0);
-		SMALL_DELAY();
-	}
+	*buf++ = 0;
+	*buf++ = 0;
+	*buf++ = 0;
+	*buf++ = 0;
 
-	/* Color cell output */
+	/* Color cells: start bit, blue, red, green */
 	for (k = 0; k < count; k++) {
-		/* Start bit */
-		MOSI(1);
-		SCLK(1);
-		SMALL_DELAY();
-		SCLK(0);
-		SMALL_DELAY();
-
-		/* Blue */
-		for (i = 0; i < 5; i++) {
-			MOSI(((colors[k].b & ((1 << 4) >> i)) != 0));
-			SCLK(1);
-			SMALL_DELAY();
-			SCLK(0);
-			SMALL_DELAY();
-		}
-		/* Red */
-		for (i = 0; i < 5; i++) {
-			MOSI(((colors[k].r & ((1 << 4) >> i)) != 0));
-			SCLK(1);
-			SMALL_DELAY();
-			SCLK(0);
-			SMALL_DELAY();
-		}
-		/* Green */
-		for (i = 0; i < 5; i++) {
-			MOSI(((colors[k].g & ((1 << 4) >> i)) != 0));
-			SCLK(1);
-			SMALL_DELAY();
-			SCLK(0);
-			SMALL_DELAY();
-		}
+		cell = 0x8000 |
+		       (color_lut[colors[k].b & 0x1F] << 10) |
+		       (color_lut[colors[k].r & 0x1F] << 5) |
+		       color_lut[colors[k].g & 0x1F];
+		*buf++ = cell >> 8;
+		*buf++ = cell;
 	}
 
 	/* End frame */
-	MOSI(0);
-	for (k = 0; k < count; k++) {
-		SCLK(1);
-		SMALL_DELAY();
-		SCLK(0);
-		SMALL_DELAY();
+	for (k = 0; k < count; k += 8)
+		*buf++ = 0;
+}
+
+static void send_frame(const uint8_t *buf, int len)
+{
+	frame_busy = 1;
+
+	dma_channel_reset(DMA1, DMA_CHANNEL5);
+	dma_set_peripheral_address(DMA1, DMA_CHANNEL5, (uint32_t)&SPI2_DR);
+	dma_set_memory_address(DMA1, DMA_CHANNEL5, (uint32_t)buf);
+	dma_set_number_of_data(DMA1, DMA_CHANNEL5, len);
+	dma_set_read_from_memory(DMA1, DMA_CHANNEL5);
+	dma_enable_memory_increment_mode(DMA1, DMA_CHANNEL5);
+	dma_set_peripheral_size(DMA1, DMA_CHANNEL5, DMA_CCR_PSIZE_8BIT);
+	dma_set_memory_size(DMA1, DMA_CHANNEL5, DMA_CCR_MSIZE_8BIT);
+	dma_set_priority(DMA1, DMA_CHANNEL5, DMA_CCR_PL_HIGH);
+	dma_enable_transfer_complete_interrupt(DMA1, DMA_CHANNEL5);
+	dma_enable_channel(DMA1, DMA_CHANNEL5);
+}
+
+/*
+ * Encode the colors into the idle frame buffer, wait for the previous
+ * frame to finish and start sending this one.  Returns right away; the
+ * colors may be changed as soon as it does.
+ */
+static void send_colors(struct color *colors, int count)
+{
+	uint8_t *buf = frame_buf[frame_next];
+
+	encode_colors(buf, colors, count);
+
+	while (frame_busy);
+
+	send_frame(buf, FRAME_BYTES(count));
+	frame_next ^= 1;
+}
+
+void dma1_channel5_isr(void)
+{
+	if (DMA1_ISR & DMA_ISR_TCIF5) {
+		DMA1_IFCR = DMA_IFCR_CTCIF5;
+		dma_disable_channel(DMA1, DMA_CHANNEL5);
+		frame_busy = 0;
 	}
 }
 
@@ -217,6 +260,8 @@ int main(void)
 
 	clock_setup();
 	gpio_setup();
+	spi_setup();
+	set_brightness(255);
 
 	reset_colors(colors, COLOR_COUNT);
 	init_colors(colors, COLOR_COUNT);
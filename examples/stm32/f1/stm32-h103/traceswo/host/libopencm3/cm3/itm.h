@@ -0,0 +1,40 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Host stand-in: every stimulus port access goes through itm_stim(), which
+ * turns the writes into ITM packets in the capture trace_test.c checks.
+ */
+
+#ifndef HOST_ITM_H
+#define HOST_ITM_H
+
+#include <stdint.h>
+
+#define ITM_STIM8(n)		(*(volatile uint8_t *)itm_stim((n), 1))
+#define ITM_STIM16(n)		(*(volatile uint16_t *)itm_stim((n), 2))
+#define ITM_STIM32(n)		(*(volatile uint32_t *)itm_stim((n), 4))
+#define ITM_STIM_FIFOREADY	(1 << 0)
+
+#define ITM_TCR_ITMENA		(1 << 0)
+
+extern volatile uint32_t ITM_TCR;
+extern volatile uint32_t ITM_TER[8];
+
+volatile void *itm_stim(unsigned port, unsigned size);
+
+#endif
@@ -0,0 +1,32 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Host stand-in: trace_test.c sets the cycle counter itself. */
+
+#ifndef HOST_SCS_H
+#define HOST_SCS_H
+
+#include <stdint.h>
+
+#define SCS_DEMCR_TRCENA		(1 << 24)
+#define SCS_DWT_CTRL_CYCCNTENA		(1 << 0)
+
+extern volatile uint32_t SCS_DEMCR;
+extern volatile uint32_t SCS_DWT_CTRL;
+extern volatile uint32_t SCS_DWT_CYCCNT;
+
+#endif
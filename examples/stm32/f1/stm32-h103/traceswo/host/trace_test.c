@@ -0,0 +1,326 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/*
+ * Host test for trace.c and swodecode.py: trace.c runs against stand-ins
+ * for the ITM and the DWT cycle counter and its stimulus port writes are
+ * stored as the ITM packets the TPIU would send.  The times between
+ * records go from a few cycles to almost a full turn of the 32 bit cycle
+ * counter, with timestamp and hardware source packets in between that the
+ * decoder has to skip.
+ *
+ * usage: trace_test capture.bin expected.txt
+ *
+ * expected.txt is the timeline and summary swodecode.py --hz 72000000
+ * must print for capture.bin.
+ */
+
+#define _DEFAULT_SOURCE		/* MAP_ANONYMOUS */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+
+#include <libopencm3/cm3/itm.h>
+#include <libopencm3/cm3/scs.h>
+
+#include "trace.h"
+
+#define HZ		72000000.0
+#define RECORDS		20000
+#define ITM_BASE	0xe0000000u	/* trace_init() unlocks the ITM here */
+
+volatile uint32_t ITM_TCR, ITM_TER[8];
+volatile uint32_t SCS_DEMCR, SCS_DWT_CTRL, SCS_DWT_CYCCNT;
+
+static FILE *capture, *expected;
+static int failures;
+
+#define CHECK(cond, ...) do {						\
+	if (!(cond)) {							\
+		if (failures++ < 10) {					\
+			printf("FAIL %s:%d: ", __FILE__, __LINE__);	\
+			printf(__VA_ARGS__);				\
+			printf("\n");					\
+		}							\
+	}								\
+} while (0)
+
+static uint32_t rng_state = 1;
+
+static uint32_t rnd(void)
+{
+	rng_state ^= rng_state << 13;
+	rng_state ^= rng_state >> 17;
+	rng_state ^= rng_state << 5;
+	return rng_state;
+}
+
+/* --- The ITM --- */
+
+/*
+ * trace.c waits for FIFOREADY before every write, so the accesses come in
+ * pairs: a read of the port, then the write.  The write is sent as a
+ * software source packet on the next access.
+ */
+static struct {
+	bool pending;
+	unsigned port, size;
+	uint32_t data;
+} stim;
+
+static uint32_t stim_ready = ITM_STIM_FIFOREADY;
+
+static void stim_flush(void)
+{
+	unsigned i;
+
+	if (!stim.pending)
+		return;
+	stim.pending = false;
+	putc(stim.port << 3 | (stim.size == 4 ? 3 : stim.size), capture);
+	for (i = 0; i < stim.size; i++)
+		putc(stim.data >> (8 * i), capture);
+}
+
+volatile void *itm_stim(unsigned port, unsigned size)
+{
+	static bool polled;
+	static unsigned poll_port, poll_size;
+
+	stim_flush();
+	if (!polled) {
+		polled = true;
+		poll_port = port;
+		poll_size = size;
+		return &stim_ready;
+	}
+	polled = false;
+	CHECK(port == poll_port && size == poll_size,
+	      "write to port %u size %u without waiting", port, size);
+	CHECK(ITM_TCR & ITM_TCR_ITMENA && ITM_TER[0] & 1 << port,
+	      "write to disabled port %u", port);
+	stim.pending = true;
+	stim.port = port;
+	stim.size = size;
+	stim.data = 0;
+	return &stim.data;
+}
+
+/* A local timestamp and a hardware source packet, to be skipped. */
+static void other_packets(void)
+{
+	static const uint8_t packets[] = { 0xc0, 0x85, 0x03, 0x0d, 0x12 };
+
+	stim_flush();
+	fwrite(packets, sizeof(packets), 1, capture);
+}
+
+static void sync_packet(void)
+{
+	static const uint8_t packet[] = { 0, 0, 0, 0, 0, 0x80 };
+
+	stim_flush();
+	fwrite(packet, sizeof(packet), 1, capture);
+}
+
+/* --- What swodecode.py has to make of it --- */
+
+static uint64_t now;		/* the full cycle count */
+static uint64_t stamped;	/* that of the last record */
+static bool open[TRACE_MAX_ID + 1];
+static uint64_t open_at[TRACE_MAX_ID + 1];
+
+static struct {
+	uint64_t count, min, max, total;
+} stats[TRACE_MAX_ID + 1];
+
+static void emit(const char *what, const char *detail)
+{
+	fprintf(expected, "%14.3f us  %-8s %s\n", stamped * 1e6 / HZ, what,
+		detail);
+}
+
+static void advance(uint64_t cycles)
+{
+	now += cycles;
+	SCS_DWT_CYCCNT = now;
+}
+
+static void event(unsigned type, unsigned id)
+{
+	static const char *const names[] = { "", "enter", "exit", "mark" };
+	char detail[40];
+	uint64_t cycles;
+
+	trace_event(type, id);
+	stamped = now;
+
+	snprintf(detail, sizeof(detail), "%u", id);
+	if (type == TRACE_ENTER) {
+		open[id] = true;
+		open_at[id] = now;
+	} else if (type == TRACE_EXIT && open[id]) {
+		open[id] = false;
+		cycles = now - open_at[id];
+		if (!stats[id].count || cycles < stats[id].min)
+			stats[id].min = cycles;
+		if (cycles > stats[id].max)
+			stats[id].max = cycles;
+		stats[id].count++;
+		stats[id].total += cycles;
+		snprintf(detail, sizeof(detail), "%u after %llu cycles", id,
+			 (unsigned long long)cycles);
+	}
+	emit(names[type], detail);
+}
+
+static void counter(unsigned id, uint32_t value)
+{
+	char detail[40];
+
+	trace_counter(id, value);
+	stamped = now;
+	snprintf(detail, sizeof(detail), "%u = %u", id, (unsigned)value);
+	emit("counter", detail);
+}
+
+static void puts_line(unsigned n)
+{
+	char line[40];
+
+	snprintf(line, sizeof(line), "line %u\r\n", n);
+	trace_puts(line);
+	snprintf(line, sizeof(line), "line %u", n);
+	emit("log", line);
+}
+
+static void summary(void)
+{
+	unsigned id;
+
+	fprintf(expected, "\n  id    count   min cyc   avg cyc   max cyc\n");
+	for (id = 0; id <= TRACE_MAX_ID; id++) {
+		if (!stats[id].count)
+			continue;
+		fprintf(expected, "%4u %8llu %9llu %9llu %9llu\n", id,
+			(unsigned long long)stats[id].count,
+			(unsigned long long)stats[id].min,
+			(unsigned long long)(stats[id].total / stats[id].count),
+			(unsigned long long)stats[id].max);
+	}
+}
+
+/*
+ * From a few cycles to a few seconds, now and then close to the longest
+ * gap trace.c can describe, 2^32 - 2^24 cycles.
+ */
+static uint64_t gap(void)
+{
+	switch (rnd() % 64) {
+	case 0:
+		return 0x80000000u + rnd() % 0x7f000000u;
+	case 1: case 2: case 3: case 4: case 5: case 6: case 7: case 8:
+		return rnd() % 400000000;
+	default:
+		return rnd() % 5000;
+	}
+}
+
+int main(int argc, char **argv)
+{
+	void *map;
+	unsigned i, id, inner;
+
+	if (argc != 3) {
+		printf("usage: %s capture.bin expected.txt\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+	capture = fopen(argv[1], "wb");
+	expected = fopen(argv[2], "w");
+	if (!capture || !expected) {
+		perror("fopen");
+		return EXIT_FAILURE;
+	}
+
+	/* trace_init() writes the ITM lock access register directly. */
+	map = mmap((void *)(uintptr_t)ITM_BASE, 4096, PROT_READ | PROT_WRITE,
+		   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (map != (void *)(uintptr_t)ITM_BASE) {
+		printf("can't map the ITM at 0x%08x\n", ITM_BASE);
+		return EXIT_FAILURE;
+	}
+
+	sync_packet();
+	trace_init();
+	CHECK(SCS_DEMCR & SCS_DEMCR_TRCENA &&
+	      SCS_DWT_CTRL & SCS_DWT_CTRL_CYCCNTENA, "cycle counter off");
+	advance(123456789);	/* SWO setup; trace_start() sends this */
+	trace_start();
+	stamped = now;
+
+	for (i = 0; i < RECORDS; i++) {
+		id = rnd() % 4;
+		advance(gap());
+		event(TRACE_ENTER, id);
+		if (rnd() % 4 == 0) {
+			inner = 4 + rnd() % 4;
+			advance(gap());
+			event(TRACE_ENTER, inner);
+			advance(gap());
+			event(TRACE_EXIT, inner);
+		}
+		advance(gap());
+		event(TRACE_EXIT, id);
+
+		switch (rnd() % 16) {
+		case 0:
+			counter(rnd() % 256, rnd() % 2 ? rnd() : 0xffffffff);
+			break;
+		case 1:
+			puts_line(i);
+			break;
+		case 2:
+			event(TRACE_MARK, TRACE_MAX_ID);
+			break;
+		case 3:
+			/* An exit without its enter has no length. */
+			event(TRACE_EXIT, 8 + rnd() % 8);
+			break;
+		case 4:
+			other_packets();
+			break;
+		case 5:
+			sync_packet();
+			break;
+		}
+	}
+	stim_flush();
+	summary();
+	fclose(capture);
+	fclose(expected);
+
+	printf("%u records over %.0f s, %llu turns of the cycle counter\n",
+	       RECORDS, now / HZ, (unsigned long long)(now >> 32));
+	if (failures) {
+		printf("%d failures\n", failures);
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,176 @@
+#! /usr/bin/env python3
+#
+# This file is part of the libopencm3 project.
+#
+# This library is free software: you can redistribute it and/or modify
+# it under the terms of the GNU Lesser General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This library is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU Lesser General Public License for more details.
+#
+# You should have received a copy of the GNU Lesser General Public License
+# along with this library.  If not, see <http://www.gnu.org/licenses/>.
+#
+
+# Turn a captured SWO byte stream from the traceswo example into a
+# timeline, followed by enter/exit statistics per event id.  The record
+# layout is described in trace.h.
+#
+# usage: swodecode.py [--hz 72000000] [--summary] capture.bin
+#
+# The capture is the raw ITM stream (TPIU formatter off), e.g. the output
+# of openocd "tpiu config ... output file" or a USB/UART SWO dongle.
+
+import sys
+
+PORT_LOG = 0
+PORT_EVENT = 1
+PORT_COUNTER = 2
+PORT_VALUE = 3
+PORT_SYNC = 4
+
+EVENT_NAMES = {1: "enter", 2: "exit", 3: "mark"}
+
+def itm_packets(data):
+	"""Yield (port, value, size) for each software stimulus packet and
+	(None, kind, 0) for overflow and sync packets; skip the others."""
+	i = 0
+	zeros = 0
+	while i < len(data):
+		b = data[i]
+		i += 1
+		if b == 0:
+			zeros += 1
+			continue
+		if zeros >= 5 and b == 0x80:
+			zeros = 0
+			yield None, "sync", 0
+			continue
+		zeros = 0
+		if b == 0x70:
+			yield None, "overflow", 0
+		elif b & 0x03:
+			size = (1, 2, 4)[(b & 0x03) - 1]
+			payload = data[i:i + size]
+			i += size
+			if len(payload) < size:
+				return
+			if not b & 0x04:	# software source
+				yield b >> 3, int.from_bytes(payload, "little"), size
+		else:
+			# Timestamp and extension packets: skip the continuation.
+			while b & 0x80 and i < len(data):
+				b = data[i]
+				i += 1
+
+class Timeline:
+	def __init__(self, hz, out):
+		self.hz = hz
+		self.out = out
+		self.now = 0		# extended cycle count
+		self.synced = False
+		self.text = b""
+		self.counter = None	# (id, time) waiting for its value
+		self.open = {}		# id -> enter time
+		self.stats = {}		# id -> [count, min, max, total]
+		self.lost = 0
+
+	def emit(self, what, detail=""):
+		if self.out:
+			self.out.write("%14.3f us  %-8s %s\n" %
+				       (self.now * 1e6 / self.hz, what, detail))
+
+	def sync(self, value):
+		low = self.now & 0xffffffff
+		base = self.now - low
+		if self.synced and value < low:
+			base += 1 << 32		# the 32 bit counter wrapped
+		self.now = base + value
+		self.synced = True
+
+	def stamp(self, t24):
+		self.now += (t24 - self.now) & 0xffffff
+
+	def packet(self, port, value, size):
+		if port is None:
+			if value == "overflow":
+				self.lost += 1
+				self.emit("overflow", "packets were lost")
+				self.open.clear()
+				self.counter = None
+			return
+
+		if port == PORT_SYNC:
+			self.sync(value)
+		elif port == PORT_LOG:
+			self.text += value.to_bytes(size, "little")
+			while b"\n" in self.text:
+				line, self.text = self.text.split(b"\n", 1)
+				self.emit("log", line.rstrip(b"\r").decode("latin-1"))
+		elif port == PORT_EVENT:
+			self.stamp(value & 0xffffff)
+			kind = value >> 30
+			ident = (value >> 24) & 0x3f
+			self.event(kind, ident)
+		elif port == PORT_COUNTER:
+			self.stamp(value & 0xffffff)
+			self.counter = value >> 24
+		elif port == PORT_VALUE and self.counter is not None:
+			self.emit("counter", "%d = %d" % (self.counter, value))
+			self.counter = None
+
+	def event(self, kind, ident):
+		name = EVENT_NAMES.get(kind, "event%d" % kind)
+		if kind == 1:
+			self.open[ident] = self.now
+			self.emit(name, "%d" % ident)
+		elif kind == 2 and ident in self.open:
+			cycles = self.now - self.open.pop(ident)
+			s = self.stats.setdefault(ident, [0, cycles, cycles, 0])
+			s[0] += 1
+			s[1] = min(s[1], cycles)
+			s[2] = max(s[2], cycles)
+			s[3] += cycles
+			self.emit(name, "%d after %d cycles" % (ident, cycles))
+		else:
+			self.emit(name, "%d" % ident)
+
+	def summary(self, out):
+		out.write("\n  id    count   min cyc   avg cyc   max cyc\n")
+		for ident in sorted(self.stats):
+			n, lo, hi, total = self.stats[ident]
+			out.write("%4d %8d %9d %9d %9d\n" %
+				  (ident, n, lo, total // n, hi))
+		if self.lost:
+			out.write("%d overflows\n" % self.lost)
+
+def main(argv):
+	hz = 72000000
+	summary_only = False
+	files = []
+	args = iter(argv[1:])
+	for a in args:
+		if a == "--hz":
+			hz = float(next(args))
+		elif a == "--summary":
+			summary_only = True
+		else:
+			files.append(a)
+	if len(files) != 1:
+		print("usage: %s [--hz 72000000] [--summary] capture.bin" %
+		      argv[0])
+		return 1
+
+	data = open(files[0], "rb").read()
+	timeline = Timeline(hz, None if summary_only else sys.stdout)
+	for packet in itm_packets(data):
+		timeline.packet(*packet)
+	timeline.summary(sys.stdout)
+	return 0
+
+if __name__ == "__main__":
+	sys.exit(main(sys.argv))
@@ -0,0 +1,122 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include <libopencm3/cm3/cortex.h>
+#include <libopencm3/cm3/scs.h>
+#include <libopencm3/cm3/itm.h>
+
+#include "trace.h"
+
+#define TRACE_PORTS		((1 << (TRACE_PORT_SYNC + 1)) - 1)
+
+static uint32_t last_time;
+
+static void stim32(unsigned port, uint32_t data)
+{
+	while (!(ITM_STIM32(port) & ITM_STIM_FIFOREADY))
+		;
+
+	ITM_STIM32(port) = data;
+}
+
+/* Call with interrupts masked, so records of one ISR don't split another. */
+static uint32_t timestamp(void)
+{
+	uint32_t now = SCS_DWT_CYCCNT;
+
+	if ((now ^ last_time) & 0xff000000)
+		stim32(TRACE_PORT_SYNC, now);
+	last_time = now;
+
+	return now & 0x00ffffff;
+}
+
+void trace_init(void)
+{
+	/* Enable trace subsystem (we'll use ITM, DWT and TPIU). */
+	SCS_DEMCR |= SCS_DEMCR_TRCENA;
+
+	/* Unlock access to ITM registers. */
+	/* FIXME: Magic numbers... Is this Cortex-M3 generic? */
+	*((volatile uint32_t *)0xE0000FB0) = 0xC5ACCE55;
+
+	/* Enable ITM with ID = 1. */
+	ITM_TCR = (1 << 16) | ITM_TCR_ITMENA;
+	/* Enable stimulus ports 0 to TRACE_PORT_SYNC. */
+	ITM_TER[0] = TRACE_PORTS;
+
+	SCS_DWT_CYCCNT = 0;
+	SCS_DWT_CTRL |= SCS_DWT_CTRL_CYCCNTENA;
+}
+
+void trace_start(void)
+{
+	uint32_t masked = cm_mask_interrupts(1);
+
+	/* Start the decoder off with the full time. */
+	last_time = SCS_DWT_CYCCNT;
+	stim32(TRACE_PORT_SYNC, last_time);
+
+	cm_mask_interrupts(masked);
+}
+
+void trace_puts(const char *s)
+{
+	size_t len = strlen(s);
+	uint32_t w;
+
+	/* Little endian, so the characters go out in order. */
+	for (; len >= 4; len -= 4, s += 4) {
+		memcpy(&w, s, 4);
+		stim32(TRACE_PORT_LOG, w);
+	}
+
+	if (len >= 2) {
+		while (!(ITM_STIM16(TRACE_PORT_LOG) & ITM_STIM_FIFOREADY))
+			;
+		ITM_STIM16(TRACE_PORT_LOG) = s[0] | s[1] << 8;
+		len -= 2;
+		s += 2;
+	}
+
+	if (len) {
+		while (!(ITM_STIM8(TRACE_PORT_LOG) & ITM_STIM_FIFOREADY))
+			;
+		ITM_STIM8(TRACE_PORT_LOG) = s[0];
+	}
+}
+
+void trace_event(unsigned type, unsigned id)
+{
+	uint32_t masked = cm_mask_interrupts(1);
+
+	stim32(TRACE_PORT_EVENT,
+	       type << 30 | (id & TRACE_MAX_ID) << 24 | timestamp());
+
+	cm_mask_interrupts(masked);
+}
+
+void trace_counter(unsigned id, uint32_t value)
+{
+	uint32_t masked = cm_mask_interrupts(1);
+
+	stim32(TRACE_PORT_COUNTER, (id & 0xff) << 24 | timestamp());
+	stim32(TRACE_PORT_VALUE, value);
+
+	cm_mask_interrupts(masked);
+}
@@ -0,0 +1,68 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+
+/*
+ * ITM trace channels, one stimulus port each.  swodecode.py turns the SWO
+ * byte stream back into a timeline.
+ *
+ * Event and counter records carry the low 24 bits of the DWT cycle
+ * counter.  Whenever the upper 8 bits have moved on since the last record,
+ * the full counter goes out on TRACE_PORT_SYNC first, so the decoder can
+ * rebuild the complete time as long as it doesn't lose packets and the
+ * records are less than 2^32 - 2^24 cycles (59 s at 72MHz) apart; after
+ * that the upper bits can be back where they were.
+ *
+ *   TRACE_PORT_LOG	text, packed four characters per write
+ *   TRACE_PORT_EVENT	type << 30 | id << 24 | time
+ *   TRACE_PORT_COUNTER	id << 24 | time, followed by
+ *   TRACE_PORT_VALUE	the 32 bit counter value
+ *   TRACE_PORT_SYNC	the full 32 bit cycle counter
+ */
+
+#define TRACE_PORT_LOG		0
+#define TRACE_PORT_EVENT	1
+#define TRACE_PORT_COUNTER	2
+#define TRACE_PORT_VALUE	3
+#define TRACE_PORT_SYNC		4
+
+#define TRACE_ENTER		1
+#define TRACE_EXIT		2
+#define TRACE_MARK		3
+
+#define TRACE_MAX_ID		63	/* event ids; counter ids go to 255 */
+
+/*
+ * Enable the ITM ports and the cycle counter; the TPIU is up to the caller.
+ * Call trace_start() once SWO is running, it sends the first full time.
+ */
+void trace_init(void);
+void trace_start(void);
+
+void trace_puts(const char *s);
+void trace_event(unsigned type, unsigned id);
+void trace_counter(unsigned id, uint32_t value);
+
+#define trace_enter(id)		trace_event(TRACE_ENTER, (id))
+#define trace_exit(id)		trace_event(TRACE_EXIT, (id))
+#define trace_mark(id)		trace_event(TRACE_MARK, (id))
+
+#endif /* !TRACE_H */
@@ -21,9 +21,16 @@
 #include <libopencm3/stm32/gpio.h>
 
 #include <libopencm3/stm32/dbgmcu.h>
-#include <libopencm3/cm3/scs.h>
 #include <libopencm3/cm3/tpiu.h>
-#include <libopencm3/cm3/itm.h>
+#include <libopencm3/cm3/systick.h>
+
+#include "trace.h"
+
+/* Event and counter ids used by this example. */
+#define ID_LOOP			0
+#define ID_SYSTICK		1
+
+static volatile uint32_t ticks;
 
 static void clock_setup(void)
 {
@@ -35,8 +42,11 @@ static void clock_setup(void)
 
 static void trace_setup(void)
 {
-	/* Enable trace subsystem (we'll use ITM and TPIU). */
-	SCS_DEMCR |= SCS_DEMCR_TRCENA;
+	/*
+	 * Enable the ITM stimulus ports and the DWT cycle counter.  This also
+	 * sets TRCENA, which the TPIU registers below need.
+	 */
+	trace_init();
 
 	/* Use Manchester code for asynchronous transmission. */
 	TPIU_SPPR = TPIU_SPPR_ASYNC_MANCHESTER;
@@ -48,14 +58,24 @@ static void trace_setup(void)
 	/* Enable TRACESWO pin for async mode. */
 	DBGMCU_CR = DBGMCU_CR_TRACE_IOEN | DBGMCU_CR_TRACE_MODE_ASYNC;
 
-	/* Unlock access to ITM registers. */
-	/* FIXME: Magic numbers... Is this Cortex-M3 generic? */
-	*((volatile uint32_t *)0xE0000FB0) = 0xC5ACCE55;
+	/* SWO is live now, give the decoder the full time. */
+	trace_start();
+}
 
-	/* Enable ITM with ID = 1. */
-	ITM_TCR = (1 << 16) | ITM_TCR_ITMENA;
-	/* Enable stimulus port 1. */
-	ITM_TER[0] = 1;
+static void systick_setup(void)
+{
+	/* 72MHz / 72000 = 1kHz, each tick shows up as an enter/exit pair. */
+	systick_set_clocksource(STK_CSR_CLKSOURCE_AHB);
+	systick_set_reload(71999);
+	systick_interrupt_enable();
+	systick_counter_enable();
+}
+
+void sys_tick_handler(void)
+{
+	trace_enter(ID_SYSTICK);
+	ticks++;
+	trace_exit(ID_SYSTICK);
 }
 
 static void gpio_setup(void)
@@ -65,33 +85,33 @@ static void gpio_setup(void)
 		      GPIO_CNF_OUTPUT_PUSHPULL, GPIO12);
 }
 
-static void trace_send_blocking(char c)
-{
-	while (!(ITM_STIM8(0) & ITM_STIM_FIFOREADY))
-		;
-
-	ITM_STIM8(0) = c;
-}
-
 int main(void)
 {
 	int i, j = 0, c = 0;
+	char digit[2] = "0";
+	uint32_t loops = 0;
 
 	clock_setup();
 	gpio_setup();
 	trace_setup();
+	systick_setup();
 
-	/* Blink the LED (PC12) on the board with every transmitted byte. */
+	/* Blink the LED (PC12) on the board with every transmitted digit. */
 	while (1) {
 		gpio_toggle(GPIOC, GPIO12);	/* LED on/off */
-		trace_send_blocking(c + '0');
+		digit[0] = c + '0';
+		trace_puts(digit);
 		c = (c == 9) ? 0 : c + 1;	/* Increment c. */
 		if ((j++ % 80) == 0) {		/* Newline after line full. */
-			trace_send_blocking('\r');
-			trace_send_blocking('\n');
+			trace_puts("\r\n");
+			trace_counter(ID_LOOP, loops);
 		}
+		loops++;
+
+		trace_enter(ID_LOOP);
 		for (i = 0; i < 800000; i++)	/* Wait a bit. */
 			__asm__("nop");
+		trace_exit(ID_LOOP);
 	}
 
 	return 0;
@@ -0,0 +1,365 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Host test for usbdfu.c: a DFU host downloads images into a simulated
+ * flash, mapped at FLASH_BASE, that follows the F1 rules (half-words
+ * programmed once from 0xffff, whole pages erased) and takes the
+ * datasheet's typical times.  Each control transfer costs 1 ms plus
+ * 1 us a byte, and the device runs its main loop in between.
+ *
+ * Downloads:
+ *  - DfuSe with an erase command per page, as dfu-util sends them,
+ *  - DfuSe without erase commands,
+ *  - plain DFU, blocks numbered from 0, with the image starting with
+ *    the byte of a DfuSe command and ending on an odd length,
+ *  - a second image over the first without a reset in between, after
+ *    an abort and after an address error cleared with DFU_CLRSTATUS.
+ *
+ * Every image must read back intact, with no page erased twice and no
+ * half-word programmed twice.
+ */
+
+#define _DEFAULT_SOURCE		/* MAP_ANONYMOUS */
+
+#include <setjmp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+
+/*
+ * usbdfu.c is built into the test.  Its main() becomes an unused static
+ * function, so the Cortex-M assembly in it is never compiled.
+ */
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wold-style-declaration"
+#pragma GCC diagnostic ignored "-Wstrict-prototypes"
+#pragma GCC diagnostic ignored "-Wreturn-type"
+#define main static __attribute__((unused)) usbdfu_main
+#include "usbdfu.c"
+#undef main
+#pragma GCC diagnostic pop
+
+#define FLASH_SIZE	(DFU_FLASH_PAGES * DFU_PAGE_SIZE)
+#define APP_SIZE	(FLASH_BASE + FLASH_SIZE - APP_ADDRESS)
+#define BLOCK_SIZE	(dfu_function.wTransferSize)
+
+#define CONTROL_US	1000	/* per control transfer, plus 1 us a byte */
+#define PROG_SIM_US	53
+#define ERASE_SIM_US	20000
+
+static int failures;
+
+#define CHECK(cond, ...) do {						\
+	if (!(cond)) {							\
+		if (failures++ < 10) {					\
+			printf("FAIL %s:%d: ", __FILE__, __LINE__);	\
+			printf(__VA_ARGS__);				\
+			printf("\n");					\
+		}							\
+	}								\
+} while (0)
+
+static uint32_t rng_state = 1;
+
+static uint32_t rnd(void)
+{
+	rng_state ^= rng_state << 13;
+	rng_state ^= rng_state >> 17;
+	rng_state ^= rng_state << 5;
+	return rng_state;
+}
+
+/* --- The device --- */
+
+static uint8_t *flash;
+static bool flash_unlocked;
+static long erases, erased_twice, program_errors;
+static uint8_t page_dirty[DFU_FLASH_PAGES];	/* erased, not written yet */
+static uint64_t now_us;
+static jmp_buf device_reset;
+
+void flash_unlock(void)
+{
+	flash_unlocked = true;
+}
+
+void flash_lock(void)
+{
+	flash_unlocked = false;
+}
+
+void flash_erase_page(uint32_t page_address)
+{
+	uint32_t page = (page_address - FLASH_BASE) / DFU_PAGE_SIZE;
+
+	CHECK(flash_unlocked, "erase while locked");
+	CHECK(page_address % DFU_PAGE_SIZE == 0 && page < DFU_FLASH_PAGES,
+	      "erase at 0x%08x", (unsigned)page_address);
+	if (page_dirty[page] == 1)
+		erased_twice++;
+	page_dirty[page] = 1;
+	memset(flash + page * DFU_PAGE_SIZE, 0xff, DFU_PAGE_SIZE);
+	erases++;
+	now_us += ERASE_SIM_US;
+}
+
+void flash_program_half_word(uint32_t address, uint16_t data)
+{
+	uint16_t *p = (uint16_t *)(flash + (address - FLASH_BASE));
+
+	CHECK(flash_unlocked, "program while locked");
+	CHECK(address % 2 == 0 && address - FLASH_BASE < FLASH_SIZE,
+	      "program at 0x%08x", (unsigned)address);
+	page_dirty[(address - FLASH_BASE) / DFU_PAGE_SIZE] = 2;
+	now_us += PROG_SIM_US;
+	if (*p != 0xffff) {
+		/* The F1 leaves the half-word alone and sets PGERR. */
+		program_errors++;
+		return;
+	}
+	*p = data;
+}
+
+void scb_reset_system(void)
+{
+	longjmp(device_reset, 1);
+}
+
+/* What a reset does to usbdfu.c: RAM starts over. */
+static void device_power_on(void)
+{
+	usbdfu_state = STATE_DFU_IDLE;
+	usbdfu_status = DFU_STATUS_OK;
+	blocks_head = blocks_count = 0;
+	dfuse = false;
+	prog_addr = APP_ADDRESS;
+	memset(erased_pages, 0, sizeof(erased_pages));
+}
+
+/* --- The host --- */
+
+static uint64_t host_ready;	/* when the host sends its next request */
+static uint8_t dfu_status[6];
+
+/* Returns false if the device stalls the request. */
+static bool request(uint8_t bRequest, uint16_t wValue, const void *data,
+		    uint16_t len)
+{
+	struct usb_setup_data req = {
+		.bmRequestType = bRequest == DFU_GETSTATUS ? 0xa1 : 0x21,
+		.bRequest = bRequest,
+		.wValue = wValue,
+		.wLength = len,
+	};
+	uint8_t *buf = usbd_control_buffer;
+	void (*complete)(usbd_device *, struct usb_setup_data *) = NULL;
+
+	/* The device's main loop, until the request comes in. */
+	while (now_us < host_ready && blocks_count)
+		usbdfu_flash_poll();
+	if (now_us < host_ready)
+		now_us = host_ready;
+
+	now_us += CONTROL_US + len;
+	if (data)
+		memcpy(buf, data, len);
+	if (usbdfu_control_request(NULL, &req, &buf, &len, &complete) !=
+	    USBD_REQ_HANDLED)
+		return false;
+	if (bRequest == DFU_GETSTATUS)
+		memcpy(dfu_status, buf, sizeof(dfu_status));
+	if (complete)
+		complete(NULL, &req);
+	host_ready = now_us;
+	return true;
+}
+
+/* DNLOAD, then GETSTATUS until the device takes more; returns bStatus. */
+static int dnload(uint16_t block, const void *data, uint16_t len)
+{
+	uint32_t timeout;
+
+	if (!request(DFU_DNLOAD, block, data, len))
+		return -1;
+	while (true) {
+		request(DFU_GETSTATUS, 0, NULL, 6);
+		timeout = dfu_status[1] | dfu_status[2] << 8 |
+			  dfu_status[3] << 16;
+		host_ready += timeout * 1000;
+		if (dfu_status[4] != STATE_DFU_DNBUSY &&
+		    dfu_status[4] != STATE_DFU_MANIFEST)
+			return dfu_status[0];
+	}
+}
+
+static int dfuse_command(uint8_t cmd, uint32_t addr)
+{
+	uint8_t buf[5] = { cmd, addr, addr >> 8, addr >> 16, addr >> 24 };
+
+	return dnload(0, buf, sizeof(buf));
+}
+
+/* The zero length DNLOAD; true if the device reset. */
+static bool manifest(void)
+{
+	if (setjmp(device_reset)) {
+		device_power_on();
+		return true;
+	}
+	dnload(0, NULL, 0);
+	return false;
+}
+
+/*
+ * Download `size' bytes of `image' to APP_ADDRESS, stopping after `stop'
+ * bytes if that is less.  DfuSe mode sets the address for every block,
+ * like dfu-util; `erase' adds an erase command for every page first.
+ */
+enum mode { PLAIN, DFUSE, DFUSE_ERASE };
+
+static bool download(enum mode mode, const uint8_t *image, uint32_t size,
+		     uint32_t stop)
+{
+	uint32_t off, addr, len;
+	uint16_t block = 0;
+
+	for (off = 0; off < size && off < stop; off += len) {
+		addr = APP_ADDRESS + off;
+		len = size - off < BLOCK_SIZE ? size - off : BLOCK_SIZE;
+		if (mode == PLAIN) {
+			if (dnload(block++, image + off, len) != DFU_STATUS_OK)
+				return false;
+			continue;
+		}
+		if (mode == DFUSE_ERASE && (addr - FLASH_BASE) % DFU_PAGE_SIZE == 0 &&
+		    dfuse_command(CMD_ERASE, addr) != DFU_STATUS_OK)
+			return false;
+		if (dfuse_command(CMD_SETADDR, addr) != DFU_STATUS_OK ||
+		    dnload(2, image + off, len) != DFU_STATUS_OK)
+			return false;
+	}
+	return true;
+}
+
+static void random_image(uint8_t *image, uint32_t size)
+{
+	uint32_t i;
+
+	for (i = 0; i < size; i++)
+		image[i] = rnd();
+}
+
+static bool image_in_flash(const uint8_t *image, uint32_t size)
+{
+	return !memcmp(flash + (APP_ADDRESS - FLASH_BASE), image, size);
+}
+
+static void run(const char *name, enum mode mode, uint32_t size)
+{
+	static uint8_t image[APP_SIZE];
+	uint64_t start = now_us;
+
+	random_image(image, size);
+	if (mode == PLAIN)
+		image[0] = CMD_ERASE;	/* must not pass for a command */
+	erases = erased_twice = program_errors = 0;
+	memset(page_dirty, 0, sizeof(page_dirty));
+
+	CHECK(download(mode, image, size, size), "%s: download failed", name);
+	CHECK(manifest(), "%s: no reset", name);
+	CHECK(image_in_flash(image, size), "%s: image wrong", name);
+	CHECK(erases == (long)((size + DFU_PAGE_SIZE - 1) / DFU_PAGE_SIZE) &&
+	      !erased_twice && !program_errors,
+	      "%s: %ld erases, %ld twice, %ld program errors", name, erases,
+	      erased_twice, program_errors);
+
+	printf("%-16s %u KB in %.2f s, %.1f KB/s\n", name,
+	       (unsigned)(size / 1024), (now_us - start) / 1e6,
+	       size / 1.024 / (now_us - start) * 1000);
+}
+
+/* A second download without a reset in between, over the first image. */
+static void run_again(const char *name, enum mode first, enum mode second,
+		      int how)
+{
+	static uint8_t a[APP_SIZE], b[APP_SIZE];
+	uint32_t size = 16 * 1024;
+	uint8_t cmd[5] = { CMD_SETADDR, 0, 0, 0, 0x20 };	/* RAM */
+
+	random_image(a, size);
+	random_image(b, size);
+	memset(page_dirty, 0, sizeof(page_dirty));
+	program_errors = 0;
+
+	switch (how) {
+	case 0:
+		/* Finished, no manifest: dfu-util aborts to idle first. */
+		CHECK(download(first, a, size, size), "%s: first", name);
+		break;
+	case 1:
+		/* Aborted half way. */
+		download(first, a, size, size / 2);
+		break;
+	default:
+		/* A block outside the flash. */
+		CHECK(download(first, a, size, size), "%s: first", name);
+		CHECK(request(DFU_ABORT, 0, NULL, 0), "abort");
+		CHECK(dnload(0, cmd, sizeof(cmd)) == DFU_STATUS_OK &&
+		      dnload(2, a, BLOCK_SIZE) == DFU_STATUS_ERR_ADDRESS,
+		      "%s: no address error", name);
+		CHECK(request(DFU_CLRSTATUS, 0, NULL, 0), "clrstatus");
+		break;
+	}
+	CHECK(request(DFU_ABORT, 0, NULL, 0), "abort");
+	CHECK(download(second, b, size, size), "%s: second", name);
+	CHECK(manifest(), "%s: no reset", name);
+	CHECK(image_in_flash(b, size) && !program_errors,
+	      "%s: image wrong, %ld program errors", name, program_errors);
+	printf("%-16s ok\n", name);
+}
+
+int main(void)
+{
+	void *map;
+
+	/* usbdfu.c reads the flash back at its real address. */
+	map = mmap((void *)(uintptr_t)FLASH_BASE, FLASH_SIZE,
+		   PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (map != (void *)(uintptr_t)FLASH_BASE) {
+		printf("can't map the flash at 0x%08x\n", FLASH_BASE);
+		return EXIT_FAILURE;
+	}
+	flash = map;
+	memset(flash, 0x5a, FLASH_SIZE);
+	device_power_on();
+
+	run("DfuSe + erase", DFUSE_ERASE, APP_SIZE);
+	run("DfuSe", DFUSE, APP_SIZE);
+	run("plain DFU", PLAIN, APP_SIZE - 3);
+	run_again("again, DfuSe", DFUSE_ERASE, DFUSE, 0);
+	run_again("again, plain", PLAIN, PLAIN, 0);
+	run_again("after abort", DFUSE, PLAIN, 1);
+	run_again("after error", PLAIN, DFUSE, 2);
+
+	if (failures) {
+		printf("%d failures\n", failures);
+		return EXIT_FAILURE;
+	}
+	printf("all passed\n");
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,558 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Host test for usbiap.c: the DFU host of usbiap_flash.py, request for
+ * request, updates the application in a simulated flash mapped at
+ * FLASH_BASE.  The flash follows the F1 rules (half-words programmed once
+ * from 0xffff, whole pages erased) and takes the datasheet's typical
+ * times; the CRC unit takes 4 AHB cycles a word.  Each control transfer
+ * costs 1 ms plus 1 us a byte, and the host waits the bwPollTimeout the
+ * device asks for.
+ *
+ * Updates of a 100 KB image, written in full, unchanged, with three pages
+ * patched and with bytes inserted half way, report the pages written, the
+ * bytes on the bus and the time taken.  After each, the image has to be
+ * in flash and image_valid() has to let it boot.  It must not after a
+ * power cut half way through an update, a commit with the wrong CRC or
+ * length or one whose record can't be programmed, a flipped bit in the
+ * application or the record, or a record for an empty image or one past
+ * the end of the application, and the next delta update has to rewrite
+ * just what is needed.
+ *
+ * The CRC is checked against a bit at a time version here, and against
+ * fixed vectors that usbiap_flash_test.py checks the host tool with.
+ * "make" builds and runs the test with the CRC unit and with the software
+ * CRC.
+ */
+
+#define _DEFAULT_SOURCE		/* MAP_ANONYMOUS */
+
+#include <setjmp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+
+/*
+ * usbiap.c is built into the test.  Its main() becomes an unused static
+ * function, so the Cortex-M assembly in it is never compiled.
+ */
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wold-style-declaration"
+#pragma GCC diagnostic ignored "-Wstrict-prototypes"
+#pragma GCC diagnostic ignored "-Wreturn-type"
+#define main static __attribute__((unused)) usbiap_main
+#include "usbiap.c"
+#undef main
+#pragma GCC diagnostic pop
+
+#define FLASH_PAGES	128
+#define FLASH_SIZE	(FLASH_PAGES * PAGE_SIZE)
+#define APP_SIZE	(APP_PAGES * PAGE_SIZE)
+#define IMAGE_SIZE	(100 * 1024)
+
+#define CONTROL_NS	1000000	/* per control transfer, plus 1 us a byte */
+#define BYTE_NS		1000
+#define PROG_SIM_NS	53000
+#define ERASE_SIM_NS	20000000
+#define CRC_WORD_NS	56	/* 4 cycles at 72MHz */
+
+static int failures;
+
+#define CHECK(cond, ...) do {						\
+	if (!(cond)) {							\
+		if (failures++ < 10) {					\
+			printf("FAIL %s:%d: ", __FILE__, __LINE__);	\
+			printf(__VA_ARGS__);				\
+			printf("\n");					\
+		}							\
+	}								\
+} while (0)
+
+static uint32_t rng_state = 1;
+
+static uint32_t rnd(void)
+{
+	rng_state ^= rng_state << 13;
+	rng_state ^= rng_state >> 17;
+	rng_state ^= rng_state << 5;
+	return rng_state;
+}
+
+/* CRC-32/MPEG-2 a bit at a time, over little endian words. */
+static uint32_t crc_ref(uint32_t crc, const uint8_t *data, uint32_t len)
+{
+	uint32_t i;
+	int bit;
+
+	for (i = 0; i < len; i++) {
+		crc ^= (uint32_t)data[i ^ 3] << 24;
+		for (bit = 0; bit < 8; bit++)
+			crc = crc & 0x80000000 ? crc << 1 ^ 0x04C11DB7 :
+			      crc << 1;
+	}
+	return crc;
+}
+
+/* --- The device --- */
+
+static uint8_t *flash;
+static bool flash_unlocked;
+static long erases, program_errors;
+static uint32_t bad_page = ~0u;		/* page that takes no programming */
+static uint64_t now_ns;
+static jmp_buf device_reset;
+
+void flash_unlock(void)
+{
+	flash_unlocked = true;
+}
+
+void flash_lock(void)
+{
+	flash_unlocked = false;
+}
+
+void flash_erase_page(uint32_t page_address)
+{
+	uint32_t page = (page_address - FLASH_BASE) / PAGE_SIZE;
+
+	CHECK(flash_unlocked, "erase while locked");
+	CHECK(page_address % PAGE_SIZE == 0 && page < FLASH_PAGES,
+	      "erase at 0x%08x", (unsigned)page_address);
+	memset(flash + page * PAGE_SIZE, 0xff, PAGE_SIZE);
+	erases++;
+	now_ns += ERASE_SIM_NS;
+}
+
+void flash_program_half_word(uint32_t address, uint16_t data)
+{
+	uint16_t *p = (uint16_t *)(flash + (address - FLASH_BASE));
+
+	CHECK(flash_unlocked, "program while locked");
+	CHECK(address % 2 == 0 && address - FLASH_BASE < FLASH_SIZE,
+	      "program at 0x%08x", (unsigned)address);
+	now_ns += PROG_SIM_NS;
+	if ((address - FLASH_BASE) / PAGE_SIZE == bad_page)
+		return;
+	if (*p != 0xffff) {
+		/* The F1 leaves the half-word alone and sets PGERR. */
+		program_errors++;
+		return;
+	}
+	*p = data;
+}
+
+static uint32_t crc_unit;
+
+void crc_reset(void)
+{
+	crc_unit = 0xFFFFFFFF;
+}
+
+uint32_t crc_calculate(uint32_t data)
+{
+	crc_unit = crc_ref(crc_unit, (const uint8_t *)&data, 4);
+	now_ns += CRC_WORD_NS;
+	return crc_unit;
+}
+
+uint32_t crc_calculate_block(uint32_t *datap, int size)
+{
+	int i;
+
+	for (i = 0; i < size; i++)
+		crc_calculate(datap[i]);
+	return crc_unit;
+}
+
+void scb_reset_system(void)
+{
+	longjmp(device_reset, 1);
+}
+
+/* What a reset does to usbiap.c: RAM starts over. */
+static void device_power_on(void)
+{
+	usbdfu_state = STATE_DFU_IDLE;
+	usbdfu_status = DFU_STATUS_OK;
+	memset(&prog, 0, sizeof(prog));
+}
+
+/* --- The host, as usbiap_flash.py --- */
+
+static uint64_t host_ready;	/* when the host sends its next request */
+static uint32_t bus_bytes;	/* setup packets and data */
+static uint8_t dfu_status[6];
+
+/* Returns false if the device stalls the request. */
+static bool request(uint8_t bRequest, uint16_t wValue, void *data,
+		    uint16_t len)
+{
+	bool in = bRequest == DFU_GETSTATUS || bRequest == DFU_UPLOAD;
+	struct usb_setup_data req = {
+		.bmRequestType = in ? 0xa1 : 0x21,
+		.bRequest = bRequest,
+		.wValue = wValue,
+		.wLength = len,
+	};
+	uint8_t *buf = usbd_control_buffer;
+	void (*complete)(usbd_device *, struct usb_setup_data *) = NULL;
+
+	if (now_ns < host_ready)
+		now_ns = host_ready;
+
+	if (data && !in)
+		memcpy(buf, data, len);
+	if (usbdfu_control_request(NULL, &req, &buf, &len, &complete) !=
+	    USBD_REQ_HANDLED)
+		return false;
+	now_ns += CONTROL_NS + (uint64_t)len * BYTE_NS;
+	bus_bytes += 8 + len;
+	if (bRequest == DFU_GETSTATUS)
+		memcpy(dfu_status, buf, sizeof(dfu_status));
+	else if (in)
+		memcpy(data, buf, len);
+	if (complete)
+		complete(NULL, &req);
+	host_ready = now_ns;
+	return true;
+}
+
+/* DNLOAD, then GETSTATUS until the device takes more; returns bStatus. */
+static int dnload(uint16_t block, const void *data, uint16_t len)
+{
+	uint32_t timeout;
+
+	if (!request(DFU_DNLOAD, block, (void *)data, len))
+		return -1;
+	while (true) {
+		request(DFU_GETSTATUS, 0, NULL, 6);
+		timeout = dfu_status[1] | dfu_status[2] << 8 |
+			  dfu_status[3] << 16;
+		host_ready += (uint64_t)timeout * 1000000;
+		if (dfu_status[4] == STATE_DFU_ERROR)
+			request(DFU_CLRSTATUS, 0, NULL, 0);
+		if (dfu_status[4] != STATE_DFU_DNBUSY)
+			return dfu_status[0];
+	}
+}
+
+static int command(uint8_t cmd, uint32_t arg0, uint32_t arg1, int args)
+{
+	uint8_t buf[9] = { cmd, arg0, arg0 >> 8, arg0 >> 16, arg0 >> 24,
+			   arg1, arg1 >> 8, arg1 >> 16, arg1 >> 24 };
+
+	return dnload(0, buf, 1 + 4 * args);
+}
+
+static int page_crcs(uint32_t *crcs)
+{
+	uint8_t buf[APP_PAGES * 4];
+	uint16_t len = sizeof(buf);
+	struct usb_setup_data req = {
+		.bmRequestType = 0xa1,
+		.bRequest = DFU_UPLOAD,
+		.wLength = len,
+	};
+	uint8_t *p = usbd_control_buffer;
+	void (*complete)(usbd_device *, struct usb_setup_data *) = NULL;
+
+	CHECK(request(DFU_ABORT, 0, NULL, 0), "abort");
+	if (now_ns < host_ready)
+		now_ns = host_ready;
+	if (usbdfu_control_request(NULL, &req, &p, &len, &complete) !=
+	    USBD_REQ_HANDLED)
+		return -1;
+	now_ns += CONTROL_NS + (uint64_t)len * BYTE_NS;
+	bus_bytes += 8 + len;
+	host_ready = now_ns;
+	memcpy(buf, p, len);
+	memcpy(crcs, buf, len);
+	return len / 4;
+}
+
+static bool write_page(uint32_t index, const uint8_t *data)
+{
+	uint32_t addr = APP_ADDRESS + index * PAGE_SIZE;
+
+	return command(CMD_ERASE, addr, 0, 1) == DFU_STATUS_OK &&
+	       command(CMD_SETADDR, addr, 0, 1) == DFU_STATUS_OK &&
+	       dnload(2, data, PAGE_SIZE) == DFU_STATUS_OK;
+}
+
+/* The zero length DNLOAD; true if the device reset. */
+static bool manifest(void)
+{
+	if (setjmp(device_reset)) {
+		device_power_on();
+		return true;
+	}
+	dnload(0, NULL, 0);
+	return false;
+}
+
+struct update {
+	int pages;		/* pages written */
+	int commit;		/* bStatus of CMD_COMMIT */
+	uint32_t bytes;		/* on the bus */
+	uint64_t ns;
+};
+
+/*
+ * usbiap_flash.py: write the pages whose CRC differs (all with `full'),
+ * stopping after `stop' pages, then commit `length' bytes with `crc' and
+ * manifest.
+ */
+static struct update update(const uint8_t *image, uint32_t size, bool full,
+			    int stop, uint32_t length, uint32_t crc)
+{
+	static uint8_t padded[APP_SIZE];
+	uint32_t crcs[APP_PAGES];
+	struct update u = { 0, -1, 0, 0 };
+	uint32_t pages = (size + PAGE_SIZE - 1) / PAGE_SIZE, i;
+	uint64_t start = now_ns;
+
+	memset(padded, 0xff, sizeof(padded));
+	memcpy(padded, image, size);
+	bus_bytes = 0;
+
+	if (!full)
+		CHECK(page_crcs(crcs) == APP_PAGES, "page CRCs not read");
+	for (i = 0; i < pages && u.pages < stop; i++) {
+		if (!full && crc_ref(0xFFFFFFFF, padded + i * PAGE_SIZE,
+				     PAGE_SIZE) == crcs[i])
+			continue;
+		CHECK(write_page(i, padded + i * PAGE_SIZE),
+		      "page %u not written", (unsigned)i);
+		u.pages++;
+	}
+	if (u.pages < stop) {
+		u.commit = command(CMD_COMMIT, length, crc, 2);
+		if (u.commit == DFU_STATUS_OK)
+			CHECK(manifest(), "no reset after the manifest");
+	}
+
+	u.bytes = bus_bytes;
+	u.ns = now_ns - start;
+	return u;
+}
+
+/* Update to the image the right way, checking the result. */
+static struct update install(const char *name, const uint8_t *image,
+			     uint32_t size, bool full)
+{
+	uint32_t length = (size + 3) & ~3u;
+	uint8_t padded[4] = { 0xff, 0xff, 0xff, 0xff };
+	struct update u;
+	uint32_t crc;
+
+	/* The tail is padded with 0xff, as the pages are. */
+	crc = crc_ref(0xFFFFFFFF, image, size & ~3u);
+	memcpy(padded, image + (size & ~3u), size & 3);
+	if (size & 3)
+		crc = crc_ref(crc, padded, 4);
+
+	erases = program_errors = 0;
+	u = update(image, size, full, APP_PAGES + 1, length, crc);
+	CHECK(u.commit == DFU_STATUS_OK, "%s: commit status %d", name,
+	      u.commit);
+	CHECK(!memcmp(flash + (APP_ADDRESS - FLASH_BASE), image, size),
+	      "%s: image wrong", name);
+	CHECK(image_valid(), "%s: image would not boot", name);
+	CHECK(!program_errors && erases == u.pages + 1,
+	      "%s: %ld erases for %d pages, %ld program errors", name,
+	      erases, u.pages, program_errors);
+
+	printf("%-26s %5d %9.1f %9.2f\n", name, u.pages, u.bytes / 1024.0,
+	       u.ns / 1e9);
+	return u;
+}
+
+/* A record put in flash directly. */
+static void write_record(uint32_t magic, uint32_t length, uint32_t crc)
+{
+	struct image_info info = { magic, length, crc };
+
+	memcpy(flash + (INFO_ADDRESS - FLASH_BASE), &info, sizeof(info));
+}
+
+static void random_bytes(uint8_t *p, uint32_t size)
+{
+	uint32_t i;
+
+	for (i = 0; i < size; i++)
+		p[i] = rnd();
+}
+
+/* --- Checks --- */
+
+static void check_crc(void)
+{
+	/* The same vectors are in usbiap_flash_test.py. */
+	static const uint8_t zero[4];
+	uint8_t ramp[PAGE_SIZE], buf[PAGE_SIZE];
+	uint32_t words[PAGE_SIZE / 4], n;
+	int run;
+
+	CHECK(crc32_words((const uint32_t *)zero, 1) == 0xC704DD7B,
+	      "CRC of a zero word is %08x", crc32_words((const uint32_t *)zero,
+							  1));
+	for (n = 0; n < PAGE_SIZE; n++)
+		ramp[n] = n * 7;
+	memcpy(words, ramp, PAGE_SIZE);
+	CHECK(crc32_words(words, PAGE_SIZE / 4) == 0x394EEDD1,
+	      "CRC of the ramp page is %08x",
+	      crc32_words(words, PAGE_SIZE / 4));
+	CHECK(crc32_words(words, 0) == 0xFFFFFFFF, "CRC of nothing");
+
+	for (run = 0; run < 1000; run++) {
+		n = rnd() % (PAGE_SIZE / 4 + 1);
+		random_bytes(buf, n * 4);
+		memcpy(words, buf, n * 4);
+		CHECK(crc32_words(words, n) == crc_ref(0xFFFFFFFF, buf, n * 4),
+		      "CRC of %u words", (unsigned)n);
+	}
+}
+
+static void check_updates(void)
+{
+	static uint8_t image[APP_SIZE], next[APP_SIZE];
+	struct update u;
+	uint32_t size = IMAGE_SIZE;
+	uint8_t word[4] = { 0, 0, 0, 0x20 };
+	int i, changed;
+
+	printf("update                     pages  KB on bus  seconds\n");
+
+	/* Whatever an old bootloader left. */
+	random_bytes(flash, FLASH_SIZE);
+	CHECK(!image_valid(), "random flash would boot");
+
+	random_bytes(image, size);
+	memcpy(image, word, 4);			/* initial stack pointer */
+	install("100 KB, all pages", image, size, true);
+	u = install("100 KB, delta, unchanged", image, size, false);
+	CHECK(u.pages == 0, "%d pages rewritten", u.pages);
+
+	for (i = 0; i < 3; i++)
+		image[(20 + i * 30) * PAGE_SIZE + rnd() % PAGE_SIZE] ^= 1;
+	u = install("100 KB, delta, 3 pages", image, size, false);
+	CHECK(u.pages == 3, "%d pages written for 3", u.pages);
+
+	memmove(image + size / 2 + 100, image + size / 2, size / 2 - 100);
+	random_bytes(image + size / 2, 100);
+	u = install("100 KB, delta, insertion", image, size, false);
+	CHECK(u.pages == 50, "%d pages written for 50", u.pages);
+
+	size = APP_SIZE - 2;
+	random_bytes(image + IMAGE_SIZE, size - IMAGE_SIZE);
+	u = install("119 KB, delta, grown", image, size, false);
+	CHECK(u.pages == 19, "%d pages written for 19", u.pages);
+
+	/* Power cut half way through a new image, then resumed. */
+	memcpy(next, image, size);
+	for (i = 0; i < 40; i++)
+		next[i * 3 * PAGE_SIZE + 1] ^= 0x80;
+	changed = 40;
+	u = update(next, size, false, changed / 2, 0, 0);
+	device_power_on();
+	CHECK(!image_valid(), "half written image would boot");
+	u = install("power cut, resumed", next, size, false);
+	CHECK(u.pages == changed - changed / 2, "%d pages written for %d",
+	      u.pages, changed - changed / 2);
+	memcpy(image, next, size);
+
+	/* Wrong CRC, then the right one. */
+	next[5 * PAGE_SIZE] ^= 1;
+	u = update(next, size, false, APP_PAGES + 1, (size + 3) & ~3u,
+		   0x12345678);
+	CHECK(u.commit == DFU_STATUS_ERR_VERIFY && !image_valid(),
+	      "wrong CRC: status %d", u.commit);
+	u = install("after a wrong CRC", next, size, false);
+	CHECK(u.pages == 0, "%d pages rewritten", u.pages);
+
+	/* Lengths it can't take. */
+	CHECK(command(CMD_COMMIT, 0, 0, 2) == DFU_STATUS_ERR_ADDRESS &&
+	      command(CMD_COMMIT, 6, 0, 2) == DFU_STATUS_ERR_ADDRESS &&
+	      command(CMD_COMMIT, APP_SIZE + 4, 0, 2) ==
+	      DFU_STATUS_ERR_ADDRESS, "bad lengths not refused");
+	CHECK(image_valid(), "refused commit broke the image");
+
+	/* Page CRCs only in dfuIDLE. */
+	CHECK(command(CMD_SETADDR, APP_ADDRESS, 0, 1) == DFU_STATUS_OK,
+	      "setaddr");
+	CHECK(!request(DFU_UPLOAD, 0, next, APP_PAGES * 4),
+	      "upload taken in dfuDNLOAD-IDLE");
+	CHECK(request(DFU_ABORT, 0, NULL, 0), "abort");
+
+	/* A flipped bit in the application, then in the record. */
+	flash[APP_ADDRESS - FLASH_BASE + 77 * PAGE_SIZE + 5] ^= 4;
+	CHECK(!image_valid(), "flipped bit would boot");
+	u = install("flipped bit repaired", next, size, false);
+	CHECK(u.pages == 1, "%d pages written for 1", u.pages);
+	flash[INFO_ADDRESS - FLASH_BASE + 8] ^= 1;
+	CHECK(!image_valid(), "bad record would boot");
+	flash[INFO_ADDRESS - FLASH_BASE + 8] ^= 1;
+	CHECK(image_valid(), "record put back");
+
+	/* Records with the right CRC for what they say. */
+	write_record(IMAGE_MAGIC ^ 1, size & ~3u,
+		     crc_ref(0xFFFFFFFF, next, size & ~3u));
+	CHECK(!image_valid(), "record with the wrong magic would boot");
+	write_record(IMAGE_MAGIC, 0, 0xFFFFFFFF);
+	CHECK(!image_valid(), "empty image would boot");
+	write_record(IMAGE_MAGIC, FLASH_SIZE, crc_ref(0xFFFFFFFF,
+		     flash + (APP_ADDRESS - FLASH_BASE),
+		     FLASH_BASE + FLASH_SIZE - APP_ADDRESS));
+	CHECK(!image_valid(), "record past the application would boot");
+
+	/* The record doesn't take, so the commit has to fail. */
+	bad_page = (INFO_ADDRESS - FLASH_BASE) / PAGE_SIZE;
+	u = update(next, size, false, APP_PAGES + 1, (size + 3) & ~3u,
+		   crc_ref(0xFFFFFFFF, flash + (APP_ADDRESS - FLASH_BASE),
+			   (size + 3) & ~3u));
+	CHECK(u.commit == DFU_STATUS_ERR_PROG && !image_valid(),
+	      "record not written: status %d", u.commit);
+	bad_page = ~0u;
+}
+
+int main(void)
+{
+	void *map;
+
+	/* usbiap.c reads the flash at its real address. */
+	map = mmap((void *)(uintptr_t)FLASH_BASE, FLASH_SIZE,
+		   PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (map != (void *)(uintptr_t)FLASH_BASE) {
+		printf("can't map the flash at 0x%08x\n", FLASH_BASE);
+		return EXIT_FAILURE;
+	}
+	flash = map;
+	device_power_on();
+
+	printf("CRC %s\n", USE_CRC_UNIT ? "unit" : "in software");
+	check_crc();
+	check_updates();
+
+	if (failures) {
+		printf("%d failures\n", failures);
+		return EXIT_FAILURE;
+	}
+	printf("all passed\n");
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,41 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Host stand-in, see rcc.h. */
+
+#ifndef HOST_GPIO_H
+#define HOST_GPIO_H
+
+#include <stdint.h>
+
+#define GPIOA			0
+#define GPIO10			(1 << 10)
+#define GPIO15			(1 << 15)
+
+#define GPIO_MODE_INPUT		0
+#define GPIO_MODE_OUTPUT_2_MHZ	2
+#define GPIO_CNF_OUTPUT_PUSHPULL	0
+
+extern volatile uint32_t AFIO_MAPR;
+#define AFIO_MAPR_SWJ_CFG_JTAG_OFF_SW_ON	(2 << 24)
+
+uint16_t gpio_get(uint32_t gpioport, uint16_t gpios);
+void gpio_set(uint32_t gpioport, uint16_t gpios);
+void gpio_set_mode(uint32_t gpioport, uint8_t mode, uint8_t cnf,
+		   uint16_t gpios);
+
+#endif
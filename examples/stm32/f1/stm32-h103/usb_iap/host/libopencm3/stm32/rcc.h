@@ -0,0 +1,49 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Host stand-ins for the parts of libopencm3 usbiap.c uses.  Only what
+ * iap_test.c calls is implemented; main() is never built.
+ */
+
+#ifndef HOST_RCC_H
+#define HOST_RCC_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+struct rcc_clock_scale {
+	uint32_t ahb_frequency;
+};
+
+enum rcc_clock_hse {
+	RCC_CLOCK_HSE8_72MHZ,
+};
+
+enum rcc_periph_clken {
+	RCC_AFIO,
+	RCC_CRC,
+	RCC_GPIOA,
+};
+
+extern const struct rcc_clock_scale rcc_hse_configs[];
+
+void rcc_clock_setup_pll(const struct rcc_clock_scale *clock);
+void rcc_periph_clock_enable(enum rcc_periph_clken clken);
+void rcc_periph_clock_disable(enum rcc_periph_clken clken);
+
+#endif
@@ -0,0 +1,124 @@
+#
+# This file is part of the libopencm3 project.
+#
+# This library is free software: you can redistribute it and/or modify
+# it under the terms of the GNU Lesser General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This library is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU Lesser General Public License for more details.
+#
+# You should have received a copy of the GNU Lesser General Public License
+# along with this library.  If not, see <http://www.gnu.org/licenses/>.
+#
+
+# Checks of usbiap_flash.py without a device: its CRC against the vectors
+# iap_test.c checks usbiap.c with, and main() against a stand-in for the
+# bootloader that keeps the flash in a bytearray.
+
+import os
+import sys
+import tempfile
+
+sys.path.insert(0, os.path.join(os.path.dirname(__file__), ".."))
+import usbiap_flash as tool
+
+failures = 0
+
+def check(cond, msg):
+	global failures
+	if not cond:
+		failures += 1
+		if failures <= 10:
+			print("FAIL " + msg)
+
+class FakeBootloader:
+	"""The commands of usbiap.c, on APP_PAGES of flash."""
+
+	def __init__(self):
+		self.flash = bytearray(FakeBootloader.flash)
+		self.written = []
+		self.commit = None
+
+	def page_crcs(self):
+		return [tool.crc32_stm32(self.flash[i * tool.PAGE_SIZE:
+						    (i + 1) * tool.PAGE_SIZE])
+			for i in range(tool.APP_PAGES)]
+
+	def write_page(self, index, data):
+		check(len(data) == tool.PAGE_SIZE, "page %d is %d bytes" %
+		      (index, len(data)))
+		self.flash[index * tool.PAGE_SIZE:(index + 1) * tool.PAGE_SIZE] = data
+		self.written.append(index)
+
+	def command(self, cmd, *args):
+		check(cmd == tool.CMD_COMMIT and len(args) == 2,
+		      "command %#x %r" % (cmd, args))
+		self.commit = args
+		FakeBootloader.flash = self.flash
+
+	def manifest(self):
+		pass
+
+def flash_image(data, *opts):
+	with tempfile.NamedTemporaryFile(suffix=".bin") as f:
+		f.write(data)
+		f.flush()
+		bl = []
+		tool.Bootloader = lambda: bl.append(FakeBootloader()) or bl[0]
+		with open(os.devnull, "w") as null:
+			out, sys.stdout = sys.stdout, null
+			try:
+				ret = tool.main(["usbiap_flash.py"] + list(opts) +
+						[f.name])
+			finally:
+				sys.stdout = out
+	check(ret == 0, "main returned %r" % ret)
+	return bl[0]
+
+def check_crc():
+	ramp = bytes(i * 7 & 0xff for i in range(tool.PAGE_SIZE))
+
+	check(tool.crc32_stm32(b"\0\0\0\0") == 0xc704dd7b, "zero word")
+	check(tool.crc32_stm32(ramp) == 0x394eedd1, "ramp page")
+	check(tool.crc32_stm32(b"") == 0xffffffff, "nothing")
+
+def check_delta():
+	size = 100 * 1024 + 1
+	image = bytearray(os.urandom(size))
+	FakeBootloader.flash = bytes(os.urandom(tool.APP_PAGES *
+						tool.PAGE_SIZE))
+
+	bl = flash_image(image, "--full")
+	check(bl.written == list(range(101)), "full: %d pages" %
+	      len(bl.written))
+	length = (size + 3) & ~3
+	check(bl.commit == (length, tool.crc32_stm32(
+		bytes(image) + b"\xff" * (length - size))),
+	      "full: commit %r" % (bl.commit,))
+	check(bl.flash[:size] == image and
+	      bl.flash[size:101 * tool.PAGE_SIZE] ==
+	      b"\xff" * (101 * tool.PAGE_SIZE - size), "full: flash")
+
+	bl = flash_image(image)
+	check(bl.written == [], "unchanged: pages %r" % bl.written)
+
+	for page in (0, 40, 100):
+		image[page * tool.PAGE_SIZE] ^= 1
+	bl = flash_image(image)
+	check(bl.written == [0, 40, 100], "patched: pages %r" % bl.written)
+	check(bl.flash[:size] == image, "patched: flash")
+
+	bl = flash_image(image, "--dry-run")
+	check(bl.written == [] and bl.commit is None, "dry run wrote")
+
+check_crc()
+check_delta()
+
+if failures:
+	print("%d failures" % failures)
+	sys.exit(1)
+print("all passed")
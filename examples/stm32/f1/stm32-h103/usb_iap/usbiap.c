@@ -21,20 +21,45 @@
 #include <libopencm3/stm32/rcc.h>
 #include <libopencm3/stm32/gpio.h>
 #include <libopencm3/stm32/flash.h>
+#include <libopencm3/stm32/crc.h>
 #include <libopencm3/cm3/scb.h>
 #include <libopencm3/usb/usbd.h>
 #include <libopencm3/usb/dfu.h>
 
 #define APP_ADDRESS	0x08002000
+#define PAGE_SIZE	1024
+/* The last page holds the image record, the application gets the rest. */
+#define INFO_ADDRESS	0x0801FC00
+#define APP_PAGES	((INFO_ADDRESS - APP_ADDRESS) / PAGE_SIZE)
+
+/* Set to 0 to compute the CRCs in software instead of with the CRC unit. */
+#ifndef USE_CRC_UNIT
+#define USE_CRC_UNIT	1
+#endif
 
 /* Commands sent with wBlockNum == 0 as per ST implementation. */
 #define CMD_SETADDR	0x21
 #define CMD_ERASE	0x41
+/* Followed by the image length and CRC32; checks the image and records it. */
+#define CMD_COMMIT	0x61
+
+#define IMAGE_MAGIC	0x31504149	/* "IAP1" */
+
+/*
+ * Written to INFO_ADDRESS once a downloaded image has been checked.  The
+ * application is only started if its CRC still matches.
+ */
+struct image_info {
+	uint32_t magic;
+	uint32_t length;	/* bytes from APP_ADDRESS, a multiple of 4 */
+	uint32_t crc;
+};
 
 /* We need a special large control buffer for this device: */
 uint8_t usbd_control_buffer[1024];
 
 static enum dfu_state usbdfu_state = STATE_DFU_IDLE;
+static enum dfu_status usbdfu_status = DFU_STATUS_OK;
 
 static struct {
 	uint8_t buf[sizeof(usbd_control_buffer)];
@@ -110,9 +135,95 @@ static const char *usb_strings[] = {
 	"DFU Demo",
 	"DEMO",
 	/* This string is used by ST Microelectronics' DfuSe utility. */
-	"@Internal Flash   /0x08000000/8*001Ka,56*001Kg",
+	"@Internal Flash   /0x08000000/8*001Ka,119*001Kg,1*001Ka",
 };
 
+/*
+ * CRC-32 as the STM32 CRC unit computes it: polynomial 0x04C11DB7, initial
+ * value 0xFFFFFFFF, fed one 32 bit word at a time MSB first, no final XOR.
+ */
+#if USE_CRC_UNIT
+static uint32_t crc32_words(const uint32_t *data, uint32_t count)
+{
+	crc_reset();
+	return count ? crc_calculate_block((uint32_t *)data, count) :
+		       0xFFFFFFFF;
+}
+#else
+static uint32_t crc32_words(const uint32_t *data, uint32_t count)
+{
+	/* A nibble at a time keeps the table small. */
+	static const uint32_t table[16] = {
+		0x00000000, 0x04C11DB7, 0x09823B6E, 0x0D4326D9,
+		0x130476DC, 0x17C56B6B, 0x1A864DB2, 0x1E475005,
+		0x2608EDB8, 0x22C9F00F, 0x2F8AD6D6, 0x2B4BCB61,
+		0x350C9B64, 0x31CD86D3, 0x3C8EA00A, 0x384FBDBD,
+	};
+	uint32_t crc = 0xFFFFFFFF;
+	int i;
+
+	while (count--) {
+		crc ^= *data++;
+		for (i = 0; i < 8; i++)
+			crc = (crc << 4) ^ table[crc >> 28];
+	}
+	return crc;
+}
+#endif
+
+static bool image_valid(void)
+{
+	const struct image_info *info = (const struct image_info *)INFO_ADDRESS;
+
+	if (info->magic != IMAGE_MAGIC || info->length == 0 ||
+	    info->length > APP_PAGES * PAGE_SIZE || (info->length & 3))
+		return false;
+
+	return crc32_words((const uint32_t *)APP_ADDRESS,
+			   info->length / 4) == info->crc;
+}
+
+/* Check the downloaded image against the host's CRC and record it. */
+static enum dfu_status image_commit(uint32_t length, uint32_t crc)
+{
+	struct image_info info = {IMAGE_MAGIC, length, crc};
+	uint16_t dat[sizeof(info) / 2];
+	uint32_t i;
+
+	if (length == 0 || length > APP_PAGES * PAGE_SIZE || (length & 3))
+		return DFU_STATUS_ERR_ADDRESS;
+	if (crc32_words((const uint32_t *)APP_ADDRESS, length / 4) != crc)
+		return DFU_STATUS_ERR_VERIFY;
+
+	/* Copied, a uint16_t pointer into info may be read before it's set. */
+	memcpy(dat, &info, sizeof(info));
+	flash_unlock();
+	flash_erase_page(INFO_ADDRESS);
+	for (i = 0; i < sizeof(info) / 2; i++)
+		flash_program_half_word(INFO_ADDRESS + i * 2, dat[i]);
+	flash_lock();
+
+	return image_valid() ? DFU_STATUS_OK : DFU_STATUS_ERR_PROG;
+}
+
+/*
+ * DFU_UPLOAD of block 0 returns the CRC32 of every application page, so
+ * the host can leave out the pages that already hold the right data.
+ */
+static uint16_t usbdfu_page_crcs(uint8_t *buf, uint16_t len)
+{
+	uint32_t crc;
+	uint16_t i;
+
+	for (i = 0; i < APP_PAGES && (i + 1) * 4 <= len; i++) {
+		crc = crc32_words((const uint32_t *)(APP_ADDRESS +
+						     i * PAGE_SIZE),
+				  PAGE_SIZE / 4);
+		memcpy(buf + i * 4, &crc, 4);
+	}
+	return i * 4;
+}
+
 static uint8_t usbdfu_getstatus(usbd_device *usbd_dev, uint32_t *bwPollTimeout)
 {
 	(void)usbd_dev;
@@ -127,7 +238,7 @@ static uint8_t usbdfu_getstatus(usbd_device *usbd_dev, uint32_t *bwPollTimeout)
 		usbdfu_state = STATE_DFU_MANIFEST;
 		return DFU_STATUS_OK;
 	default:
-		return DFU_STATUS_OK;
+		return usbdfu_status;
 	}
 }
 
@@ -154,6 +265,16 @@ static void usbdfu_getstatus_complete(usbd_device *usbd_dev, struct usb_setup_da
 					prog.addr = *dat;
 				}
 				break;
+			case CMD_COMMIT:
+				{
+					/* Unaligned, don't let the loads merge. */
+					uint32_t len, crc;
+
+					memcpy(&len, prog.buf + 1, 4);
+					memcpy(&crc, prog.buf + 5, 4);
+					usbdfu_status = image_commit(len, crc);
+				}
+				break;
 			}
 		} else {
 			uint32_t baseaddr = prog.addr + ((prog.blocknum - 2) *
@@ -166,6 +287,11 @@ static void usbdfu_getstatus_complete(usbd_device *usbd_dev, struct usb_setup_da
 		}
 		flash_lock();
 
+		if (usbdfu_status != DFU_STATUS_OK) {
+			usbdfu_state = STATE_DFU_ERROR;
+			return;
+		}
+
 		/* Jump straight to dfuDNLOAD-IDLE, skipping dfuDNLOAD-SYNC. */
 		usbdfu_state = STATE_DFU_DNLOAD_IDLE;
 		return;
@@ -198,16 +324,21 @@ static enum usbd_request_return_codes usbdfu_control_request(usbd_device *usbd_d
 		return USBD_REQ_HANDLED;
 	case DFU_CLRSTATUS:
 		/* Clear error and return to dfuIDLE. */
-		if (usbdfu_state == STATE_DFU_ERROR)
+		if (usbdfu_state == STATE_DFU_ERROR) {
 			usbdfu_state = STATE_DFU_IDLE;
+			usbdfu_status = DFU_STATUS_OK;
+		}
 		return USBD_REQ_HANDLED;
 	case DFU_ABORT:
 		/* Abort returns to dfuIDLE state. */
 		usbdfu_state = STATE_DFU_IDLE;
 		return USBD_REQ_HANDLED;
 	case DFU_UPLOAD:
-		/* Upload not supported for now. */
-		return USBD_REQ_NOTSUPP;
+		/* Only the page CRCs can be read back. */
+		if (req->wValue != 0 || usbdfu_state != STATE_DFU_IDLE)
+			return USBD_REQ_NOTSUPP;
+		*len = usbdfu_page_crcs(*buf, *len);
+		return USBD_REQ_HANDLED;
 	case DFU_GETSTATUS: {
 		uint32_t bwPollTimeout = 0; /* 24-bit integer in DFU class spec */
 		(*buf)[0] = usbdfu_getstatus(usbd_dev, &bwPollTimeout);
@@ -247,10 +378,13 @@ int main(void)
 	usbd_device *usbd_dev;
 
 	rcc_periph_clock_enable(RCC_GPIOA);
+	rcc_periph_clock_enable(RCC_CRC);
 
 	if (!gpio_get(GPIOA, GPIO10)) {
-		/* Boot the application if it's valid. */
-		if ((*(volatile uint32_t *)APP_ADDRESS & 0x2FFE0000) == 0x20000000) {
+		/* Boot the application if it's valid and intact. */
+		if ((*(volatile uint32_t *)APP_ADDRESS & 0x2FFE0000) == 0x20000000 &&
+		    image_valid()) {
+			rcc_periph_clock_disable(RCC_CRC);
 			/* Set vector table base address. */
 			SCB_VTOR = APP_ADDRESS & 0xFFFF;
 			/* Initialise master stack pointer. */
@@ -0,0 +1,162 @@
+#! /usr/bin/env python3
+#
+# This file is part of the libopencm3 project.
+#
+# This library is free software: you can redistribute it and/or modify
+# it under the terms of the GNU Lesser General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This library is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU Lesser General Public License for more details.
+#
+# You should have received a copy of the GNU Lesser General Public License
+# along with this library.  If not, see <http://www.gnu.org/licenses/>.
+#
+
+# Download an application binary to the usbiap bootloader.
+#
+# The bootloader reports the CRC32 of every application page, and only the
+# pages that differ from the new image are erased and written.  The image
+# CRC is then sent with CMD_COMMIT, which the bootloader checks before it
+# marks the image bootable.
+#
+# usage: usbiap_flash.py [--full] [--dry-run] app.bin
+
+import struct
+import sys
+import time
+
+APP_ADDRESS = 0x08002000
+PAGE_SIZE = 1024
+APP_PAGES = 119
+
+CMD_SETADDR = 0x21
+CMD_ERASE = 0x41
+CMD_COMMIT = 0x61
+
+DFU_DNLOAD = 1
+DFU_UPLOAD = 2
+DFU_GETSTATUS = 3
+DFU_CLRSTATUS = 4
+DFU_ABORT = 6
+
+STATE_DFU_DNBUSY = 4
+STATE_DFU_ERROR = 10
+
+def _crc_table():
+	table = []
+	for i in range(256):
+		crc = i << 24
+		for j in range(8):
+			if crc & 0x80000000:
+				crc = ((crc << 1) ^ 0x04c11db7) & 0xffffffff
+			else:
+				crc = (crc << 1) & 0xffffffff
+		table.append(crc)
+	return table
+
+CRC_TABLE = _crc_table()
+
+def crc32_stm32(data):
+	"""CRC-32 the way the STM32 CRC unit computes it over 32 bit words."""
+	crc = 0xffffffff
+	for i in range(0, len(data), 4):
+		# The unit takes little endian words MSB first.
+		for b in (data[i + 3], data[i + 2], data[i + 1], data[i]):
+			crc = ((crc << 8) & 0xffffffff) ^ CRC_TABLE[(crc >> 24) ^ b]
+	return crc
+
+def pad(data, size):
+	return data + b"\xff" * (-len(data) % size)
+
+def changed_pages(image, page_crcs):
+	"""Indexes of the pages of `image' whose CRC differs on the device."""
+	return [i for i in range(len(image) // PAGE_SIZE)
+		if crc32_stm32(image[i * PAGE_SIZE:(i + 1) * PAGE_SIZE]) !=
+		   page_crcs[i]]
+
+class Bootloader:
+	def __init__(self):
+		import usb.core
+		self.dev = usb.core.find(idVendor=0x0483, idProduct=0xdf11)
+		if self.dev is None:
+			raise ValueError("Device not found")
+		self.dev.set_configuration()
+
+	def status(self):
+		st = self.dev.ctrl_transfer(0xa1, DFU_GETSTATUS, 0, 0, 6)
+		return st[0], st[1] | st[2] << 8 | st[3] << 16, st[4]
+
+	def dnload(self, block, data):
+		self.dev.ctrl_transfer(0x21, DFU_DNLOAD, block, 0, data)
+		while True:
+			status, timeout, state = self.status()
+			if state == STATE_DFU_ERROR:
+				self.dev.ctrl_transfer(0x21, DFU_CLRSTATUS, 0, 0, None)
+				raise IOError("bootloader error status %d" % status)
+			if state != STATE_DFU_DNBUSY:
+				return
+			time.sleep(timeout / 1000.0)
+
+	def command(self, cmd, *args):
+		self.dnload(0, struct.pack("<B%dI" % len(args), cmd, *args))
+
+	def page_crcs(self):
+		self.dev.ctrl_transfer(0x21, DFU_ABORT, 0, 0, None)
+		data = self.dev.ctrl_transfer(0xa1, DFU_UPLOAD, 0, 0,
+					      APP_PAGES * 4)
+		return list(struct.unpack("<%dI" % (len(data) // 4), data))
+
+	def write_page(self, index, data):
+		addr = APP_ADDRESS + index * PAGE_SIZE
+		self.command(CMD_ERASE, addr)
+		self.command(CMD_SETADDR, addr)
+		self.dnload(2, data)
+
+	def manifest(self):
+		self.dev.ctrl_transfer(0x21, DFU_DNLOAD, 0, 0, None)
+		try:
+			self.status()
+		except Exception:
+			pass	# the device resets
+
+def main(argv):
+	full = "--full" in argv
+	dry_run = "--dry-run" in argv
+	files = [a for a in argv[1:] if not a.startswith("--")]
+	if len(files) != 1:
+		print("usage: %s [--full] [--dry-run] app.bin" % argv[0])
+		return 1
+
+	data = open(files[0], "rb").read()
+	image = pad(data, PAGE_SIZE)
+	if len(image) > APP_PAGES * PAGE_SIZE:
+		print("image too large")
+		return 1
+	length = len(pad(data, 4))
+	crc = crc32_stm32(image[:length])
+
+	bl = Bootloader()
+	if full:
+		pages = list(range(len(image) // PAGE_SIZE))
+	else:
+		pages = changed_pages(image, bl.page_crcs())
+
+	print("%d of %d pages to write, %d bytes" %
+	      (len(pages), len(image) // PAGE_SIZE, len(pages) * PAGE_SIZE))
+	if dry_run:
+		return 0
+
+	start = time.time()
+	for i in pages:
+		bl.write_page(i, image[i * PAGE_SIZE:(i + 1) * PAGE_SIZE])
+	bl.command(CMD_COMMIT, length, crc)
+	print("written and verified in %.2f s" % (time.time() - start))
+	bl.manifest()
+	return 0
+
+if __name__ == "__main__":
+	sys.exit(main(sys.argv))
@@ -20,15 +20,13 @@
 #include <libopencm3/stm32/rcc.h>
 #include <libopencm3/stm32/usart.h>
 #include <libopencm3/stm32/gpio.h>
-#include <libopencm3/stm32/flash.h>
+#include <string.h>
+#include "kvstore.h"
 
 #define USART_ECHO_EN 1
 #define SEND_BUFFER_SIZE 256
-#define FLASH_OPERATION_ADDRESS ((uint32_t)0x0800f000)
-#define FLASH_PAGE_NUM_MAX 127
-#define FLASH_PAGE_SIZE 0x800
-#define FLASH_WRONG_DATA_WRITTEN 0x80
-#define RESULT_OK 0
+#define KEY_BOOT_COUNT 1
+#define KEY_STRING 2
 
 /*hardware initialization*/
 static void init_system(void);
@@ -36,37 +34,57 @@ static void init_usart(void);
 /*usart operations*/
 static void usart_send_string(uint32_t usart, uint8_t *string, uint16_t str_size);
 static void usart_get_string(uint32_t usart, uint8_t *string, uint16_t str_max_size);
-/*flash operations*/
-static uint32_t flash_program_data(uint32_t start_address, uint8_t *input_data, uint16_t num_elements);
-static void flash_read_data(uint32_t start_address, uint16_t num_elements, uint8_t *output_data);
 /*local functions to work with strings*/
 static void local_ltoa_hex(uint32_t value, uint8_t *out_string);
 
 int main(void)
 {
-	uint32_t result = 0;
+	int result = 0;
+	uint32_t boot_count = 0;
 	uint8_t str_send[SEND_BUFFER_SIZE], str_verify[SEND_BUFFER_SIZE];
 
 	init_system();
 
+	result = kv_init();
+	if(result == KV_OK)
+	{
+		/*small updates like this append a record instead of erasing a page*/
+		kv_get(KEY_BOOT_COUNT, &boot_count, sizeof(boot_count));
+		boot_count++;
+		result = kv_set(KEY_BOOT_COUNT, &boot_count, sizeof(boot_count));
+	}
+	if(result != KV_OK)
+	{
+		usart_send_string(USART1, (uint8_t*)"Flash store error: ", SEND_BUFFER_SIZE);
+		local_ltoa_hex(result, str_send);
+		usart_send_string(USART1, str_send, SEND_BUFFER_SIZE);
+		usart_send_string(USART1, (uint8_t*)"\r\n", 3);
+	}
+
+	usart_send_string(USART1, (uint8_t*)"Boot count: ", SEND_BUFFER_SIZE);
+	local_ltoa_hex(boot_count, str_send);
+	usart_send_string(USART1, str_send, SEND_BUFFER_SIZE);
+	usart_send_string(USART1, (uint8_t*)"\r\n", 3);
+
 	while(1)
 	{
 		usart_send_string(USART1, (uint8_t*)"Please enter string to write into Flash memory:\n\r", SEND_BUFFER_SIZE);
 		usart_get_string(USART1, str_send, SEND_BUFFER_SIZE);
-		result = flash_program_data(FLASH_OPERATION_ADDRESS, str_send, SEND_BUFFER_SIZE);
+		str_send[SEND_BUFFER_SIZE - 1] = 0;
+		result = kv_set(KEY_STRING, str_send, strlen((char*)str_send) + 1);
 
 		switch(result)
 		{
-		case RESULT_OK: /*everything ok*/
+		case KV_OK: /*everything ok*/
 			usart_send_string(USART1, (uint8_t*)"Verification of written data: ", SEND_BUFFER_SIZE);
-			flash_read_data(FLASH_OPERATION_ADDRESS, SEND_BUFFER_SIZE, str_verify);
+			kv_get(KEY_STRING, str_verify, SEND_BUFFER_SIZE);
 			usart_send_string(USART1, str_verify, SEND_BUFFER_SIZE);
 			break;
-		case FLASH_WRONG_DATA_WRITTEN: /*data read from Flash is different than written data*/
-			usart_send_string(USART1, (uint8_t*)"Wrong data written into flash memory", SEND_BUFFER_SIZE);
+		case KV_ERR_FULL: /*no room left, even after garbage collection*/
+			usart_send_string(USART1, (uint8_t*)"Flash store full", SEND_BUFFER_SIZE);
 			break;
-		default: /*wrong flags' values in Flash Status Register (FLASH_SR)*/
-			usart_send_string(USART1, (uint8_t*)"Wrong value of FLASH_SR: ", SEND_BUFFER_SIZE);
+		default: /*erase or program failed, or data read back differs*/
+			usart_send_string(USART1, (uint8_t*)"Flash store error: ", SEND_BUFFER_SIZE);
 			local_ltoa_hex(result, str_send);
 			usart_send_string(USART1, str_send, SEND_BUFFER_SIZE);
 			break;
@@ -135,58 +153,6 @@ static void usart_get_string(uint32_t usart, uint8_t *out_string, uint16_t str_m
 	}
 }
 
-static uint32_t flash_program_data(uint32_t start_address, uint8_t *input_data, uint16_t num_elements)
-{
-	uint16_t iter;
-	uint32_t current_address = start_address;
-	uint32_t page_address = start_address;
-	uint32_t flash_status = 0;
-
-	/*check if start_address is in proper range*/
-	if((start_address - FLASH_BASE) >= (FLASH_PAGE_SIZE * (FLASH_PAGE_NUM_MAX+1)))
-		return 1;
-
-	/*calculate current page address*/
-	if(start_address % FLASH_PAGE_SIZE)
-		page_address -= (start_address % FLASH_PAGE_SIZE);
-
-	flash_unlock();
-
-	/*Erasing page*/
-	flash_erase_page(page_address);
-	flash_status = flash_get_status_flags();
-	if(flash_status != FLASH_SR_EOP)
-		return flash_status;
-
-	/*programming flash memory*/
-	for(iter=0; iter<num_elements; iter += 4)
-	{
-		/*programming word data*/
-		flash_program_word(current_address+iter, *((uint32_t*)(input_data + iter)));
-		flash_status = flash_get_status_flags();
-		if(flash_status != FLASH_SR_EOP)
-			return flash_status;
-
-		/*verify if correct data is programmed*/
-		if(*((uint32_t*)(current_address+iter)) != *((uint32_t*)(input_data + iter)))
-			return FLASH_WRONG_DATA_WRITTEN;
-	}
-
-	return 0;
-}
-
-static void flash_read_data(uint32_t start_address, uint16_t num_elements, uint8_t *output_data)
-{
-	uint16_t iter;
-	uint32_t *memory_ptr= (uint32_t*)start_address;
-
-	for(iter=0; iter<num_elements/4; iter++)
-	{
-		*(uint32_t*)output_data = *(memory_ptr + iter);
-		output_data += 4;
-	}
-}
-
 static void local_ltoa_hex(uint32_t value, uint8_t *out_string)
 {
 	uint8_t iter;
@@ -0,0 +1,437 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Host test for kvstore.c on a simulated F1 flash, mapped at KV_BASE.
+ *
+ * The flash follows the F1 rules: a half-word can only be programmed
+ * from 0xffff, except with zero, and erasing sets a whole page to 0xff.
+ * A power cut can land in any program or erase.  A program cut short
+ * leaves only some of its zero bits, an erase cut short leaves some of
+ * the page erased.  After a cut kv_init() runs again, and may itself be
+ * cut once, the most kvstore.c keeps room for.  The key being written
+ * must then hold its old or its new value and every other key its own.
+ *
+ * Four runs:
+ *  - wear: one counter updated 100000 times, the erases must be spread
+ *    evenly over the pages,
+ *  - exhaustive: writes that open a new page and reclaim the oldest one,
+ *    cut at each of their flash operations in turn,
+ *  - full page: the same for a reclaim of a page full of live records as
+ *    big as they get, with kv_init() cut once more every time,
+ *  - fuzz: random sets and deletes against a reference, cut at random,
+ *    with a reboot now and then.
+ */
+
+#define _DEFAULT_SOURCE		/* MAP_ANONYMOUS */
+
+#include <setjmp.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <libopencm3/stm32/flash.h>
+
+#include "kvstore.h"
+
+#define FLASH_SIZE	(KV_PAGES * KV_PAGE_SIZE)
+#define KEYS		24
+#define COUNTER_UPDATES	100000
+#define ROTATIONS	40
+#define FUZZ_OPS	200000
+
+static int failures;
+
+#define CHECK(cond, ...) do {						\
+	if (!(cond)) {							\
+		if (failures++ < 10) {					\
+			printf("FAIL %s:%d: ", __FILE__, __LINE__);	\
+			printf(__VA_ARGS__);				\
+			printf("\n");					\
+		}							\
+	}								\
+} while (0)
+
+static uint32_t rng_state = 1;
+
+static uint32_t rnd(void)
+{
+	rng_state ^= rng_state << 13;
+	rng_state ^= rng_state >> 17;
+	rng_state ^= rng_state << 5;
+	return rng_state;
+}
+
+/* --- The flash --- */
+
+static uint8_t *flash;
+static uint32_t flash_sr;
+static bool flash_unlocked;
+static long flash_ops, programs, erases[KV_PAGES];
+
+/* Cut the power in flash operation number cut_at, if not 0. */
+static long cut_at;
+/* Odds of kv_init() being cut too, and within how many operations. */
+static int init_cut_odds = 4;
+static int init_cut_within = 64;
+static jmp_buf power_cut;
+static long cuts;
+
+void flash_unlock(void)
+{
+	flash_unlocked = true;
+}
+
+void flash_lock(void)
+{
+	flash_unlocked = false;
+}
+
+void flash_clear_status_flags(void)
+{
+	flash_sr = 0;
+}
+
+uint32_t flash_get_status_flags(void)
+{
+	return flash_sr;
+}
+
+static uint8_t *flash_at(uint32_t address, uint32_t align)
+{
+	CHECK(address >= KV_BASE && address < KV_BASE + FLASH_SIZE &&
+	      address % align == 0, "flash access at 0x%08x",
+	      (unsigned)address);
+	CHECK(flash_unlocked, "flash written while locked");
+	return flash + (address - KV_BASE);
+}
+
+void flash_program_half_word(uint32_t address, uint16_t data)
+{
+	uint16_t *p = (uint16_t *)flash_at(address, 2);
+
+	if (++flash_ops == cut_at) {
+		/* Some of the zero bits made it. */
+		*p &= data | (uint16_t)rnd();
+		cuts++;
+		longjmp(power_cut, 1);
+	}
+	programs++;
+	if (*p != 0xffff && data != 0) {
+		flash_sr |= FLASH_SR_PGERR;
+		return;
+	}
+	*p &= data;
+	flash_sr |= FLASH_SR_EOP;
+}
+
+void flash_erase_page(uint32_t page_address)
+{
+	uint8_t *p = flash_at(page_address, KV_PAGE_SIZE);
+	int i;
+
+	if (++flash_ops == cut_at) {
+		/* Some of the page got erased. */
+		for (i = 0; i < KV_PAGE_SIZE; i += 2)
+			if (rnd() % 2)
+				p[i] = p[i + 1] = 0xff;
+		cuts++;
+		longjmp(power_cut, 1);
+	}
+	erases[(page_address - KV_BASE) / KV_PAGE_SIZE]++;
+	memset(p, 0xff, KV_PAGE_SIZE);
+	flash_sr |= FLASH_SR_EOP;
+}
+
+/* --- The reference --- */
+
+struct value {
+	int len;		/* KV_ERR_NOT_FOUND if the key isn't there */
+	uint8_t data[KV_MAX_VALUE];
+};
+
+static struct value ref[KEYS];
+
+static bool holds(uint16_t key, const struct value *v)
+{
+	uint8_t buf[KV_MAX_VALUE];
+	int len = kv_get(key, buf, sizeof(buf));
+
+	return len == v->len && (len <= 0 || !memcmp(buf, v->data, len));
+}
+
+static void check_keys(const char *when)
+{
+	int k;
+
+	for (k = 0; k < KEYS; k++)
+		CHECK(holds(k, &ref[k]), "key %d wrong %s", k, when);
+}
+
+/*
+ * Most writes go to a few keys, so the others stay behind in old pages
+ * and have to be copied forward when those are reclaimed.
+ */
+static uint16_t random_key(void)
+{
+	return rnd() % 8 == 0 ? rnd() % KEYS : rnd() % 4;
+}
+
+static void random_value(struct value *v, bool del)
+{
+	int i;
+
+	if (del) {
+		v->len = KV_ERR_NOT_FOUND;
+		return;
+	}
+	/* Mostly small, now and then as big as it gets. */
+	v->len = rnd() % 16 == 0 ? rnd() % (KV_MAX_VALUE + 1) : rnd() % 24;
+	for (i = 0; i < v->len; i++)
+		v->data[i] = rnd();
+}
+
+/* Run kv_init() until it gets through, cutting it at most once. */
+static void recover(void)
+{
+	volatile int tries = 0;
+	int err;
+
+	if (setjmp(power_cut))
+		tries++;
+	cut_at = tries == 0 && rnd() % init_cut_odds == 0 ?
+		 flash_ops + 1 + rnd() % init_cut_within : 0;
+	err = kv_init();
+	cut_at = 0;
+	CHECK(err == KV_OK, "kv_init() returned %d", err);
+}
+
+/*
+ * Set or delete a key, cutting the power in its flash operation number
+ * `cut' (0 for none).  Afterwards the key holds the old or the new value
+ * and the reference is updated to match.
+ */
+static void update(uint16_t key, const struct value *v, long cut)
+{
+	int err;
+
+	cut_at = cut ? flash_ops + cut : 0;
+	if (setjmp(power_cut)) {
+		recover();
+		if (holds(key, v))
+			ref[key] = *v;
+		CHECK(holds(key, &ref[key]), "key %d torn", key);
+		check_keys("after a power cut");
+		return;
+	}
+	if (v->len < 0)
+		err = kv_delete(key);
+	else
+		err = kv_set(key, v->data, v->len);
+	cut_at = 0;
+
+	if (err == KV_OK || (err == KV_ERR_NOT_FOUND && v->len < 0))
+		ref[key] = *v;
+	else
+		CHECK(err == KV_ERR_FULL && v->len >= 0,
+		      "key %d: error %d", key, err);
+	CHECK(holds(key, &ref[key]), "key %d wrong after update", key);
+}
+
+static void format(void)
+{
+	int k;
+
+	memset(flash, 0xff, FLASH_SIZE);
+	for (k = 0; k < KEYS; k++)
+		ref[k].len = KV_ERR_NOT_FOUND;
+	CHECK(kv_init() == KV_OK, "kv_init() on erased flash");
+}
+
+/* --- The runs --- */
+
+static void test_wear(void)
+{
+	long before = programs, min, max;
+	uint32_t n;
+	int p;
+
+	format();
+	memset(erases, 0, sizeof(erases));
+	for (n = 0; n < COUNTER_UPDATES; n++)
+		CHECK(kv_set(0, &n, sizeof(n)) == KV_OK, "counter %u",
+		      (unsigned)n);
+	CHECK(kv_init() == KV_OK && kv_get(0, &n, sizeof(n)) == sizeof(n) &&
+	      n == COUNTER_UPDATES - 1, "counter lost");
+
+	min = max = erases[0];
+	for (p = 1; p < KV_PAGES; p++) {
+		min = erases[p] < min ? erases[p] : min;
+		max = erases[p] > max ? erases[p] : max;
+	}
+	CHECK(max - min <= 1, "erases from %ld to %ld per page", min, max);
+	printf("wear: %d counter updates, %.1f half-words programmed each, "
+	       "%ld to %ld erases per page\n", COUNTER_UPDATES,
+	       (double)(programs - before) / COUNTER_UPDATES, min, max);
+}
+
+static void test_exhaustive(void)
+{
+	static uint8_t saved_flash[FLASH_SIZE];
+	static struct value saved_ref[KEYS];
+	struct value v, next;
+	long ops, start, cut, total = 0;
+	uint16_t key;
+	int i;
+
+	format();
+	for (i = 0; i < ROTATIONS; i++) {
+		/* Fill the newest page until the next write opens one. */
+		while (true) {
+			key = random_key();
+			random_value(&v, rnd() % 8 == 0);
+			if (v.len >= 0 && kv_free() < 6 + ((v.len + 1) & ~1))
+				break;
+			update(key, &v, 0);
+		}
+
+		memcpy(saved_flash, flash, FLASH_SIZE);
+		memcpy(saved_ref, ref, sizeof(ref));
+		start = flash_ops;
+		update(key, &v, 0);
+		ops = flash_ops - start;
+
+		for (cut = 1; cut <= ops; cut++) {
+			memcpy(flash, saved_flash, FLASH_SIZE);
+			memcpy(ref, saved_ref, sizeof(ref));
+			CHECK(kv_init() == KV_OK, "kv_init()");
+			update(key, &v, cut);
+			/* And the store still works. */
+			random_value(&next, false);
+			update((key + 1) % KEYS, &next, 0);
+			CHECK(kv_init() == KV_OK, "kv_init()");
+			check_keys("after a reboot");
+		}
+		total += ops;
+	}
+	printf("exhaustive: %d page rotations, cut at each of their %ld "
+	       "flash operations\n", ROTATIONS, total);
+}
+
+static void test_full_page(void)
+{
+	static uint8_t saved_flash[FLASH_SIZE];
+	static struct value saved_ref[KEYS];
+	struct value v;
+	long ops, start, cut;
+	uint16_t key;
+	int rotations = 0, big = 0;
+
+	format();
+	/* Fill the first page with big values that stay. */
+	for (key = 4; kv_free() >= 6 + KV_MAX_VALUE; key++) {
+		random_value(&v, false);
+		v.len = KV_MAX_VALUE;
+		update(key, &v, 0);
+		big++;
+	}
+	/* Then churn the rest until the first page is the oldest. */
+	while (true) {
+		key = rnd() % 4;
+		random_value(&v, false);
+		v.len %= 24;
+		if (kv_free() < 6 + ((v.len + 1) & ~1) &&
+		    ++rotations == KV_PAGES - 1)
+			break;
+		update(key, &v, 0);
+	}
+
+	memcpy(saved_flash, flash, FLASH_SIZE);
+	memcpy(saved_ref, ref, sizeof(ref));
+	start = flash_ops;
+	update(key, &v, 0);
+	ops = flash_ops - start;
+
+	init_cut_odds = 1;
+	init_cut_within = ops;
+	for (cut = 1; cut <= ops; cut++) {
+		memcpy(flash, saved_flash, FLASH_SIZE);
+		memcpy(ref, saved_ref, sizeof(ref));
+		CHECK(kv_init() == KV_OK, "kv_init()");
+		update(key, &v, cut);
+		CHECK(kv_init() == KV_OK, "kv_init()");
+		check_keys("after a reboot");
+	}
+	init_cut_odds = 4;
+	init_cut_within = 64;
+
+	printf("full page: %d values of %d bytes reclaimed, cut twice at "
+	       "each of %ld flash operations\n", big, KV_MAX_VALUE, ops);
+}
+
+static void test_fuzz(void)
+{
+	struct value v;
+	long n, before = cuts;
+	clock_t start;
+	double cpu;
+
+	format();
+	start = clock();
+	for (n = 0; n < FUZZ_OPS; n++) {
+		random_value(&v, rnd() % 8 == 0);
+		update(random_key(), &v,
+		       rnd() % 20 == 0 ? 1 + (long)(rnd() % 24) : 0);
+		if (n % 1000 == 999) {
+			CHECK(kv_init() == KV_OK, "kv_init()");
+			check_keys("after a reboot");
+		}
+	}
+	cpu = (double)(clock() - start) / CLOCKS_PER_SEC;
+	check_keys("at the end");
+
+	printf("fuzz: %d operations, %ld power cuts, %.0f operations/s "
+	       "on the host\n", FUZZ_OPS, cuts - before, FUZZ_OPS / cpu);
+}
+
+int main(void)
+{
+	void *map;
+
+	/* kvstore.c reads the flash at its real address. */
+	map = mmap((void *)(uintptr_t)KV_BASE, FLASH_SIZE,
+		   PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (map != (void *)(uintptr_t)KV_BASE) {
+		printf("can't map the flash at 0x%08x\n", (unsigned)KV_BASE);
+		return EXIT_FAILURE;
+	}
+	flash = map;
+
+	test_wear();
+	test_exhaustive();
+	test_full_page();
+	test_fuzz();
+
+	if (failures) {
+		printf("%d failures\n", failures);
+		return EXIT_FAILURE;
+	}
+	printf("all passed\n");
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,28 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Host stand-in, the flash is mapped at KV_BASE by kvstore_test.c. */
+
+#ifndef HOST_COMMON_H
+#define HOST_COMMON_H
+
+#include <stdint.h>
+
+#define MMIO16(addr)		(*(volatile uint16_t *)(uintptr_t)(addr))
+#define MMIO32(addr)		(*(volatile uint32_t *)(uintptr_t)(addr))
+
+#endif
@@ -0,0 +1,422 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Flash layout.
+ *
+ * Each page in use starts with a header of four half-words: KV_MAGIC, the
+ * page sequence number (low, high) and KV_PAGE_VALID.  The newest page has
+ * the highest sequence number.  Records follow the header back to back:
+ *
+ *   key, len, data padded to a half-word, KV_COMMIT
+ *
+ * A record is written front to back and only counts once its commit
+ * marker is there, so a record cut short by a power loss is skipped.  A
+ * len of KV_LEN_DELETED, with no data, deletes the key.  A key that reads
+ * as 0xffff marks the end of the records in a page.
+ *
+ * The F1 can program each half-word once between erases, from 0xffff, so
+ * nothing is ever rewritten in place.  The one exception is that zero may
+ * be written over anything, which is used to retire a page.
+ *
+ * When the newest page is full, the erased page after it in the ring is
+ * opened.  The page after that is then the oldest one; the records in it
+ * that are still current are copied into the new page and it is erased,
+ * so there is always a spare.  Should power fail on the way, kv_init()
+ * sees a page in use right after the newest one and repeats the copy; the
+ * copies already made are newer and win over the originals.
+ *
+ * The copy cut short stays behind as a torn record and takes up room, so
+ * new records stop KV_RESERVE bytes before the end of a page: whatever
+ * is live in the oldest page then still fits into the new one after two
+ * power cuts in the middle of a reclaim.
+ */
+
+#include <string.h>
+#include <libopencm3/cm3/common.h>
+#include <libopencm3/stm32/flash.h>
+
+#include "kvstore.h"
+
+#define KV_MAGIC		0x4b56
+#define KV_PAGE_VALID		0x5aa5
+#define KV_COMMIT		0xa55a
+#define KV_LEN_DELETED		0x8000
+#define KV_HDR_SIZE		8
+
+#define PAGE_ADDR(p)		(KV_BASE + (p) * KV_PAGE_SIZE)
+#define PAGE_END(p)		(PAGE_ADDR(p) + KV_PAGE_SIZE)
+/* Room kept free at the end of each page for repeating a reclaim. */
+#define KV_RESERVE		(2 * (6 + KV_MAX_VALUE))
+#define APPEND_END(p)		(PAGE_END(p) - KV_RESERVE)
+/* Live data that can always be compacted without running out of pages. */
+#define KV_CAPACITY		((KV_PAGES - 2) * \
+				 (KV_PAGE_SIZE - KV_HDR_SIZE - KV_RESERVE))
+
+enum page_state {
+	PAGE_ERASED,
+	PAGE_USED,
+	PAGE_BAD,
+};
+
+struct kv_entry {
+	uint16_t key;
+	uint32_t addr;		/* of the current record */
+};
+
+static struct kv_entry kv_index[KV_MAX_KEYS];
+static int kv_keys;
+
+static int head;		/* newest page */
+static uint32_t head_seq;
+static uint32_t wr;		/* next free address in the newest page */
+
+static uint16_t rd(uint32_t addr)
+{
+	return MMIO16(addr);
+}
+
+static uint16_t rec_size(uint16_t len)
+{
+	if (len == KV_LEN_DELETED)
+		len = 0;
+	return 6 + ((len + 1) & ~1);
+}
+
+static int prog(uint32_t addr, uint16_t data)
+{
+	flash_clear_status_flags();
+	flash_program_half_word(addr, data);
+	if (flash_get_status_flags() != FLASH_SR_EOP)
+		return KV_ERR_FLASH;
+	if (rd(addr) != data)
+		return KV_ERR_FLASH;
+	return KV_OK;
+}
+
+static int erase(int page)
+{
+	flash_clear_status_flags();
+	flash_erase_page(PAGE_ADDR(page));
+	if (flash_get_status_flags() != FLASH_SR_EOP)
+		return KV_ERR_FLASH;
+	return KV_OK;
+}
+
+static enum page_state page_state(int page)
+{
+	uint32_t a = PAGE_ADDR(page);
+
+	if (rd(a) == KV_MAGIC && rd(a + 6) == KV_PAGE_VALID)
+		return PAGE_USED;
+
+	for (; a < PAGE_END(page); a += 4)
+		if (MMIO32(a) != 0xffffffff)
+			return PAGE_BAD;
+	return PAGE_ERASED;
+}
+
+static uint32_t page_seq(int page)
+{
+	return rd(PAGE_ADDR(page) + 2) | ((uint32_t)rd(PAGE_ADDR(page) + 4) << 16);
+}
+
+static int index_find(uint16_t key)
+{
+	int i;
+
+	for (i = 0; i < kv_keys; i++)
+		if (kv_index[i].key == key)
+			return i;
+	return -1;
+}
+
+/* Make the record at `addr' the current one for its key. */
+static void index_apply(uint32_t addr)
+{
+	uint16_t key = rd(addr);
+	int i = index_find(key);
+
+	if (rd(addr + 2) == KV_LEN_DELETED) {
+		if (i >= 0)
+			kv_index[i] = kv_index[--kv_keys];
+		return;
+	}
+
+	if (i < 0) {
+		if (kv_keys == KV_MAX_KEYS)
+			return;
+		i = kv_keys++;
+		kv_index[i].key = key;
+	}
+	kv_index[i].addr = addr;
+}
+
+/*
+ * Walk the records of a page, applying the committed ones to the index if
+ * `apply' is set.  Returns the address after the last record.
+ */
+static uint32_t page_scan(int page, int apply)
+{
+	uint32_t a = PAGE_ADDR(page) + KV_HDR_SIZE;
+	uint32_t end = PAGE_END(page);
+	uint16_t len, size;
+
+	while (a < end && rd(a) != 0xffff) {
+		len = rd(a + 2);
+		if (len == 0xffff ||
+		    (len != KV_LEN_DELETED && len > KV_MAX_VALUE)) {
+			/*
+			 * Power failed after the key was written, or while
+			 * the length was.  Nothing after it was written then,
+			 * the next record starts right behind.
+			 */
+			a += 4;
+			continue;
+		}
+		size = rec_size(len);
+		if (a + size > end)
+			return end;
+		if (apply && rd(a + size - 2) == KV_COMMIT)
+			index_apply(a);
+		a += size;
+	}
+
+	return a < end ? a : end;
+}
+
+static int rec_write(uint32_t addr, uint16_t key, const uint8_t *data,
+		     uint16_t len)
+{
+	uint16_t n = (len == KV_LEN_DELETED) ? 0 : len;
+	uint16_t i, hw;
+	int err;
+
+	if ((err = prog(addr, key)) || (err = prog(addr + 2, len)))
+		return err;
+	addr += 4;
+
+	for (i = 0; i < n; i += 2) {
+		hw = data[i] | ((i + 1 < n ? data[i + 1] : 0xff) << 8);
+		if ((err = prog(addr, hw)))
+			return err;
+		addr += 2;
+	}
+
+	return prog(addr, KV_COMMIT);
+}
+
+static int page_open(int page, uint32_t seq)
+{
+	uint32_t a = PAGE_ADDR(page);
+	int err;
+
+	if ((err = prog(a, KV_MAGIC)) || (err = prog(a + 2, seq)) ||
+	    (err = prog(a + 4, seq >> 16)) || (err = prog(a + 6, KV_PAGE_VALID)))
+		return err;
+
+	head = page;
+	head_seq = seq;
+	wr = a + KV_HDR_SIZE;
+	return KV_OK;
+}
+
+/* Copy the current records out of the oldest page and erase it. */
+static int page_reclaim(int page)
+{
+	uint32_t addr;
+	uint16_t size;
+	int i, err;
+
+	for (i = 0; i < kv_keys; i++) {
+		addr = kv_index[i].addr;
+		if (addr < PAGE_ADDR(page) || addr >= PAGE_END(page))
+			continue;
+
+		size = rec_size(rd(addr + 2));
+		if (wr + size > PAGE_END(head))
+			return KV_ERR_FULL;
+		err = rec_write(wr, rd(addr), (const uint8_t *)(addr + 4),
+				rd(addr + 2));
+		kv_index[i].addr = wr;
+		wr += size;
+		if (err)
+			return err;
+	}
+
+	/*
+	 * Zero the header first (zero can be programmed over anything), so
+	 * a page whose erase is cut short can't pass for one in use.
+	 */
+	if ((err = prog(PAGE_ADDR(page), 0)) ||
+	    (err = prog(PAGE_ADDR(page) + 6, 0)))
+		return err;
+	return erase(page);
+}
+
+static int rotate(void)
+{
+	int next = (head + 1) % KV_PAGES;
+	int err;
+
+	if ((err = page_open(next, head_seq + 1)))
+		return err;
+
+	/* The page after the new head is the oldest one, if in use. */
+	next = (head + 1) % KV_PAGES;
+	if (page_state(next) != PAGE_ERASED)
+		return page_reclaim(next);
+	return KV_OK;
+}
+
+static uint32_t live_size(void)
+{
+	uint32_t n = 0;
+	int i;
+
+	for (i = 0; i < kv_keys; i++)
+		n += rec_size(rd(kv_index[i].addr + 2));
+	return n;
+}
+
+static int kv_append(uint16_t key, const uint8_t *data, uint16_t len)
+{
+	uint16_t size = rec_size(len);
+	uint32_t addr;
+	int i, err = KV_OK;
+
+	flash_unlock();
+
+	for (i = 0; wr + size > APPEND_END(head); i++) {
+		if (i == KV_PAGES - 1) {
+			err = KV_ERR_FULL;
+			goto out;
+		}
+		if ((err = rotate()))
+			goto out;
+	}
+
+	/* The space is used even if programming fails half way. */
+	addr = wr;
+	wr += size;
+	if ((err = rec_write(addr, key, data, len)))
+		goto out;
+	index_apply(addr);
+
+out:
+	flash_lock();
+	return err;
+}
+
+int kv_get(uint16_t key, void *buf, uint16_t size)
+{
+	int i = index_find(key);
+	uint16_t len;
+
+	if (i < 0)
+		return KV_ERR_NOT_FOUND;
+
+	len = rd(kv_index[i].addr + 2);
+	memcpy(buf, (const void *)(kv_index[i].addr + 4),
+	       len < size ? len : size);
+	return len;
+}
+
+int kv_set(uint16_t key, const void *value, uint16_t len)
+{
+	int i = index_find(key);
+	uint32_t live;
+
+	if (key == 0xffff || len > KV_MAX_VALUE)
+		return KV_ERR_INVALID;
+
+	live = live_size() + rec_size(len);
+	if (i >= 0) {
+		/* Leave the flash alone if nothing changes. */
+		if (rd(kv_index[i].addr + 2) == len &&
+		    !memcmp((const void *)(kv_index[i].addr + 4), value, len))
+			return KV_OK;
+		live -= rec_size(rd(kv_index[i].addr + 2));
+	} else if (kv_keys == KV_MAX_KEYS) {
+		return KV_ERR_FULL;
+	}
+
+	if (live > KV_CAPACITY)
+		return KV_ERR_FULL;
+
+	return kv_append(key, value, len);
+}
+
+int kv_delete(uint16_t key)
+{
+	if (index_find(key) < 0)
+		return KV_ERR_NOT_FOUND;
+
+	return kv_append(key, NULL, KV_LEN_DELETED);
+}
+
+uint16_t kv_free(void)
+{
+	return wr < APPEND_END(head) ? APPEND_END(head) - wr : 0;
+}
+
+int kv_init(void)
+{
+	enum page_state state[KV_PAGES];
+	int p, k, err = KV_OK;
+	int newest = -1;
+
+	kv_keys = 0;
+
+	flash_unlock();
+
+	for (p = 0; p < KV_PAGES; p++) {
+		state[p] = page_state(p);
+		if (state[p] == PAGE_BAD) {
+			/* Cut short while being opened or erased. */
+			if ((err = erase(p)))
+				goto out;
+			state[p] = PAGE_ERASED;
+		}
+		if (state[p] == PAGE_USED &&
+		    (newest < 0 || page_seq(p) > page_seq(newest)))
+			newest = p;
+	}
+
+	if (newest < 0) {
+		err = page_open(0, 1);
+		goto out;
+	}
+
+	/* Oldest to newest, so later records win. */
+	for (k = 1; k <= KV_PAGES; k++) {
+		p = (newest + k) % KV_PAGES;
+		if (state[p] == PAGE_USED)
+			wr = page_scan(p, 1);
+	}
+	head = newest;
+	head_seq = page_seq(newest);
+
+	/* No spare after the newest page: a reclaim didn't finish. */
+	p = (head + 1) % KV_PAGES;
+	if (state[p] == PAGE_USED)
+		err = page_reclaim(p);
+
+out:
+	flash_lock();
+	return err;
+}
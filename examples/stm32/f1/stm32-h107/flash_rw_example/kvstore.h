@@ -0,0 +1,58 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef KVSTORE_H
+#define KVSTORE_H
+
+#include <stdint.h>
+
+/*
+ * Append-only key/value store in the last KV_PAGES pages of flash.
+ *
+ * Every kv_set() appends a record to the newest page; nothing is erased
+ * until the pages run out.  The pages are used as a ring, so the erases
+ * are spread evenly over all of them.  See kvstore.c for the layout.
+ */
+
+#ifndef KV_BASE
+#define KV_BASE			((uint32_t)0x0803e000)	/* last 8K of 256K */
+#endif
+#define KV_PAGE_SIZE		0x800
+#define KV_PAGES		4	/* one of them is kept erased */
+#define KV_MAX_KEYS		32
+#define KV_MAX_VALUE		256	/* bytes */
+
+#define KV_OK			0
+#define KV_ERR_NOT_FOUND	-1
+#define KV_ERR_FULL		-2	/* no room for the record or key */
+#define KV_ERR_INVALID		-3	/* bad key or length */
+#define KV_ERR_FLASH		-4	/* erase or program failed */
+
+/* Scan the pages, build the index and finish an interrupted cleanup. */
+int kv_init(void);
+
+/* Returns the value length, which may be more than `size'. */
+int kv_get(uint16_t key, void *buf, uint16_t size);
+
+/* Keys are 0 to 0xfffe. */
+int kv_set(uint16_t key, const void *value, uint16_t len);
+int kv_delete(uint16_t key);
+
+/* Bytes left for new records in the newest page. */
+uint16_t kv_free(void);
+
+#endif /* !KVSTORE_H */
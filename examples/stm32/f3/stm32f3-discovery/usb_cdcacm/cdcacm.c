@@ -23,6 +23,8 @@
 #include <libopencm3/usb/usbd.h>
 #include <libopencm3/usb/cdc.h>
 
+#include "ring.h"
+
 static const struct usb_device_descriptor dev = {
 	.bLength = USB_DT_DEVICE_SIZE,
 	.bDescriptorType = USB_DT_DEVICE,
@@ -202,17 +204,113 @@ static enum usbd_request_return_codes cdcacm_control_request(usbd_device *usbd_d
 	return USBD_REQ_NOTSUPP;
 }
 
+/*
+ * Buffered data path.
+ *
+ * Packets from the OUT endpoint are queued in rx_ring, data for the
+ * host in tx_ring. The IN endpoint is refilled from its completion
+ * callback, so packets go out back to back for as long as there is
+ * data. Nothing is dropped when the host is slow to read: the data
+ * waits in tx_ring, then in rx_ring, and once rx_ring is nearly full
+ * the OUT endpoint NAKs until cdcacm_read() has made room again.
+ * The headroom is two packets because one more may already have been
+ * accepted by the time the NAK takes effect.
+ *
+ * A bulk transfer ends with a short packet, so when the data runs
+ * out right after a full size packet a zero length packet follows.
+ */
+#define CDC_PACKET_SIZE		64
+#define CDC_RING_SIZE		1024	/* power of two */
+#define CDC_RX_HEADROOM		(2 * CDC_PACKET_SIZE)
+
+static uint8_t rx_buf[CDC_RING_SIZE];
+static uint8_t tx_buf[CDC_RING_SIZE];
+static struct ring rx_ring;
+static struct ring tx_ring;
+
+static uint8_t tx_packet[CDC_PACKET_SIZE];
+static uint16_t tx_len;		/* bytes in tx_packet not yet sent */
+static int tx_busy;		/* IN endpoint holds a packet */
+static int tx_zlp;		/* last packet sent was full size */
+static int rx_nak;		/* OUT endpoint is NAKing */
+static uint32_t rx_dropped;	/* should stay zero */
+
+static void cdcacm_tx_kick(usbd_device *usbd_dev)
+{
+	if (tx_busy) {
+		return;
+	}
+	if (tx_len == 0) {
+		tx_len = ring_read(&tx_ring, tx_packet, CDC_PACKET_SIZE);
+		if (tx_len == 0 && !tx_zlp) {
+			return;
+		}
+	}
+	if (usbd_ep_write_packet(usbd_dev, 0x82, tx_packet, tx_len) != tx_len) {
+		return;		/* endpoint not ready, retry later */
+	}
+	tx_busy = 1;
+	tx_zlp = (tx_len == CDC_PACKET_SIZE);
+	tx_len = 0;
+}
+
+static void cdcacm_data_tx_cb(usbd_device *usbd_dev, uint8_t ep)
+{
+	(void)ep;
+
+	tx_busy = 0;
+	cdcacm_tx_kick(usbd_dev);
+}
+
 static void cdcacm_data_rx_cb(usbd_device *usbd_dev, uint8_t ep)
 {
+	uint8_t buf[CDC_PACKET_SIZE];
+	int len;
+
 	(void)ep;
-	(void)usbd_dev;
 
-	char buf[64];
-	int len = usbd_ep_read_packet(usbd_dev, 0x01, buf, 64);
+	len = usbd_ep_read_packet(usbd_dev, 0x01, buf, sizeof(buf));
+	rx_dropped += len - ring_write(&rx_ring, buf, len);
+	if (!rx_nak && ring_free(&rx_ring) < CDC_RX_HEADROOM) {
+		rx_nak = 1;
+		usbd_ep_nak_set(usbd_dev, 0x01, 1);
+	}
+}
+
+/* Read up to len received bytes, returns how many there were. */
+static int cdcacm_read(usbd_device *usbd_dev, void *buf, int len)
+{
+	int n = ring_read(&rx_ring, buf, len);
+
+	if (rx_nak && ring_free(&rx_ring) >= CDC_RX_HEADROOM) {
+		rx_nak = 0;
+		usbd_ep_nak_set(usbd_dev, 0x01, 0);
+	}
+	return n;
+}
+
+/* Queue up to len bytes for the host, returns how many fitted. */
+static int cdcacm_write(usbd_device *usbd_dev, const void *buf, int len)
+{
+	int n = ring_write(&tx_ring, buf, len);
+
+	cdcacm_tx_kick(usbd_dev);
+	return n;
+}
 
-	if (len) {
-		usbd_ep_write_packet(usbd_dev, 0x82, buf, len);
+/* Echo received data back as fast as the host takes it. */
+static void cdcacm_echo(usbd_device *usbd_dev)
+{
+	uint8_t buf[CDC_PACKET_SIZE];
+	int n = ring_free(&tx_ring);
+
+	if (n > CDC_PACKET_SIZE) {
+		n = CDC_PACKET_SIZE;
 	}
+	n = cdcacm_read(usbd_dev, buf, n);
+
+	/* Even with nothing new, this retries a packet still pending. */
+	cdcacm_write(usbd_dev, buf, n);
 }
 
 static void cdcacm_set_config(usbd_device *usbd_dev, uint16_t wValue)
@@ -220,8 +318,16 @@ static void cdcacm_set_config(usbd_device *usbd_dev, uint16_t wValue)
 	(void)wValue;
 	(void)usbd_dev;
 
+	ring_init(&rx_ring, rx_buf, sizeof(rx_buf));
+	ring_init(&tx_ring, tx_buf, sizeof(tx_buf));
+	tx_len = 0;
+	tx_busy = 0;
+	tx_zlp = 0;
+	rx_nak = 0;
+
 	usbd_ep_setup(usbd_dev, 0x01, USB_ENDPOINT_ATTR_BULK, 64, cdcacm_data_rx_cb);
-	usbd_ep_setup(usbd_dev, 0x82, USB_ENDPOINT_ATTR_BULK, 64, NULL);
+	usbd_ep_setup(usbd_dev, 0x82, USB_ENDPOINT_ATTR_BULK, 64,
+			cdcacm_data_tx_cb);
 	usbd_ep_setup(usbd_dev, 0x83, USB_ENDPOINT_ATTR_INTERRUPT, 16, NULL);
 
 	usbd_register_control_callback(
@@ -256,5 +362,6 @@ int main(void)
 
 	while (1) {
 		usbd_poll(usbd_dev);
+		cdcacm_echo(usbd_dev);
 	}
 }
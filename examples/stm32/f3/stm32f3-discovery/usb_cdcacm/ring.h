@@ -0,0 +1,165 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef RING_H
+#define RING_H
+
+#include <stdint.h>
+
+/*
+ * Single producer, single consumer ring buffer.
+ *
+ * One side (say an interrupt handler) only ever calls the write
+ * functions and the other side (say the main loop) only ever calls
+ * the read functions, then neither side needs to disable interrupts.
+ * The producer owns 'end' and the consumer owns 'begin'; both count
+ * up forever and are masked when used as an index, so the buffer
+ * size must be a power of two and every byte of it can be used.
+ *
+ * The functions are inline so interrupt handlers using them stay
+ * small leaf functions.
+ */
+struct ring {
+	uint8_t *data;
+	uint32_t mask;			/* size - 1 */
+	volatile uint32_t begin;	/* next byte to read */
+	volatile uint32_t end;		/* next byte to write */
+};
+
+/*
+ * Keep the compiler from moving buffer accesses across an index
+ * update. A single Cortex-M core sees its own stores in order so
+ * nothing stronger is needed between thread and handler mode.
+ */
+#define RING_BARRIER()	__asm__ volatile ("" : : : "memory")
+
+/* 'size' must be a power of two */
+static inline void ring_init(struct ring *ring, uint8_t *buf, uint32_t size)
+{
+	ring->data = buf;
+	ring->mask = size - 1;
+	ring->begin = 0;
+	ring->end = 0;
+}
+
+/* Number of bytes waiting to be read */
+static inline uint32_t ring_used(const struct ring *ring)
+{
+	return ring->end - ring->begin;
+}
+
+/* Number of bytes that can be written */
+static inline uint32_t ring_free(const struct ring *ring)
+{
+	return ring->mask + 1 - (ring->end - ring->begin);
+}
+
+/* Returns the byte written, or -1 if the ring is full */
+static inline int32_t ring_write_ch(struct ring *ring, uint8_t ch)
+{
+	uint32_t end = ring->end;
+
+	if (end - ring->begin > ring->mask) {
+		return -1;
+	}
+	ring->data[end & ring->mask] = ch;
+	RING_BARRIER();
+	ring->end = end + 1;
+	return ch;
+}
+
+/* Returns the byte read, or -1 if the ring is empty */
+static inline int32_t ring_read_ch(struct ring *ring, uint8_t *ch)
+{
+	uint32_t begin = ring->begin;
+	uint8_t c;
+
+	if (begin == ring->end) {
+		return -1;
+	}
+	RING_BARRIER();
+	c = ring->data[begin & ring->mask];
+	RING_BARRIER();
+	ring->begin = begin + 1;
+	if (ch) {
+		*ch = c;
+	}
+	return c;
+}
+
+/* Write up to 'len' bytes, returns how many fitted */
+static inline uint32_t ring_write(struct ring *ring, const uint8_t *data,
+				  uint32_t len)
+{
+	uint32_t end = ring->end;
+	uint32_t i, n = ring_free(ring);
+
+	if (len < n) {
+		n = len;
+	}
+	for (i = 0; i < n; i++) {
+		ring->data[(end + i) & ring->mask] = data[i];
+	}
+	RING_BARRIER();
+	ring->end = end + n;
+	return n;
+}
+
+/* Read up to 'len' bytes, returns how many were available */
+static inline uint32_t ring_read(struct ring *ring, uint8_t *data,
+				 uint32_t len)
+{
+	uint32_t begin = ring->begin;
+	uint32_t i, n = ring_used(ring);
+
+	if (len < n) {
+		n = len;
+	}
+	RING_BARRIER();
+	for (i = 0; i < n; i++) {
+		data[i] = ring->data[(begin + i) & ring->mask];
+	}
+	RING_BARRIER();
+	ring->begin = begin + n;
+	return n;
+}
+
+/*
+ * Point '*data' at the oldest unread byte and return how many
+ * bytes follow it without wrapping, so they can be handed to a
+ * DMA channel as they are. Call ring_skip() once they are sent.
+ */
+static inline uint32_t ring_peek(struct ring *ring, uint8_t **data)
+{
+	uint32_t begin = ring->begin & ring->mask;
+	uint32_t n = ring_used(ring);
+
+	if (n > ring->mask + 1 - begin) {
+		n = ring->mask + 1 - begin;
+	}
+	*data = &ring->data[begin];
+	return n;
+}
+
+/* Drop 'len' bytes that were consumed in place */
+static inline void ring_skip(struct ring *ring, uint32_t len)
+{
+	RING_BARRIER();
+	ring->begin += len;
+}
+
+#endif
@@ -0,0 +1,267 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * aes-session.h on the CRYP peripheral.
+ *
+ * The CRYP holds the key and chaining state of one session at a time.  As
+ * long as the same session keeps calling aes_session_update(), it just
+ * carries on: no key is written and, for CBC decryption, the key isn't
+ * prepared again.  The IV of every session is also tracked here from the
+ * data, so switching to another session and back only needs the key and
+ * IV written; nothing has to be read back from the CRYP.
+ *
+ * The data type is set to bytes, so the CRYP swaps each word and buffers
+ * can be fed as they are in memory.  The key and IV registers are not
+ * swapped and get big endian words.
+ *
+ * DMA2 stream 6 channel 2 feeds the input FIFO and stream 5 channel 2
+ * empties the output one.  The input can only run ahead of the output,
+ * so in == out is fine.
+ */
+
+#include <string.h>
+#include <libopencm3/cm3/common.h>
+#include <libopencm3/stm32/crypto.h>
+#include <libopencm3/stm32/dma.h>
+
+#include "aes-session.h"
+
+/* IV0LR, IV0RR, IV1LR, IV1RR */
+#define CRYP_IV(i)		MMIO32(CRYP_BASE + 0x40 + (i) * 4)
+
+#define CRYP_DMA		DMA2
+#define CRYP_DMA_IN		DMA_STREAM6
+#define CRYP_DMA_OUT		DMA_STREAM5
+#define CRYP_DMA_CHANNEL	DMA_SxCR_CHSEL_2
+
+/* Below this, setting up the DMA costs more than feeding the FIFO. */
+#define DMA_MIN_LEN		64
+/* Words per DMA run, a whole number of blocks. */
+#define DMA_MAX_WORDS		0xfffc
+
+static struct aes_session *loaded;
+
+static uint32_t get_be32(const uint8_t *p)
+{
+	return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 |
+	       (uint32_t)p[2] << 8 | p[3];
+}
+
+static void put_be32(uint8_t *p, uint32_t v)
+{
+	p[0] = v >> 24;
+	p[1] = v >> 16;
+	p[2] = v >> 8;
+	p[3] = v;
+}
+
+static void cryp_wait_idle(void)
+{
+	while (CRYP_SR & CRYP_SR_BUSY);
+}
+
+static void cryp_write_iv(const uint8_t *iv)
+{
+	int i;
+
+	for (i = 0; i < 4; i++)
+		CRYP_IV(i) = get_be32(iv + 4 * i);
+}
+
+static void cryp_load(struct aes_session *s)
+{
+	uint64_t key[4] = { 0 };
+	enum crypto_mode mode;
+	int i, first;
+
+	if (loaded) {
+		cryp_wait_idle();
+		crypto_stop();
+	}
+
+	/* K0LR..K3RR; a 128 bit key goes in the last four words. */
+	first = s->key_bits == 256 ? 0 : 2;
+	for (i = first; i < 4; i++)
+		key[i] = s->key[2 * (i - first)] |
+			 (uint64_t)s->key[2 * (i - first) + 1] << 32;
+
+	crypto_set_key(s->key_bits == 256 ? CRYPTO_KEY_256BIT :
+			CRYPTO_KEY_128BIT, key);
+	cryp_write_iv(s->iv);
+
+	if (s->mode == AES_CTR)
+		mode = ENCRYPT_AES_CTR;	/* the same both ways */
+	else if (s->dir == AES_ENCRYPT)
+		mode = ENCRYPT_AES_CBC;
+	else
+		mode = DECRYPT_AES_CBC;	/* prepares the decryption key */
+	crypto_set_algorithm(mode);
+	crypto_set_datatype(CRYPTO_DATA_8BIT);
+
+	CRYP_CR |= CRYP_CR_FFLUSH;
+	crypto_start();
+	loaded = s;
+}
+
+/* Feed the FIFOs a block at a time; any alignment, any length. */
+static void cryp_run_cpu(const uint8_t *in, uint8_t *out, size_t len)
+{
+	uint32_t w[4];
+	size_t n;
+	int i;
+
+	for (n = 0; n < len; n += AES_BLOCK_SIZE) {
+		memcpy(w, in + n, sizeof(w));
+		for (i = 0; i < 4; i++) {
+			while (!(CRYP_SR & CRYP_SR_IFNF));
+			CRYP_DIN = w[i];
+		}
+		for (i = 0; i < 4; i++) {
+			while (!(CRYP_SR & CRYP_SR_OFNE));
+			w[i] = CRYP_DOUT;
+		}
+		memcpy(out + n, w, sizeof(w));
+	}
+}
+
+static void cryp_dma_stream(uint32_t stream, uint32_t dir, uint32_t periph,
+			    const void *mem, uint16_t words)
+{
+	dma_stream_reset(CRYP_DMA, stream);
+	dma_set_priority(CRYP_DMA, stream, DMA_SxCR_PL_HIGH);
+	dma_set_memory_size(CRYP_DMA, stream, DMA_SxCR_MSIZE_32BIT);
+	dma_set_peripheral_size(CRYP_DMA, stream, DMA_SxCR_PSIZE_32BIT);
+	dma_enable_memory_increment_mode(CRYP_DMA, stream);
+	dma_set_transfer_mode(CRYP_DMA, stream, dir);
+	dma_set_peripheral_address(CRYP_DMA, stream, periph);
+	dma_set_memory_address(CRYP_DMA, stream, (uint32_t)mem);
+	dma_set_number_of_data(CRYP_DMA, stream, words);
+	dma_channel_select(CRYP_DMA, stream, CRYP_DMA_CHANNEL);
+	dma_enable_stream(CRYP_DMA, stream);
+}
+
+static void cryp_run_dma(const uint8_t *in, uint8_t *out, size_t len)
+{
+	size_t words = len / 4;
+	uint16_t n;
+
+	while (words) {
+		n = words < DMA_MAX_WORDS ? words : DMA_MAX_WORDS;
+
+		/* Output first, so it is ready when the first block is. */
+		cryp_dma_stream(CRYP_DMA_OUT, DMA_SxCR_DIR_PERIPHERAL_TO_MEM,
+				(uint32_t)&CRYP_DOUT, out, n);
+		cryp_dma_stream(CRYP_DMA_IN, DMA_SxCR_DIR_MEM_TO_PERIPHERAL,
+				(uint32_t)&CRYP_DIN, in, n);
+		CRYP_DMACR = CRYP_DMACR_DIEN | CRYP_DMACR_DOEN;
+
+		while (!dma_get_interrupt_flag(CRYP_DMA, CRYP_DMA_OUT,
+					       DMA_TCIF));
+
+		CRYP_DMACR = 0;
+		dma_disable_stream(CRYP_DMA, CRYP_DMA_IN);
+		dma_disable_stream(CRYP_DMA, CRYP_DMA_OUT);
+
+		in += n * 4;
+		out += n * 4;
+		words -= n;
+	}
+}
+
+int aes_session_init(struct aes_session *s, enum aes_mode mode,
+		     enum aes_dir dir, const uint8_t *key, unsigned key_bits,
+		     const uint8_t *iv)
+{
+	unsigned i;
+
+	if (key_bits != 128 && key_bits != 256)
+		return AES_ERR_KEY;
+
+	/* The CRYP may hold an older key for this session. */
+	if (loaded == s) {
+		cryp_wait_idle();
+		crypto_stop();
+		loaded = NULL;
+	}
+
+	s->mode = mode;
+	s->dir = dir;
+	s->key_bits = key_bits;
+	memcpy(s->iv, iv, AES_BLOCK_SIZE);
+	for (i = 0; i < key_bits / 32; i++)
+		s->key[i] = get_be32(key + 4 * i);
+
+	return AES_OK;
+}
+
+void aes_session_set_iv(struct aes_session *s, const uint8_t *iv)
+{
+	memcpy(s->iv, iv, AES_BLOCK_SIZE);
+
+	/* Keep the (prepared) key, just restart the chaining. */
+	if (loaded == s) {
+		cryp_wait_idle();
+		crypto_stop();
+		cryp_write_iv(iv);
+		CRYP_CR |= CRYP_CR_FFLUSH;
+		crypto_start();
+	}
+}
+
+int aes_session_update(struct aes_session *s, const uint8_t *in,
+		       uint8_t *out, size_t len)
+{
+	uint8_t next_iv[AES_BLOCK_SIZE];
+	uint32_t blocks = len / AES_BLOCK_SIZE;
+
+	if (len % AES_BLOCK_SIZE)
+		return AES_ERR_LENGTH;
+	if (len == 0)
+		return AES_OK;
+
+	if (loaded != s)
+		cryp_load(s);
+
+	/* CBC decryption chains on the last ciphertext, out may overwrite it. */
+	if (s->mode == AES_CBC && s->dir == AES_DECRYPT)
+		memcpy(next_iv, in + len - AES_BLOCK_SIZE, AES_BLOCK_SIZE);
+
+	if (len >= DMA_MIN_LEN && !((uint32_t)in & 3) && !((uint32_t)out & 3))
+		cryp_run_dma(in, out, len);
+	else
+		cryp_run_cpu(in, out, len);
+
+	if (s->mode == AES_CTR)
+		put_be32(s->iv + 12, get_be32(s->iv + 12) + blocks);
+	else if (s->dir == AES_ENCRYPT)
+		memcpy(s->iv, out + len - AES_BLOCK_SIZE, AES_BLOCK_SIZE);
+	else
+		memcpy(s->iv, next_iv, AES_BLOCK_SIZE);
+
+	return AES_OK;
+}
+
+void aes_session_end(struct aes_session *s)
+{
+	if (loaded == s) {
+		cryp_wait_idle();
+		crypto_stop();
+		loaded = NULL;
+	}
+	memset(s, 0, sizeof(*s));
+}
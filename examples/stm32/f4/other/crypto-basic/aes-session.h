@@ -0,0 +1,78 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef AES_SESSION_H
+#define AES_SESSION_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * AES-128/256 in CBC or CTR mode, one session per key and direction.
+ *
+ * aes-cryp.c runs the sessions on the CRYP peripheral: the key stays
+ * loaded (and, for CBC decryption, prepared) between calls as long as the
+ * same session is used, and longer buffers are moved through the FIFOs by
+ * DMA2.  aes-soft.c is a plain C version of the same thing, to check the
+ * hardware against and to build on parts without a CRYP.
+ *
+ * Buffers may overlap exactly (in == out).  For DMA they must be word
+ * aligned and not in CCM RAM; other buffers go through the FIFOs by hand.
+ *
+ * In CTR mode the counter is the last 32 bits of the IV, big endian, and
+ * wraps without carrying into the rest, as the CRYP does.
+ */
+
+#define AES_BLOCK_SIZE		16
+
+#define AES_OK			0
+#define AES_ERR_KEY		-1	/* key size not 128 or 256 */
+#define AES_ERR_LENGTH		-2	/* not a whole number of blocks */
+
+enum aes_mode {
+	AES_CBC,
+	AES_CTR,
+};
+
+enum aes_dir {
+	AES_ENCRYPT,
+	AES_DECRYPT,
+};
+
+struct aes_session {
+	enum aes_mode mode;
+	enum aes_dir dir;
+	unsigned key_bits;
+	uint8_t iv[AES_BLOCK_SIZE];	/* for the next block */
+	uint32_t key[60];		/* raw key, or the software schedule */
+};
+
+int aes_session_init(struct aes_session *s, enum aes_mode mode,
+		     enum aes_dir dir, const uint8_t *key, unsigned key_bits,
+		     const uint8_t *iv);
+
+/* Start a new message with the same key. */
+void aes_session_set_iv(struct aes_session *s, const uint8_t *iv);
+
+/* len is a multiple of AES_BLOCK_SIZE; the chaining carries on. */
+int aes_session_update(struct aes_session *s, const uint8_t *in,
+		       uint8_t *out, size_t len);
+
+/* Release the CRYP and wipe the key. */
+void aes_session_end(struct aes_session *s);
+
+#endif /* !AES_SESSION_H */
@@ -0,0 +1,315 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Software AES behind the aes-session.h interface.
+ *
+ * This is the usual 32 bit table implementation (FIPS-197 section 5 and
+ * the equivalent inverse cipher of 5.3.5), with one table per direction
+ * rotated on the fly.  The tables are built on first use, which costs
+ * 2.5K of RAM instead of flash.  It does not try to be constant time.
+ */
+
+#include <string.h>
+
+#include "aes-session.h"
+
+static uint8_t sbox[256], inv_sbox[256];
+static uint32_t te[256], td[256];
+static int tables_ready;
+
+#define ROR8(x)		(((x) >> 8) | ((x) << 24))
+#define ROR16(x)	(((x) >> 16) | ((x) << 16))
+#define ROR24(x)	(((x) >> 24) | ((x) << 8))
+
+static uint8_t xtime(uint8_t x)
+{
+	return (x << 1) ^ ((x & 0x80) ? 0x1b : 0);
+}
+
+static uint8_t gmul(uint8_t a, uint8_t b)
+{
+	uint8_t r = 0;
+
+	while (b) {
+		if (b & 1)
+			r ^= a;
+		a = xtime(a);
+		b >>= 1;
+	}
+	return r;
+}
+
+static void tables_init(void)
+{
+	uint8_t p = 1, q = 1, s;
+	int i;
+
+	/* Walk the multiplicative group with generator 3 for the inverses. */
+	do {
+		p ^= xtime(p);
+		q ^= q << 1;
+		q ^= q << 2;
+		q ^= q << 4;
+		if (q & 0x80)
+			q ^= 0x09;
+		s = q ^ (q << 1 | q >> 7) ^ (q << 2 | q >> 6) ^
+		    (q << 3 | q >> 5) ^ (q << 4 | q >> 4);
+		sbox[p] = s ^ 0x63;
+	} while (p != 1);
+	sbox[0] = 0x63;
+
+	for (i = 0; i < 256; i++)
+		inv_sbox[sbox[i]] = i;
+
+	for (i = 0; i < 256; i++) {
+		s = sbox[i];
+		te[i] = (uint32_t)gmul(s, 2) << 24 | (uint32_t)s << 16 |
+			(uint32_t)s << 8 | gmul(s, 3);
+		s = inv_sbox[i];
+		td[i] = (uint32_t)gmul(s, 14) << 24 | (uint32_t)gmul(s, 9) << 16 |
+			(uint32_t)gmul(s, 13) << 8 | gmul(s, 11);
+	}
+
+	tables_ready = 1;
+}
+
+static uint32_t get_be32(const uint8_t *p)
+{
+	return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 |
+	       (uint32_t)p[2] << 8 | p[3];
+}
+
+static void put_be32(uint8_t *p, uint32_t v)
+{
+	p[0] = v >> 24;
+	p[1] = v >> 16;
+	p[2] = v >> 8;
+	p[3] = v;
+}
+
+static uint32_t sub_word(uint32_t w)
+{
+	return (uint32_t)sbox[w >> 24] << 24 | (uint32_t)sbox[(w >> 16) & 0xff] << 16 |
+	       (uint32_t)sbox[(w >> 8) & 0xff] << 8 | sbox[w & 0xff];
+}
+
+static int rounds(const struct aes_session *s)
+{
+	return s->key_bits == 256 ? 14 : 10;
+}
+
+static void expand_key(struct aes_session *s, const uint8_t *key)
+{
+	int nk = s->key_bits / 32;
+	int n = 4 * (rounds(s) + 1);
+	uint32_t *rk = s->key;
+	uint32_t t, rcon = 0x01;
+	int i;
+
+	for (i = 0; i < nk; i++)
+		rk[i] = get_be32(key + 4 * i);
+
+	for (; i < n; i++) {
+		t = rk[i - 1];
+		if (i % nk == 0) {
+			t = sub_word((t << 8) | (t >> 24)) ^ (rcon << 24);
+			rcon = xtime(rcon);
+		} else if (nk > 6 && i % nk == 4) {
+			t = sub_word(t);
+		}
+		rk[i] = rk[i - nk] ^ t;
+	}
+}
+
+/* Equivalent inverse cipher: reverse the rounds, InvMixColumns inside. */
+static void invert_key(struct aes_session *s)
+{
+	int nr = rounds(s);
+	uint32_t *rk = s->key;
+	uint32_t t;
+	int i, j;
+
+	for (i = 0, j = 4 * nr; i < j; i += 4, j -= 4) {
+		t = rk[i]; rk[i] = rk[j]; rk[j] = t;
+		t = rk[i + 1]; rk[i + 1] = rk[j + 1]; rk[j + 1] = t;
+		t = rk[i + 2]; rk[i + 2] = rk[j + 2]; rk[j + 2] = t;
+		t = rk[i + 3]; rk[i + 3] = rk[j + 3]; rk[j + 3] = t;
+	}
+
+	for (i = 4; i < 4 * nr; i++) {
+		t = rk[i];
+		rk[i] = td[sbox[t >> 24]] ^ ROR8(td[sbox[(t >> 16) & 0xff]]) ^
+			ROR16(td[sbox[(t >> 8) & 0xff]]) ^ ROR24(td[sbox[t & 0xff]]);
+	}
+}
+
+static void encrypt_block(const struct aes_session *s, const uint8_t *in,
+			  uint8_t *out)
+{
+	const uint32_t *rk = s->key;
+	uint32_t s0, s1, s2, s3, t0, t1, t2, t3;
+	int r;
+
+	s0 = get_be32(in) ^ rk[0];
+	s1 = get_be32(in + 4) ^ rk[1];
+	s2 = get_be32(in + 8) ^ rk[2];
+	s3 = get_be32(in + 12) ^ rk[3];
+
+	for (r = 1; r < rounds(s); r++) {
+		rk += 4;
+		t0 = te[s0 >> 24] ^ ROR8(te[(s1 >> 16) & 0xff]) ^
+		     ROR16(te[(s2 >> 8) & 0xff]) ^ ROR24(te[s3 & 0xff]) ^ rk[0];
+		t1 = te[s1 >> 24] ^ ROR8(te[(s2 >> 16) & 0xff]) ^
+		     ROR16(te[(s3 >> 8) & 0xff]) ^ ROR24(te[s0 & 0xff]) ^ rk[1];
+		t2 = te[s2 >> 24] ^ ROR8(te[(s3 >> 16) & 0xff]) ^
+		     ROR16(te[(s0 >> 8) & 0xff]) ^ ROR24(te[s1 & 0xff]) ^ rk[2];
+		t3 = te[s3 >> 24] ^ ROR8(te[(s0 >> 16) & 0xff]) ^
+		     ROR16(te[(s1 >> 8) & 0xff]) ^ ROR24(te[s2 & 0xff]) ^ rk[3];
+		s0 = t0; s1 = t1; s2 = t2; s3 = t3;
+	}
+
+	rk += 4;
+	put_be32(out, ((uint32_t)sbox[s0 >> 24] << 24 |
+		       (uint32_t)sbox[(s1 >> 16) & 0xff] << 16 |
+		       (uint32_t)sbox[(s2 >> 8) & 0xff] << 8 |
+		       sbox[s3 & 0xff]) ^ rk[0]);
+	put_be32(out + 4, ((uint32_t)sbox[s1 >> 24] << 24 |
+			   (uint32_t)sbox[(s2 >> 16) & 0xff] << 16 |
+			   (uint32_t)sbox[(s3 >> 8) & 0xff] << 8 |
+			   sbox[s0 & 0xff]) ^ rk[1]);
+	put_be32(out + 8, ((uint32_t)sbox[s2 >> 24] << 24 |
+			   (uint32_t)sbox[(s3 >> 16) & 0xff] << 16 |
+			   (uint32_t)sbox[(s0 >> 8) & 0xff] << 8 |
+			   sbox[s1 & 0xff]) ^ rk[2]);
+	put_be32(out + 12, ((uint32_t)sbox[s3 >> 24] << 24 |
+			    (uint32_t)sbox[(s0 >> 16) & 0xff] << 16 |
+			    (uint32_t)sbox[(s1 >> 8) & 0xff] << 8 |
+			    sbox[s2 & 0xff]) ^ rk[3]);
+}
+
+static void decrypt_block(const struct aes_session *s, const uint8_t *in,
+			  uint8_t *out)
+{
+	const uint32_t *rk = s->key;
+	uint32_t s0, s1, s2, s3, t0, t1, t2, t3;
+	int r;
+
+	s0 = get_be32(in) ^ rk[0];
+	s1 = get_be32(in + 4) ^ rk[1];
+	s2 = get_be32(in + 8) ^ rk[2];
+	s3 = get_be32(in + 12) ^ rk[3];
+
+	for (r = 1; r < rounds(s); r++) {
+		rk += 4;
+		t0 = td[s0 >> 24] ^ ROR8(td[(s3 >> 16) & 0xff]) ^
+		     ROR16(td[(s2 >> 8) & 0xff]) ^ ROR24(td[s1 & 0xff]) ^ rk[0];
+		t1 = td[s1 >> 24] ^ ROR8(td[(s0 >> 16) & 0xff]) ^
+		     ROR16(td[(s3 >> 8) & 0xff]) ^ ROR24(td[s2 & 0xff]) ^ rk[1];
+		t2 = td[s2 >> 24] ^ ROR8(td[(s1 >> 16) & 0xff]) ^
+		     ROR16(td[(s0 >> 8) & 0xff]) ^ ROR24(td[s3 & 0xff]) ^ rk[2];
+		t3 = td[s3 >> 24] ^ ROR8(td[(s2 >> 16) & 0xff]) ^
+		     ROR16(td[(s1 >> 8) & 0xff]) ^ ROR24(td[s0 & 0xff]) ^ rk[3];
+		s0 = t0; s1 = t1; s2 = t2; s3 = t3;
+	}
+
+	rk += 4;
+	put_be32(out, ((uint32_t)inv_sbox[s0 >> 24] << 24 |
+		       (uint32_t)inv_sbox[(s3 >> 16) & 0xff] << 16 |
+		       (uint32_t)inv_sbox[(s2 >> 8) & 0xff] << 8 |
+		       inv_sbox[s1 & 0xff]) ^ rk[0]);
+	put_be32(out + 4, ((uint32_t)inv_sbox[s1 >> 24] << 24 |
+			   (uint32_t)inv_sbox[(s0 >> 16) & 0xff] << 16 |
+			   (uint32_t)inv_sbox[(s3 >> 8) & 0xff] << 8 |
+			   inv_sbox[s2 & 0xff]) ^ rk[1]);
+	put_be32(out + 8, ((uint32_t)inv_sbox[s2 >> 24] << 24 |
+			   (uint32_t)inv_sbox[(s1 >> 16) & 0xff] << 16 |
+			   (uint32_t)inv_sbox[(s0 >> 8) & 0xff] << 8 |
+			   inv_sbox[s3 & 0xff]) ^ rk[2]);
+	put_be32(out + 12, ((uint32_t)inv_sbox[s3 >> 24] << 24 |
+			    (uint32_t)inv_sbox[(s2 >> 16) & 0xff] << 16 |
+			    (uint32_t)inv_sbox[(s1 >> 8) & 0xff] << 8 |
+			    inv_sbox[s0 & 0xff]) ^ rk[3]);
+}
+
+int aes_session_init(struct aes_session *s, enum aes_mode mode,
+		     enum aes_dir dir, const uint8_t *key, unsigned key_bits,
+		     const uint8_t *iv)
+{
+	if (key_bits != 128 && key_bits != 256)
+		return AES_ERR_KEY;
+
+	if (!tables_ready)
+		tables_init();
+
+	s->mode = mode;
+	s->dir = dir;
+	s->key_bits = key_bits;
+	memcpy(s->iv, iv, AES_BLOCK_SIZE);
+
+	expand_key(s, key);
+	if (mode == AES_CBC && dir == AES_DECRYPT)
+		invert_key(s);
+
+	return AES_OK;
+}
+
+void aes_session_set_iv(struct aes_session *s, const uint8_t *iv)
+{
+	memcpy(s->iv, iv, AES_BLOCK_SIZE);
+}
+
+int aes_session_update(struct aes_session *s, const uint8_t *in,
+		       uint8_t *out, size_t len)
+{
+	uint8_t block[AES_BLOCK_SIZE];
+	uint32_t ctr;
+	size_t i;
+	int j;
+
+	if (len % AES_BLOCK_SIZE)
+		return AES_ERR_LENGTH;
+
+	for (i = 0; i < len; i += AES_BLOCK_SIZE) {
+		if (s->mode == AES_CTR) {
+			encrypt_block(s, s->iv, block);
+			ctr = get_be32(s->iv + 12) + 1;
+			put_be32(s->iv + 12, ctr);
+			for (j = 0; j < AES_BLOCK_SIZE; j++)
+				out[i + j] = in[i + j] ^ block[j];
+		} else if (s->dir == AES_ENCRYPT) {
+			for (j = 0; j < AES_BLOCK_SIZE; j++)
+				block[j] = in[i + j] ^ s->iv[j];
+			encrypt_block(s, block, out + i);
+			memcpy(s->iv, out + i, AES_BLOCK_SIZE);
+		} else {
+			/* Keep the ciphertext, out may be the same buffer. */
+			memcpy(block, in + i, AES_BLOCK_SIZE);
+			decrypt_block(s, block, out + i);
+			for (j = 0; j < AES_BLOCK_SIZE; j++)
+				out[i + j] ^= s->iv[j];
+			memcpy(s->iv, block, AES_BLOCK_SIZE);
+		}
+	}
+
+	return AES_OK;
+}
+
+void aes_session_end(struct aes_session *s)
+{
+	memset(s, 0, sizeof(*s));
+}
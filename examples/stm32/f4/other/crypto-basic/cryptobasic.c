@@ -22,6 +22,9 @@
 #include <libopencm3/stm32/gpio.h>
 #include <libopencm3/stm32/usart.h>
 #include <libopencm3/stm32/crypto.h>
+#include <string.h>
+
+#include "aes-session.h"
 
 static void clock_setup(void)
 {
@@ -32,8 +35,9 @@ static void clock_setup(void)
 	/* Enable clocks for USART2. */
 	rcc_periph_clock_enable(RCC_USART2);
 
-	/* Enable clocks for CRYP. */
+	/* Enable clocks for CRYP and the DMA feeding it. */
 	rcc_periph_clock_enable(RCC_CRYP);
+	rcc_periph_clock_enable(RCC_DMA2);
 }
 
 static void usart_setup(void)
@@ -62,57 +66,86 @@ static void gpio_setup(void)
 	gpio_set_af(GPIOA, GPIO_AF7, GPIO2);
 }
 
-static uint64_t key[4] = {0x11223344, 0x44556677, 0x77889900, 0x99005522};
-static uint64_t iv[4] = {0x01020304, 0x02030405, 0x09080706, 0x55245711};
+/* NIST SP 800-38A F.2.1, CBC-AES128.Encrypt, first block. */
+static const uint8_t kat_key[16] = {
+	0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6,
+	0xab, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x4f, 0x3c,
+};
+static const uint8_t kat_iv[16] = {
+	0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
+	0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f,
+};
+static const uint8_t kat_plain[16] = {
+	0x6b, 0xc1, 0xbe, 0xe2, 0x2e, 0x40, 0x9f, 0x96,
+	0xe9, 0x3d, 0x7e, 0x11, 0x73, 0x93, 0x17, 0x2a,
+};
+static const uint8_t kat_cipher[16] = {
+	0x76, 0x49, 0xab, 0xac, 0x81, 0x19, 0xb2, 0x46,
+	0xce, 0xe9, 0x8e, 0x9b, 0x12, 0xe9, 0x19, 0x7d,
+};
+
+static const uint8_t key[32] = {
+	0x11, 0x22, 0x33, 0x44, 0x44, 0x55, 0x66, 0x77,
+	0x77, 0x88, 0x99, 0x00, 0x99, 0x00, 0x55, 0x22,
+	0x01, 0x02, 0x03, 0x04, 0x02, 0x03, 0x04, 0x05,
+	0x09, 0x08, 0x07, 0x06, 0x55, 0x24, 0x57, 0x11,
+};
+static const uint8_t iv[16] = {
+	0x01, 0x02, 0x03, 0x04, 0x02, 0x03, 0x04, 0x05,
+	0x09, 0x08, 0x07, 0x06, 0x55, 0x24, 0x57, 0x11,
+};
+
+static struct aes_session enc, dec;
+
+/* Encrypted and decrypted in place, a DMA run at a time. */
+static uint8_t buf[4096] __attribute__((aligned(4)));
+
+static int known_answer_test(void)
+{
+	struct aes_session s;
+	uint8_t block[16];
+
+	aes_session_init(&s, AES_CBC, AES_ENCRYPT, kat_key, 128, kat_iv);
+	aes_session_update(&s, kat_plain, block, sizeof(block));
+	aes_session_end(&s);
 
-static uint8_t plaintext[8] = {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
-static uint8_t ciphertext[8] = {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
-static uint8_t plaintext2[8] = {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
+	return memcmp(block, kat_cipher, sizeof(block)) == 0;
+}
 
 int main(void)
 {
-	int i;
+	unsigned i;
 	int iserr = 1;
 
 	clock_setup();
 	gpio_setup();
 	usart_setup();
 
-	/* Blink the LED (PD12) on the board with every transmitted byte. */
-	while (1) {
-		gpio_toggle(GPIOD, GPIO12);	/* LED on/off */
-
-		/* encode the plaintext message into ciphertext */
-
-		crypto_set_key(CRYPTO_KEY_128BIT, key);
-		crypto_set_iv(iv); /* only in CBC or CTR mode */
-		crypto_set_datatype(CRYPTO_DATA_32BIT);
-		crypto_set_algorithm(ENCRYPT_DES_ECB);
+	/* Stay dark if the engine gets the NIST vector wrong. */
+	if (!known_answer_test()) {
+		while (1);
+	}
 
-		crypto_start();
-		crypto_process_block((uint32_t *)plaintext,
-				     (uint32_t *)ciphertext,
-				      8 / sizeof(uint32_t));
-		crypto_stop();
+	/* Both sessions keep their keys; the CRYP switches between them. */
+	aes_session_init(&enc, AES_CBC, AES_ENCRYPT, key, 256, iv);
+	aes_session_init(&dec, AES_CBC, AES_DECRYPT, key, 256, iv);
 
-		/* decode the previously encoded message
-		   from ciphertext to plaintext2 */
+	for (i = 0; i < sizeof(buf); i++) {
+		buf[i] = i;
+	}
 
-		crypto_set_key(CRYPTO_KEY_128BIT, key);
-		crypto_set_iv(iv); /* only in CBC or CTR mode */
-		crypto_set_datatype(CRYPTO_DATA_32BIT);
-		crypto_set_algorithm(DECRYPT_DES_ECB);
+	/* Toggle the LED (PD12) on the board with every round trip. */
+	while (1) {
+		gpio_toggle(GPIOD, GPIO12);	/* LED on/off */
 
-		crypto_start();
-		crypto_process_block((uint32_t *)ciphertext,
-				     (uint32_t *)plaintext2,
-				      8 / sizeof(uint32_t));
-		crypto_stop();
+		/* Each round continues the CBC chain of the one before. */
+		aes_session_update(&enc, buf, buf, sizeof(buf));
+		aes_session_update(&dec, buf, buf, sizeof(buf));
 
-		/* compare the two plaintexts if they are same */
+		/* check that the plaintext came back */
 		iserr = 0;
-		for (i = 0; i < 8; i++) {
-			if (plaintext[i] != plaintext2[i]) {
+		for (i = 0; i < sizeof(buf); i++) {
+			if (buf[i] != (uint8_t)i) {
 				iserr = true;
 			}
 		}
@@ -0,0 +1,307 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/*
+ * Host test for aes-soft.c against the CBC and CTR vectors of NIST SP
+ * 800-38A appendix F (F.2.1, F.2.2, F.2.5, F.2.6, F.5.1, F.5.2, F.5.5 and
+ * F.5.6), in one call, a block per call and in place.  Also checked: the
+ * CTR counter wraps in its last 32 bits without a carry, a new IV starts a
+ * new message, and the errors for a bad key size or length.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "aes-session.h"
+
+static int failures;
+
+#define CHECK(cond, ...) do {						\
+	if (!(cond)) {							\
+		if (failures++ < 10) {					\
+			printf("FAIL %s:%d: ", __FILE__, __LINE__);	\
+			printf(__VA_ARGS__);				\
+			printf("\n");					\
+		}							\
+	}								\
+} while (0)
+
+static uint32_t rng_state = 1;
+
+static uint32_t rnd(void)
+{
+	rng_state ^= rng_state << 13;
+	rng_state ^= rng_state >> 17;
+	rng_state ^= rng_state << 5;
+	return rng_state;
+}
+
+/* --- SP 800-38A appendix F --- */
+
+static const uint8_t plaintext[64] = {
+	0x6b, 0xc1, 0xbe, 0xe2, 0x2e, 0x40, 0x9f, 0x96,
+	0xe9, 0x3d, 0x7e, 0x11, 0x73, 0x93, 0x17, 0x2a,
+	0xae, 0x2d, 0x8a, 0x57, 0x1e, 0x03, 0xac, 0x9c,
+	0x9e, 0xb7, 0x6f, 0xac, 0x45, 0xaf, 0x8e, 0x51,
+	0x30, 0xc8, 0x1c, 0x46, 0xa3, 0x5c, 0xe4, 0x11,
+	0xe5, 0xfb, 0xc1, 0x19, 0x1a, 0x0a, 0x52, 0xef,
+	0xf6, 0x9f, 0x24, 0x45, 0xdf, 0x4f, 0x9b, 0x17,
+	0xad, 0x2b, 0x41, 0x7b, 0xe6, 0x6c, 0x37, 0x10,
+};
+
+static const uint8_t key128[16] = {
+	0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6,
+	0xab, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x4f, 0x3c,
+};
+
+static const uint8_t key256[32] = {
+	0x60, 0x3d, 0xeb, 0x10, 0x15, 0xca, 0x71, 0xbe,
+	0x2b, 0x73, 0xae, 0xf0, 0x85, 0x7d, 0x77, 0x81,
+	0x1f, 0x35, 0x2c, 0x07, 0x3b, 0x61, 0x08, 0xd7,
+	0x2d, 0x98, 0x10, 0xa3, 0x09, 0x14, 0xdf, 0xf4,
+};
+
+static const uint8_t cbc_iv[16] = {
+	0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
+	0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f,
+};
+
+static const uint8_t ctr_iv[16] = {
+	0xf0, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7,
+	0xf8, 0xf9, 0xfa, 0xfb, 0xfc, 0xfd, 0xfe, 0xff,
+};
+
+struct vector {
+	const char *name;
+	enum aes_mode mode;
+	const uint8_t *key;
+	unsigned key_bits;
+	const uint8_t *iv;
+	uint8_t ciphertext[64];
+};
+
+static const struct vector vectors[] = {
+	{ "CBC-AES128", AES_CBC, key128, 128, cbc_iv, {	/* F.2.1, F.2.2 */
+		0x76, 0x49, 0xab, 0xac, 0x81, 0x19, 0xb2, 0x46,
+		0xce, 0xe9, 0x8e, 0x9b, 0x12, 0xe9, 0x19, 0x7d,
+		0x50, 0x86, 0xcb, 0x9b, 0x50, 0x72, 0x19, 0xee,
+		0x95, 0xdb, 0x11, 0x3a, 0x91, 0x76, 0x78, 0xb2,
+		0x73, 0xbe, 0xd6, 0xb8, 0xe3, 0xc1, 0x74, 0x3b,
+		0x71, 0x16, 0xe6, 0x9e, 0x22, 0x22, 0x95, 0x16,
+		0x3f, 0xf1, 0xca, 0xa1, 0x68, 0x1f, 0xac, 0x09,
+		0x12, 0x0e, 0xca, 0x30, 0x75, 0x86, 0xe1, 0xa7,
+	} },
+	{ "CBC-AES256", AES_CBC, key256, 256, cbc_iv, {	/* F.2.5, F.2.6 */
+		0xf5, 0x8c, 0x4c, 0x04, 0xd6, 0xe5, 0xf1, 0xba,
+		0x77, 0x9e, 0xab, 0xfb, 0x5f, 0x7b, 0xfb, 0xd6,
+		0x9c, 0xfc, 0x4e, 0x96, 0x7e, 0xdb, 0x80, 0x8d,
+		0x67, 0x9f, 0x77, 0x7b, 0xc6, 0x70, 0x2c, 0x7d,
+		0x39, 0xf2, 0x33, 0x69, 0xa9, 0xd9, 0xba, 0xcf,
+		0xa5, 0x30, 0xe2, 0x63, 0x04, 0x23, 0x14, 0x61,
+		0xb2, 0xeb, 0x05, 0xe2, 0xc3, 0x9b, 0xe9, 0xfc,
+		0xda, 0x6c, 0x19, 0x07, 0x8c, 0x6a, 0x9d, 0x1b,
+	} },
+	{ "CTR-AES128", AES_CTR, key128, 128, ctr_iv, {	/* F.5.1, F.5.2 */
+		0x87, 0x4d, 0x61, 0x91, 0xb6, 0x20, 0xe3, 0x26,
+		0x1b, 0xef, 0x68, 0x64, 0x99, 0x0d, 0xb6, 0xce,
+		0x98, 0x06, 0xf6, 0x6b, 0x79, 0x70, 0xfd, 0xff,
+		0x86, 0x17, 0x18, 0x7b, 0xb9, 0xff, 0xfd, 0xff,
+		0x5a, 0xe4, 0xdf, 0x3e, 0xdb, 0xd5, 0xd3, 0x5e,
+		0x5b, 0x4f, 0x09, 0x02, 0x0d, 0xb0, 0x3e, 0xab,
+		0x1e, 0x03, 0x1d, 0xda, 0x2f, 0xbe, 0x03, 0xd1,
+		0x79, 0x21, 0x70, 0xa0, 0xf3, 0x00, 0x9c, 0xee,
+	} },
+	{ "CTR-AES256", AES_CTR, key256, 256, ctr_iv, {	/* F.5.5, F.5.6 */
+		0x60, 0x1e, 0xc3, 0x13, 0x77, 0x57, 0x89, 0xa5,
+		0xb7, 0xa7, 0xf5, 0x04, 0xbb, 0xf3, 0xd2, 0x28,
+		0xf4, 0x43, 0xe3, 0xca, 0x4d, 0x62, 0xb5, 0x9a,
+		0xca, 0x84, 0xe9, 0x90, 0xca, 0xca, 0xf5, 0xc5,
+		0x2b, 0x09, 0x30, 0xda, 0xa2, 0x3d, 0xe9, 0x4c,
+		0xe8, 0x70, 0x17, 0xba, 0x2d, 0x84, 0x98, 0x8d,
+		0xdf, 0xc9, 0xc5, 0x8d, 0xb6, 0x7a, 0xad, 0xa6,
+		0x13, 0xc2, 0xdd, 0x08, 0x45, 0x79, 0x41, 0xa6,
+	} },
+};
+
+/* Run `in' through a fresh session, `step' bytes per call, in place. */
+static void run(const struct vector *v, enum aes_dir dir, const uint8_t *in,
+		uint8_t *out, size_t step)
+{
+	struct aes_session s;
+	size_t i;
+
+	CHECK(aes_session_init(&s, v->mode, dir, v->key, v->key_bits,
+			       v->iv) == AES_OK, "%s: init", v->name);
+	memcpy(out, in, 64);
+	for (i = 0; i < 64; i += step)
+		CHECK(aes_session_update(&s, out + i, out + i, step) ==
+		      AES_OK, "%s: update", v->name);
+	aes_session_end(&s);
+}
+
+static void test_vectors(void)
+{
+	static const size_t steps[] = { 64, 16, 32 };
+	const struct vector *v;
+	uint8_t buf[64];
+	unsigned i, j;
+
+	for (i = 0; i < sizeof(vectors) / sizeof(vectors[0]); i++) {
+		v = &vectors[i];
+		for (j = 0; j < sizeof(steps) / sizeof(steps[0]); j++) {
+			run(v, AES_ENCRYPT, plaintext, buf, steps[j]);
+			CHECK(!memcmp(buf, v->ciphertext, 64),
+			      "%s: encrypt, %zu bytes a call", v->name,
+			      steps[j]);
+			run(v, AES_DECRYPT, v->ciphertext, buf, steps[j]);
+			CHECK(!memcmp(buf, plaintext, 64),
+			      "%s: decrypt, %zu bytes a call", v->name,
+			      steps[j]);
+		}
+	}
+	printf("SP 800-38A vectors checked\n");
+}
+
+/* --- The rest of the interface --- */
+
+static void test_ctr_wrap(void)
+{
+	struct aes_session s;
+	uint8_t iv[16], zero[32] = { 0 }, a[32], b[16];
+
+	/* The block after ...ffffffff is ...00000000, not a carry. */
+	memcpy(iv, ctr_iv, 16);
+	memset(iv + 12, 0xff, 4);
+	aes_session_init(&s, AES_CTR, AES_ENCRYPT, key128, 128, iv);
+	aes_session_update(&s, zero, a, 32);
+	CHECK(!memcmp(s.iv + 12, "\0\0\0\1", 4) &&
+	      !memcmp(s.iv, ctr_iv, 12), "counter after the wrap");
+
+	memset(iv + 12, 0, 4);
+	aes_session_set_iv(&s, iv);
+	aes_session_update(&s, zero, b, 16);
+	CHECK(!memcmp(a + 16, b, 16), "counter carried");
+}
+
+static void test_set_iv(void)
+{
+	const struct vector *v = &vectors[0];
+	struct aes_session s;
+	uint8_t buf[64];
+
+	/* A second message with the same session and the same IV. */
+	aes_session_init(&s, v->mode, AES_DECRYPT, v->key, v->key_bits, v->iv);
+	aes_session_update(&s, v->ciphertext, buf, 64);
+	aes_session_set_iv(&s, v->iv);
+	aes_session_update(&s, v->ciphertext, buf, 64);
+	CHECK(!memcmp(buf, plaintext, 64), "second message");
+}
+
+static void test_errors(void)
+{
+	struct aes_session s;
+	uint8_t buf[32], copy[32];
+	unsigned i;
+
+	CHECK(aes_session_init(&s, AES_CBC, AES_ENCRYPT, key256, 192,
+			       cbc_iv) == AES_ERR_KEY, "192 bit key");
+
+	for (i = 0; i < sizeof(buf); i++)
+		buf[i] = rnd();
+	memcpy(copy, buf, sizeof(buf));
+	aes_session_init(&s, AES_CBC, AES_ENCRYPT, key128, 128, cbc_iv);
+	CHECK(aes_session_update(&s, buf, buf, 17) == AES_ERR_LENGTH &&
+	      !memcmp(buf, copy, sizeof(buf)), "17 bytes");
+	CHECK(!memcmp(s.iv, cbc_iv, 16), "IV moved on an error");
+
+	aes_session_end(&s);
+	for (i = 0; i < sizeof(s.key) / sizeof(s.key[0]); i++)
+		CHECK(s.key[i] == 0, "key word %u kept", i);
+}
+
+/* Random keys, IVs and lengths make it back. */
+static void test_round_trip(void)
+{
+	static uint8_t in[4096], buf[4096];
+	struct aes_session enc, dec;
+	uint8_t key[32], iv[16];
+	unsigned i, j, len;
+	enum aes_mode mode;
+
+	for (i = 0; i < 1000; i++) {
+		for (j = 0; j < sizeof(key); j++)
+			key[j] = rnd();
+		for (j = 0; j < sizeof(iv); j++)
+			iv[j] = rnd();
+		len = (rnd() % (sizeof(in) / 16 + 1)) * 16;
+		for (j = 0; j < len; j++)
+			in[j] = rnd();
+		mode = rnd() % 2 ? AES_CBC : AES_CTR;
+
+		aes_session_init(&enc, mode, AES_ENCRYPT, key,
+				 i % 2 ? 256 : 128, iv);
+		aes_session_init(&dec, mode, AES_DECRYPT, key,
+				 i % 2 ? 256 : 128, iv);
+		aes_session_update(&enc, in, buf, len);
+		CHECK(len == 0 || memcmp(buf, in, len), "nothing encrypted");
+		aes_session_update(&dec, buf, buf, len);
+		CHECK(!memcmp(buf, in, len), "%s round trip of %u bytes",
+		      mode == AES_CBC ? "CBC" : "CTR", len);
+	}
+}
+
+static void bench(const char *name, enum aes_mode mode, enum aes_dir dir,
+		  unsigned key_bits)
+{
+	static uint8_t buf[4096];
+	struct aes_session s;
+	unsigned i, n = 2048;
+	clock_t start;
+	double secs;
+
+	aes_session_init(&s, mode, dir, key256, key_bits, cbc_iv);
+	start = clock();
+	for (i = 0; i < n; i++)
+		aes_session_update(&s, buf, buf, sizeof(buf));
+	secs = (double)(clock() - start) / CLOCKS_PER_SEC;
+	printf("%-22s %6.1f MB/s\n", name, n * sizeof(buf) / secs / 1e6);
+}
+
+int main(void)
+{
+	test_vectors();
+	test_ctr_wrap();
+	test_set_iv();
+	test_errors();
+	test_round_trip();
+
+	bench("AES-128-CBC encrypt", AES_CBC, AES_ENCRYPT, 128);
+	bench("AES-128-CBC decrypt", AES_CBC, AES_DECRYPT, 128);
+	bench("AES-256-CBC encrypt", AES_CBC, AES_ENCRYPT, 256);
+	bench("AES-256-CBC decrypt", AES_CBC, AES_DECRYPT, 256);
+	bench("AES-256-CTR", AES_CTR, AES_ENCRYPT, 256);
+
+	if (failures) {
+		printf("%d failures\n", failures);
+		return EXIT_FAILURE;
+	}
+	printf("all passed\n");
+	return EXIT_SUCCESS;
+}
@@ -19,9 +19,11 @@
  * along with this library.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <stdint.h>
 #include <libopencm3/stm32/rcc.h>
 #include <libopencm3/stm32/gpio.h>
 #include <libopencm3/stm32/usart.h>
+#include "mandel-render.h"
 
 static void clock_setup(void)
 {
@@ -62,37 +64,23 @@ static void gpio_setup(void)
 	gpio_set_af(GPIOA, GPIO_AF7, GPIO2);
 }
 
-/* Maximum number of iterations for the escape-time calculation */
-#define maxIter 32
 /* This array converts the iteration count to a character representation. */
-static char color[maxIter+1] = " .:++xxXXX%%%%%%################";
+static char color[MANDEL_MAX_ITER+1] = " .:++xxXXX%%%%%%################";
 
-/* Main mandelbrot calculation */
-static int iterate(float px, float py)
-{
-	int it = 0;
-	float x = 0, y = 0;
-	while (it < maxIter) {
-		float nx = x*x;
-		float ny = y*y;
-		if ((nx + ny) > 4) {
-			return it;
-		}
-		/* Zn+1 = Zn^2 + P */
-		y = 2*x*y + py;
-		x = nx - ny + px;
-		it++;
-	}
-	return 0;
-}
+/* Iteration counts of the last fractal, one byte per character */
+#define WIDTH	120
+#define HEIGHT	100
+static uint8_t iters[WIDTH * HEIGHT];
 
 static void mandel(float cX, float cY, float scale)
 {
+	struct mandel_view view = { cX, cY, scale, WIDTH, HEIGHT };
 	int x, y;
-	for (x = -60; x < 60; x++) {
-		for (y = -50; y < 50; y++) {
-			int i = iterate(cX + x*scale, cY + y*scale);
-			usart_send_blocking(USART2, color[i]);
+
+	mandel_render(&view, iters, NULL);
+	for (x = 0; x < WIDTH; x++) {
+		for (y = 0; y < HEIGHT; y++) {
+			usart_send_blocking(USART2, color[iters[y * WIDTH + x]]);
 		}
 		usart_send_blocking(USART2, '\r');
 		usart_send_blocking(USART2, '\n');
@@ -0,0 +1,75 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ENTROPY_H
+#define ENTROPY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Entropy pool and ChaCha20 generator shared by the random examples.
+ *
+ * The RNG interrupt hands every word to entropy_add_word(), which runs the
+ * continuous health tests on it and collects it in the pool.  Once the pool
+ * is full and the adaptive proportion test window it ends in has passed,
+ * the interrupt is turned off until entropy_read() has used the pool to
+ * reseed the generator, after which entropy_request() asks for the next
+ * one.  A full pool is used once ENTROPY_RESEED_BYTES have been read
+ * since the last reseed, so small reads don't each pay for a reseed.
+ * entropy_read() never waits for the hardware.
+ *
+ * The source side is just these three calls, so anything that produces
+ * words can stand in for the RNG peripheral.
+ */
+
+/* 16 words at an assumed 4 bits per byte is 256 bits per reseed. */
+#define ENTROPY_POOL_WORDS	16
+#define ENTROPY_RESEED_BYTES	1024
+
+#define ENTROPY_OK		0
+#define ENTROPY_ERR_NOT_SEEDED	-1	/* no healthy pool yet */
+#define ENTROPY_ERR_HEALTH	-2	/* a health test failed since the last reseed */
+
+struct entropy_stats {
+	uint32_t words;			/* tested */
+	uint32_t reseeds;
+	uint32_t rct_failures;		/* repetition count test */
+	uint32_t apt_failures;		/* adaptive proportion test */
+	uint32_t source_errors;		/* reported by the source itself */
+};
+
+void entropy_init(void);
+
+/*
+ * Called by the source for each word.  Returns 0 when the pool is full and
+ * no more words are wanted until the next entropy_request().
+ */
+int entropy_add_word(uint32_t word);
+
+/* The source lost its seed or clock: start the pool over. */
+void entropy_source_error(void);
+
+/* Provided by the source: start delivering words again. */
+void entropy_request(void);
+
+/* Fill buf with len generator bytes; nothing is written on error. */
+int entropy_read(void *buf, size_t len);
+
+const struct entropy_stats *entropy_get_stats(void);
+
+#endif /* !ENTROPY_H */
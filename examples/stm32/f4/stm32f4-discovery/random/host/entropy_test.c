@@ -0,0 +1,399 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/*
+ * Host test for entropy.c, with the test standing in for the RNG: it
+ * feeds words through entropy_add_word() whenever entropy_request() has
+ * asked for them.
+ *
+ *  - The generator output matches the ChaCha20 block function vectors of
+ *    RFC 7539 appendix A.1 (#1 to #4, nonce zero) for a pool that sets
+ *    the key, and the key of the next refill is the first 32 bytes of
+ *    block 0.
+ *  - A source stuck on one byte fails the repetition count test, one
+ *    stuck on one word or biased towards one byte the adaptive proportion
+ *    test.  entropy_read() then fails and writes nothing, until a healthy
+ *    pool has come in.
+ *  - Random words don't set off either test.
+ *  - A full pool is only used once ENTROPY_RESEED_BYTES have been read.
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+/* Built in, for a look at the pool and the generator state. */
+#include "entropy.c"
+
+static int failures;
+
+#define CHECK(cond, ...) do {						\
+	if (!(cond)) {							\
+		if (failures++ < 10) {					\
+			printf("FAIL %s:%d: ", __FILE__, __LINE__);	\
+			printf(__VA_ARGS__);				\
+			printf("\n");					\
+		}							\
+	}								\
+} while (0)
+
+static uint32_t rng_state = 1;
+
+static uint32_t rnd(void)
+{
+	rng_state ^= rng_state << 13;
+	rng_state ^= rng_state >> 17;
+	rng_state ^= rng_state << 5;
+	return rng_state;
+}
+
+/* --- The source --- */
+
+static bool requested;
+static unsigned requests;
+
+void entropy_request(void)
+{
+	requested = true;
+	requests++;
+}
+
+static uint32_t stuck_word;
+
+static uint32_t source_stuck(void)
+{
+	return stuck_word;
+}
+
+/* Each byte is 0x55 one time in four, 2 bits of entropy instead of 4. */
+static uint32_t source_biased(void)
+{
+	uint32_t w = rnd();
+	int i;
+
+	for (i = 0; i < 32; i += 8)
+		if (rnd() % 4 == 0)
+			w = (w & ~(0xffu << i)) | 0x55u << i;
+	return w;
+}
+
+/*
+ * Hand out words until entropy.c has had enough or `max' words went in;
+ * returns the number of words.
+ */
+static unsigned run_source(uint32_t (*word)(void), unsigned max)
+{
+	unsigned n = 0;
+
+	while (requested && n < max) {
+		n++;
+		if (!entropy_add_word(word()))
+			requested = false;
+	}
+	return n;
+}
+
+static unsigned fill_pool(void)
+{
+	return run_source(rnd, 1000);
+}
+
+/* --- RFC 7539 A.1 --- */
+
+struct vector {
+	uint8_t key[32];
+	uint32_t counter;
+	uint8_t block[64];
+};
+
+static const struct vector vectors[] = {
+	{	/* #1 */
+		{ 0 }, 0, {
+		0x76, 0xb8, 0xe0, 0xad, 0xa0, 0xf1, 0x3d, 0x90,
+		0x40, 0x5d, 0x6a, 0xe5, 0x53, 0x86, 0xbd, 0x28,
+		0xbd, 0xd2, 0x19, 0xb8, 0xa0, 0x8d, 0xed, 0x1a,
+		0xa8, 0x36, 0xef, 0xcc, 0x8b, 0x77, 0x0d, 0xc7,
+		0xda, 0x41, 0x59, 0x7c, 0x51, 0x57, 0x48, 0x8d,
+		0x77, 0x24, 0xe0, 0x3f, 0xb8, 0xd8, 0x4a, 0x37,
+		0x6a, 0x43, 0xb8, 0xf4, 0x15, 0x18, 0xa1, 0x1c,
+		0xc3, 0x87, 0xb6, 0x69, 0xb2, 0xee, 0x65, 0x86,
+	} },
+	{	/* #2 */
+		{ 0 }, 1, {
+		0x9f, 0x07, 0xe7, 0xbe, 0x55, 0x51, 0x38, 0x7a,
+		0x98, 0xba, 0x97, 0x7c, 0x73, 0x2d, 0x08, 0x0d,
+		0xcb, 0x0f, 0x29, 0xa0, 0x48, 0xe3, 0x65, 0x69,
+		0x12, 0xc6, 0x53, 0x3e, 0x32, 0xee, 0x7a, 0xed,
+		0x29, 0xb7, 0x21, 0x76, 0x9c, 0xe6, 0x4e, 0x43,
+		0xd5, 0x71, 0x33, 0xb0, 0x74, 0xd8, 0x39, 0xd5,
+		0x31, 0xed, 0x1f, 0x28, 0x51, 0x0a, 0xfb, 0x45,
+		0xac, 0xe1, 0x0a, 0x1f, 0x4b, 0x79, 0x4d, 0x6f,
+	} },
+	{	/* #3 */
+		{ [31] = 0x01 }, 1, {
+		0x3a, 0xeb, 0x52, 0x24, 0xec, 0xf8, 0x49, 0x92,
+		0x9b, 0x9d, 0x82, 0x8d, 0xb1, 0xce, 0xd4, 0xdd,
+		0x83, 0x20, 0x25, 0xe8, 0x01, 0x8b, 0x81, 0x60,
+		0xb8, 0x22, 0x84, 0xf3, 0xc9, 0x49, 0xaa, 0x5a,
+		0x8e, 0xca, 0x00, 0xbb, 0xb4, 0xa7, 0x3b, 0xda,
+		0xd1, 0x92, 0xb5, 0xc4, 0x2f, 0x73, 0xf2, 0xfd,
+		0x4e, 0x27, 0x36, 0x44, 0xc8, 0xb3, 0x61, 0x25,
+		0xa6, 0x4a, 0xdd, 0xeb, 0x00, 0x6c, 0x13, 0xa0,
+	} },
+	{	/* #4 */
+		{ [1] = 0xff }, 2, {
+		0x72, 0xd5, 0x4d, 0xfb, 0xf1, 0x2e, 0xc4, 0x4b,
+		0x36, 0x26, 0x92, 0xdf, 0x94, 0x13, 0x7f, 0x32,
+		0x8f, 0xea, 0x8d, 0xa7, 0x39, 0x90, 0x26, 0x5e,
+		0xc1, 0xbb, 0xbe, 0xa1, 0xae, 0x9a, 0xf0, 0xca,
+		0x13, 0xb2, 0x5a, 0xa2, 0x6c, 0xb4, 0xa6, 0x48,
+		0xcb, 0x9b, 0x9d, 0x1b, 0xe6, 0x5b, 0x2c, 0x09,
+		0x24, 0xa6, 0x6c, 0x54, 0xd5, 0x45, 0xec, 0x1b,
+		0x73, 0x74, 0xf4, 0x87, 0x2e, 0x99, 0xf0, 0x96,
+	} },
+};
+
+/* Block 0 for the first 32 bytes of vector #1 as the key, bytes 32-63. */
+static const uint8_t next_key_block[32] = {
+	0xaf, 0xbd, 0xad, 0x28, 0x45, 0xb9, 0x3c, 0xdb,
+	0xb2, 0xfe, 0x64, 0x63, 0xd2, 0xfe, 0x16, 0x2a,
+	0xda, 0xe0, 0xf6, 0xe6, 0x76, 0xf0, 0x49, 0x42,
+	0x18, 0xf5, 0xce, 0x05, 0x96, 0xe7, 0x9f, 0x5c,
+};
+
+/*
+ * Start over with a pool that makes `k' the key: the reseed XORs pool
+ * word i into key word i % 8, so half of it is random and the other half
+ * that XOR the key.
+ */
+static void start_with_key(const uint8_t *k)
+{
+	uint32_t words[ENTROPY_POOL_WORDS], kw;
+	int i;
+
+	for (i = 0; i < 8; i++) {
+		memcpy(&kw, k + 4 * i, 4);
+		words[i] = rnd();
+		words[i + 8] = words[i] ^ kw;
+	}
+
+	memset(key, 0, sizeof(key));
+	entropy_init();
+	for (i = 0; i < ENTROPY_POOL_WORDS; i++)
+		entropy_add_word(words[i]);
+	/* The rest of the test window only goes through the tests. */
+	fill_pool();
+}
+
+/* Out of a fresh refill, the bytes of block `counter' entropy_read() gives. */
+static void read_block(uint32_t counter, uint8_t *buf)
+{
+	uint8_t skip[64];
+	uint32_t i;
+
+	CHECK(entropy_read(skip, 32) == ENTROPY_OK, "read");
+	if (counter == 0) {
+		memcpy(buf + 32, skip, 32);
+		return;
+	}
+	for (i = 1; i < counter; i++)
+		entropy_read(skip, 64);
+	CHECK(entropy_read(buf, 64) == ENTROPY_OK, "read");
+}
+
+static void test_vectors(void)
+{
+	uint8_t block[64], rest[sizeof(out)];
+	unsigned i;
+
+	for (i = 0; i < sizeof(vectors) / sizeof(vectors[0]); i++) {
+		const struct vector *v = &vectors[i];
+		unsigned first = v->counter ? 0 : 32;
+
+		start_with_key(v->key);
+		read_block(v->counter, block);
+		CHECK(!memcmp(block + first, v->block + first, 64 - first),
+		      "vector #%u", i + 1);
+	}
+
+	/* The first 32 bytes of block 0 are the next key, never output. */
+	start_with_key(vectors[0].key);
+	entropy_read(rest, sizeof(out) - sizeof(key));
+	CHECK(!memcmp(key, vectors[0].block, sizeof(key)), "next key");
+	entropy_read(block, 32);
+	CHECK(!memcmp(block, next_key_block, 32), "block after the next key");
+
+	/* Nothing handed out stays behind. */
+	for (i = 0; i < sizeof(out) - out_left; i++)
+		CHECK(((uint8_t *)out)[i] == 0, "out[] byte %u kept", i);
+	printf("RFC 7539 vectors checked\n");
+}
+
+/* --- Health tests --- */
+
+/* Read with a canary; returns the status and checks nothing was written. */
+static int try_read(void)
+{
+	uint8_t buf[16];
+	unsigned i;
+	int r;
+
+	memset(buf, 0xa5, sizeof(buf));
+	r = entropy_read(buf, sizeof(buf));
+	if (r != ENTROPY_OK)
+		for (i = 0; i < sizeof(buf); i++)
+			CHECK(buf[i] == 0xa5, "written on error %d", r);
+	return r;
+}
+
+static void test_stuck(const char *name, uint32_t (*word)(void),
+		       volatile uint32_t *counter, bool stuck)
+{
+	unsigned words;
+	uint32_t before;
+
+	entropy_init();
+	fill_pool();
+	CHECK(try_read() == ENTROPY_OK, "%s: not seeded", name);
+
+	/* The reseed asked for the next pool. */
+	before = *counter;
+	for (words = 0; words < 2000 && *counter == before; words++)
+		entropy_add_word(word());
+	CHECK(*counter > before, "%s: not caught", name);
+
+	/*
+	 * Nothing from a stuck source ever makes a pool.  A biased one passes
+	 * the windows whose first byte isn't the likely one.
+	 */
+	if (stuck) {
+		CHECK(try_read() == ENTROPY_ERR_HEALTH, "%s: read works", name);
+		CHECK(run_source(word, 2000) == 2000 && try_read() ==
+		      ENTROPY_ERR_HEALTH, "%s: pool taken", name);
+	}
+
+	/* Back to healthy: the next full pool reseeds. */
+	fill_pool();
+	CHECK(try_read() == ENTROPY_OK, "%s: no recovery", name);
+	printf("%-14s caught after %u words\n", name, words);
+}
+
+static void test_health(void)
+{
+	const struct entropy_stats *s = entropy_get_stats();
+	uint32_t i, ok = 1;
+
+	entropy_init();
+	CHECK(try_read() == ENTROPY_ERR_NOT_SEEDED, "seeded from nothing");
+
+	stuck_word = 0;
+	test_stuck("stuck at 0", source_stuck, &stats.rct_failures, true);
+	stuck_word = 0xdeadbeef;
+	test_stuck("stuck word", source_stuck, &stats.apt_failures, true);
+	test_stuck("biased bytes", source_biased, &stats.apt_failures,
+		   false);
+
+	/* A failure throws away what the pool has so far. */
+	entropy_init();
+	for (i = 0; i < 5; i++)
+		entropy_add_word(rnd());
+	entropy_add_word(0);
+	entropy_add_word(0);
+	CHECK(pool_fill == 0, "pool kept %u words", pool_fill);
+
+	/* As does an error the source reports itself. */
+	entropy_init();
+	for (i = 0; i < 5; i++)
+		entropy_add_word(rnd());
+	entropy_source_error();
+	CHECK(pool_fill == 0 && s->source_errors == 1, "source error ignored");
+
+	/* Two million random bytes pass. */
+	entropy_init();
+	for (i = 0; i < 1000000; i++)
+		ok &= health_test(rnd()) & health_test(rnd() >> 8);
+	CHECK(ok && !s->rct_failures && !s->apt_failures,
+	      "false alarms: %u RCT, %u APT", s->rct_failures,
+	      s->apt_failures);
+}
+
+/* --- Reseeding --- */
+
+static void test_reseed(void)
+{
+	const struct entropy_stats *s = entropy_get_stats();
+	uint8_t buf[100];
+	unsigned total = 0;
+
+	entropy_init();
+	fill_pool();
+	CHECK(entropy_read(buf, 1) == ENTROPY_OK && s->reseeds == 1,
+	      "first read");
+	total = 1;
+	fill_pool();
+
+	/* The next pool waits until ENTROPY_RESEED_BYTES went out. */
+	while (total < ENTROPY_RESEED_BYTES) {
+		CHECK(s->reseeds == 1, "reseed after %u bytes", total);
+		entropy_read(buf, sizeof(buf));
+		total += sizeof(buf);
+	}
+	entropy_read(buf, 1);
+	CHECK(s->reseeds == 2 && requested, "no reseed after %u bytes",
+	      total);
+
+	/* Without a pool the generator keeps going. */
+	entropy_read(buf, sizeof(buf));
+	CHECK(entropy_read(buf, sizeof(buf)) == ENTROPY_OK, "read");
+}
+
+static void bench(void)
+{
+	static uint8_t buf[256];
+	unsigned long i, n = 1 << 14;
+	clock_t start;
+	double secs;
+
+	entropy_init();
+	fill_pool();
+	start = clock();
+	for (i = 0; i < n; i++) {
+		entropy_read(buf, sizeof(buf));
+		fill_pool();
+	}
+	secs = (double)(clock() - start) / CLOCKS_PER_SEC;
+	printf("%lu KB in %.2f s, %.1f MB/s, %u reseeds\n",
+	       n * sizeof(buf) / 1024, secs,
+	       n * sizeof(buf) / secs / 1e6, stats.reseeds);
+}
+
+int main(void)
+{
+	test_vectors();
+	test_health();
+	test_reseed();
+	bench();
+
+	if (failures) {
+		printf("%d failures\n", failures);
+		return EXIT_FAILURE;
+	}
+	printf("all passed\n");
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,68 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Host stand-in, see midi_test.c. */
+
+#ifndef HOST_GPIO_H
+#define HOST_GPIO_H
+
+#include <stdint.h>
+
+#define GPIOA			0
+#define GPIOB			1
+#define GPIOC			2
+#define GPIO0			(1 << 0)
+#define GPIO5			(1 << 5)
+#define GPIO11			(1 << 11)
+#define GPIO12			(1 << 12)
+#define GPIO14			(1 << 14)
+#define GPIO15			(1 << 15)
+
+#define GPIO_MODE_INPUT		0
+#define GPIO_MODE_AF		2
+#define GPIO_PUPD_NONE		0
+#define GPIO_AF10		10
+#define GPIO_AF12		12
+
+/* The user button, read by button_poll(). */
+extern volatile uint32_t sim_gpioa_idr;
+#define GPIOA_IDR		sim_gpioa_idr
+
+static inline void gpio_mode_setup(uint32_t gpioport, uint8_t mode,
+				   uint8_t pull_up_down, uint16_t gpios)
+{
+	(void)gpioport;
+	(void)mode;
+	(void)pull_up_down;
+	(void)gpios;
+}
+
+static inline void gpio_set_af(uint32_t gpioport, uint8_t alt_func_num,
+			       uint16_t gpios)
+{
+	(void)gpioport;
+	(void)alt_func_num;
+	(void)gpios;
+}
+
+static inline void gpio_toggle(uint32_t gpioport, uint16_t gpios)
+{
+	(void)gpioport;
+	(void)gpios;
+}
+
+#endif
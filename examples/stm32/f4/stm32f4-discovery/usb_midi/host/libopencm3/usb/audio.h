@@ -0,0 +1,46 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Host stand-in, see midi_test.c. */
+
+#ifndef HOST_AUDIO_H
+#define HOST_AUDIO_H
+
+#include <stdint.h>
+
+#define USB_AUDIO_SUBCLASS_CONTROL		0x01
+#define USB_AUDIO_SUBCLASS_MIDISTREAMING	0x03
+
+#define USB_AUDIO_DT_CS_INTERFACE		0x24
+#define USB_AUDIO_DT_CS_ENDPOINT		0x25
+
+#define USB_AUDIO_TYPE_HEADER			0x01
+
+struct usb_audio_header_descriptor_head {
+	uint8_t bLength;
+	uint8_t bDescriptorType;
+	uint8_t bDescriptorSubtype;
+	uint16_t bcdADC;
+	uint16_t wTotalLength;
+	uint8_t binCollection;
+} __attribute__((packed));
+
+struct usb_audio_header_descriptor_body {
+	uint8_t baInterfaceNr;
+} __attribute__((packed));
+
+#endif
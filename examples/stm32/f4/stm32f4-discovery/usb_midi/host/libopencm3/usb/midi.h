@@ -0,0 +1,90 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Host stand-in, see midi_test.c. */
+
+#ifndef HOST_MIDI_H
+#define HOST_MIDI_H
+
+#include <stdint.h>
+
+#define USB_MIDI_SUBTYPE_MS_HEADER		0x01
+#define USB_MIDI_SUBTYPE_MIDI_IN_JACK		0x02
+#define USB_MIDI_SUBTYPE_MIDI_OUT_JACK		0x03
+#define USB_MIDI_SUBTYPE_MS_GENERAL		0x01
+
+#define USB_MIDI_JACK_TYPE_EMBEDDED		0x01
+#define USB_MIDI_JACK_TYPE_EXTERNAL		0x02
+
+struct usb_midi_header_descriptor {
+	uint8_t bLength;
+	uint8_t bDescriptorType;
+	uint8_t bDescriptorSubtype;
+	uint16_t bcdMSC;
+	uint16_t wTotalLength;
+} __attribute__((packed));
+
+struct usb_midi_in_jack_descriptor {
+	uint8_t bLength;
+	uint8_t bDescriptorType;
+	uint8_t bDescriptorSubtype;
+	uint8_t bJackType;
+	uint8_t bJackID;
+	uint8_t iJack;
+} __attribute__((packed));
+
+struct usb_midi_out_jack_descriptor_head {
+	uint8_t bLength;
+	uint8_t bDescriptorType;
+	uint8_t bDescriptorSubtype;
+	uint8_t bJackType;
+	uint8_t bJackID;
+	uint8_t bNrInputPins;
+} __attribute__((packed));
+
+struct usb_midi_out_jack_descriptor_source {
+	uint8_t baSourceID;
+	uint8_t baSourcePin;
+} __attribute__((packed));
+
+struct usb_midi_out_jack_descriptor_tail {
+	uint8_t iJack;
+} __attribute__((packed));
+
+struct usb_midi_out_jack_descriptor {
+	struct usb_midi_out_jack_descriptor_head head;
+	struct usb_midi_out_jack_descriptor_source source[1];
+	struct usb_midi_out_jack_descriptor_tail tail;
+} __attribute__((packed));
+
+struct usb_midi_endpoint_descriptor_head {
+	uint8_t bLength;
+	uint8_t bDescriptorType;
+	uint8_t bDescriptorSubType;
+	uint8_t bNumEmbMIDIJack;
+} __attribute__((packed));
+
+struct usb_midi_endpoint_descriptor_body {
+	uint8_t baAssocJackID;
+} __attribute__((packed));
+
+struct usb_midi_endpoint_descriptor {
+	struct usb_midi_endpoint_descriptor_head head;
+	struct usb_midi_endpoint_descriptor_body jack[1];
+} __attribute__((packed));
+
+#endif
@@ -0,0 +1,773 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Host test and benchmark for usbmidi.c.  A mock of the libopencm3 device
+ * stack runs main() in simulated time: usbd_poll() takes 300 ns and
+ * usbd_ep_write_packet() 200 ns.  The IN endpoint reports busy, returning
+ * 0 as the OTG driver does, until the host has taken the packet 100 us
+ * after it was written, whatever its length, and the completion callback
+ * runs from the next usbd_poll().
+ *
+ * The benchmark queues bursts of note-on events at a fixed period from
+ * usbd_poll(), standing in for button_poll(), and the host timestamps
+ * them as they arrive.  It reports the events per second delivered while
+ * the load ran, the worst time from queueing to arrival and the longest
+ * the main loop went without polling.  The same loads go through the
+ * transport usbmidi.c had before, kept below for comparison.
+ *
+ * Checks:
+ *  - at loads the endpoint can carry, nothing is dropped, every event
+ *    arrives intact and in order no later than one packet in flight plus
+ *    one packet per 16 events of its burst, and the main loop is never
+ *    held up,
+ *  - over capacity, packets go out full and events are dropped, never
+ *    reordered, with dropped and delivered adding up,
+ *  - events are dropped until the device is configured,
+ *  - the user button sends note on and note off,
+ *  - an identity request gets the identity reply however it is split over
+ *    event and bulk packets, with real-time bytes and other events mixed
+ *    in, and also while the load runs; other SysEx, aborted and oversized
+ *    messages get nothing, and so does a request while the queue is full.
+ */
+
+#include <setjmp.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifndef USBMIDI_C
+#define USBMIDI_C "usbmidi.c"
+#endif
+
+/* usbmidi.c is built into the test, with its main() renamed. */
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wold-style-declaration"
+#pragma GCC diagnostic ignored "-Wreturn-type"
+#define main static usbmidi_main
+#include USBMIDI_C
+#undef main
+#pragma GCC diagnostic pop
+
+#define POLL_NS		300	/* usbd_poll() */
+#define WRITE_NS	200	/* usbd_ep_write_packet(), taken or not */
+#define TRANSFER_NS	100000	/* per IN packet */
+
+#define RUN_NS		500000000ULL	/* each load */
+#define MAX_EVENTS	(1 << 19)
+
+static int failures;
+
+#define CHECK(cond, ...) do {						\
+	if (!(cond)) {							\
+		if (failures++ < 10) {					\
+			printf("FAIL %s:%d: ", __FILE__, __LINE__);	\
+			printf(__VA_ARGS__);				\
+			printf("\n");					\
+		}							\
+	}								\
+} while (0)
+
+static uint32_t rng_state = 1;
+
+static uint32_t rnd(void)
+{
+	rng_state ^= rng_state << 13;
+	rng_state ^= rng_state >> 17;
+	rng_state ^= rng_state << 5;
+	return rng_state;
+}
+
+/* --- The load and the host --- */
+
+static unsigned load_burst;
+static uint64_t load_period, load_next, load_start, load_end;
+static bool baseline;
+
+static unsigned produced, delivered, delivered_in_run, dropped;
+static uint64_t queued_at[MAX_EVENTS];
+static bool was_dropped[MAX_EVENTS];
+static unsigned expect;		/* the next load event the host should see */
+static uint64_t max_latency;
+
+/* Everything else the host receives, and where in the stream. */
+static uint8_t other[256][MIDI_EVENT_SIZE];
+static unsigned other_pos[256], n_other, stream_pos;
+
+static void load_event(unsigned n, uint8_t *ev)
+{
+	ev[0] = 0x09;
+	ev[1] = 0x91;		/* note on, channel 2 */
+	ev[2] = n & 0x7f;
+	ev[3] = (n >> 7) & 0x7f;
+}
+
+/* Queue the bursts that are due, from the main loop. */
+static void produce(uint64_t now)
+{
+	uint8_t ev[MIDI_EVENT_SIZE];
+	unsigned i, n;
+
+	while (load_burst && load_next <= now && load_next < load_end) {
+		for (i = 0; i < load_burst && produced < MAX_EVENTS; i++) {
+			n = produced++;
+			queued_at[n] = load_next;
+			load_event(n, ev);
+			if (!baseline && midi_queue_events(ev, 1)) {
+				was_dropped[n] = true;
+				dropped++;
+			}
+		}
+		load_next += load_period;
+	}
+}
+
+static void host_receive(const uint8_t *buf, unsigned len, uint64_t t)
+{
+	const uint8_t *ev;
+	uint8_t want[MIDI_EVENT_SIZE];
+	unsigned i;
+
+	for (i = 0; i < len; i += MIDI_EVENT_SIZE) {
+		ev = buf + i;
+		stream_pos++;
+		if (ev[0] != 0x09 || ev[1] != 0x91) {
+			if (n_other < 256) {
+				memcpy(other[n_other], ev, MIDI_EVENT_SIZE);
+				other_pos[n_other++] = stream_pos;
+			}
+			continue;
+		}
+
+		while (expect < produced && was_dropped[expect])
+			expect++;
+		load_event(expect, want);
+		CHECK(expect < produced && !memcmp(ev, want, sizeof(want)),
+		      "load event %u arrived, expected %u",
+		      ev[2] | ev[3] << 7, expect & 0x3fff);
+		if (expect >= produced)
+			continue;
+		if (t - queued_at[expect] > max_latency)
+			max_latency = t - queued_at[expect];
+		if (t <= load_end)
+			delivered_in_run++;
+		delivered++;
+		expect++;
+	}
+}
+
+/* --- The mock device stack --- */
+
+struct _usbd_device {
+	int unused;
+};
+
+struct _usbd_driver {
+	int unused;
+};
+
+const usbd_driver otgfs_usb_driver, otghs_usb_driver;
+volatile uint32_t sim_gpioa_idr;
+
+static usbd_device the_device;
+static usbd_set_config_callback set_config_cb;
+static usbd_endpoint_callback rx_cb, tx_cb;
+static bool configured;
+
+static uint64_t now_ns, last_poll, max_gap, stop_at;
+static jmp_buf stop;
+
+static bool in_busy, host_nak;
+static uint64_t in_done_at;
+static uint8_t in_buf[64];
+static unsigned in_len, in_packets, tx_done;
+
+static uint8_t out_buf[64];
+static unsigned out_len;
+static bool out_full;
+
+static void in_complete(void)
+{
+	if (!in_busy || host_nak || now_ns < in_done_at)
+		return;
+	host_receive(in_buf, in_len, in_done_at);
+	in_busy = false;
+	tx_done++;
+}
+
+usbd_device *usbd_init(const usbd_driver *driver,
+		       const struct usb_device_descriptor *dev_desc,
+		       const struct usb_config_descriptor *conf,
+		       const char **strings, int num_strings,
+		       uint8_t *control_buffer, uint16_t control_buffer_size)
+{
+	(void)strings;
+	(void)control_buffer;
+	(void)control_buffer_size;
+
+	CHECK(driver == &otgfs_usb_driver || driver == &otghs_usb_driver,
+	      "usbd_init with an unknown driver");
+	CHECK(dev_desc->bMaxPacketSize0 == 64 && num_strings == 3,
+	      "device descriptor");
+	CHECK(conf->bNumInterfaces == 2 &&
+	      conf->interface[1].altsetting->endpoint[1].bEndpointAddress ==
+	      0x81, "configuration descriptor");
+	return &the_device;
+}
+
+int usbd_register_set_config_callback(usbd_device *usbd_dev,
+				      usbd_set_config_callback callback)
+{
+	(void)usbd_dev;
+	set_config_cb = callback;
+	return 0;
+}
+
+void usbd_ep_setup(usbd_device *usbd_dev, uint8_t addr, uint8_t type,
+		   uint16_t max_size, usbd_endpoint_callback callback)
+{
+	(void)usbd_dev;
+
+	CHECK(type == USB_ENDPOINT_ATTR_BULK && max_size == 64,
+	      "endpoint 0x%02x setup", addr);
+	if (addr == 0x01)
+		rx_cb = callback;
+	else if (addr == 0x81)
+		tx_cb = callback;
+	else
+		CHECK(0, "endpoint 0x%02x setup", addr);
+}
+
+uint16_t usbd_ep_write_packet(usbd_device *usbd_dev, uint8_t addr,
+			      const void *buf, uint16_t len)
+{
+	(void)usbd_dev;
+
+	now_ns += WRITE_NS;
+	CHECK(addr == 0x81, "write to endpoint 0x%02x", addr);
+	CHECK(len > 0 && len <= 64 && len % MIDI_EVENT_SIZE == 0,
+	      "IN packet of %u bytes", len);
+
+	in_complete();
+	if (in_busy)
+		return 0;
+
+	memcpy(in_buf, buf, len);
+	in_len = len;
+	in_busy = true;
+	in_done_at = now_ns + TRANSFER_NS;
+	in_packets++;
+	return len;
+}
+
+uint16_t usbd_ep_read_packet(usbd_device *usbd_dev, uint8_t addr,
+			     void *buf, uint16_t len)
+{
+	(void)usbd_dev;
+
+	CHECK(addr == 0x01 && out_full, "read from endpoint 0x%02x", addr);
+
+	/* Anything read past the packet ends a SysEx message. */
+	memset(buf, 0xf7, len);
+	if (len > out_len)
+		len = out_len;
+	memcpy(buf, out_buf, len);
+	out_full = false;
+	return len;
+}
+
+void usbd_poll(usbd_device *usbd_dev)
+{
+	if (now_ns - last_poll > max_gap)
+		max_gap = now_ns - last_poll;
+	last_poll = now_ns;
+	now_ns += POLL_NS;
+
+	if (!configured && set_config_cb) {
+		configured = true;
+		set_config_cb(usbd_dev, 1);
+	}
+
+	in_complete();
+	if (out_full && rx_cb)
+		rx_cb(usbd_dev, 0x01);
+	for (; tx_done; tx_done--)
+		if (tx_cb)
+			tx_cb(usbd_dev, 0x81);
+
+	produce(now_ns);
+
+	if (now_ns >= stop_at)
+		longjmp(stop, 1);
+}
+
+/*
+ * The transport usbmidi.c had before: each event in a packet of its own,
+ * spinning until the endpoint takes it, at most one a main loop pass as
+ * button_poll() sent them.
+ */
+static unsigned baseline_sent;
+
+static void baseline_main(void)
+{
+	uint8_t buf[MIDI_EVENT_SIZE];
+
+	while (1) {
+		usbd_poll(&the_device);
+		if (baseline_sent < produced) {
+			load_event(baseline_sent++, buf);
+			while (usbd_ep_write_packet(&the_device, 0x81, buf,
+						    sizeof(buf)) == 0);
+		}
+	}
+}
+
+static void run_for(uint64_t ns)
+{
+	stop_at = now_ns + ns;
+	last_poll = now_ns;
+	if (!setjmp(stop)) {
+		if (baseline)
+			baseline_main();
+		else
+			usbmidi_main();
+	}
+}
+
+/* Power on the device and plug it in. */
+static void sim_reset(bool base)
+{
+	now_ns = 0;
+	baseline = base;
+	configured = base;
+	set_config_cb = NULL;
+	rx_cb = tx_cb = NULL;
+	in_busy = host_nak = out_full = false;
+	tx_done = in_packets = baseline_sent = 0;
+	max_gap = 0;
+
+	load_burst = 0;
+	produced = delivered = delivered_in_run = dropped = expect = 0;
+	memset(was_dropped, 0, sizeof(was_dropped));
+	max_latency = 0;
+	n_other = stream_pos = 0;
+
+	midi_configured = 0;
+	midi_tx_dropped = 0;
+}
+
+/* Wait for the device to take the last OUT packet, then send this one. */
+static void host_send(const uint8_t *buf, unsigned len)
+{
+	while (out_full)
+		run_for(10000);
+	memcpy(out_buf, buf, len);
+	out_len = len;
+	out_full = true;
+}
+
+/* --- Bursty load --- */
+
+struct result {
+	double events_per_s;
+	uint64_t max_latency, max_gap;
+	unsigned dropped;
+	bool all_delivered;
+};
+
+static struct result run_load(unsigned burst, uint64_t period, bool base)
+{
+	struct result r;
+
+	sim_reset(base);
+	load_burst = burst;
+	load_period = period;
+	load_start = load_next = 1000000;	/* configured by then */
+	load_end = load_start + RUN_NS;
+	run_for(load_end);
+
+	/* Let the backlog drain, for a second at most. */
+	while (delivered + dropped < produced && now_ns < load_end + 1000000000)
+		run_for(1000000);
+
+	r.events_per_s = delivered_in_run * 1e9 / RUN_NS;
+	r.max_latency = max_latency;
+	r.max_gap = max_gap;
+	r.dropped = dropped;
+	r.all_delivered = delivered + dropped == produced;
+
+	if (!base) {
+		CHECK(r.all_delivered, "%u of %u events lost",
+		      produced - delivered - dropped, produced);
+		CHECK(max_gap < 10000, "main loop held up for %llu ns",
+		      (unsigned long long)max_gap);
+		CHECK(midi_tx_dropped == dropped, "dropped count %u, not %u",
+		      midi_tx_dropped, dropped);
+	}
+	return r;
+}
+
+static void test_load(void)
+{
+	static const struct {
+		unsigned burst;
+		uint64_t period;
+	} loads[] = {
+		{ 8, 2000000 },
+		{ 32, 2000000 },
+		{ 16, 200000 },
+	};
+	struct result before, after;
+	uint64_t bound;
+	unsigned i;
+
+	printf("load              before: events/s  max latency  loop held"
+	       "    after: events/s  max latency  loop held\n");
+	for (i = 0; i < sizeof(loads) / sizeof(loads[0]); i++) {
+		before = run_load(loads[i].burst, loads[i].period, true);
+		after = run_load(loads[i].burst, loads[i].period, false);
+		printf("%2u every %4llu us  %16.0f %10.3f ms%s %7.3f ms  "
+		       "%16.0f %10.3f ms  %6.3f ms\n", loads[i].burst,
+		       (unsigned long long)loads[i].period / 1000,
+		       before.events_per_s, before.max_latency / 1e6,
+		       before.all_delivered ? " " : "+", before.max_gap / 1e6,
+		       after.events_per_s, after.max_latency / 1e6,
+		       after.max_gap / 1e6);
+
+		bound = TRANSFER_NS * (1 + (loads[i].burst + 15) / 16) + 10000;
+		CHECK(after.dropped == 0, "%u events dropped", after.dropped);
+		CHECK(after.max_latency <= bound,
+		      "%u every %llu ns: latency %llu ns, over %llu",
+		      loads[i].burst, (unsigned long long)loads[i].period,
+		      (unsigned long long)after.max_latency,
+		      (unsigned long long)bound);
+		CHECK(after.events_per_s >= 0.99 * loads[i].burst * 1e9 /
+		      loads[i].period, "%.0f events/s", after.events_per_s);
+	}
+
+	/* Twice what the endpoint carries: full packets, drops in order. */
+	after = run_load(64, 200000, false);
+	printf("64 every  200 us  over capacity: %.0f events/s, %u dropped\n",
+	       after.events_per_s, after.dropped);
+	CHECK(after.dropped > 0, "nothing dropped over capacity");
+	CHECK(after.events_per_s >= 0.98 * 16 * 1e9 / TRANSFER_NS,
+	      "%.0f events/s over capacity", after.events_per_s);
+}
+
+/* --- The button --- */
+
+static bool other_is(unsigned i, uint8_t cin, uint8_t status, uint8_t d1,
+		     uint8_t d2)
+{
+	const uint8_t want[MIDI_EVENT_SIZE] = { cin, status, d1, d2 };
+
+	return i < n_other && !memcmp(other[i], want, sizeof(want));
+}
+
+static void test_button(void)
+{
+	const uint8_t ev[MIDI_EVENT_SIZE] = { 0x09, 0x90, 60, 64 };
+
+	sim_reset(false);
+	CHECK(midi_queue_events(ev, 1) && midi_tx_dropped == 1,
+	      "event queued before the device was configured");
+	run_for(1000000);
+	CHECK(n_other == 0, "%u events before the button", n_other);
+
+	sim_gpioa_idr = 1;
+	run_for(1000000);
+	CHECK(n_other == 1 && other_is(0, 0x09, 0x90, 60, 64), "note on");
+
+	sim_gpioa_idr = 0;
+	run_for(1000000);
+	CHECK(n_other == 2 && other_is(1, 0x08, 0x80, 60, 64), "note off");
+}
+
+/* --- SysEx --- */
+
+/* Identity replies received, all of them whole and in one piece. */
+static unsigned identity_replies(void)
+{
+	unsigned i, n = sizeof(sysex_identity) / MIDI_EVENT_SIZE;
+	bool ok = n_other % n == 0;
+
+	for (i = 0; ok && i < n_other; i++)
+		ok = !memcmp(other[i], &sysex_identity[i % n * 4], 4) &&
+		     (i % n == 0 || other_pos[i] == other_pos[i - 1] + 1);
+	CHECK(ok, "%u events that are not identity replies", n_other);
+	return n_other / n;
+}
+
+/*
+ * MIDI bytes as SysEx event packets, three bytes to each but the last,
+ * which ends the message.
+ */
+static unsigned sysex_events(const uint8_t *msg, unsigned len, uint8_t *ev)
+{
+	unsigned n, k;
+
+	for (n = 0; len; n++, msg += k, len -= k) {
+		k = len > 3 ? 3 : len;
+		memset(&ev[n * 4], 0, 4);
+		ev[n * 4] = len > 3 ? 0x04 : 0x04 + k;
+		memcpy(&ev[n * 4 + 1], msg, k);
+	}
+	return n;
+}
+
+/* Send the events in bulk packets of 1 to 16, then let the device answer. */
+static void host_send_events(const uint8_t *ev, unsigned n)
+{
+	unsigned k;
+
+	for (; n; n -= k, ev += k * 4) {
+		k = 1 + rnd() % 16;
+		if (k > n)
+			k = n;
+		host_send(ev, k * 4);
+	}
+	run_for(2000000);
+}
+
+static unsigned send_sysex(const uint8_t *msg, unsigned len)
+{
+	uint8_t ev[64 * 4];
+
+	n_other = 0;
+	host_send_events(ev, sysex_events(msg, len, ev));
+	return identity_replies();
+}
+
+static void test_sysex_fixed(void)
+{
+	static const uint8_t request[] = { 0xf0, 0x7e, 0x7f, 0x06, 0x01, 0xf7 };
+	static const uint8_t to_us[] = { 0xf0, 0x7e, 0x00, 0x06, 0x01, 0xf7 };
+	static const uint8_t to_other[] = { 0xf0, 0x7e, 0x05, 0x06, 0x01, 0xf7 };
+	static const uint8_t reply[] = { 0xf0, 0x7e, 0x7f, 0x06, 0x02, 0xf7 };
+	static const uint8_t aborted[] = {
+		0x04, 0xf0, 0x7e, 0x7f,
+		0x02, 0xf1, 0x05, 0x00,	/* MTC quarter frame */
+		0x07, 0x06, 0x01, 0xf7,
+	};
+	static const uint8_t restarted[] = {
+		0x04, 0xf0, 0x7e, 0x7f,
+		0x04, 0xf0, 0x7e, 0x7f,
+		0x07, 0x06, 0x01, 0xf7,
+	};
+	static const uint8_t one_byte_events[] = {
+		0x0f, 0xf0, 0x00, 0x00,	/* single bytes are not SysEx */
+		0x0f, 0x7e, 0x00, 0x00,
+		0x0f, 0x7f, 0x00, 0x00,
+		0x0f, 0x06, 0x00, 0x00,
+		0x0f, 0x01, 0x00, 0x00,
+		0x0f, 0xf7, 0x00, 0x00,
+	};
+	uint8_t big[48];
+
+	sim_reset(false);
+	run_for(1000000);
+
+	CHECK(send_sysex(request, sizeof(request)) == 1, "identity request");
+	CHECK(send_sysex(to_us, sizeof(to_us)) == 1, "request to channel 0");
+	CHECK(send_sysex(to_other, sizeof(to_other)) == 0,
+	      "request to channel 5");
+	CHECK(send_sysex(reply, sizeof(reply)) == 0, "identity reply");
+	CHECK(send_sysex(request + 1, sizeof(request) - 1) == 0,
+	      "request without 0xf0");
+	CHECK(send_sysex(request, sizeof(request) - 1) == 0 &&
+	      send_sysex(request + 5, 1) == 1, "request ended later");
+
+	n_other = 0;
+	host_send_events(aborted, sizeof(aborted) / 4);
+	CHECK(identity_replies() == 0, "aborted request");
+	n_other = 0;
+	host_send_events(restarted, sizeof(restarted) / 4);
+	CHECK(identity_replies() == 1, "restarted request");
+	n_other = 0;
+	host_send_events(one_byte_events, sizeof(one_byte_events) / 4);
+	CHECK(identity_replies() == 0, "request in single byte events");
+
+	/* Too long, with a request at the end of what fits. */
+	memset(big, 0x11, sizeof(big));
+	big[0] = 0xf0;
+	memcpy(&big[SYSEX_MAX - 5], request + 1, 5);
+	big[sizeof(big) - 1] = 0xf7;
+	CHECK(send_sysex(big, sizeof(big)) == 0, "oversized message");
+	CHECK(send_sysex(request, sizeof(request)) == 1,
+	      "request after an oversized message");
+
+	/* The end of a request in a partial event packet. */
+	n_other = 0;
+	host_send(restarted + 4, 7);
+	run_for(2000000);
+	CHECK(identity_replies() == 0, "partial event packet");
+	CHECK(send_sysex(request, sizeof(request)) == 1,
+	      "request after a partial event packet");
+}
+
+/*
+ * Identity requests with real-time bytes inside and real-time and note
+ * events in between, half of them spoilt.
+ */
+static void test_sysex_random(void)
+{
+	uint8_t msg[32], ev[64 * 4], mixed[64 * 4];
+	unsigned i, j, len, n, m, spoilt;
+
+	sim_reset(false);
+	run_for(1000000);
+
+	for (i = 0; i < 1000; i++) {
+		len = 0;
+		msg[len++] = 0xf0;
+		msg[len++] = 0x7e;
+		msg[len++] = rnd() % 2 ? 0x7f : 0x00;
+		msg[len++] = 0x06;
+		msg[len++] = 0x01;
+		msg[len++] = 0xf7;
+
+		spoilt = rnd() % 2 ? 1 + rnd() % 4 : 0;
+		switch (spoilt) {
+		case 1:		/* another sub-ID */
+			msg[3 + rnd() % 2] ^= 1 + rnd() % 0x7f;
+			break;
+		case 2:		/* a byte more */
+			j = 1 + rnd() % 5;
+			memmove(&msg[j + 1], &msg[j], len++ - j);
+			msg[j] = rnd() % 0x80;
+			break;
+		case 3:		/* a byte less */
+			j = 1 + rnd() % 4;
+			memmove(&msg[j], &msg[j + 1], len-- - j - 1);
+			break;
+		case 4:		/* interrupted by a status byte */
+			j = 1 + rnd() % 5;
+			memmove(&msg[j + 1], &msg[j], len++ - j);
+			msg[j] = 0x80 + rnd() % 0x78;
+			if (msg[j] == 0xf0 || msg[j] == 0xf7)
+				msg[j] = 0xf1;
+			break;
+		}
+
+		/* Real-time bytes may turn up anywhere. */
+		for (j = rnd() % 4; j; j--) {
+			unsigned at = rnd() % (len + 1);
+
+			memmove(&msg[at + 1], &msg[at], len++ - at);
+			msg[at] = 0xf8 + rnd() % 8;
+		}
+
+		n = sysex_events(msg, len, ev);
+		for (j = m = 0; j < n; j++) {
+			if (rnd() % 4 == 0) {
+				uint8_t rt[4] = { 0x0f, 0xf8, 0, 0 };
+				uint8_t note[4] = { 0x09, 0x90, 60, 64 };
+
+				memcpy(&mixed[m++ * 4], rnd() % 2 ? rt : note, 4);
+			}
+			memcpy(&mixed[m++ * 4], &ev[j * 4], 4);
+		}
+
+		n_other = 0;
+		host_send_events(mixed, m);
+		CHECK(identity_replies() == !spoilt,
+		      "request %u, spoilt %u, got %u replies", i, spoilt,
+		      identity_replies());
+	}
+}
+
+/* The reply goes out whole between load events. */
+static void test_sysex_under_load(void)
+{
+	static const uint8_t request[] = {
+		0x04, 0xf0, 0x7e, 0x7f, 0x07, 0x06, 0x01, 0xf7,
+	};
+
+	sim_reset(false);
+	load_burst = 16;
+	load_period = 200000;
+	load_start = load_next = 1000000;
+	load_end = load_start + 20000000;
+	run_for(10000000);
+	host_send(request, sizeof(request));
+	run_for(20000000);
+
+	CHECK(identity_replies() == 1, "no reply under load");
+	CHECK(dropped == 0 && delivered == produced,
+	      "%u dropped, %u of %u delivered", dropped, delivered, produced);
+}
+
+/* With the host not reading, a request finds the queue full. */
+static void test_sysex_queue_full(void)
+{
+	static const uint8_t request[] = {
+		0x04, 0xf0, 0x7e, 0x7f, 0x07, 0x06, 0x01, 0xf7,
+	};
+	uint8_t ev[MIDI_EVENT_SIZE];
+	unsigned i, queued = 0;
+
+	sim_reset(false);
+	run_for(1000000);
+	host_nak = true;
+
+	/* Fill the queue and both packets. */
+	for (i = 0; i < 3; i++) {
+		while (1) {
+			load_event(queued, ev);
+			ev[1] = 0x92;
+			if (midi_queue_events(ev, 1))
+				break;
+			queued++;
+		}
+		run_for(1000000);
+	}
+	CHECK(queued == MIDI_TX_EVENTS + 2 * 16, "%u events queued", queued);
+
+	i = midi_tx_dropped;
+	host_send(request, sizeof(request));
+	run_for(1000000);
+	CHECK(midi_tx_dropped == i + sizeof(sysex_identity) / 4,
+	      "%u reply events dropped", midi_tx_dropped - i);
+
+	host_nak = false;
+	run_for(10000000);
+	CHECK(n_other == queued, "%u of %u events delivered", n_other, queued);
+	for (i = 0; i < n_other; i++) {
+		load_event(i, ev);
+		ev[1] = 0x92;
+		CHECK(!memcmp(other[i], ev, sizeof(ev)),
+		      "event %u is %02x %02x %02x %02x", i, other[i][0],
+		      other[i][1], other[i][2], other[i][3]);
+	}
+}
+
+int main(void)
+{
+	test_load();
+	test_button();
+	test_sysex_fixed();
+	test_sysex_random();
+	test_sysex_under_load();
+	test_sysex_queue_full();
+
+	if (failures) {
+		printf("%d failures\n", failures);
+		return EXIT_FAILURE;
+	}
+	printf("all passed\n");
+	return EXIT_SUCCESS;
+}
@@ -18,6 +18,7 @@
  */
 
 #include <stdlib.h>
+#include <string.h>
 #include <libopencm3/usb/usbd.h>
 #include <libopencm3/usb/audio.h>
 #include <libopencm3/usb/midi.h>
@@ -303,21 +304,152 @@ const uint8_t sysex_identity[] = {
 	0x00,	/* Padding */
 };
 
+/*
+ * Outgoing USB-MIDI event packets, 4 bytes each, wait in midi_tx_queue
+ * until the IN endpoint is free and then go out as many as will fit in
+ * one bulk packet.  Events queued while a packet is in flight are sent
+ * together in the next one, so a burst costs one transfer per 16 events
+ * and nothing ever has to wait for the host.
+ */
+#define MIDI_EVENT_SIZE		4
+#define MIDI_TX_EVENTS		64	/* power of two */
+
+static uint8_t midi_tx_queue[MIDI_TX_EVENTS][MIDI_EVENT_SIZE];
+static unsigned midi_tx_head, midi_tx_tail;	/* free running */
+static uint8_t midi_tx_packet[64];
+static unsigned midi_tx_len;
+static unsigned midi_tx_dropped;
+static int midi_configured;
+
+/* Queue n events, or none of them if they don't all fit. */
+static int midi_queue_events(const uint8_t *events, unsigned n)
+{
+	unsigned i;
+
+	if (!midi_configured ||
+	    n > MIDI_TX_EVENTS - (midi_tx_head - midi_tx_tail)) {
+		midi_tx_dropped += n;
+		return -1;
+	}
+
+	for (i = 0; i < n; i++, events += MIDI_EVENT_SIZE)
+		memcpy(midi_tx_queue[midi_tx_head++ % MIDI_TX_EVENTS], events,
+		       MIDI_EVENT_SIZE);
+	return 0;
+}
+
+static void midi_tx_flush(usbd_device *usbd_dev)
+{
+	/* Top up the pending packet with whatever was queued since. */
+	while (midi_tx_len < sizeof(midi_tx_packet) &&
+	       midi_tx_tail != midi_tx_head) {
+		memcpy(&midi_tx_packet[midi_tx_len],
+		       midi_tx_queue[midi_tx_tail++ % MIDI_TX_EVENTS],
+		       MIDI_EVENT_SIZE);
+		midi_tx_len += MIDI_EVENT_SIZE;
+	}
+
+	/* Zero means the last packet is still on its way; try again later. */
+	if (midi_tx_len &&
+	    usbd_ep_write_packet(usbd_dev, 0x81, midi_tx_packet, midi_tx_len))
+		midi_tx_len = 0;
+}
+
+static void usbmidi_data_tx_cb(usbd_device *usbd_dev, uint8_t ep)
+{
+	(void)ep;
+
+	midi_tx_flush(usbd_dev);
+}
+
+/*
+ * Incoming SysEx is split over event packets (code index 0x4 for three
+ * bytes of a message that carries on, 0x5 to 0x7 for the last one to
+ * three bytes) and a long message over several bulk packets, so it is
+ * collected byte by byte across callbacks.
+ */
+#define SYSEX_MAX		32
+
+enum sysex_state {
+	SYSEX_IDLE,
+	SYSEX_DATA,
+	SYSEX_SKIP,	/* too long for sysex_buf, wait for the end */
+};
+
+static enum sysex_state sysex_state;
+static uint8_t sysex_buf[SYSEX_MAX];
+static unsigned sysex_len;
+
+/* MIDI bytes in an event packet, by code index number (Table 4-1). */
+static const uint8_t cin_length[16] = {
+	0, 0, 2, 3, 3, 1, 2, 3, 3, 3, 3, 3, 2, 2, 3, 1
+};
+
+static void sysex_message(void)
+{
+	/* Identity request, to our channel or to all. */
+	if (sysex_len == 6 && sysex_buf[1] == 0x7e &&
+	    (sysex_buf[2] == 0x00 || sysex_buf[2] == 0x7f) &&
+	    sysex_buf[3] == 0x06 && sysex_buf[4] == 0x01)
+		midi_queue_events(sysex_identity,
+				  sizeof(sysex_identity) / MIDI_EVENT_SIZE);
+}
+
+static void sysex_byte(uint8_t b)
+{
+	if (b >= 0xf8)
+		return;		/* real time, may appear anywhere */
+
+	if (b == 0xf0) {
+		sysex_state = SYSEX_DATA;
+		sysex_len = 0;
+	} else if (sysex_state == SYSEX_IDLE) {
+		return;
+	} else if ((b & 0x80) && b != 0xf7) {
+		sysex_state = SYSEX_IDLE;	/* aborted by another status */
+		return;
+	}
+
+	if (sysex_state == SYSEX_DATA) {
+		if (sysex_len < SYSEX_MAX)
+			sysex_buf[sysex_len++] = b;
+		else
+			sysex_state = SYSEX_SKIP;
+	}
+
+	if (b == 0xf7) {
+		if (sysex_state == SYSEX_DATA)
+			sysex_message();
+		sysex_state = SYSEX_IDLE;
+	}
+}
+
+static void midi_rx_event(const uint8_t *event)
+{
+	uint8_t cin = event[0] & 0x0f;
+	int i;
+
+	/* Only system common and SysEx packets matter here. */
+	if (cin < 0x2 || cin > 0x7)
+		return;
+
+	for (i = 0; i < cin_length[cin]; i++)
+		sysex_byte(event[1 + i]);
+}
+
 static void usbmidi_data_rx_cb(usbd_device *usbd_dev, uint8_t ep)
 {
 	(void)ep;
 
-	char buf[64];
+	uint8_t buf[64];
 	int len = usbd_ep_read_packet(usbd_dev, 0x01, buf, 64);
+	int i;
 
-	/* This implementation treats any message from the host as a SysEx
-	 * identity request. This works well enough providing the host
-	 * packs the identify request in a single 8 byte USB message.
-	 */
-	if (len) {
-		while (usbd_ep_write_packet(usbd_dev, 0x81, sysex_identity,
-					    sizeof(sysex_identity)) == 0);
-	}
+	for (i = 0; i + MIDI_EVENT_SIZE <= len; i += MIDI_EVENT_SIZE)
+		midi_rx_event(&buf[i]);
+
+	/* Send any reply straight away if the endpoint is free. */
+	midi_tx_flush(usbd_dev);
 
 	gpio_toggle(GPIOC, GPIO5);
 }
@@ -328,24 +460,30 @@ static void usbmidi_set_config(usbd_device *usbd_dev, uint16_t wValue)
 
 	usbd_ep_setup(usbd_dev, 0x01, USB_ENDPOINT_ATTR_BULK, 64,
 			usbmidi_data_rx_cb);
-	usbd_ep_setup(usbd_dev, 0x81, USB_ENDPOINT_ATTR_BULK, 64, NULL);
+	usbd_ep_setup(usbd_dev, 0x81, USB_ENDPOINT_ATTR_BULK, 64,
+			usbmidi_data_tx_cb);
+
+	midi_tx_head = midi_tx_tail = 0;
+	midi_tx_len = 0;
+	sysex_state = SYSEX_IDLE;
+	midi_configured = 1;
 }
 
-static void button_send_event(usbd_device *usbd_dev, int pressed)
+static void button_send_event(int pressed)
 {
-	char buf[4] = { 0x08, /* USB framing: virtual cable 0, note on */
-			0x80, /* MIDI command: note on, channel 1 */
-			60,   /* Note 60 (middle C) */
-			64,   /* "Normal" velocity */
+	uint8_t buf[4] = { 0x08, /* USB framing: virtual cable 0, note on */
+			   0x80, /* MIDI command: note on, channel 1 */
+			   60,   /* Note 60 (middle C) */
+			   64,   /* "Normal" velocity */
 	};
 
 	buf[0] |= pressed;
 	buf[1] |= pressed << 4;
 
-	while (usbd_ep_write_packet(usbd_dev, 0x81, buf, sizeof(buf)) == 0);
+	midi_queue_events(buf, 1);
 }
 
-static void button_poll(usbd_device *usbd_dev)
+static void button_poll(void)
 {
 	static uint32_t button_state = 0;
 
@@ -357,7 +495,7 @@ static void button_poll(usbd_device *usbd_dev)
 	uint32_t old_button_state = button_state;
 	button_state = (button_state << 1) | (GPIOA_IDR & 1);
 	if ((0 == button_state) != (0 == old_button_state)) {
-		button_send_event(usbd_dev, !!button_state);
+		button_send_event(!!button_state);
 	}
 }
 
@@ -387,6 +525,7 @@ int main(void)
 
 	while (1) {
 		usbd_poll(usbd_dev);
-		button_poll(usbd_dev);
+		button_poll();
+		midi_tx_flush(usbd_dev);
 	}
 }
@@ -24,12 +24,22 @@
 #include <libopencm3/cm3/nvic.h>
 #include <libopencm3/stm32/dac.h>
 #include <libopencm3/stm32/dma.h>
+#include "synth.h"
 
-/* Timer 2 count period, 16 microseconds for a 72MHz APB2 clock */
-#define PERIOD 1152
+/* Output sample rate, TIM2 runs from the doubled 42MHz APB1 clock */
+#define SAMPLE_RATE	48000
+#define PERIOD		(84000000 / SAMPLE_RATE - 1)
 
-/* Globals */
-uint8_t waveform[256];
+/*
+ * The DMA plays dac_buf in circular mode.  While it reads one half the
+ * other is refilled by the synthesizer, DAC_BLOCK samples at a time.
+ */
+#define DAC_BLOCK	256
+
+static uint16_t dac_buf[2 * DAC_BLOCK];
+
+volatile uint32_t dac_blocks;	/* blocks generated */
+volatile uint32_t dac_late;	/* blocks the DMA got to before we did */
 
 /*--------------------------------------------------------------------*/
 static void clock_setup(void)
@@ -61,17 +71,10 @@ static void timer_setup(void)
 		       TIM_CR1_CMS_EDGE, TIM_CR1_DIR_UP);
 	timer_continuous_mode(TIM2);
 	timer_set_period(TIM2, PERIOD);
-	timer_disable_oc_output(TIM2, TIM_OC2 | TIM_OC3 | TIM_OC4);
-	timer_enable_oc_output(TIM2, TIM_OC1);
-	timer_disable_oc_clear(TIM2, TIM_OC1);
-	timer_disable_oc_preload(TIM2, TIM_OC1);
-	timer_set_oc_slow_mode(TIM2, TIM_OC1);
-	timer_set_oc_mode(TIM2, TIM_OC1, TIM_OCM_TOGGLE);
-	timer_set_oc_value(TIM2, TIM_OC1, 500);
 	timer_disable_preload(TIM2);
-	/* Set the timer trigger output (for the DAC) to the channel 1 output
-	   compare */
-	timer_set_master_mode(TIM2, TIM_CR2_MMS_COMPARE_OC1REF);
+	/* Set the timer trigger output (for the DAC) to the update event,
+	   one trigger per period */
+	timer_set_master_mode(TIM2, TIM_CR2_MMS_UPDATE);
 	timer_enable_counter(TIM2);
 }
 
@@ -84,18 +87,19 @@ static void dma_setup(void)
 	nvic_enable_irq(NVIC_DMA1_STREAM5_IRQ);
 	dma_stream_reset(DMA1, DMA_STREAM5);
 	dma_set_priority(DMA1, DMA_STREAM5, DMA_SxCR_PL_LOW);
-	dma_set_memory_size(DMA1, DMA_STREAM5, DMA_SxCR_MSIZE_8BIT);
-	dma_set_peripheral_size(DMA1, DMA_STREAM5, DMA_SxCR_PSIZE_8BIT);
+	dma_set_memory_size(DMA1, DMA_STREAM5, DMA_SxCR_MSIZE_16BIT);
+	dma_set_peripheral_size(DMA1, DMA_STREAM5, DMA_SxCR_PSIZE_16BIT);
 	dma_enable_memory_increment_mode(DMA1, DMA_STREAM5);
 	dma_enable_circular_mode(DMA1, DMA_STREAM5);
 	dma_set_transfer_mode(DMA1, DMA_STREAM5,
 				DMA_SxCR_DIR_MEM_TO_PERIPHERAL);
-	/* The register to target is the DAC1 8-bit right justified data
+	/* The register to target is the DAC1 12-bit right justified data
 	   register */
-	dma_set_peripheral_address(DMA1, DMA_STREAM5, (uint32_t) &DAC_DHR8R1(DAC1));
-	/* The array v[] is filled with the waveform data to be output */
-	dma_set_memory_address(DMA1, DMA_STREAM5, (uint32_t) waveform);
-	dma_set_number_of_data(DMA1, DMA_STREAM5, 256);
+	dma_set_peripheral_address(DMA1, DMA_STREAM5, (uint32_t) &DAC_DHR12R1(DAC1));
+	/* The array dac_buf[] is refilled by the ISR as it is played */
+	dma_set_memory_address(DMA1, DMA_STREAM5, (uint32_t) dac_buf);
+	dma_set_number_of_data(DMA1, DMA_STREAM5, 2 * DAC_BLOCK);
+	dma_enable_half_transfer_interrupt(DMA1, DMA_STREAM5);
 	dma_enable_transfer_complete_interrupt(DMA1, DMA_STREAM5);
 	dma_channel_select(DMA1, DMA_STREAM5, DMA_SxCR_CHSEL_7);
 	dma_enable_stream(DMA1, DMA_STREAM5);
@@ -115,44 +119,72 @@ static void dac_setup(void)
 }
 
 /*--------------------------------------------------------------------*/
-/* The ISR simply provides a test output for a CRO trigger */
+/*
+ * Half transfer means the DMA has moved on to the second half, so the
+ * first can be refilled, and transfer complete the other way round.  If
+ * both flags are set we are a whole block late: refill the half the DMA
+ * is not reading and count it.  PC1 toggles once per buffer as a CRO
+ * trigger.
+ */
 
 void dma1_stream5_isr(void)
 {
-	if (dma_get_interrupt_flag(DMA1, DMA_STREAM5, DMA_TCIF)) {
-		dma_clear_interrupt_flags(DMA1, DMA_STREAM5, DMA_TCIF);
-		/* Toggle PC1 just to keep aware of activity and frequency. */
+	int ht = dma_get_interrupt_flag(DMA1, DMA_STREAM5, DMA_HTIF);
+	int tc = dma_get_interrupt_flag(DMA1, DMA_STREAM5, DMA_TCIF);
+	int half;
+
+	dma_clear_interrupt_flags(DMA1, DMA_STREAM5, DMA_HTIF | DMA_TCIF);
+
+	if (ht && tc) {
+		dac_late++;
+		half = DMA_SNDTR(DMA1, DMA_STREAM5) > DAC_BLOCK;
+	} else if (ht) {
+		half = 0;
+	} else if (tc) {
+		half = 1;
 		gpio_toggle(GPIOC, GPIO1);
+	} else {
+		return;
 	}
+
+	synth_fill(&dac_buf[half * DAC_BLOCK], DAC_BLOCK);
+	dac_blocks++;
+}
+
+/*--------------------------------------------------------------------*/
+static void wait_blocks(uint32_t n)
+{
+	uint32_t start = dac_blocks;
+
+	while (dac_blocks - start < n);
 }
 
 /*--------------------------------------------------------------------*/
 int main(void)
 {
-	/* Fill the array with funky waveform data */
-	/* This is for dual channel 8-bit right aligned */
-	uint16_t i, x;
-	for (i = 0; i < 256; i++) {
-		if (i < 10) {
-			x = 10;
-		} else if (i < 121) {
-			x = 10 + ((i*i) >> 7);
-		} else if (i < 170) {
-			x = i/2;
-		} else if (i < 246) {
-			x = i + (80 - i/2);
-		} else {
-			x = 10;
-		}
-		waveform[i] = x;
-	}
+	/* A major arpeggio over a held root, one note per quarter second */
+	static const float notes[] = { 261.63, 329.63, 392.00, 523.25 };
+	const uint32_t quarter = SAMPLE_RATE / DAC_BLOCK / 4;
+	int i = 0;
+
 	clock_setup();
 	gpio_setup();
+
+	synth_init(SAMPLE_RATE);
+	synth_tone(0, 130.81, 0.3);
+	synth_tone(1, notes[0], 0.3);
+	/* Prime both halves before the DMA starts reading them */
+	synth_fill(dac_buf, 2 * DAC_BLOCK);
+
 	timer_setup();
 	dma_setup();
 	dac_setup();
 
-	while (1);
+	while (1) {
+		wait_blocks(quarter);
+		i = (i + 1) % 4;
+		synth_tone(1, notes[i], 0.3);
+	}
 
 	return 0;
 }
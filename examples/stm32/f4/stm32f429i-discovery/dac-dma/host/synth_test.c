@@ -0,0 +1,200 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Plays synth.c through a model of the example's DMA: a circular buffer
+ * of two DAC_BLOCK halves read one sample per tick, with synth_fill()
+ * called on the half the DMA has just left, as dma1_stream5_isr() does.
+ * The "main program" runs between ticks and queues stream samples or
+ * changes tones.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "synth.h"
+
+#define SAMPLE_RATE	48000
+#define DAC_BLOCK	256
+#define PI		3.14159265358979
+
+static uint16_t dac_buf[2 * DAC_BLOCK];
+static int dma_pos;
+
+static void dma_start(void)
+{
+	synth_fill(dac_buf, 2 * DAC_BLOCK);
+	dma_pos = 0;
+}
+
+/* One DAC trigger: returns the sample the DMA hands to the DAC. */
+static uint16_t dma_tick(void)
+{
+	uint16_t s = dac_buf[dma_pos++];
+
+	if (dma_pos == DAC_BLOCK) {
+		synth_fill(dac_buf, DAC_BLOCK);			/* HT */
+	} else if (dma_pos == 2 * DAC_BLOCK) {
+		synth_fill(&dac_buf[DAC_BLOCK], DAC_BLOCK);	/* TC */
+		dma_pos = 0;
+	}
+	return s;
+}
+
+/*
+ * Queue a counting pattern in random sized chunks, with tones off, and
+ * check it comes out of the DAC complete and in order.  With 'stall'
+ * the producer stops now and then for longer than the queue lasts.
+ */
+static int check_stream(int stall)
+{
+	static uint16_t chunk[256];
+	uint32_t next_in = 0, next_out = 0, lost = 0, pause = 0;
+	uint16_t s;
+	int i, n, k;
+
+	synth_init(SAMPLE_RATE);
+	/* Start with a full queue, like a player would. */
+	while (synth_stream_free()) {
+		chunk[0] = next_in % 4000 + 48;
+		next_in += synth_stream_write(chunk, 1);
+	}
+	dma_start();
+	for (i = 0; i < 2000000; i++) {
+		if (pause) {
+			pause--;
+		} else if (rand() % 64 == 0) {
+			n = 1 + rand() % 256;
+			for (k = 0; k < n; k++) {
+				chunk[k] = (next_in + k) % 4000 + 48;
+			}
+			next_in += synth_stream_write(chunk, n);
+			if (stall && rand() % 200 == 0) {
+				pause = 2 * SYNTH_STREAM_SIZE;
+			}
+		}
+
+		s = dma_tick();
+		if (s == 2048 && next_out % 4000 + 48 != 2048) {
+			continue;	/* silence, nothing queued */
+		}
+		if (s != next_out % 4000 + 48) {
+			lost++;
+		}
+		next_out++;
+	}
+
+	printf("stream%s: %u samples out, %u wrong, %u underruns\n",
+	       stall ? " with stalls" : "", next_out, lost,
+	       synth_underruns);
+	if (lost || (next_in - next_out > SYNTH_STREAM_SIZE + 2 * DAC_BLOCK)) {
+		return 1;
+	}
+	return stall ? (synth_underruns == 0) : (synth_underruns != 0);
+}
+
+/*
+ * A single tone whose frequency and amplitude change every few blocks,
+ * at random points between DMA interrupts.  A continuous phase keeps the
+ * step between two samples below what the highest frequency and the
+ * largest amplitude allow; any reset or jump shows up as a big step.
+ */
+static int check_phase(void)
+{
+	const float max_freq = 2000, max_amp = 0.9f;
+	const float bound = 2047 * max_amp * 2 * PI * max_freq / SAMPLE_RATE;
+	int i, prev = -1, d, worst = 0, changes = 0;
+	double err, max_err = 0;
+	uint16_t s;
+
+	synth_init(SAMPLE_RATE);
+	synth_tone(0, 1000, 0.5f);
+	dma_start();
+
+	/* A steady tone first, against the ideal sine. */
+	for (i = 0; i < 2 * DAC_BLOCK; i++) {
+		dma_tick();
+	}
+	for (; i < SAMPLE_RATE; i++) {
+		s = dma_tick();
+		err = s - (2048 + 2047 * 0.5 *
+			   sin(2 * PI * 1000.0 * i / SAMPLE_RATE));
+		if (fabs(err) > max_err) {
+			max_err = fabs(err);
+		}
+	}
+
+	for (i = 0; i < 20 * SAMPLE_RATE; i++) {
+		if (rand() % 1500 == 0) {
+			synth_tone(0, 50 + rand() % (int)(max_freq - 50),
+				   max_amp * rand() / RAND_MAX);
+			changes++;
+		}
+		s = dma_tick();
+		if (prev >= 0) {
+			d = abs(s - prev);
+			if (d > worst) {
+				worst = d;
+			}
+		}
+		prev = s;
+	}
+
+	printf("phase: steady tone within %.1f LSB of a sine, %d changes, "
+	       "largest step %d LSB (limit %.0f)\n", max_err, changes, worst,
+	       bound + 4);
+	return (max_err > 4) || (worst > bound + 4) || synth_underruns;
+}
+
+static void bench(void)
+{
+	static uint16_t buf[DAC_BLOCK];
+	static uint16_t chunk[DAC_BLOCK];
+	double t;
+	int i, n = 20000;
+
+	synth_init(SAMPLE_RATE);
+	for (i = 0; i < SYNTH_TONES; i++) {
+		synth_tone(i, 220 * (i + 1), 0.2f);
+	}
+	for (i = 0; i < DAC_BLOCK; i++) {
+		chunk[i] = 2048;
+	}
+
+	t = (double)clock() / CLOCKS_PER_SEC;
+	for (i = 0; i < n; i++) {
+		synth_stream_write(chunk, DAC_BLOCK);
+		synth_fill(buf, DAC_BLOCK);
+	}
+	t = (double)clock() / CLOCKS_PER_SEC - t;
+	printf("%d tones and a stream: %.1f Msamples/s\n", SYNTH_TONES,
+	       n * DAC_BLOCK / t / 1e6);
+}
+
+int main(void)
+{
+	int failed = 0;
+
+	srand(1);
+	failed += check_stream(0);
+	failed += check_stream(1);
+	failed += check_phase();
+	bench();
+
+	return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
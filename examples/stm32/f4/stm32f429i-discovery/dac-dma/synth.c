@@ -0,0 +1,184 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <assert.h>
+#include <math.h>
+#include "synth.h"
+
+/*
+ * One sine period in SINE_SIZE steps, Q15, with a guard entry so the
+ * interpolation never wraps.  The top SINE_BITS of a phase pick the entry
+ * and the next 16 bits interpolate to the following one.
+ */
+#define SINE_BITS	10
+#define SINE_SIZE	(1 << SINE_BITS)
+#define TWO_PI		6.2831853f
+
+/*
+ * Keep the compiler from moving stream[] accesses across an index
+ * update, like RING_BARRIER() in ring.h.
+ */
+#define STREAM_BARRIER()	__asm__ volatile ("" : : : "memory")
+
+static int16_t sine[SINE_SIZE + 1];
+
+struct tone {
+	uint32_t phase;
+	uint32_t step;		/* phase increment per sample */
+	int32_t amp;		/* Q16 */
+	/* Written by synth_tone(), picked up at the next block. */
+	volatile uint32_t next_step;
+	volatile int32_t next_amp;
+	volatile uint8_t pending;
+};
+
+static struct tone tones[SYNTH_TONES];
+static float phase_per_hz;
+
+static uint16_t stream[SYNTH_STREAM_SIZE];
+static volatile uint32_t stream_head;	/* written by synth_stream_write */
+static volatile uint32_t stream_tail;	/* written by synth_fill */
+static uint8_t streaming;
+
+volatile uint32_t synth_underruns;
+
+void synth_init(uint32_t sample_rate)
+{
+	int i;
+
+	for (i = 0; i <= SINE_SIZE; i++)
+		sine[i] = 32767 * sinf(TWO_PI * i / SINE_SIZE);
+
+	for (i = 0; i < SYNTH_TONES; i++) {
+		tones[i].phase = 0;
+		tones[i].step = 0;
+		tones[i].amp = 0;
+		tones[i].pending = 0;
+	}
+	phase_per_hz = 4294967296.0f / sample_rate;
+
+	stream_head = stream_tail = 0;
+	streaming = 0;
+	synth_underruns = 0;
+}
+
+void synth_tone(int tone, float freq, float amp)
+{
+	struct tone *t = &tones[tone];
+
+	if (amp < 0)
+		amp = 0;
+	if (amp > 1)
+		amp = 1;
+
+	/* Hold the block off our fields while they are half written. */
+	t->pending = 0;
+	t->next_step = freq * phase_per_hz;
+	t->next_amp = amp * 65536;
+	t->pending = 1;
+}
+
+int synth_stream_free(void)
+{
+	return SYNTH_STREAM_SIZE - (stream_head - stream_tail);
+}
+
+int synth_stream_write(const uint16_t *samples, int count)
+{
+	uint32_t head = stream_head;
+	int i, n = synth_stream_free();
+
+	if (count > n)
+		count = n;
+	for (i = 0; i < count; i++)
+		stream[head++ & (SYNTH_STREAM_SIZE - 1)] = samples[i];
+	STREAM_BARRIER();
+	stream_head = head;
+
+	return count;
+}
+
+static inline int32_t sine_at(uint32_t phase)
+{
+	uint32_t i = phase >> (32 - SINE_BITS);
+	int32_t frac = (phase >> (16 - SINE_BITS)) & 0xffff;
+	int32_t a = sine[i];
+
+	return a + (((sine[i + 1] - a) * frac) >> 16);
+}
+
+void synth_fill(uint16_t *buf, int count)
+{
+	static int32_t mix[SYNTH_MAX_BLOCK];
+	int32_t amp, damp;
+	uint32_t phase, step, head, tail;
+	int i, k;
+
+	assert(count <= SYNTH_MAX_BLOCK);
+	for (i = 0; i < count; i++)
+		mix[i] = 0;
+
+	for (k = 0; k < SYNTH_TONES; k++) {
+		struct tone *t = &tones[k];
+		int32_t target = t->amp;
+
+		if (t->pending) {
+			t->step = t->next_step;
+			target = t->next_amp;
+			t->pending = 0;
+		}
+
+		amp = t->amp;
+		damp = (target - amp) / count;
+		if (amp == 0 && damp == 0)
+			continue;
+
+		phase = t->phase;
+		step = t->step;
+		for (i = 0; i < count; i++) {
+			mix[i] += (sine_at(phase) * (amp >> 1)) >> 15;
+			phase += step;
+			amp += damp;
+		}
+		t->phase = phase;
+		t->amp = target;
+	}
+
+	/* mix[] is Q15, +-1 being full scale; center it on the 12 bit range. */
+	tail = stream_tail;
+	head = stream_head;
+	STREAM_BARRIER();
+	for (i = 0; i < count; i++) {
+		int32_t s = 2048 + (mix[i] >> 4);
+
+		if (tail != head) {
+			s += stream[tail++ & (SYNTH_STREAM_SIZE - 1)] - 2048;
+			streaming = 1;
+		} else if (streaming) {
+			synth_underruns++;
+			streaming = 0;
+		}
+
+		if (s < 0)
+			s = 0;
+		if (s > 4095)
+			s = 4095;
+		buf[i] = s;
+	}
+	STREAM_BARRIER();
+	stream_tail = tail;
+}
@@ -0,0 +1,54 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SYNTH_H
+#define SYNTH_H
+
+#include <stdint.h>
+
+/*
+ * Sample generator for the DAC.  Each output sample is the sum of
+ * SYNTH_TONES sine oscillators (DDS phase accumulators) and a stream of
+ * raw samples queued by the application, as a 12 bit right aligned value
+ * ready for DAC_DHR12R1.
+ *
+ * synth_fill() is called from the DMA interrupt; the other calls are made
+ * from the main program.  Tone changes take effect at the start of the
+ * next block, keep the phase running, and ramp the amplitude over that
+ * block, so they don't click.  Nothing here touches the hardware.
+ */
+
+#define SYNTH_TONES		4
+#define SYNTH_STREAM_SIZE	1024	/* samples, must be a power of 2 */
+#define SYNTH_MAX_BLOCK		512	/* most samples per synth_fill() */
+
+void synth_init(uint32_t sample_rate);
+
+/* Set a tone's frequency in Hz and its amplitude, 0 to 1 of full scale. */
+void synth_tone(int tone, float freq, float amp);
+
+/* Queue 12 bit samples; returns how many fit. */
+int synth_stream_write(const uint16_t *samples, int count);
+int synth_stream_free(void);
+
+/* Not reentrant: one caller at a time, count up to SYNTH_MAX_BLOCK. */
+void synth_fill(uint16_t *buf, int count);
+
+/* Times the stream ran dry while it was playing. */
+extern volatile uint32_t synth_underruns;
+
+#endif /* !SYNTH_H */
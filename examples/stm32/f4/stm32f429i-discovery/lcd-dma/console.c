@@ -35,18 +35,22 @@
 #include <libopencm3/cm3/cortex.h>
 #include "clock.h"
 #include "console.h"
+#include "ring.h"
 
 
-/* This is a ring buffer to holding characters as they are typed
- * it maintains both the place to put the next character received
- * from the UART, and the place where the last character was
- * read by the program. See the README file for a discussion of
- * the failure semantics.
+/* These are the ring buffers holding characters as they are typed
+ * and characters waiting to be sent. The interrupt handler is the
+ * only writer of the receive ring and the only reader of the transmit
+ * ring, so neither side has to disable interrupts (see ring.h). If
+ * the receive ring is full, newly typed characters are dropped. See
+ * the README file for a discussion of the failure semantics.
  */
-#define RECV_BUF_SIZE	128		/* Arbitrary buffer size */
-char recv_buf[RECV_BUF_SIZE];
-static volatile int recv_ndx_nxt;	/* Next place to store */
-static volatile int recv_ndx_cur;	/* Next place to read */
+#define RECV_BUF_SIZE	128		/* Must be a power of 2 */
+#define XMIT_BUF_SIZE	256		/* Must be a power of 2 */
+static uint8_t recv_buf[RECV_BUF_SIZE];
+static uint8_t xmit_buf[XMIT_BUF_SIZE];
+static struct ring recv_ring;
+static struct ring xmit_ring;
 
 /* For interrupt handling we add a new function which is called
  * when receive interrupts happen. The name (usart1_isr) is created
@@ -62,41 +66,48 @@ static volatile int recv_ndx_cur;	/* Next place to read */
 void usart1_isr(void)
 {
 	uint32_t	reg;
-	int			i;
+	uint8_t		c;
 
 	do {
 		reg = USART_SR(CONSOLE_UART);
 		if (reg & USART_SR_RXNE) {
-			recv_buf[recv_ndx_nxt] = USART_DR(CONSOLE_UART);
+			c = USART_DR(CONSOLE_UART);
 #ifdef RESET_ON_CTRLC
 			/* Check for "reset" */
-			if (recv_buf[recv_ndx_nxt] == '\003') {
+			if (c == '\003') {
 				scb_reset_system();
 			}
 #endif
-			/* Check for "overrun" */
-			i = (recv_ndx_nxt + 1) % RECV_BUF_SIZE;
-			if (i != recv_ndx_cur) {
-				recv_ndx_nxt = i;
-			}
+			/* Dropped if the ring is full ("overrun") */
+			ring_write_ch(&recv_ring, c);
 		}
 	} while ((reg & USART_SR_RXNE) != 0);
 				/* can read back-to-back interrupts */
+
+	/* Send the next queued character, or stop the transmit
+	 * interrupt when there is nothing left to send.
+	 */
+	if (((USART_CR1(CONSOLE_UART) & USART_CR1_TXEIE) != 0) &&
+	    ((USART_SR(CONSOLE_UART) & USART_SR_TXE) != 0)) {
+		if (ring_read_ch(&xmit_ring, &c) < 0) {
+			usart_disable_tx_interrupt(CONSOLE_UART);
+		} else {
+			USART_DR(CONSOLE_UART) = c;
+		}
+	}
 }
 
 /*
  * console_putc(char c)
  *
- * Send the character 'c' to the USART, wait for the USART
- * transmit buffer to be empty first.
+ * Queue the character 'c' for the USART and make sure the
+ * transmit interrupt is on to send it. This only waits if
+ * the transmit ring is full.
  */
 void console_putc(char c)
 {
-	uint32_t	reg;
-	do {
-		reg = USART_SR(CONSOLE_UART);
-	} while ((reg & USART_SR_TXE) == 0);
-	USART_DR(CONSOLE_UART) = (uint16_t) c & 0xff;
+	while (ring_write_ch(&xmit_ring, c) < 0);
+	usart_enable_tx_interrupt(CONSOLE_UART);
 }
 
 /*
@@ -111,13 +122,10 @@ void console_putc(char c)
  */
 char console_getc(int wait)
 {
-	char		c = 0;
+	uint8_t		c = 0;
 
-	while ((wait != 0) && (recv_ndx_cur == recv_ndx_nxt));
-	if (recv_ndx_cur != recv_ndx_nxt) {
-		c = recv_buf[recv_ndx_cur];
-		recv_ndx_cur = (recv_ndx_cur + 1) % RECV_BUF_SIZE;
-	}
+	while ((wait != 0) && (ring_used(&recv_ring) == 0));
+	ring_read_ch(&recv_ring, &c);
 	return c;
 }
 
@@ -216,6 +224,9 @@ void console_setup(int baud)
 	usart_set_flow_control(CONSOLE_UART, USART_FLOWCONTROL_NONE);
 	usart_enable(CONSOLE_UART);
 
+	ring_init(&recv_ring, recv_buf, RECV_BUF_SIZE);
+	ring_init(&xmit_ring, xmit_buf, XMIT_BUF_SIZE);
+
 	/* Enable interrupts from the USART */
 	nvic_enable_irq(NVIC_USART1_IRQ);
 
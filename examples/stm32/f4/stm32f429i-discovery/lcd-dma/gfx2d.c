@@ -0,0 +1,461 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifndef GFX2D_CPU_ONLY
+#include <libopencm3/cm3/common.h>
+#include <libopencm3/cm3/nvic.h>
+#include <libopencm3/stm32/memorymap.h>
+#include <libopencm3/stm32/rcc.h>
+#endif
+
+#include "gfx2d.h"
+
+/*
+ * Rectangles smaller than this are not worth the engine's setup
+ * cost and are drawn by the CPU.
+ */
+#define GFX2D_CPU_PIXELS 64
+
+volatile uint32_t gfx2d_errors;
+
+static void (*done_callback)(void);
+static int cpu_only;
+
+#ifndef GFX2D_CPU_ONLY
+
+/*
+ * DMA2D registers, from RM0090 section 11.5.  Only the bits used
+ * here are defined.
+ */
+#ifndef DMA2D_BASE
+#define DMA2D_BASE		(PERIPH_BASE_AHB1 + 0xB000)
+#endif
+
+#ifndef DMA2D_CR
+#define DMA2D_CR		MMIO32(DMA2D_BASE + 0x00)
+#define DMA2D_ISR		MMIO32(DMA2D_BASE + 0x04)
+#define DMA2D_IFCR		MMIO32(DMA2D_BASE + 0x08)
+#define DMA2D_FGMAR		MMIO32(DMA2D_BASE + 0x0C)
+#define DMA2D_FGOR		MMIO32(DMA2D_BASE + 0x10)
+#define DMA2D_BGMAR		MMIO32(DMA2D_BASE + 0x14)
+#define DMA2D_BGOR		MMIO32(DMA2D_BASE + 0x18)
+#define DMA2D_FGPFCCR		MMIO32(DMA2D_BASE + 0x1C)
+#define DMA2D_BGPFCCR		MMIO32(DMA2D_BASE + 0x24)
+#define DMA2D_OPFCCR		MMIO32(DMA2D_BASE + 0x34)
+#define DMA2D_OCOLR		MMIO32(DMA2D_BASE + 0x38)
+#define DMA2D_OMAR		MMIO32(DMA2D_BASE + 0x3C)
+#define DMA2D_OOR		MMIO32(DMA2D_BASE + 0x40)
+#define DMA2D_NLR		MMIO32(DMA2D_BASE + 0x44)
+
+#define DMA2D_CR_START		(1 << 0)
+#define DMA2D_CR_TEIE		(1 << 8)
+#define DMA2D_CR_TCIE		(1 << 9)
+#define DMA2D_CR_CEIE		(1 << 13)
+#define DMA2D_CR_MODE_M2M_PFC	(1 << 16)
+#define DMA2D_CR_MODE_M2M_BLEND	(2 << 16)
+#define DMA2D_CR_MODE_R2M	(3 << 16)
+
+#define DMA2D_ISR_TEIF		(1 << 0)
+#define DMA2D_ISR_TCIF		(1 << 1)
+#define DMA2D_ISR_CEIF		(1 << 5)
+
+#define DMA2D_xPFCCR_AM_MULTIPLY (2 << 16)
+#define DMA2D_xPFCCR_ALPHA_SHIFT 24
+
+#define DMA2D_NLR_PL_SHIFT	16
+#endif
+
+static volatile int engine_busy;
+
+#endif /* !GFX2D_CPU_ONLY */
+
+static int format_size(int format)
+{
+	switch (format) {
+	case GFX2D_ARGB8888:
+		return 4;
+	case GFX2D_RGB888:
+		return 3;
+	default:
+		return 2;
+	}
+}
+
+static uint8_t *pixel_addr(const struct gfx2d_surface *s, int x, int y)
+{
+	return (uint8_t *)s->pixels +
+	       ((size_t)y * s->pitch + x) * format_size(s->format);
+}
+
+/*
+ * Expand a pixel to ARGB8888.  Short fields are widened by repeating
+ * their top bits, so full intensity stays full intensity.
+ */
+static uint32_t unpack(int format, const uint8_t *p)
+{
+	uint32_t v, a, r, g, b;
+
+	switch (format) {
+	case GFX2D_ARGB8888:
+		return *(const uint32_t *)p;
+	case GFX2D_RGB888:
+		return 0xFF000000 | p[2] << 16 | p[1] << 8 | p[0];
+	case GFX2D_RGB565:
+		v = *(const uint16_t *)p;
+		r = v >> 11 & 0x1F;
+		g = v >> 5 & 0x3F;
+		b = v & 0x1F;
+		r = r << 3 | r >> 2;
+		g = g << 2 | g >> 4;
+		b = b << 3 | b >> 2;
+		return 0xFF000000 | r << 16 | g << 8 | b;
+	case GFX2D_ARGB1555:
+		v = *(const uint16_t *)p;
+		a = v & 0x8000 ? 0xFF : 0;
+		r = v >> 10 & 0x1F;
+		g = v >> 5 & 0x1F;
+		b = v & 0x1F;
+		r = r << 3 | r >> 2;
+		g = g << 3 | g >> 2;
+		b = b << 3 | b >> 2;
+		return a << 24 | r << 16 | g << 8 | b;
+	default:
+		v = *(const uint16_t *)p;
+		a = (v >> 12 & 0xF) * 0x11;
+		r = (v >> 8 & 0xF) * 0x11;
+		g = (v >> 4 & 0xF) * 0x11;
+		b = (v & 0xF) * 0x11;
+		return a << 24 | r << 16 | g << 8 | b;
+	}
+}
+
+/* Reduce an ARGB8888 color to `format' by truncation, as DMA2D does. */
+static uint32_t pack(int format, uint32_t argb)
+{
+	uint32_t a = argb >> 24, r = argb >> 16 & 0xFF;
+	uint32_t g = argb >> 8 & 0xFF, b = argb & 0xFF;
+
+	switch (format) {
+	case GFX2D_ARGB8888:
+		return argb;
+	case GFX2D_RGB888:
+		return argb & 0xFFFFFF;
+	case GFX2D_RGB565:
+		return (r >> 3) << 11 | (g >> 2) << 5 | b >> 3;
+	case GFX2D_ARGB1555:
+		return (a >> 7) << 15 | (r >> 3) << 10 | (g >> 3) << 5 | b >> 3;
+	default:
+		return (a >> 4) << 12 | (r >> 4) << 8 | (g >> 4) << 4 | b >> 4;
+	}
+}
+
+static void store(int format, uint8_t *p, uint32_t v)
+{
+	switch (format_size(format)) {
+	case 4:
+		*(uint32_t *)p = v;
+		break;
+	case 3:
+		p[0] = v;
+		p[1] = v >> 8;
+		p[2] = v >> 16;
+		break;
+	default:
+		*(uint16_t *)p = v;
+		break;
+	}
+}
+
+/*
+ * The blending equation from RM0090 section 11.3.7, with the
+ * foreground alpha already multiplied by the constant alpha.
+ */
+static uint32_t blend_pixel(uint32_t fg, uint32_t bg, uint32_t alpha)
+{
+	uint32_t af = (fg >> 24) * alpha / 255;
+	uint32_t ab = bg >> 24;
+	uint32_t am = af * ab / 255;
+	uint32_t ao = af + ab - am;
+	uint32_t out = ao << 24;
+	int shift;
+
+	if (ao == 0) {
+		return 0;
+	}
+	for (shift = 0; shift < 24; shift += 8) {
+		uint32_t cf = fg >> shift & 0xFF;
+		uint32_t cb = bg >> shift & 0xFF;
+		out |= (cf * af + cb * ab - cb * am) / ao << shift;
+	}
+	return out;
+}
+
+/*
+ * Clip the destination rectangle (and the matching source rectangle,
+ * if there is one) to the surfaces.  Returns 0 if nothing is left.
+ */
+static int clip(const struct gfx2d_surface *dst, int *dx, int *dy,
+		const struct gfx2d_surface *src, int *sx, int *sy,
+		int *w, int *h)
+{
+	int lo;
+
+	lo = *dx < 0 ? -*dx : 0;
+	if (src && *sx + lo < 0) {
+		lo = -*sx;
+	}
+	*dx += lo;
+	*w -= lo;
+	if (src) {
+		*sx += lo;
+	}
+	lo = *dy < 0 ? -*dy : 0;
+	if (src && *sy + lo < 0) {
+		lo = -*sy;
+	}
+	*dy += lo;
+	*h -= lo;
+	if (src) {
+		*sy += lo;
+	}
+
+	if (*dx + *w > dst->width) {
+		*w = dst->width - *dx;
+	}
+	if (*dy + *h > dst->height) {
+		*h = dst->height - *dy;
+	}
+	if (src && *sx + *w > src->width) {
+		*w = src->width - *sx;
+	}
+	if (src && *sy + *h > src->height) {
+		*h = src->height - *sy;
+	}
+	return *w > 0 && *h > 0;
+}
+
+/*
+ * CPU operations finish immediately, but they must not overtake an
+ * engine operation that is still running.
+ */
+static void cpu_begin(void)
+{
+	gfx2d_wait();
+}
+
+static void cpu_end(void)
+{
+	if (done_callback) {
+		done_callback();
+	}
+}
+
+#ifndef GFX2D_CPU_ONLY
+
+static int use_engine(int w, int h)
+{
+	return !cpu_only && w * h >= GFX2D_CPU_PIXELS;
+}
+
+static void engine_start(uint32_t mode, int w, int h)
+{
+	DMA2D_NLR = (uint32_t)w << DMA2D_NLR_PL_SHIFT | h;
+	DMA2D_IFCR = 0x3F;
+	engine_busy = 1;
+	DMA2D_CR = mode | DMA2D_CR_TEIE | DMA2D_CR_TCIE | DMA2D_CR_CEIE |
+		   DMA2D_CR_START;
+}
+
+void dma2d_isr(void)
+{
+	uint32_t isr = DMA2D_ISR;
+
+	DMA2D_IFCR = isr;
+	if (isr & (DMA2D_ISR_TEIF | DMA2D_ISR_CEIF)) {
+		gfx2d_errors++;
+	}
+	engine_busy = 0;
+	if (done_callback) {
+		done_callback();
+	}
+}
+
+#endif /* !GFX2D_CPU_ONLY */
+
+void gfx2d_init(void)
+{
+#ifndef GFX2D_CPU_ONLY
+	rcc_periph_clock_enable(RCC_DMA2D);
+	nvic_enable_irq(NVIC_DMA2D_IRQ);
+#endif
+}
+
+int gfx2d_busy(void)
+{
+#ifdef GFX2D_CPU_ONLY
+	return 0;
+#else
+	return engine_busy;
+#endif
+}
+
+void gfx2d_wait(void)
+{
+	while (gfx2d_busy()) {
+		continue;
+	}
+}
+
+void gfx2d_set_done_callback(void (*cb)(void))
+{
+	done_callback = cb;
+}
+
+void gfx2d_use_cpu(int on)
+{
+	gfx2d_wait();
+	cpu_only = on;
+}
+
+void gfx2d_fill(const struct gfx2d_surface *dst, int x, int y, int w, int h,
+		uint32_t argb)
+{
+	uint32_t v = pack(dst->format, argb);
+	int row, col;
+
+	if (!clip(dst, &x, &y, NULL, NULL, NULL, &w, &h)) {
+		return;
+	}
+
+#ifndef GFX2D_CPU_ONLY
+	if (use_engine(w, h)) {
+		gfx2d_wait();
+		DMA2D_OPFCCR = dst->format;
+		DMA2D_OCOLR = v;
+		DMA2D_OMAR = (uint32_t)pixel_addr(dst, x, y);
+		DMA2D_OOR = dst->pitch - w;
+		engine_start(DMA2D_CR_MODE_R2M, w, h);
+		return;
+	}
+#endif
+
+	cpu_begin();
+	for (row = 0; row < h; row++) {
+		uint8_t *p = pixel_addr(dst, x, y + row);
+		int sz = format_size(dst->format);
+
+		for (col = 0; col < w; col++, p += sz) {
+			store(dst->format, p, v);
+		}
+	}
+	cpu_end();
+}
+
+void gfx2d_blit(const struct gfx2d_surface *dst, int dx, int dy,
+		const struct gfx2d_surface *src, int sx, int sy, int w, int h)
+{
+	int row, col;
+
+	if (!clip(dst, &dx, &dy, src, &sx, &sy, &w, &h)) {
+		return;
+	}
+
+#ifndef GFX2D_CPU_ONLY
+	if (use_engine(w, h)) {
+		gfx2d_wait();
+		DMA2D_FGMAR = (uint32_t)pixel_addr(src, sx, sy);
+		DMA2D_FGOR = src->pitch - w;
+		DMA2D_FGPFCCR = src->format;
+		DMA2D_OPFCCR = dst->format;
+		DMA2D_OMAR = (uint32_t)pixel_addr(dst, dx, dy);
+		DMA2D_OOR = dst->pitch - w;
+		engine_start(DMA2D_CR_MODE_M2M_PFC, w, h);
+		return;
+	}
+#endif
+
+	cpu_begin();
+	for (row = 0; row < h; row++) {
+		const uint8_t *s = pixel_addr(src, sx, sy + row);
+		uint8_t *d = pixel_addr(dst, dx, dy + row);
+		int ssz = format_size(src->format);
+		int dsz = format_size(dst->format);
+
+		if (src->format == dst->format) {
+			for (col = 0; col < w * dsz; col++) {
+				d[col] = s[col];
+			}
+			continue;
+		}
+		for (col = 0; col < w; col++, s += ssz, d += dsz) {
+			store(dst->format, d,
+			      pack(dst->format, unpack(src->format, s)));
+		}
+	}
+	cpu_end();
+}
+
+void gfx2d_blend(const struct gfx2d_surface *dst, int dx, int dy,
+		 const struct gfx2d_surface *src, int sx, int sy, int w, int h,
+		 uint8_t alpha)
+{
+	int row, col;
+
+	if (!clip(dst, &dx, &dy, src, &sx, &sy, &w, &h)) {
+		return;
+	}
+
+#ifndef GFX2D_CPU_ONLY
+	if (use_engine(w, h)) {
+		uint32_t out = (uint32_t)pixel_addr(dst, dx, dy);
+
+		gfx2d_wait();
+		DMA2D_FGMAR = (uint32_t)pixel_addr(src, sx, sy);
+		DMA2D_FGOR = src->pitch - w;
+		DMA2D_FGPFCCR = src->format | DMA2D_xPFCCR_AM_MULTIPLY |
+				(uint32_t)alpha << DMA2D_xPFCCR_ALPHA_SHIFT;
+		DMA2D_BGMAR = out;
+		DMA2D_BGOR = dst->pitch - w;
+		DMA2D_BGPFCCR = dst->format;
+		DMA2D_OPFCCR = dst->format;
+		DMA2D_OMAR = out;
+		DMA2D_OOR = dst->pitch - w;
+		engine_start(DMA2D_CR_MODE_M2M_BLEND, w, h);
+		return;
+	}
+#endif
+
+	cpu_begin();
+	for (row = 0; row < h; row++) {
+		const uint8_t *s = pixel_addr(src, sx, sy + row);
+		uint8_t *d = pixel_addr(dst, dx, dy + row);
+		int ssz = format_size(src->format);
+		int dsz = format_size(dst->format);
+
+		for (col = 0; col < w; col++, s += ssz, d += dsz) {
+			uint32_t fg = unpack(src->format, s);
+			uint32_t bg = unpack(dst->format, d);
+
+			store(dst->format, d,
+			      pack(dst->format, blend_pixel(fg, bg, alpha)));
+		}
+	}
+	cpu_end();
+}
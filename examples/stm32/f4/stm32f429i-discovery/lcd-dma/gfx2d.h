@@ -0,0 +1,84 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GFX2D_H
+#define GFX2D_H
+
+#include <stdint.h>
+
+/*
+ * 2D drawing operations backed by the DMA2D (Chrom-ART) engine.
+ *
+ * Every operation is asynchronous: it starts the engine and returns.
+ * The next operation waits for the previous one, so a sequence of
+ * calls is always executed in order.  Call gfx2d_wait() before the
+ * CPU touches a buffer the engine may still be writing.
+ *
+ * Small rectangles, and everything when built with -DGFX2D_CPU_ONLY,
+ * are done on the CPU instead.  Those complete before the call
+ * returns.  The CPU path has no hardware dependencies and can be
+ * compiled on a host.
+ */
+
+/* Pixel formats, numbered as in the DMA2D CM fields. */
+enum gfx2d_format {
+	GFX2D_ARGB8888 = 0,
+	GFX2D_RGB888   = 1,
+	GFX2D_RGB565   = 2,
+	GFX2D_ARGB1555 = 3,
+	GFX2D_ARGB4444 = 4,
+};
+
+struct gfx2d_surface {
+	void *pixels;
+	uint16_t width;
+	uint16_t height;
+	uint16_t pitch;		/* pixels per line, >= width */
+	uint8_t format;
+};
+
+void gfx2d_init(void);
+
+/* Fill a rectangle with a color given as ARGB8888. */
+void gfx2d_fill(const struct gfx2d_surface *dst, int x, int y, int w, int h,
+		uint32_t argb);
+
+/* Copy a rectangle, converting the pixel format if the surfaces differ. */
+void gfx2d_blit(const struct gfx2d_surface *dst, int dx, int dy,
+		const struct gfx2d_surface *src, int sx, int sy, int w, int h);
+
+/*
+ * Blend a rectangle of src over dst.  The source alpha is multiplied
+ * by `alpha' (0xFF leaves it unchanged).
+ */
+void gfx2d_blend(const struct gfx2d_surface *dst, int dx, int dy,
+		 const struct gfx2d_surface *src, int sx, int sy, int w, int h,
+		 uint8_t alpha);
+
+int gfx2d_busy(void);
+void gfx2d_wait(void);
+
+/* Called from the interrupt handler when an operation finishes. */
+void gfx2d_set_done_callback(void (*cb)(void));
+
+/* Force every operation onto the CPU (e.g. to compare the two paths). */
+void gfx2d_use_cpu(int on);
+
+/* Number of operations the engine reported as failed. */
+extern volatile uint32_t gfx2d_errors;
+
+#endif /* !GFX2D_H */
@@ -0,0 +1,812 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Host test and benchmark for gfx2d.c.
+ *
+ * gfx2d.c is built as on the target, with MMIO32 going to a model of
+ * the DMA2D registers.  A thread plays the engine: when START is set it
+ * does the operation described by the registers, as RM0090 section 11
+ * describes it, then raises TCIF and calls dma2d_isr().  The model's
+ * pixel formats and blending are written from the manual, separately
+ * from the CPU path in gfx2d.c.
+ *
+ * Random sequences of fills, blits and blends are done three ways: on
+ * the engine path without waiting between operations, on the CPU path,
+ * and per pixel by a naive reference.  The three results must match
+ * byte for byte, including the padding and the guard after each surface.
+ *
+ * The benchmark runs the same scenes through both paths.  The "dma2d
+ * model" column is the register model running on this host, not the
+ * engine, so it only says the scenes were identical; the engine's own
+ * rate has to be measured on the board.
+ *
+ * Built with -DGFX2D_CPU_ONLY only the CPU path and the reference run.
+ */
+
+#define _DEFAULT_SOURCE
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+
+#include <libopencm3/cm3/common.h>
+#include <libopencm3/cm3/nvic.h>
+#include <libopencm3/stm32/memorymap.h>
+
+#include "gfx2d.h"
+
+static int failures;
+
+#define CHECK(cond, ...) do {						\
+	if (!(cond)) {							\
+		if (failures++ < 10) {					\
+			printf("FAIL %s:%d: ", __FILE__, __LINE__);	\
+			printf(__VA_ARGS__);				\
+			printf("\n");					\
+		}							\
+	}								\
+} while (0)
+
+static uint32_t rng_state = 1;
+
+static uint32_t rnd(void)
+{
+	rng_state ^= rng_state << 13;
+	rng_state ^= rng_state >> 17;
+	rng_state ^= rng_state << 5;
+	return rng_state;
+}
+
+int sim_irq_enabled[NVIC_IRQ_COUNT];
+
+/*
+ * Surfaces live in an arena below 4 GB, since the engine path passes
+ * their addresses through 32-bit registers.
+ */
+#define ARENA_SIZE	(64 << 20)
+#define GUARD		64
+
+static uint8_t *arena;
+static size_t arena_used;
+
+static void arena_init(void)
+{
+	void *p = mmap((void *)0x20000000, ARENA_SIZE, PROT_READ | PROT_WRITE,
+		       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+	if (p == MAP_FAILED || (uintptr_t)p + ARENA_SIZE > 0xFFFFFFFFu) {
+		printf("can't map the arena below 4 GB\n");
+		exit(EXIT_FAILURE);
+	}
+	arena = p;
+}
+
+/* --- Pixel formats, from the DMA2D chapter --- */
+
+static const struct format {
+	const char *name;
+	int size;
+	int bits[4], shift[4];		/* A, R, G, B */
+} formats[] = {
+	[GFX2D_ARGB8888] = { "ARGB8888", 4, { 8, 8, 8, 8 }, { 24, 16, 8, 0 } },
+	[GFX2D_RGB888]   = { "RGB888",   3, { 0, 8, 8, 8 }, { 0, 16, 8, 0 } },
+	[GFX2D_RGB565]   = { "RGB565",   2, { 0, 5, 6, 5 }, { 0, 11, 5, 0 } },
+	[GFX2D_ARGB1555] = { "ARGB1555", 2, { 1, 5, 5, 5 }, { 15, 10, 5, 0 } },
+	[GFX2D_ARGB4444] = { "ARGB4444", 2, { 4, 4, 4, 4 }, { 12, 8, 4, 0 } },
+};
+
+static uint32_t load(const uint8_t *p, int size)
+{
+	uint32_t v = 0;
+	int i;
+
+	for (i = size - 1; i >= 0; i--)
+		v = v << 8 | p[i];
+	return v;
+}
+
+static void save(uint8_t *p, int size, uint32_t v)
+{
+	int i;
+
+	for (i = 0; i < size; i++, v >>= 8)
+		p[i] = v;
+}
+
+/* Widen a field to 8 bits by repeating it, e.g. 5 bits abcde to abcdeabc */
+static uint32_t widen(uint32_t v, int bits)
+{
+	uint32_t out = 0;
+	int s;
+
+	for (s = 8 - bits; s > -bits; s -= bits)
+		out |= s >= 0 ? v << s : v >> -s;
+	return out & 0xFF;
+}
+
+static uint32_t to_argb(int format, uint32_t raw)
+{
+	const struct format *f = &formats[format];
+	uint32_t argb = 0, c;
+	int i;
+
+	for (i = 0; i < 4; i++) {
+		if (f->bits[i])
+			c = widen(raw >> f->shift[i] & ((1u << f->bits[i]) - 1),
+				  f->bits[i]);
+		else
+			c = 0xFF;
+		argb |= c << (24 - 8 * i);
+	}
+	return argb;
+}
+
+static uint32_t from_argb(int format, uint32_t argb)
+{
+	const struct format *f = &formats[format];
+	uint32_t raw = 0;
+	int i;
+
+	for (i = 0; i < 4; i++)
+		if (f->bits[i])
+			raw |= (argb >> (24 - 8 * i) & 0xFF) >>
+			       (8 - f->bits[i]) << f->shift[i];
+	return raw;
+}
+
+/* Foreground over background, both with straight alpha */
+static uint32_t blend(uint32_t fg, uint32_t bg)
+{
+	uint32_t af = fg >> 24, ab = bg >> 24;
+	uint32_t am = af * ab / 255, ao = af + ab - am;
+	uint32_t out, cf, cb;
+	int i;
+
+	if (!ao)
+		return 0;
+	out = ao << 24;
+	for (i = 0; i < 24; i += 8) {
+		cf = fg >> i & 0xFF;
+		cb = bg >> i & 0xFF;
+		out |= (cf * af + cb * ab - cb * am) / ao << i;
+	}
+	return out;
+}
+
+/* --- The reference: one pixel at a time, skipping those off a surface --- */
+
+static uint8_t *at(const struct gfx2d_surface *s, int x, int y)
+{
+	if (x < 0 || y < 0 || x >= s->width || y >= s->height)
+		return NULL;
+	return (uint8_t *)s->pixels +
+	       ((size_t)y * s->pitch + x) * formats[s->format].size;
+}
+
+static int ref_fill(const struct gfx2d_surface *dst, int x, int y, int w,
+		    int h, uint32_t argb)
+{
+	int i, j, n = 0, sz = formats[dst->format].size;
+	uint8_t *d;
+
+	for (j = 0; j < h; j++)
+		for (i = 0; i < w; i++)
+			if ((d = at(dst, x + i, y + j))) {
+				save(d, sz, from_argb(dst->format, argb));
+				n++;
+			}
+	return n;
+}
+
+/* Blit, or blend if alpha is not negative */
+static int ref_copy(const struct gfx2d_surface *dst, int dx, int dy,
+		    const struct gfx2d_surface *src, int sx, int sy, int w,
+		    int h, int alpha)
+{
+	int i, j, n = 0;
+	int ssz = formats[src->format].size, dsz = formats[dst->format].size;
+	uint32_t fg, bg;
+	uint8_t *d, *s;
+
+	for (j = 0; j < h; j++) {
+		for (i = 0; i < w; i++) {
+			d = at(dst, dx + i, dy + j);
+			s = at(src, sx + i, sy + j);
+			if (!d || !s)
+				continue;
+			fg = to_argb(src->format, load(s, ssz));
+			if (alpha >= 0) {
+				bg = to_argb(dst->format, load(d, dsz));
+				fg = (fg & 0xFFFFFF) |
+				     (fg >> 24) * alpha / 255 << 24;
+				fg = blend(fg, bg);
+			}
+			save(d, dsz, from_argb(dst->format, fg));
+			n++;
+		}
+	}
+	return n;
+}
+
+#ifndef GFX2D_CPU_ONLY
+
+/* --- The DMA2D model --- */
+
+#define DMA2D_ADDR	(PERIPH_BASE_AHB1 + 0xB000)
+
+enum {
+	CR, ISR, IFCR, FGMAR, FGOR, BGMAR, BGOR, FGPFCCR, FGCOLR, BGPFCCR,
+	BGCOLR, FGCMAR, BGCMAR, OPFCCR, OCOLR, OMAR, OOR, NLR, REGS
+};
+
+#define CR_START	(1 << 0)
+#define CR_TCIE		(1 << 9)
+#define ISR_TCIF	(1 << 1)
+#define ISR_CEIF	(1 << 5)
+
+static volatile uint32_t reg[REGS];
+static pthread_t engine;
+static volatile int engine_stop, engine_running;
+
+static struct {
+	uint32_t ops, pixels;
+	uint32_t config_errors, bad_addresses, touched_while_running;
+	uint32_t unacked;
+} model;
+
+volatile uint32_t *sim_mmio32(uint32_t addr)
+{
+	uint32_t i = (addr - DMA2D_ADDR) / 4;
+
+	if (addr < DMA2D_ADDR || addr % 4 || i >= REGS) {
+		printf("access outside DMA2D at 0x%08x\n", addr);
+		abort();
+	}
+	if (engine_running && !pthread_equal(pthread_self(), engine))
+		model.touched_while_running++;
+	return &reg[i];
+}
+
+/* Address of pixel x of line y, or NULL if it is outside the arena */
+static uint8_t *model_addr(uint32_t base, uint32_t offset, uint32_t pl,
+			   int format, uint32_t x, uint32_t y)
+{
+	uint64_t a = base + ((uint64_t)y * (pl + offset) + x) *
+		     formats[format].size;
+	uint64_t lo = (uintptr_t)arena, hi = lo + ARENA_SIZE;
+
+	if (a < lo || a + formats[format].size > hi) {
+		model.bad_addresses++;
+		return NULL;
+	}
+	return (uint8_t *)(uintptr_t)a;
+}
+
+static uint32_t model_fg(uint32_t x, uint32_t y, uint32_t pl)
+{
+	uint32_t pfccr = reg[FGPFCCR], cm = pfccr & 0xF;
+	uint32_t alpha = pfccr >> 24, a, argb;
+	uint8_t *p = model_addr(reg[FGMAR], reg[FGOR], pl, cm, x, y);
+
+	if (!p)
+		return 0;
+	argb = to_argb(cm, load(p, formats[cm].size));
+	a = argb >> 24;
+	switch (pfccr >> 16 & 3) {
+	case 1:
+		a = alpha;
+		break;
+	case 2:
+		a = a * alpha / 255;
+		break;
+	}
+	return (argb & 0xFFFFFF) | a << 24;
+}
+
+static uint32_t model_bg(uint32_t x, uint32_t y, uint32_t pl)
+{
+	uint32_t cm = reg[BGPFCCR] & 0xF;
+	uint8_t *p = model_addr(reg[BGMAR], reg[BGOR], pl, cm, x, y);
+
+	return p ? to_argb(cm, load(p, formats[cm].size)) : 0;
+}
+
+/* Returns 0 on a configuration error (CEIF) */
+static int model_run(void)
+{
+	uint32_t mode = reg[CR] >> 16 & 3, out = reg[OPFCCR] & 7;
+	uint32_t pl = reg[NLR] >> 16 & 0x3FFF, nl = reg[NLR] & 0xFFFF;
+	uint32_t x, y, v;
+	uint8_t *o;
+
+	if (out > GFX2D_ARGB4444 || !pl || !nl || mode == 0 ||
+	    (mode != 3 && (reg[FGPFCCR] & 0xF) > GFX2D_ARGB4444) ||
+	    (mode == 2 && (reg[BGPFCCR] & 0xF) > GFX2D_ARGB4444) ||
+	    reg[OOR] > 0x3FFF || reg[FGOR] > 0x3FFF || reg[BGOR] > 0x3FFF)
+		return 0;
+
+	for (y = 0; y < nl; y++) {
+		for (x = 0; x < pl; x++) {
+			if (mode == 3)
+				v = reg[OCOLR];
+			else if (mode == 1)
+				v = from_argb(out, model_fg(x, y, pl));
+			else
+				v = from_argb(out, blend(model_fg(x, y, pl),
+							 model_bg(x, y, pl)));
+			o = model_addr(reg[OMAR], reg[OOR], pl, out, x, y);
+			if (o)
+				save(o, formats[out].size, v);
+		}
+	}
+	model.pixels += pl * nl;
+	return 1;
+}
+
+static void *engine_main(void *arg)
+{
+	/* idle polls sleep, so the CPU path is timed on its own */
+	static const struct timespec idle = { 0, 20000 };
+
+	(void)arg;
+
+	while (!engine_stop) {
+		if (!(reg[CR] & CR_START)) {
+			nanosleep(&idle, NULL);
+			continue;
+		}
+		engine_running = 1;
+		reg[ISR] &= ~reg[IFCR];
+		reg[IFCR] = 0;
+		if (model_run()) {
+			reg[ISR] |= ISR_TCIF;
+		} else {
+			reg[ISR] |= ISR_CEIF;
+			model.config_errors++;
+		}
+		model.ops++;
+		reg[CR] &= ~CR_START;
+		engine_running = 0;
+
+		if ((reg[CR] & CR_TCIE) && sim_irq_enabled[NVIC_DMA2D_IRQ]) {
+			dma2d_isr();
+			/* the handler must clear what it was called for */
+			if (reg[ISR] & ~reg[IFCR] & 0x3F)
+				model.unacked++;
+		}
+	}
+	return NULL;
+}
+
+static void engine_init(void)
+{
+	if (pthread_create(&engine, NULL, engine_main, NULL)) {
+		printf("can't start the engine thread\n");
+		exit(EXIT_FAILURE);
+	}
+}
+
+static void engine_exit(void)
+{
+	engine_stop = 1;
+	pthread_join(engine, NULL);
+	CHECK(!model.config_errors && !model.bad_addresses &&
+	      !model.touched_while_running && !model.unacked && !gfx2d_errors,
+	      "engine: %u configuration errors, %u pixels outside the "
+	      "arena, registers touched %u times while running, %u "
+	      "interrupts not cleared, %u reported errors",
+	      model.config_errors, model.bad_addresses,
+	      model.touched_while_running, model.unacked, gfx2d_errors);
+}
+
+#endif /* !GFX2D_CPU_ONLY */
+
+/* --- Random operations, three ways --- */
+
+#define SURFACES	3
+#define OPS		24
+
+static uint32_t callbacks;
+
+static void count_callback(void)
+{
+	callbacks++;
+}
+
+static size_t surface_bytes(const struct gfx2d_surface *s)
+{
+	return (size_t)s->pitch * s->height * formats[s->format].size + GUARD;
+}
+
+static void alloc_surface(struct gfx2d_surface *s, const uint8_t *init)
+{
+	size_t n = surface_bytes(s);
+
+	/* keep every surface aligned as the engine needs */
+	arena_used = (arena_used + 3) & ~(size_t)3;
+	if (arena_used + n > ARENA_SIZE) {
+		printf("arena too small\n");
+		exit(EXIT_FAILURE);
+	}
+	s->pixels = arena + arena_used;
+	arena_used += n;
+	memcpy(s->pixels, init, n);
+}
+
+struct op {
+	int kind;			/* 0 fill, 1 blit, 2 blend */
+	int dst, src;
+	int dx, dy, sx, sy, w, h;
+	uint32_t argb;
+	uint8_t alpha;
+};
+
+static void random_op(struct op *op, const struct gfx2d_surface *s)
+{
+	op->kind = rnd() % 3;
+	op->dst = rnd() % SURFACES;
+	op->src = (op->dst + 1 + rnd() % (SURFACES - 1)) % SURFACES;
+	/* a quarter of them hang off an edge of one of the surfaces */
+	op->dx = (int)(rnd() % (s[op->dst].width + 8)) - 4;
+	op->dy = (int)(rnd() % (s[op->dst].height + 8)) - 4;
+	op->sx = (int)(rnd() % (s[op->src].width + 8)) - 4;
+	op->sy = (int)(rnd() % (s[op->src].height + 8)) - 4;
+	/* small ones go to the CPU on the engine path too */
+	op->w = rnd() % 4 ? (int)(rnd() % 40) : (int)(rnd() % 8);
+	op->h = rnd() % 4 ? (int)(rnd() % 40) : (int)(rnd() % 8);
+	op->argb = rnd();
+	op->alpha = rnd() % 3 ? rnd() : (rnd() % 2 ? 0xFF : 0);
+}
+
+static void do_op(const struct op *op, const struct gfx2d_surface *s)
+{
+	const struct gfx2d_surface *d = &s[op->dst], *src = &s[op->src];
+
+	switch (op->kind) {
+	case 0:
+		gfx2d_fill(d, op->dx, op->dy, op->w, op->h, op->argb);
+		break;
+	case 1:
+		gfx2d_blit(d, op->dx, op->dy, src, op->sx, op->sy, op->w,
+			   op->h);
+		break;
+	default:
+		gfx2d_blend(d, op->dx, op->dy, src, op->sx, op->sy, op->w,
+			    op->h, op->alpha);
+		break;
+	}
+}
+
+static int ref_op(const struct op *op, const struct gfx2d_surface *s)
+{
+	const struct gfx2d_surface *d = &s[op->dst], *src = &s[op->src];
+
+	if (op->kind == 0)
+		return ref_fill(d, op->dx, op->dy, op->w, op->h, op->argb);
+	return ref_copy(d, op->dx, op->dy, src, op->sx, op->sy, op->w, op->h,
+			op->kind == 1 ? -1 : op->alpha);
+}
+
+static int same(const struct gfx2d_surface *a, const struct gfx2d_surface *b,
+		const char *what, int run)
+{
+	size_t i, n = surface_bytes(a);
+	const uint8_t *pa = a->pixels, *pb = b->pixels;
+
+	for (i = 0; i < n && pa[i] == pb[i]; i++)
+		continue;
+	CHECK(i == n, "run %d: %s differs at byte %zu of a %ux%u (pitch %u) "
+	      "%s surface", run, what, i, a->width, a->height, a->pitch,
+	      formats[a->format].name);
+	return i == n;
+}
+
+static void random_ops(void)
+{
+	static uint8_t init[SURFACES][80 * 60 * 4 + GUARD];
+	struct gfx2d_surface ref[SURFACES], cpu[SURFACES];
+	struct op ops[OPS];
+	uint32_t drawn;
+	size_t mark = arena_used;
+	int run, i, j;
+#ifndef GFX2D_CPU_ONLY
+	struct gfx2d_surface eng[SURFACES];
+	uint32_t engine_ops = model.ops;
+#endif
+
+	gfx2d_set_done_callback(count_callback);
+
+	for (run = 0; run < 400; run++) {
+		arena_used = mark;
+		for (i = 0; i < SURFACES; i++) {
+			ref[i].format = rnd() % 5;
+			ref[i].width = 1 + rnd() % 60;
+			ref[i].height = 1 + rnd() % 60;
+			ref[i].pitch = ref[i].width + (rnd() % 3 ? 0 : rnd() % 8);
+			for (j = 0; j < (int)sizeof(init[i]); j++)
+				init[i][j] = rnd();
+			cpu[i] = ref[i];
+			alloc_surface(&ref[i], init[i]);
+			alloc_surface(&cpu[i], init[i]);
+#ifndef GFX2D_CPU_ONLY
+			eng[i] = ref[i];
+			alloc_surface(&eng[i], init[i]);
+#endif
+		}
+
+		drawn = 0;
+		for (i = 0; i < OPS; i++) {
+			random_op(&ops[i], ref);
+			drawn += ref_op(&ops[i], ref) > 0;
+		}
+
+		gfx2d_use_cpu(1);
+		callbacks = 0;
+		for (i = 0; i < OPS; i++)
+			do_op(&ops[i], cpu);
+		CHECK(callbacks == drawn, "run %d: cpu path: %u callbacks for "
+		      "%u operations", run, callbacks, drawn);
+		for (i = 0; i < SURFACES; i++)
+			same(&cpu[i], &ref[i], "cpu path", run);
+
+#ifndef GFX2D_CPU_ONLY
+		/* no waiting between the operations */
+		gfx2d_use_cpu(0);
+		callbacks = 0;
+		for (i = 0; i < OPS; i++)
+			do_op(&ops[i], eng);
+		gfx2d_wait();
+		CHECK(callbacks == drawn, "run %d: engine path: %u callbacks "
+		      "for %u operations", run, callbacks, drawn);
+		for (i = 0; i < SURFACES; i++)
+			same(&eng[i], &ref[i], "engine path", run);
+#endif
+	}
+
+#ifndef GFX2D_CPU_ONLY
+	printf("random operations: %u of them on the engine\n",
+	       model.ops - engine_ops);
+	CHECK(model.ops - engine_ops > 400, "hardly any engine operations");
+#endif
+	gfx2d_set_done_callback(NULL);
+	arena_used = mark;
+}
+
+/* A few conversions worked out by hand */
+static void known_values(void)
+{
+	static const struct {
+		int format;
+		uint32_t raw, argb;
+	} v[] = {
+		{ GFX2D_RGB565, 0xF800, 0xFFFF0000 },
+		{ GFX2D_RGB565, 0x07E0, 0xFF00FF00 },
+		{ GFX2D_RGB565, 0x8410, 0xFF848284 },
+		{ GFX2D_ARGB1555, 0x7FFF, 0x00FFFFFF },
+		{ GFX2D_ARGB1555, 0x8000, 0xFF000000 },
+		{ GFX2D_ARGB4444, 0x8C3F, 0x88CC33FF },
+		{ GFX2D_RGB888, 0x123456, 0xFF123456 },
+	};
+	uint8_t pix[4], out[4];
+	struct gfx2d_surface s = { pix, 1, 1, 1, 0 };
+	struct gfx2d_surface d = { out, 1, 1, 1, GFX2D_ARGB8888 };
+	uint32_t i;
+
+	gfx2d_use_cpu(1);
+	for (i = 0; i < sizeof(v) / sizeof(v[0]); i++) {
+		CHECK(to_argb(v[i].format, v[i].raw) == v[i].argb,
+		      "model: %s 0x%x", formats[v[i].format].name, v[i].raw);
+		s.format = v[i].format;
+		save(pix, formats[s.format].size, v[i].raw);
+		gfx2d_blit(&d, 0, 0, &s, 0, 0, 1, 1);
+		CHECK(load(out, 4) == v[i].argb, "gfx2d: %s 0x%x is 0x%08x",
+		      formats[s.format].name, v[i].raw, load(out, 4));
+	}
+
+	/* opaque over anything is itself, transparent over anything is bg */
+	CHECK(blend(0xFF123456, 0x80ABCDEF) == 0xFF123456 &&
+	      blend(0x00123456, 0x80ABCDEF) == 0x80ABCDEF &&
+	      blend(0x80FF0000, 0xFF0000FF) == 0xFF80007F,
+	      "blending equation");
+}
+
+/* --- The benchmark --- */
+
+#define BENCH_W		240
+#define BENCH_H		320
+
+static struct gfx2d_surface screen, screen565, screen4444, pattern, sprite;
+
+static void scene_fill(void)
+{
+	gfx2d_fill(&screen, 0, 0, BENCH_W, BENCH_H, 0xFF336699);
+}
+
+static void scene_blit(void)
+{
+	gfx2d_blit(&screen, 0, 0, &pattern, 0, 0, BENCH_W, BENCH_H);
+}
+
+static void scene_from565(void)
+{
+	gfx2d_blit(&screen, 0, 0, &screen565, 0, 0, BENCH_W, BENCH_H);
+}
+
+static void scene_to4444(void)
+{
+	gfx2d_blit(&screen4444, 0, 0, &pattern, 0, 0, BENCH_W, BENCH_H);
+}
+
+static void scene_blend(void)
+{
+	gfx2d_blend(&screen, 0, 0, &screen4444, 0, 0, BENCH_W, BENCH_H, 0xC0);
+}
+
+/* What lcd-dma.c does per frame: scroll the pattern, put a sprite on */
+static int phase;
+
+static void scene_demo(void)
+{
+	phase = (phase + 1) % BENCH_H;
+	gfx2d_blit(&screen, 0, 0, &pattern, 0, phase, BENCH_W,
+		   BENCH_H - phase);
+	gfx2d_blit(&screen, 0, BENCH_H - phase, &pattern, 0, 0, BENCH_W,
+		   phase);
+	gfx2d_blend(&screen, 40, 60, &sprite, 0, 0, 64, 64, 0xFF);
+}
+
+static void scene_small(void)
+{
+	int x, y;
+
+	for (y = 0; y < BENCH_H; y += 8)
+		for (x = 0; x < BENCH_W; x += 8)
+			gfx2d_fill(&screen, x, y, 7, 7, 0xFF000000 | x << 8 | y);
+}
+
+static const struct scene {
+	const char *name;
+	void (*draw)(void);
+	uint32_t bytes;			/* written per scene */
+} scenes[] = {
+	{ "fill ARGB8888", scene_fill, BENCH_W * BENCH_H * 4 },
+	{ "blit ARGB8888", scene_blit, BENCH_W * BENCH_H * 4 },
+	{ "RGB565 to ARGB8888", scene_from565, BENCH_W * BENCH_H * 4 },
+	{ "ARGB8888 to ARGB4444", scene_to4444, BENCH_W * BENCH_H * 2 },
+	{ "blend ARGB4444", scene_blend, BENCH_W * BENCH_H * 4 },
+	{ "demo frame", scene_demo, (BENCH_W * BENCH_H + 64 * 64) * 4 },
+	{ "7x7 fills", scene_small, (BENCH_W / 8) * (BENCH_H / 8) * 49 * 4 },
+};
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/*
+ * MB/s for one scene, and the screen it draws once more from a known
+ * start, for comparing the two paths.
+ */
+static double bench_one(const struct scene *sc, uint8_t *result)
+{
+	double start = now(), t;
+	uint32_t n = 0;
+
+	do {
+		sc->draw();
+		gfx2d_wait();
+		n++;
+		t = now() - start;
+	} while (t < 0.2);
+
+	memcpy(screen.pixels, pattern.pixels, surface_bytes(&screen));
+	phase = 0;
+	sc->draw();
+	gfx2d_wait();
+	memcpy(result, screen.pixels, surface_bytes(&screen));
+	return n * (double)sc->bytes / t / 1e6;
+}
+
+static void make_surface(struct gfx2d_surface *s, int w, int h, int format)
+{
+	static uint8_t zero[BENCH_W * BENCH_H * 4 + GUARD];
+
+	s->width = s->pitch = w;
+	s->height = h;
+	s->format = format;
+	alloc_surface(s, zero);
+}
+
+static void bench(void)
+{
+	static uint8_t cpu[BENCH_W * BENCH_H * 4 + GUARD];
+	static const uint32_t colors[] = { 0xFF202020, 0xFFE0E0E0 };
+#ifndef GFX2D_CPU_ONLY
+	static uint8_t eng[BENCH_W * BENCH_H * 4 + GUARD];
+#endif
+	double rate;
+	uint32_t i;
+	int x, y;
+
+	make_surface(&screen, BENCH_W, BENCH_H, GFX2D_ARGB8888);
+	make_surface(&screen565, BENCH_W, BENCH_H, GFX2D_RGB565);
+	make_surface(&screen4444, BENCH_W, BENCH_H, GFX2D_ARGB4444);
+	make_surface(&pattern, BENCH_W, BENCH_H, GFX2D_ARGB8888);
+	make_surface(&sprite, 64, 64, GFX2D_ARGB4444);
+
+	gfx2d_use_cpu(1);
+	for (y = 0; y < BENCH_H; y += 16)
+		for (x = 0; x < BENCH_W; x += 16)
+			gfx2d_fill(&pattern, x, y, 16, 16,
+				   colors[(x + y) / 16 % 2]);
+	gfx2d_blit(&screen565, 0, 0, &pattern, 0, 0, BENCH_W, BENCH_H);
+	for (y = 0; y < 64; y++)
+		gfx2d_fill(&sprite, 0, y, 64, 1, (uint32_t)y * 4 << 24 |
+			   0xFF8000);
+
+#ifndef GFX2D_CPU_ONLY
+	printf("%-22s %10s %10s %12s\n", "scene", "bytes", "cpu path",
+	       "dma2d model");
+#else
+	printf("%-22s %10s %10s\n", "scene", "bytes", "cpu path");
+#endif
+	for (i = 0; i < sizeof(scenes) / sizeof(scenes[0]); i++) {
+		gfx2d_use_cpu(1);
+		rate = bench_one(&scenes[i], cpu);
+		printf("%-22s %10u %6.0f MB/s", scenes[i].name,
+		       scenes[i].bytes, rate);
+#ifndef GFX2D_CPU_ONLY
+		gfx2d_use_cpu(0);
+		rate = bench_one(&scenes[i], eng);
+		printf(" %8.0f MB/s", rate);
+		CHECK(!memcmp(cpu, eng, surface_bytes(&screen)), "%s: the two paths drew different "
+		      "screens", scenes[i].name);
+#endif
+		printf("\n");
+	}
+}
+
+int main(void)
+{
+	arena_init();
+	gfx2d_init();
+#ifndef GFX2D_CPU_ONLY
+	CHECK(sim_irq_enabled[NVIC_DMA2D_IRQ], "DMA2D interrupt not enabled");
+	engine_init();
+#endif
+
+	known_values();
+	random_ops();
+	bench();
+
+#ifndef GFX2D_CPU_ONLY
+	engine_exit();
+#endif
+	if (failures) {
+		printf("%d failures\n", failures);
+		return EXIT_FAILURE;
+	}
+	printf("all passed\n");
+	return EXIT_SUCCESS;
+}
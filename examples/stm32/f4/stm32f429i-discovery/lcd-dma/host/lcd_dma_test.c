@@ -0,0 +1,402 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/*
+ * Host model of the LTDC scanout for the page flipping in lcd-dma.c.
+ *
+ * lcd_dma_init() programs the simulated LTDC and the model takes the
+ * frame timing from those registers.  It then steps one scan line at a
+ * time: during the active lines it "scans" the line of layer 1 from the
+ * active CFBAR, and at the first line of vertical blanking it copies the
+ * shadow registers to the active ones if VBR was set, and raises the
+ * reload interrupt.  lcd_tft_isr() runs a random number of lines later.
+ *
+ * The CPU side does what main() does, a few rows per line: it takes the
+ * back buffer, draws frame n into it row by row, presents it, and waits
+ * for the fence.  Every row the CPU draws is tagged with its frame
+ * number.  A scanned frame whose rows carry different tags, or come from
+ * two buffers, was presented half drawn or drawn over while on screen.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Only the flip code and the interrupt handler run here. */
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wold-style-declaration"
+#pragma GCC diagnostic ignored "-Wreturn-type"
+#define main static __attribute__((unused)) lcd_dma_main
+#include "lcd-dma.c"
+#undef main
+#pragma GCC diagnostic pop
+
+static int failures;
+
+#define CHECK(cond, ...) do {						\
+	if (!(cond)) {							\
+		if (failures++ < 10) {					\
+			printf("FAIL %s:%d: ", __FILE__, __LINE__);	\
+			printf(__VA_ARGS__);				\
+			printf("\n");					\
+		}							\
+	}								\
+} while (0)
+
+static uint32_t rng_state = 1;
+
+static uint32_t rnd(void)
+{
+	rng_state ^= rng_state << 13;
+	rng_state ^= rng_state >> 17;
+	rng_state ^= rng_state << 5;
+	return rng_state;
+}
+
+/* --- The simulated registers --- */
+
+struct sim_ltdc sim_ltdc;
+uint32_t sim_rcc_cr = RCC_CR_PLLSAIRDY, sim_rcc_pllcfgr, sim_rcc_pllsaicfgr;
+uint32_t sim_rcc_dckcfgr, sim_rcc_apb2enr;
+int sim_irq_enabled[NVIC_IRQ_COUNT];
+
+/* --- The scanout --- */
+
+#define FIELD(reg, shift, bits)	(((reg) >> (shift)) & ((1u << (bits)) - 1))
+
+static struct {
+	uint32_t total_w, total_h;	/* clocks per line, lines per frame */
+	uint32_t first, last;		/* active lines */
+	double pixel_clock, frame_rate;
+} timing;
+
+static struct sim_ltdc active;		/* the registers in use */
+static uint32_t line;
+
+/* The frame drawn into each row of each layer 1 buffer, -1 if none */
+static int32_t tags[2][LCD_LAYER1_HEIGHT];
+
+static struct {
+	uint32_t frames, distinct;	/* frames scanned, different ones */
+	uint32_t torn, garbage, early, backwards;
+	int32_t tag, last_tag;
+	int buf;
+} scan;
+
+static struct {
+	int pending;
+	uint32_t delay, max_latency;	/* in lines */
+	uint32_t calls;
+} irq;
+
+static void read_timing(void)
+{
+	uint32_t n, r, div;
+
+	timing.total_w = FIELD(LTDC_TWCR, LTDC_TWCR_TOTALW_SHIFT, 12) + 1;
+	timing.total_h = FIELD(LTDC_TWCR, LTDC_TWCR_TOTALH_SHIFT, 11) + 1;
+	timing.first = FIELD(LTDC_BPCR, LTDC_BPCR_AVBP_SHIFT, 11) + 1;
+	timing.last = FIELD(LTDC_AWCR, LTDC_AWCR_AAH_SHIFT, 11);
+
+	/* 8 MHz HSE / PLLM 8 into PLLSAI, see lcd_dma_init() */
+	n = FIELD(RCC_PLLSAICFGR, RCC_PLLSAICFGR_PLLSAIN_SHIFT, 9);
+	r = FIELD(RCC_PLLSAICFGR, RCC_PLLSAICFGR_PLLSAIR_SHIFT, 3);
+	div = 2 << FIELD(RCC_DCKCFGR, RCC_DCKCFGR_PLLSAIDIVR_SHIFT, 2);
+	timing.pixel_clock = r ? 1e6 * n / r / div : 0;
+	timing.frame_rate = timing.pixel_clock /
+			    (timing.total_w * timing.total_h);
+}
+
+static int buffer_of(uint32_t cfbar)
+{
+	int i;
+
+	for (i = 0; i < 2; i++)
+		if (cfbar == (uint32_t)lcd_layers[LCD_LAYER1].buf[i])
+			return i;
+	return -1;
+}
+
+static void reload(void)
+{
+	memcpy(&active, &sim_ltdc, sizeof(active));
+	if (sim_ltdc.ier & LTDC_IER_RRIE) {
+		sim_ltdc.isr |= LTDC_ISR_RRIF;
+		if (!irq.pending) {
+			irq.pending = 1;
+			irq.delay = rnd() % (irq.max_latency + 1);
+		}
+	}
+}
+
+/* Layer 1 puts out one line. */
+static void scan_line(void)
+{
+	struct sim_ltdc_layer *l = &active.l[0];
+	uint32_t top = FIELD(l->wvpcr, LTDC_LxWVPCR_WVSTPOS_SHIFT, 11);
+	uint32_t row = line - top;
+	int b = buffer_of(l->cfbar);
+
+	if (!(active.gcr & LTDC_GCR_LTDC_ENABLE) ||
+	    !(l->cr & LTDC_LxCR_LAYER_ENABLE) || row >= l->cfblnr)
+		return;
+	if (b < 0) {
+		scan.garbage++;
+		return;
+	}
+	if (row == 0) {
+		scan.tag = tags[b][0];
+		scan.buf = b;
+	} else if (tags[b][row] != scan.tag || b != scan.buf) {
+		scan.torn++;
+		scan.tag = -2;		/* count each frame once */
+	}
+	if (row + 1 < l->cfblnr || scan.tag == -2)
+		return;
+
+	scan.frames++;
+	if (scan.tag < 0)
+		scan.garbage++;
+	if (scan.tag < scan.last_tag)
+		scan.backwards++;
+	if (scan.tag != scan.last_tag)
+		scan.distinct++;
+	scan.last_tag = scan.tag;
+}
+
+static void irq_step(void)
+{
+	if (!irq.pending || !sim_irq_enabled[NVIC_LCD_TFT_IRQ])
+		return;
+	if (irq.delay) {
+		irq.delay--;
+		return;
+	}
+	lcd_tft_isr();
+	irq.calls++;
+	if (sim_ltdc.icr & LTDC_ICR_CRRIF)
+		sim_ltdc.isr &= ~LTDC_ISR_RRIF;
+	sim_ltdc.icr = 0;
+	irq.pending = (sim_ltdc.isr & LTDC_ISR_RRIF) != 0;
+}
+
+/* --- The CPU --- */
+
+enum cpu_state { NEED_BUFFER, DRAWING, WAIT_FENCE };
+
+static struct {
+	enum cpu_state state;
+	int wait_fence;
+	uint32_t speed;			/* rows per line, in 1/16 */
+	uint32_t acc, row, fence;
+	int32_t frame, presented;
+	int buf;
+	uint32_t early_fences, presents;
+	uint32_t fence_lines, max_fence_lines;
+} cpu;
+
+static void cpu_step(void)
+{
+	struct lcd_layer *lp = &lcd_layers[LCD_LAYER1];
+
+	switch (cpu.state) {
+	case NEED_BUFFER:
+		/* lcd_layer_back_buffer() would spin, so don't call it yet */
+		if (lp->state != FLIP_IDLE)
+			break;
+		cpu.buf = lcd_layer_back_buffer(LCD_LAYER1) == lp->buf[1];
+		cpu.frame++;
+		cpu.row = 0;
+		cpu.acc = 0;
+		cpu.state = DRAWING;
+		/* fall through */
+	case DRAWING:
+		cpu.acc += rnd() % (2 * cpu.speed + 1);
+		for (; cpu.acc >= 16 && cpu.row < LCD_LAYER1_HEIGHT;
+		     cpu.acc -= 16)
+			tags[cpu.buf][cpu.row++] = cpu.frame;
+		if (cpu.row < LCD_LAYER1_HEIGHT)
+			break;
+		cpu.fence = lcd_layer_present(LCD_LAYER1);
+		cpu.presented = cpu.frame;
+		cpu.presents++;
+		cpu.fence_lines = 0;
+		cpu.state = cpu.wait_fence ? WAIT_FENCE : NEED_BUFFER;
+		break;
+	case WAIT_FENCE:
+		cpu.fence_lines++;
+		if (!lcd_fence_done(LCD_LAYER1, cpu.fence))
+			break;
+		/* the fence means the buffer is being scanned out now */
+		if (buffer_of(active.l[0].cfbar) != cpu.buf)
+			cpu.early_fences++;
+		if (cpu.fence_lines > cpu.max_fence_lines)
+			cpu.max_fence_lines = cpu.fence_lines;
+		cpu.state = NEED_BUFFER;
+		break;
+	}
+}
+
+/* --- The runs --- */
+
+static void line_step(void)
+{
+	if (line >= timing.first && line <= timing.last)
+		scan_line();
+	if (++line == timing.total_h)
+		line = 0;
+	if (line == timing.last + 1 && (sim_ltdc.srcr & LTDC_SRCR_VBR)) {
+		sim_ltdc.srcr &= ~LTDC_SRCR_VBR;
+		reload();
+	}
+	if (sim_ltdc.srcr & LTDC_SRCR_IMR) {
+		sim_ltdc.srcr &= ~LTDC_SRCR_IMR;
+		reload();
+	}
+
+	/* the handler and the main loop, in either order */
+	if (rnd() % 2) {
+		irq_step();
+		cpu_step();
+	} else {
+		cpu_step();
+		irq_step();
+	}
+	/* a shown frame can't be newer than the last one presented */
+	if (scan.last_tag > cpu.presented)
+		scan.early++;
+}
+
+static void reset(void)
+{
+	int i;
+
+	memset(&sim_ltdc, 0, sizeof(sim_ltdc));
+	memset(&active, 0, sizeof(active));
+	memset(&scan, 0, sizeof(scan));
+	memset(&irq, 0, sizeof(irq));
+	memset(&cpu, 0, sizeof(cpu));
+	for (i = 0; i < LCD_LAYERS; i++) {
+		lcd_layers[i].front = 0;
+		lcd_layers[i].state = FLIP_IDLE;
+		lcd_layers[i].queued = lcd_layers[i].shown = 0;
+	}
+
+	/* main() blits frame 0 into buffer 0 before starting the LTDC */
+	for (i = 0; i < LCD_LAYER1_HEIGHT; i++) {
+		tags[0][i] = 0;
+		tags[1][i] = -1;
+	}
+	scan.last_tag = 0;
+	line = 0;
+	lcd_dma_init();
+	read_timing();
+}
+
+/* Frames per second put on screen, for 'frames' scanned frames */
+static double run(uint32_t speed, int wait_fence, uint32_t max_latency,
+		  uint32_t frames)
+{
+	const char *how = wait_fence ? "fence" : "no fence";
+
+	reset();
+	cpu.speed = speed;
+	cpu.wait_fence = wait_fence;
+	irq.max_latency = max_latency;
+
+	/* stop an interrupt storm early, it is reported below */
+	while (scan.frames < frames && irq.calls <= 2 * frames + 2)
+		line_step();
+
+	CHECK(!scan.torn && !scan.garbage,
+	      "%u/16 rows per line, %s, latency %u: %u torn frames, %u "
+	      "from a buffer never drawn", speed, how, max_latency,
+	      scan.torn, scan.garbage);
+	CHECK(!scan.early && !scan.backwards && !cpu.early_fences,
+	      "%u/16 rows per line, %s: %u shown before present, %u "
+	      "backwards, %u fences early", speed, how, scan.early,
+	      scan.backwards, cpu.early_fences);
+	CHECK(irq.calls <= scan.frames + 1,
+	      "%u/16 rows per line, %s: %u interrupts in %u frames", speed,
+	      how, irq.calls, scan.frames);
+	CHECK(scan.distinct > frames / 8 || speed < 4,
+	      "%u/16 rows per line, %s: only %u new frames", speed, how,
+	      scan.distinct);
+	return scan.distinct * timing.frame_rate / scan.frames;
+}
+
+static void setup(void)
+{
+	reset();
+	printf("frame: %u x %u clocks at %.1f MHz, %.1f Hz\n",
+	       timing.total_w, timing.total_h, timing.pixel_clock / 1e6,
+	       timing.frame_rate);
+
+	CHECK(timing.last - timing.first + 1 == LCD_HEIGHT &&
+	      timing.total_h == VSYNC + VBP + LCD_HEIGHT + VFP &&
+	      timing.total_w == HSYNC + HBP + LCD_WIDTH + HFP,
+	      "timing registers don't match the constants");
+	CHECK(FIELD(LTDC_L1WVPCR, LTDC_LxWVPCR_WVSTPOS_SHIFT, 11) ==
+	      timing.first && LTDC_L1CFBLNR == LCD_LAYER1_HEIGHT,
+	      "layer 1 window");
+	CHECK(LTDC_L1CFBAR == (uint32_t)lcd_layers[LCD_LAYER1].buf[0] &&
+	      (LTDC_SRCR & LTDC_SRCR_VBR) && (LTDC_IER & LTDC_IER_RRIE) &&
+	      sim_irq_enabled[NVIC_LCD_TFT_IRQ],
+	      "layer 1 start or reload interrupt");
+}
+
+/*
+ * Draw speeds from a quarter row per line (a frame takes about five
+ * refreshes) to a whole frame in a few lines, with and without waiting
+ * for the fence, and with the interrupt up to two lines or up to a
+ * whole frame late.
+ */
+static void flips(void)
+{
+	static const uint32_t speeds[] = { 4, 16, 64, 16 * 160 };
+	static const char *const names[] = {
+		"1/4 row per line", "1 row per line", "4 rows per line",
+		"160 rows per line",
+	};
+	uint32_t i, frames = 2000;
+	double fence, nofence, late;
+
+	printf("%-20s %8s %8s %14s\n", "drawing", "fence", "no fence",
+	       "late interrupt");
+	for (i = 0; i < 4; i++) {
+		fence = run(speeds[i], 1, 2, frames);
+		nofence = run(speeds[i], 0, 2, frames);
+		late = run(speeds[i], 1, timing.total_h, frames);
+		printf("%-20s %6.1f/s %6.1f/s %12.1f/s\n", names[i], fence,
+		       nofence, late);
+	}
+	printf("longest fence wait: %u lines\n", cpu.max_fence_lines);
+}
+
+int main(void)
+{
+	setup();
+	flips();
+
+	if (failures) {
+		printf("%d failures\n", failures);
+		return EXIT_FAILURE;
+	}
+	printf("all passed\n");
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,29 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Host stand-in, see gfx2d_test.c.  The DMA2D registers are simulated. */
+
+#ifndef HOST_COMMON_H
+#define HOST_COMMON_H
+
+#include <stdint.h>
+
+volatile uint32_t *sim_mmio32(uint32_t addr);
+
+#define MMIO32(addr)		(*sim_mmio32(addr))
+
+#endif
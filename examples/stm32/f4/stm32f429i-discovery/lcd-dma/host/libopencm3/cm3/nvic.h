@@ -0,0 +1,39 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Host stand-in, see lcd_dma_test.c and gfx2d_test.c. */
+
+#ifndef HOST_NVIC_H
+#define HOST_NVIC_H
+
+#include <stdint.h>
+
+#define NVIC_LCD_TFT_IRQ	88
+#define NVIC_DMA2D_IRQ		90
+#define NVIC_IRQ_COUNT		91
+
+extern int sim_irq_enabled[NVIC_IRQ_COUNT];
+
+static inline void nvic_enable_irq(uint8_t irq)
+{
+	sim_irq_enabled[irq] = 1;
+}
+
+void lcd_tft_isr(void);
+void dma2d_isr(void);
+
+#endif
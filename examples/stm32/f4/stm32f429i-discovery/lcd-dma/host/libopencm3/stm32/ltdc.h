@@ -0,0 +1,98 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Host stand-in for the LTDC registers lcd-dma.c uses.  The bit
+ * positions are the real ones, the scanout is modelled in lcd_dma_test.c.
+ */
+
+#ifndef HOST_LTDC_H
+#define HOST_LTDC_H
+
+#include <stdint.h>
+
+struct sim_ltdc {
+	uint32_t sscr, bpcr, awcr, twcr, gcr, srcr, bccr, ier, isr, icr;
+	struct sim_ltdc_layer {
+		uint32_t cr, whpcr, wvpcr, pfcr, cacr, bfcr;
+		uint32_t cfbar, cfblr, cfblnr;
+	} l[2];
+};
+
+/* What the CPU writes; the model copies it to its active set on reload */
+extern struct sim_ltdc sim_ltdc;
+
+#define LTDC_SSCR			(sim_ltdc.sscr)
+#define LTDC_BPCR			(sim_ltdc.bpcr)
+#define LTDC_AWCR			(sim_ltdc.awcr)
+#define LTDC_TWCR			(sim_ltdc.twcr)
+#define LTDC_GCR			(sim_ltdc.gcr)
+#define LTDC_SRCR			(sim_ltdc.srcr)
+#define LTDC_BCCR			(sim_ltdc.bccr)
+#define LTDC_IER			(sim_ltdc.ier)
+#define LTDC_ISR			(sim_ltdc.isr)
+#define LTDC_ICR			(sim_ltdc.icr)
+
+#define LTDC_L1CR			(sim_ltdc.l[0].cr)
+#define LTDC_L1WHPCR			(sim_ltdc.l[0].whpcr)
+#define LTDC_L1WVPCR			(sim_ltdc.l[0].wvpcr)
+#define LTDC_L1PFCR			(sim_ltdc.l[0].pfcr)
+#define LTDC_L1CACR			(sim_ltdc.l[0].cacr)
+#define LTDC_L1BFCR			(sim_ltdc.l[0].bfcr)
+#define LTDC_L1CFBAR			(sim_ltdc.l[0].cfbar)
+#define LTDC_L1CFBLR			(sim_ltdc.l[0].cfblr)
+#define LTDC_L1CFBLNR			(sim_ltdc.l[0].cfblnr)
+#define LTDC_L2CR			(sim_ltdc.l[1].cr)
+#define LTDC_L2WHPCR			(sim_ltdc.l[1].whpcr)
+#define LTDC_L2WVPCR			(sim_ltdc.l[1].wvpcr)
+#define LTDC_L2PFCR			(sim_ltdc.l[1].pfcr)
+#define LTDC_L2CACR			(sim_ltdc.l[1].cacr)
+#define LTDC_L2BFCR			(sim_ltdc.l[1].bfcr)
+#define LTDC_L2CFBAR			(sim_ltdc.l[1].cfbar)
+#define LTDC_L2CFBLR			(sim_ltdc.l[1].cfblr)
+#define LTDC_L2CFBLNR			(sim_ltdc.l[1].cfblnr)
+
+#define LTDC_SSCR_HSW_SHIFT		16
+#define LTDC_SSCR_VSH_SHIFT		0
+#define LTDC_BPCR_AHBP_SHIFT		16
+#define LTDC_BPCR_AVBP_SHIFT		0
+#define LTDC_AWCR_AAW_SHIFT		16
+#define LTDC_AWCR_AAH_SHIFT		0
+#define LTDC_TWCR_TOTALW_SHIFT		16
+#define LTDC_TWCR_TOTALH_SHIFT		0
+
+#define LTDC_GCR_LTDC_ENABLE		(1 << 0)
+#define LTDC_GCR_PCPOL_ACTIVE_HIGH	(1 << 28)
+#define LTDC_SRCR_IMR			(1 << 0)
+#define LTDC_SRCR_VBR			(1 << 1)
+#define LTDC_IER_RRIE			(1 << 3)
+#define LTDC_ISR_RRIF			(1 << 3)
+#define LTDC_ICR_CRRIF			(1 << 3)
+
+#define LTDC_LxCR_LAYER_ENABLE		(1 << 0)
+#define LTDC_LxWHPCR_WHSTPOS_SHIFT	0
+#define LTDC_LxWHPCR_WHSPPOS_SHIFT	16
+#define LTDC_LxWVPCR_WVSTPOS_SHIFT	0
+#define LTDC_LxWVPCR_WVSPPOS_SHIFT	16
+#define LTDC_LxPFCR_ARGB8888		0
+#define LTDC_LxPFCR_ARGB4444		4
+#define LTDC_LxCFBLR_CFBLL_SHIFT	0
+#define LTDC_LxCFBLR_CFBP_SHIFT		16
+#define LTDC_LxBFCR_BF1_PIXEL_ALPHA_x_CONST_ALPHA	(6 << 8)
+#define LTDC_LxBFCR_BF2_PIXEL_ALPHA_x_CONST_ALPHA	(7 << 0)
+
+#endif
@@ -0,0 +1,58 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Host stand-in, see lcd_dma_test.c and gfx2d_test.c. */
+
+#ifndef HOST_RCC_H
+#define HOST_RCC_H
+
+#include <stdint.h>
+
+/* PLLSAIRDY is set from the start, the model runs the pixel clock */
+extern uint32_t sim_rcc_cr, sim_rcc_pllcfgr, sim_rcc_pllsaicfgr;
+extern uint32_t sim_rcc_dckcfgr, sim_rcc_apb2enr;
+
+#define RCC_CR				(sim_rcc_cr)
+#define RCC_PLLCFGR			(sim_rcc_pllcfgr)
+#define RCC_PLLSAICFGR			(sim_rcc_pllsaicfgr)
+#define RCC_DCKCFGR			(sim_rcc_dckcfgr)
+#define RCC_APB2ENR			(sim_rcc_apb2enr)
+
+#define RCC_CR_PLLSAION			(1 << 28)
+#define RCC_CR_PLLSAIRDY		(1 << 29)
+#define RCC_PLLSAICFGR_PLLSAIN_SHIFT	6
+#define RCC_PLLSAICFGR_PLLSAIQ_SHIFT	24
+#define RCC_PLLSAICFGR_PLLSAIQ_MASK	0xf
+#define RCC_PLLSAICFGR_PLLSAIR_SHIFT	28
+#define RCC_DCKCFGR_PLLSAIDIVR_SHIFT	16
+#define RCC_DCKCFGR_PLLSAIDIVR_DIVR_8	2
+#define RCC_APB2ENR_LTDCEN		(1 << 26)
+
+#define RCC_GPIOA			(1 << 0)
+#define RCC_GPIOB			(1 << 1)
+#define RCC_GPIOC			(1 << 2)
+#define RCC_GPIOD			(1 << 3)
+#define RCC_GPIOF			(1 << 5)
+#define RCC_GPIOG			(1 << 6)
+#define RCC_DMA2D			(1 << 23)
+
+static inline void rcc_periph_clock_enable(uint32_t clken)
+{
+	(void)clken;
+}
+
+#endif
@@ -9,6 +9,7 @@
 
 #include "clock.h"
 #include "console.h"
+#include "gfx2d.h"
 #include "lcd-spi.h"
 #include "sdram.h"
 
@@ -29,7 +30,6 @@
 typedef uint32_t layer1_pixel;
 #define LCD_LAYER1_PIXFORMAT LTDC_LxPFCR_ARGB8888
 
-layer1_pixel *const lcd_layer1_frame_buffer = (void *)SDRAM_BASE_ADDRESS;
 #define LCD_LAYER1_PIXEL_SIZE (sizeof(layer1_pixel))
 #define LCD_LAYER1_WIDTH  LCD_WIDTH
 #define LCD_LAYER1_HEIGHT LCD_HEIGHT
@@ -40,14 +40,85 @@ layer1_pixel *const lcd_layer1_frame_buffer = (void *)SDRAM_BASE_ADDRESS;
 
 typedef uint16_t layer2_pixel;
 #define LCD_LAYER2_PIXFORMAT LTDC_LxPFCR_ARGB4444
-layer2_pixel *const lcd_layer2_frame_buffer =
-	(void *)SDRAM_BASE_ADDRESS + LCD_LAYER1_BYTES;
 #define LCD_LAYER2_PIXEL_SIZE (sizeof(layer2_pixel))
 #define LCD_LAYER2_WIDTH 128
 #define LCD_LAYER2_HEIGHT 128
-#define LCD_LAYER2_PIXELS (LCD_LAYER2_WIDTH * LCD_LAYER2_HEIGH)
+#define LCD_LAYER2_PIXELS (LCD_LAYER2_WIDTH * LCD_LAYER2_HEIGHT)
 #define LCD_LAYER2_BYTES (LCD_LAYER2_PIXELS * LCD_LAYER2_PIXEL_SIZE)
 
+/*
+ * Each layer has two frame buffers in SDRAM.  The LTDC scans out the
+ * front buffer while the CPU draws into the back buffer.  When the
+ * drawing is finished, lcd_layer_present() queues the back buffer and
+ * the interrupt handler writes its address into the layer's shadow
+ * CFBAR register.  The shadow registers are only copied to the active
+ * registers during vertical blanking (LTDC_SRCR_VBR), so the switch
+ * always happens between two frames and a half-drawn buffer is never
+ * scanned out.
+ *
+ * The reload interrupt that follows tells us the flip has happened.
+ * Only then does the old front buffer become the new back buffer, and
+ * only then is the fence returned by lcd_layer_present() signaled.
+ *
+ *   SDRAM_BASE_ADDRESS
+ *     + 0                                       layer 1, buffer 0
+ *     + LCD_LAYER1_BYTES                        layer 1, buffer 1
+ *     + 2 * LCD_LAYER1_BYTES                    layer 2, buffer 0
+ *     + 2 * LCD_LAYER1_BYTES + LCD_LAYER2_BYTES layer 2, buffer 1
+ */
+
+enum {
+	LCD_LAYER1,
+	LCD_LAYER2,
+	LCD_LAYERS
+};
+
+enum flip_state {
+	FLIP_IDLE,		/* back buffer belongs to the CPU */
+	FLIP_QUEUED,		/* presented, CFBAR not yet written */
+	FLIP_LATCHED,		/* CFBAR written, waiting for reload */
+};
+
+struct lcd_layer {
+	void *buf[2];
+	volatile uint32_t *cfbar;
+	volatile uint8_t front;
+	volatile uint8_t state;
+	volatile uint32_t queued;	/* fence of the last present */
+	volatile uint32_t shown;	/* fence of the last completed flip */
+};
+
+static struct lcd_layer lcd_layers[LCD_LAYERS] = {
+	[LCD_LAYER1] = {
+		.buf = {
+			(void *)SDRAM_BASE_ADDRESS,
+			(void *)SDRAM_BASE_ADDRESS + LCD_LAYER1_BYTES,
+		},
+		.cfbar = &LTDC_L1CFBAR,
+	},
+	[LCD_LAYER2] = {
+		.buf = {
+			(void *)SDRAM_BASE_ADDRESS + 2 * LCD_LAYER1_BYTES,
+			(void *)SDRAM_BASE_ADDRESS + 2 * LCD_LAYER1_BYTES +
+				LCD_LAYER2_BYTES,
+		},
+		.cfbar = &LTDC_L2CFBAR,
+	},
+};
+
+/*
+ * The checkerboard is drawn once into a third buffer after the layer
+ * buffers.  Each frame is then a pair of DMA2D blits from it.
+ */
+static const struct gfx2d_surface lcd_pattern = {
+	.pixels = (void *)SDRAM_BASE_ADDRESS +
+		  2 * (LCD_LAYER1_BYTES + LCD_LAYER2_BYTES),
+	.width = LCD_LAYER1_WIDTH,
+	.height = LCD_LAYER1_HEIGHT,
+	.pitch = LCD_LAYER1_WIDTH,
+	.format = GFX2D_ARGB8888,
+};
+
 /*
  * Pin assignments
  *     R2      = PC10, AF14
@@ -213,7 +284,7 @@ static void lcd_dma_init(void)
 		LTDC_L1PFCR = LCD_LAYER1_PIXFORMAT;
 
 		/* The color frame buffer start address */
-		LTDC_L1CFBAR = (uint32_t)lcd_layer1_frame_buffer;
+		LTDC_L1CFBAR = (uint32_t)lcd_layers[LCD_LAYER1].buf[0];
 
 		/* The line length and pitch of the color frame buffer */
 		uint32_t pitch = LCD_LAYER1_WIDTH * LCD_LAYER1_PIXEL_SIZE;
@@ -251,7 +322,7 @@ static void lcd_dma_init(void)
 		LTDC_L2PFCR = LCD_LAYER2_PIXFORMAT;
 
 		/* The color frame buffer start address */
-		LTDC_L2CFBAR = (uint32_t)lcd_layer2_frame_buffer;
+		LTDC_L2CFBAR = (uint32_t)lcd_layers[LCD_LAYER2].buf[0];
 
 		/* The line length and pitch of the color frame buffer */
 		uint32_t pitch = LCD_LAYER2_WIDTH * LCD_LAYER2_PIXEL_SIZE;
@@ -367,27 +438,101 @@ static void move_sprite(void)
 	LTDC_L2CACR = 0x000000FF - age;
 }
 
+/*
+ * The back buffer of a layer.  If a flip is still in flight, wait for
+ * it; the buffer returned is not being scanned out and may be drawn
+ * into until the next lcd_layer_present().
+ */
+
+static void *lcd_layer_back_buffer(int layer)
+{
+	struct lcd_layer *lp = &lcd_layers[layer];
+
+	while (lp->state != FLIP_IDLE) {
+		continue;
+	}
+	return lp->buf[!lp->front];
+}
+
+/*
+ * Queue the back buffer for display at the next vertical blank.
+ * Returns a fence that lcd_fence_done() reports as signaled once the
+ * buffer is on screen.
+ */
+
+static uint32_t lcd_layer_present(int layer)
+{
+	struct lcd_layer *lp = &lcd_layers[layer];
+	uint32_t fence;
+
+	while (lp->state != FLIP_IDLE) {
+		continue;
+	}
+	fence = lp->queued + 1;
+	lp->queued = fence;
+	lp->state = FLIP_QUEUED;
+	return fence;
+}
+
+static int lcd_fence_done(int layer, uint32_t fence)
+{
+	return (int32_t)(lcd_layers[layer].shown - fence) >= 0;
+}
+
+static void lcd_fence_wait(int layer, uint32_t fence)
+{
+	while (!lcd_fence_done(layer, fence)) {
+		continue;
+	}
+}
+
 /*
  * Here is where all the work is done.  We poke a total of 6 registers
- * for each frame.
+ * for each frame, plus CFBAR for every layer with a flip queued.
+ *
+ * The reload interrupt fires during vertical blanking, right after
+ * the shadow registers were copied, so any CFBAR written on the
+ * previous pass is now active.
  */
 
 void lcd_tft_isr(void)
 {
+	int i;
+
 	LTDC_ICR |= LTDC_ICR_CRRIF;
 
+	for (i = 0; i < LCD_LAYERS; i++) {
+		struct lcd_layer *lp = &lcd_layers[i];
+
+		if (lp->state == FLIP_LATCHED) {
+			lp->front = !lp->front;
+			lp->shown = lp->queued;
+			lp->state = FLIP_IDLE;
+		}
+	}
+
 	mutate_background_color();
 	move_sprite();
 
+	for (i = 0; i < LCD_LAYERS; i++) {
+		struct lcd_layer *lp = &lcd_layers[i];
+
+		if (lp->state == FLIP_QUEUED) {
+			*lp->cfbar = (uint32_t)lp->buf[!lp->front];
+			lp->state = FLIP_LATCHED;
+		}
+	}
+
 	LTDC_SRCR |= LTDC_SRCR_VBR;
 }
 
 /*
  * Checkerboard pattern.  Odd squares are transparent; even squares are
- * all different colors.
+ * all different colors.  This is drawn once, into the pattern buffer,
+ * and scrolled onto layer 1 with the DMA2D.
  */
 
-static void draw_layer_1(void)
+static void draw_layer_1(layer1_pixel *fb)
 {
 	int row, col;
 	int cel_count = (LCD_LAYER1_WIDTH >> 5) + (LCD_LAYER1_HEIGHT >> 5);
@@ -422,7 +567,7 @@ static void draw_layer_1(void)
 			} else if (row < 20 && col < 20) {
 				pix = 0xFF000000;
 			}
-			lcd_layer1_frame_buffer[i] = pix;
+			fb[i] = pix;
 		}
 	}
 }
@@ -432,7 +577,7 @@ static void draw_layer_1(void)
  * magenta/cyan diamond outlined in black.
  */
 
-static void draw_layer_2(void)
+static void draw_layer_2(layer2_pixel *fb)
 {
 	int row, col;
 	const uint8_t hw = LCD_LAYER2_WIDTH / 2;
@@ -460,7 +605,7 @@ static void draw_layer_2(void)
 				r = g = b = 0;
 			}
 			layer2_pixel pix = a << 12 | r << 8 | g << 4 | b << 0;
-			lcd_layer2_frame_buffer[i] = pix;
+			fb[i] = pix;
 		}
 	}
 }
@@ -479,8 +624,29 @@ int main(void)
 
 	printf("Preloading frame buffers\n");
 
-	draw_layer_1();
-	draw_layer_2();
+	gfx2d_init();
+
+	struct gfx2d_surface layer1 = lcd_pattern;
+	struct gfx2d_surface layer2 = {
+		.pixels = lcd_layers[LCD_LAYER2].buf[0],
+		.width = LCD_LAYER2_WIDTH,
+		.height = LCD_LAYER2_HEIGHT,
+		.pitch = LCD_LAYER2_WIDTH,
+		.format = GFX2D_ARGB4444,
+	};
+	struct gfx2d_surface sprite = layer2;
+
+	draw_layer_1(lcd_pattern.pixels);
+	layer1.pixels = lcd_layers[LCD_LAYER1].buf[0];
+	gfx2d_blit(&layer1, 0, 0, &lcd_pattern, 0, 0,
+		   LCD_LAYER1_WIDTH, LCD_LAYER1_HEIGHT);
+
+	/* Both sprite buffers hold the same image; layer 2 never flips. */
+	draw_layer_2(sprite.pixels);
+	layer2.pixels = lcd_layers[LCD_LAYER2].buf[1];
+	gfx2d_blit(&layer2, 0, 0, &sprite, 0, 0,
+		   LCD_LAYER2_WIDTH, LCD_LAYER2_HEIGHT);
+	gfx2d_wait();
 
 	printf("Initializing LCD\n");
 
@@ -489,7 +655,21 @@ int main(void)
 
 	printf("Initialized.\n");
 
+	/*
+	 * Scroll the pattern up one line per frame: copy it into the
+	 * back buffer in two strips, wait for the DMA2D, and flip.
+	 */
+	int phase = 0;
+	uint32_t fence;
 	while (1) {
-		continue;
+		phase = (phase + 1) % LCD_LAYER1_HEIGHT;
+		layer1.pixels = lcd_layer_back_buffer(LCD_LAYER1);
+		gfx2d_blit(&layer1, 0, 0, &lcd_pattern, 0, phase,
+			   LCD_LAYER1_WIDTH, LCD_LAYER1_HEIGHT - phase);
+		gfx2d_blit(&layer1, 0, LCD_LAYER1_HEIGHT - phase,
+			   &lcd_pattern, 0, 0, LCD_LAYER1_WIDTH, phase);
+		gfx2d_wait();
+		fence = lcd_layer_present(LCD_LAYER1);
+		lcd_fence_wait(LCD_LAYER1, fence);
 	}
 }
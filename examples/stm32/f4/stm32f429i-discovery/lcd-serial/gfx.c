@@ -44,6 +44,8 @@
 #include "font-7x12.c"
 
 #define pgm_read_byte(addr) (*(const unsigned char *)(addr))
+#define min(a, b) ((a) < (b) ? (a) : (b))
+#define max(a, b) ((a) > (b) ? (a) : (b))
 
 struct gfx_state __gfx_state;
 
@@ -58,6 +60,78 @@ gfx_drawPixel(int x, int y, uint16_t color)
 }
 #define true 1
 
+/*
+ * Spans.  A span is a run of pixels x0..x1 (inclusive) on row y.
+ * Fills, text and filled shapes are broken into spans and handed to
+ * the display's fill_span/blit_span functions if it registered them,
+ * so it can store whole runs at once instead of taking a call per
+ * pixel.  Clipping happens here, once per span or rectangle; the
+ * backend only ever sees coordinates that are on screen.  Without a
+ * span backend the runs go pixel by pixel through drawpixel.
+ */
+static void
+raw_span(int x0, int x1, int y, uint16_t color)
+{
+	if (__gfx_state.fillspan) {
+		(__gfx_state.fillspan)(x0, x1, y, color);
+		return;
+	}
+	for (; x0 <= x1; x0++) {
+		(__gfx_state.drawpixel)(x0, y, color);
+	}
+}
+
+static void
+span(int x0, int x1, int y, uint16_t color)
+{
+	if ((y < 0) || (y >= __gfx_state._height)) {
+		return;
+	}
+	x0 = max(x0, 0);
+	x1 = min(x1, __gfx_state._width - 1);
+	if (x0 <= x1) {
+		raw_span(x0, x1, y, color);
+	}
+}
+
+/* Clip a rectangle to the screen, returns 0 if nothing is left */
+static int
+clip_rect(int *x, int *y, int *w, int *h)
+{
+	if (*x < 0) {
+		*w += *x;
+		*x = 0;
+	}
+	if (*y < 0) {
+		*h += *y;
+		*y = 0;
+	}
+	*w = min(*w, __gfx_state._width - *x);
+	*h = min(*h, __gfx_state._height - *y);
+	return (*w > 0) && (*h > 0);
+}
+
+/*
+ * A negative width or height extends left or up from the given point,
+ * so -w pixels end at x.  Zero covers no pixels.
+ */
+static void
+normalize_extent(int *pos, int *len)
+{
+	if (*len < 0) {
+		*pos += *len + 1;
+		*len = -*len;
+	}
+}
+
+void
+gfx_setSpanFuncs(void (*fill_span)(int, int, int, uint16_t),
+		 void (*blit_span)(int, int, int, const uint16_t *))
+{
+	__gfx_state.fillspan = fill_span;
+	__gfx_state.blitspan = blit_span;
+}
+
 void
 gfx_init(void (*pixel_func)(int, int, uint16_t), int width, int height)
 {
@@ -70,6 +144,121 @@ gfx_init(void (*pixel_func)(int, int, uint16_t), int width, int height)
 	__gfx_state.textbgcolor = 0xFFFF;
 	__gfx_state.wrap      = true;
 	__gfx_state.drawpixel = pixel_func;
+	__gfx_state.fillspan  = NULL;
+	__gfx_state.blitspan  = NULL;
+}
+
+/*
+ * Dirty rectangles.  Two rectangles are merged when the union costs
+ * no more than GFX_DIRTY_SLACK extra pixels over sending both.  On the
+ * ILI9341 a window costs 11 bytes of commands plus the chip select
+ * toggles, so sending a few spare pixels is cheaper than a new window.
+ * When the list is full the new mark goes to whichever rectangle
+ * grows least.
+ */
+#define GFX_DIRTY_SLACK 32
+
+static struct gfx_rect dirty[GFX_DIRTY_RECTS];
+static int n_dirty;
+static int last_dirty;
+
+static struct gfx_rect
+rect_union(const struct gfx_rect *a, const struct gfx_rect *b)
+{
+	struct gfx_rect u;
+	int x1 = max(a->x + a->w, b->x + b->w);
+	int y1 = max(a->y + a->h, b->y + b->h);
+
+	u.x = min(a->x, b->x);
+	u.y = min(a->y, b->y);
+	u.w = x1 - u.x;
+	u.h = y1 - u.y;
+	return u;
+}
+
+/* Extra pixels sent if a and b go out as one window. */
+static int32_t
+merge_cost(const struct gfx_rect *a, const struct gfx_rect *b)
+{
+	struct gfx_rect u = rect_union(a, b);
+
+	return (int32_t)u.w * u.h - (int32_t)a->w * a->h -
+	       (int32_t)b->w * b->h;
+}
+
+void
+gfx_markDirty(int x, int y, int w, int h)
+{
+	struct gfx_rect r = { x, y, w, h };
+	struct gfx_rect *l = &dirty[last_dirty];
+	int32_t cost, best_cost = GFX_DIRTY_SLACK;
+	int i, best = -1;
+
+	/* Most drawing is local, so try the last rectangle first. */
+	if (n_dirty && x >= l->x && y >= l->y &&
+	    x + w <= l->x + l->w && y + h <= l->y + l->h) {
+		return;
+	}
+
+	for (i = 0; i < n_dirty; i++) {
+		cost = merge_cost(&dirty[i], &r);
+		if (cost <= best_cost || (n_dirty == GFX_DIRTY_RECTS &&
+					  (best < 0 || cost < best_cost))) {
+			best = i;
+			best_cost = cost;
+		}
+	}
+	if (best < 0) {
+		dirty[n_dirty] = r;
+		last_dirty = n_dirty++;
+		return;
+	}
+
+	/* The grown rectangle may now swallow some of the others. */
+	dirty[best] = rect_union(&dirty[best], &r);
+	for (i = 0; i < n_dirty; i++) {
+		if (i == best ||
+		    merge_cost(&dirty[best], &dirty[i]) > GFX_DIRTY_SLACK) {
+			continue;
+		}
+		dirty[best] = rect_union(&dirty[best], &dirty[i]);
+		dirty[i] = dirty[--n_dirty];
+		if (best == n_dirty) {
+			best = i;
+		}
+		i = -1;
+	}
+	last_dirty = best;
+}
+
+/*
+ * Copy out up to max dirty rectangles and reset the list.  Returns
+ * the number copied; if max is too small, the rest are merged into
+ * the last one returned.
+ */
+int
+gfx_takeDirty(struct gfx_rect *rects, int max)
+{
+	int i, n = n_dirty;
+
+	if (n > max) {
+		for (i = max; i < n; i++) {
+			dirty[max - 1] = rect_union(&dirty[max - 1], &dirty[i]);
+		}
+		n = max;
+	}
+	for (i = 0; i < n; i++) {
+		rects[i] = dirty[i];
+	}
+	gfx_clearDirty();
+	return n;
+}
+
+void
+gfx_clearDirty(void)
+{
+	n_dirty = 0;
+	last_dirty = 0;
 }
 
 /* Draw a circle outline */
@@ -148,11 +337,24 @@ void gfx_drawCircleHelper(int16_t x0, int16_t y0,
 void gfx_fillCircle(int16_t x0, int16_t y0, int16_t r,
 		    uint16_t color)
 {
-	gfx_drawFastVLine(x0, y0 - r, 2*r+1, color);
 	gfx_fillCircleHelper(x0, y0, r, 3, 0, color);
 }
 
 /* Used to do circles and roundrects */
+static void
+circle_span(int16_t x0, int16_t y, int16_t hw,
+	    uint8_t cornername, uint16_t color)
+{
+	span((cornername & 0x2) ? x0 - hw : x0,
+	     (cornername & 0x1) ? x0 + hw : x0, y, color);
+}
+
+/*
+ * Fill the right (cornername & 1) and/or left (cornername & 2) half
+ * of a circle, stretched down by delta rows, as horizontal spans.
+ * Rows y0 .. y0 + delta are the full radius; above and below, each
+ * step of the midpoint circle gives the half width for two rows.
+ */
 void gfx_fillCircleHelper(int16_t x0, int16_t y0, int16_t r,
 			  uint8_t cornername, int16_t delta, uint16_t color)
 {
@@ -161,6 +363,11 @@ void gfx_fillCircleHelper(int16_t x0, int16_t y0, int16_t r,
 	int16_t ddF_y = -2 * r;
 	int16_t x     = 0;
 	int16_t y     = r;
+	int16_t i;
+
+	for (i = 0; i <= delta; i++) {
+		circle_span(x0, y0 + i, r, cornername, color);
+	}
 
 	while (x < y) {
 		if (f >= 0) {
@@ -172,13 +379,12 @@ void gfx_fillCircleHelper(int16_t x0, int16_t y0, int16_t r,
 		ddF_x += 2;
 		f     += ddF_x;
 
-		if (cornername & 0x1) {
-			gfx_drawFastVLine(x0+x, y0-y, 2*y+1+delta, color);
-			gfx_drawFastVLine(x0+y, y0-x, 2*x+1+delta, color);
-		}
-		if (cornername & 0x2) {
-			gfx_drawFastVLine(x0-x, y0-y, 2*y+1+delta, color);
-			gfx_drawFastVLine(x0-y, y0-x, 2*x+1+delta, color);
+		circle_span(x0, y0 - x, y, cornername, color);
+		circle_span(x0, y0 + x + delta, y, cornername, color);
+		/* rows y0 +/- y only once, at their widest */
+		if ((f >= 0) || (x + 1 >= y)) {
+			circle_span(x0, y0 - y, x, cornername, color);
+			circle_span(x0, y0 + y + delta, x, cornername, color);
 		}
 	}
 }
@@ -205,6 +411,7 @@ void gfx_drawLine(int16_t x0, int16_t y0,
 
 	int16_t err = dx / 2;
 	int16_t ystep;
+	int16_t xs = x0;
 
 	if (y0 < y1) {
 		ystep = 1;
@@ -212,18 +419,24 @@ void gfx_drawLine(int16_t x0, int16_t y0,
 		ystep = -1;
 	}
 
+	/* Shallow lines go out as one span per row */
 	for (; x0 <= x1; x0++) {
 		if (steep) {
 			gfx_drawPixel(y0, x0, color);
-		} else {
-			gfx_drawPixel(x0, y0, color);
 		}
 		err -= dy;
 		if (err < 0) {
+			if (!steep) {
+				span(xs, x0, y0, color);
+			}
+			xs = x0 + 1;
 			y0 += ystep;
 			err += dx;
 		}
 	}
+	if (!steep && xs <= x1) {
+		span(xs, x1, y0, color);
+	}
 }
 
 /* Draw a rectangle */
@@ -231,33 +444,54 @@ void gfx_drawRect(int16_t x, int16_t y,
 		  int16_t w, int16_t h,
 		  uint16_t color)
 {
-	gfx_drawFastHLine(x, y, w, color);
-	gfx_drawFastHLine(x, y + h - 1, w, color);
-	gfx_drawFastVLine(x, y, h, color);
-	gfx_drawFastVLine(x + w - 1, y, h, color);
+	int cx = x, cy = y, cw = w, ch = h;
+
+	normalize_extent(&cx, &cw);
+	normalize_extent(&cy, &ch);
+	if ((cw == 0) || (ch == 0)) {
+		return;
+	}
+	gfx_drawFastHLine(cx, cy, cw, color);
+	gfx_drawFastHLine(cx, cy + ch - 1, cw, color);
+	gfx_drawFastVLine(cx, cy, ch, color);
+	gfx_drawFastVLine(cx + cw - 1, cy, ch, color);
 }
 
 void gfx_drawFastVLine(int16_t x, int16_t y,
 		       int16_t h, uint16_t color)
 {
-	/* Update in subclasses if desired! */
-	gfx_drawLine(x, y, x, y + h - 1, color);
+	int cx = x, cy = y, cw = 1, ch = h;
+
+	normalize_extent(&cy, &ch);
+	if (!clip_rect(&cx, &cy, &cw, &ch)) {
+		return;
+	}
+	for (; ch > 0; ch--, cy++) {
+		(__gfx_state.drawpixel)(cx, cy, color);
+	}
 }
 
 void gfx_drawFastHLine(int16_t x, int16_t y,
 		       int16_t w, uint16_t color)
 {
-	/* Update in subclasses if desired! */
-	gfx_drawLine(x, y, x + w - 1, y, color);
+	int cx = x, cw = w;
+
+	normalize_extent(&cx, &cw);
+	span(cx, cx + cw - 1, y, color);
 }
 
 void gfx_fillRect(int16_t x, int16_t y, int16_t w, int16_t h,
 		  uint16_t color)
 {
-	/* Update in subclasses if desired! */
-	int16_t i;
-	for (i = x; i < x + w; i++) {
-		gfx_drawFastVLine(i, y, h, color);
+	int cx = x, cy = y, cw = w, ch = h;
+
+	normalize_extent(&cx, &cw);
+	normalize_extent(&cy, &ch);
+	if (!clip_rect(&cx, &cy, &cw, &ch)) {
+		return;
+	}
+	for (; ch > 0; ch--, cy++) {
+		raw_span(cx, cx + cw - 1, cy, color);
 	}
 }
 
@@ -401,14 +635,45 @@ void gfx_drawBitmap(int16_t x, int16_t y,
 		    const uint8_t *bitmap, int16_t w, int16_t h,
 		    uint16_t color)
 {
-	int16_t i, j, byteWidth = (w + 7) / 8;
+	int16_t i, j, start, byteWidth = (w + 7) / 8;
 
+	/* Runs of set bits become spans */
 	for (j = 0; j < h; j++) {
-		for (i = 0; i < w; i++) {
-			if (pgm_read_byte(bitmap + j * byteWidth + i / 8) &
-					 (128 >> (i & 7))) {
-				gfx_drawPixel(x + i, y + j, color);
+		for (i = 0; i < w; ) {
+			if (!(pgm_read_byte(bitmap + j * byteWidth + i / 8) &
+					 (128 >> (i & 7)))) {
+				i++;
+				continue;
+			}
+			start = i;
+			while (i < w &&
+			       (pgm_read_byte(bitmap + j * byteWidth + i / 8) &
+					 (128 >> (i & 7)))) {
+				i++;
 			}
+			span(x + start, x + i - 1, y + j, color);
+		}
+	}
+}
+
+/* Draw an RGB565 image, one blit_span per row */
+void gfx_drawImage(int16_t x, int16_t y, int16_t w, int16_t h,
+		   const uint16_t *pixels)
+{
+	int cx = x, cy = y, cw = w, ch = h;
+	int i;
+
+	if (!clip_rect(&cx, &cy, &cw, &ch)) {
+		return;
+	}
+	pixels += (cy - y) * w + (cx - x);
+	for (; ch > 0; ch--, cy++, pixels += w) {
+		if (__gfx_state.blitspan) {
+			(__gfx_state.blitspan)(cx, cy, cw, pixels);
+			continue;
+		}
+		for (i = 0; i < cw; i++) {
+			(__gfx_state.drawpixel)(cx + i, cy, pixels[i]);
 		}
 	}
 }
@@ -446,9 +711,10 @@ void gfx_puts(char *s)
 void gfx_drawChar(int16_t x, int16_t y, unsigned char c,
 		  uint16_t color, uint16_t bg, uint8_t size)
 {
-	int8_t i, j, line;
+	int8_t i, j, start, line;
 	int8_t descender;
 	unsigned const char *glyph;
+	uint8_t on;
 
 	glyph = &mcm_font[(c & 0x7f) * 9];
 
@@ -466,23 +732,22 @@ void gfx_drawChar(int16_t x, int16_t y, unsigned char c,
 			}
 		}
 		line &= 0x7f;
-		for (j = 0; j < 8; j++) {
-			if (line & 0x80) {
-				if (size == 1) /* default size */
-					gfx_drawPixel(x+j, y+i, color);
-				else {  /* big size */
-					gfx_fillRect(x+(j*size), y+(i*size),
-						     size, size, color);
-				}
+
+		/* Each run of foreground or background becomes a span
+		 * (a size x size block per pixel for big text). */
+		for (j = 0; j < 8; ) {
+			start = j;
+			on = (line & (0x80 >> j)) != 0;
+			while (j < 8 && ((line & (0x80 >> j)) != 0) == on) {
+				j++;
+			}
+			if (on) {
+				gfx_fillRect(x + start * size, y + i * size,
+					     (j - start) * size, size, color);
 			} else if (bg != color) {
-				if (size == 1) /* default size */
-					gfx_drawPixel(x+j, y+i, bg);
-				else {  /* big size */
-					gfx_fillRect(x+j*size, y+i*size,
-						     size, size, bg);
-				}
+				gfx_fillRect(x + start * size, y + i * size,
+					     (j - start) * size, size, bg);
 			}
-			line <<= 1;
 		}
 	}
 }
@@ -11,6 +11,10 @@
 void gfx_drawPixel(int x, int y, uint16_t color);
 void gfx_drawLine(int16_t x0, int16_t y0, int16_t x1, int16_t y1,
 		  uint16_t color);
+/*
+ * Lines and rectangles given a negative width or height extend left or up
+ * from (x, y), ending on it; a zero width or height draws nothing.
+ */
 void gfx_drawFastVLine(int16_t x, int16_t y, int16_t h, uint16_t color);
 void gfx_drawFastHLine(int16_t x, int16_t y, int16_t w, uint16_t color);
 void gfx_drawRect(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t color);
@@ -22,6 +26,8 @@ void gfx_drawCircleHelper(int16_t x0, int16_t y0, int16_t r,
 			  uint8_t cornername, uint16_t color);
 void gfx_fillCircle(int16_t x0, int16_t y0, int16_t r, uint16_t color);
 void gfx_init(void (*draw)(int, int, uint16_t), int, int);
+void gfx_setSpanFuncs(void (*fill_span)(int, int, int, uint16_t),
+		      void (*blit_span)(int, int, int, const uint16_t *));
 
 void gfx_fillCircleHelper(int16_t x0, int16_t y0, int16_t r,
 			  uint8_t cornername, int16_t delta, uint16_t color);
@@ -35,6 +41,8 @@ void gfx_fillRoundRect(int16_t x0, int16_t y0, int16_t w, int16_t h,
 		       int16_t radius, uint16_t color);
 void gfx_drawBitmap(int16_t x, int16_t y, const uint8_t *bitmap,
 		    int16_t w, int16_t h, uint16_t color);
+void gfx_drawImage(int16_t x, int16_t y, int16_t w, int16_t h,
+		   const uint16_t *pixels);
 void gfx_drawChar(int16_t x, int16_t y, unsigned char c, uint16_t color,
 		  uint16_t bg, uint8_t size);
 void gfx_setCursor(int16_t x, int16_t y);
@@ -50,6 +58,22 @@ uint16_t gfx_width(void);
 
 uint8_t gfx_getRotation(void);
 
+/*
+ * Dirty rectangle tracking.  The display driver reports every pixel
+ * that actually changes with gfx_markDirty(); the marks are merged
+ * into at most GFX_DIRTY_RECTS rectangles, which the driver collects
+ * with gfx_takeDirty() and sends as partial windows.
+ */
+#define GFX_DIRTY_RECTS 8
+
+struct gfx_rect {
+	int16_t x, y, w, h;
+};
+
+void gfx_markDirty(int x, int y, int w, int h);
+int gfx_takeDirty(struct gfx_rect *rects, int max);
+void gfx_clearDirty(void);
+
 #define GFX_WIDTH   320
 #define GFX_HEIGHT  240
 
@@ -59,6 +83,9 @@ struct gfx_state {
 	uint8_t textsize, rotation;
 	uint8_t wrap;
 	void (*drawpixel)(int, int, uint16_t);
+	/* optional: fill x0..x1 of row y / copy w pixels to row y at x */
+	void (*fillspan)(int, int, int, uint16_t);
+	void (*blitspan)(int, int, int, const uint16_t *);
 };
 
 extern struct gfx_state __gfx_state;
@@ -0,0 +1,263 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Draws the same random primitives, partly off screen, once through the
+ * per-pixel drawpixel path and once through fill_span/blit_span, and
+ * checks the two framebuffers stay identical.  Checks that negative
+ * sizes mirror positive ones, then times both paths.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "gfx.h"
+
+#define W	240
+#define H	320
+
+static uint16_t fb[2][W * H];
+static uint16_t *cur;
+
+static void draw_pixel(int x, int y, uint16_t color)
+{
+	if ((x < 0) || (x >= W) || (y < 0) || (y >= H)) {
+		printf("FAIL pixel off screen at %d,%d\n", x, y);
+		exit(EXIT_FAILURE);
+	}
+	cur[y * W + x] = color;
+}
+
+static void fill_span(int x0, int x1, int y, uint16_t color)
+{
+	uint16_t *p = &cur[y * W + x0];
+
+	if ((x0 < 0) || (x1 >= W) || (x0 > x1) || (y < 0) || (y >= H)) {
+		printf("FAIL span off screen %d..%d,%d\n", x0, x1, y);
+		exit(EXIT_FAILURE);
+	}
+	while (x0++ <= x1) {
+		*p++ = color;
+	}
+}
+
+static void blit_span(int x, int y, int w, const uint16_t *pixels)
+{
+	if ((x < 0) || (w < 1) || (x + w > W) || (y < 0) || (y >= H)) {
+		printf("FAIL blit off screen %d+%d,%d\n", x, w, y);
+		exit(EXIT_FAILURE);
+	}
+	memcpy(&cur[y * W + x], pixels, w * 2);
+}
+
+static void use(int spans)
+{
+	cur = fb[spans];
+	gfx_init(draw_pixel, W, H);
+	if (spans) {
+		gfx_setSpanFuncs(fill_span, blit_span);
+	}
+}
+
+static uint16_t image[32 * 32];
+static const uint8_t bitmap[4 * 16] = {
+	0xf0, 0x0f, 0xaa, 0x55, 0x81, 0x42, 0x24, 0x18,
+	0x18, 0x24, 0x42, 0x81, 0xff, 0x00, 0x3c, 0xc3,
+};
+
+static int coord(int range)
+{
+	return rand() % (range + 80) - 40;
+}
+
+static int size(void)
+{
+	return rand() % 120 - 30;
+}
+
+/* One random primitive, drawn with the arguments in a. */
+static void draw(int kind, const int *a)
+{
+	uint16_t c = a[6];
+
+	switch (kind) {
+	case 0:
+		gfx_fillRect(a[0], a[1], a[2], a[3], c);
+		break;
+	case 1:
+		gfx_drawRect(a[0], a[1], a[2], a[3], c);
+		break;
+	case 2:
+		gfx_drawFastHLine(a[0], a[1], a[2], c);
+		break;
+	case 3:
+		gfx_drawFastVLine(a[0], a[1], a[3], c);
+		break;
+	case 4:
+		gfx_drawLine(a[0], a[1], a[4], a[5], c);
+		break;
+	case 5:
+		gfx_fillCircle(a[0], a[1], abs(a[2]) / 2, c);
+		break;
+	case 6:
+		gfx_drawCircle(a[0], a[1], abs(a[2]) / 2, c);
+		break;
+	case 7:
+		gfx_fillTriangle(a[0], a[1], a[4], a[5], a[0] + a[2],
+				 a[1] + a[3], c);
+		break;
+	case 8:
+		gfx_fillRoundRect(a[0], a[1], abs(a[2]) + 8, abs(a[3]) + 8, 4,
+				  c);
+		break;
+	case 9:
+		gfx_drawImage(a[0], a[1], 32, 32, image);
+		break;
+	case 10:
+		gfx_drawBitmap(a[0], a[1], bitmap, 16, 4, c);
+		break;
+	default:
+		gfx_setCursor(a[0], a[1]);
+		gfx_setTextSize(1 + (a[2] & 1));
+		gfx_setTextColor(c, ~c);
+		gfx_puts((char *)"Hello, spans!");
+		break;
+	}
+}
+
+#define KINDS	12
+
+static void random_args(int *a)
+{
+	a[0] = coord(W);
+	a[1] = coord(H);
+	a[2] = size();
+	a[3] = size();
+	a[4] = coord(W);
+	a[5] = coord(H);
+	a[6] = rand() & 0xffff;
+}
+
+static int compare(void)
+{
+	return memcmp(fb[0], fb[1], sizeof(fb[0])) != 0;
+}
+
+/* fillRect/drawRect with negative sizes cover the mirrored rectangle. */
+static int check_negative(void)
+{
+	int i, x, y, w, h, kind, failed = 0;
+
+	for (i = 0; i < 2000; i++) {
+		x = coord(W);
+		y = coord(H);
+		w = rand() % 60 + 1;
+		h = rand() % 60 + 1;
+		kind = rand() % 2;
+		memset(fb, 0, sizeof(fb));
+
+		use(0);
+		if (kind) {
+			gfx_drawRect(x, y, -w, -h, 0x1234);
+		} else {
+			gfx_fillRect(x, y, -w, -h, 0x1234);
+		}
+		gfx_drawFastHLine(x, y + 5, -w, 0x4321);
+		gfx_drawFastVLine(x + 5, y, -h, 0x5678);
+		gfx_fillRect(x, y, 0, h, 0xffff);
+		gfx_drawRect(x, y, w, 0, 0xffff);
+
+		use(1);
+		if (kind) {
+			gfx_drawRect(x - w + 1, y - h + 1, w, h, 0x1234);
+		} else {
+			gfx_fillRect(x - w + 1, y - h + 1, w, h, 0x1234);
+		}
+		gfx_drawFastHLine(x - w + 1, y + 5, w, 0x4321);
+		gfx_drawFastVLine(x + 5, y - h + 1, h, 0x5678);
+
+		if (compare()) {
+			printf("FAIL negative size %d at %d,%d %dx%d\n", kind,
+			       x, y, w, h);
+			failed++;
+		}
+	}
+	return failed;
+}
+
+static double seconds(void)
+{
+	return (double)clock() / CLOCKS_PER_SEC;
+}
+
+static void bench(void)
+{
+	static int args[4096][7];
+	double t[2];
+	int i, spans, n = 0;
+
+	for (i = 0; i < 4096; i++) {
+		random_args(args[i]);
+	}
+	for (spans = 0; spans < 2; spans++) {
+		use(spans);
+		t[spans] = seconds();
+		for (n = 0; n < 40 * 4096; n++) {
+			draw(n % KINDS, args[n % 4096]);
+		}
+		t[spans] = seconds() - t[spans];
+	}
+	printf("per pixel %.0f, spans %.0f primitives/s\n", n / t[0],
+	       n / t[1]);
+}
+
+int main(void)
+{
+	int i, kind, failed = 0;
+	int a[7];
+
+	for (i = 0; i < 32 * 32; i++) {
+		image[i] = i * 37;
+	}
+
+	srand(1);
+	for (i = 0; i < 20000; i++) {
+		kind = rand() % KINDS;
+		random_args(a);
+		use(0);
+		draw(kind, a);
+		use(1);
+		draw(kind, a);
+		if (compare()) {
+			printf("FAIL primitive %d: %d %d %d %d %d %d\n", kind,
+			       a[0], a[1], a[2], a[3], a[4], a[5]);
+			memcpy(fb[1], fb[0], sizeof(fb[0]));
+			failed++;
+		}
+	}
+	printf("%d of 20000 primitives identical on both paths\n",
+	       20000 - failed);
+
+	i = check_negative();
+	printf("%d of 2000 negative size checks pass\n", 2000 - i);
+	failed += i;
+
+	bench();
+
+	return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
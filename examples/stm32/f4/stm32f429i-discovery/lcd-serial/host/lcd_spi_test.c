@@ -0,0 +1,512 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Host check and benchmark for the partial updates in lcd-spi.c.
+ *
+ * lcd-spi.c and gfx.c are built as on the target.  Chip select, D/CX
+ * and every SPI byte go to a model of the ILI9341: column and page
+ * address set (0x2A, 0x2B) open a window, memory write (0x2C) fills it
+ * left to right and top to bottom.  After every update the model's
+ * memory has to match the frame buffer, and lcd_update() has to return
+ * the bytes that really went over the wire.
+ *
+ * The workloads are the demo in lcd-serial.c, a text console (one
+ * character or one line per update, scrolling by redrawing every row),
+ * a moving sprite and scattered rectangles.
+ * Each reports the SPI bytes per update, against a full frame for every
+ * update before.
+ */
+
+#define _DEFAULT_SOURCE
+
+#include <stdint.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include <libopencm3/stm32/gpio.h>
+#include <libopencm3/stm32/spi.h>
+
+#include "console.h"
+#include "clock.h"
+#include "sdram.h"
+#include "lcd-spi.h"
+#include "gfx.h"
+
+static int failures;
+
+#define CHECK(cond, ...) do {						\
+	if (!(cond)) {							\
+		if (failures++ < 10) {					\
+			printf("FAIL %s:%d: ", __FILE__, __LINE__);	\
+			printf(__VA_ARGS__);				\
+			printf("\n");					\
+		}							\
+	}								\
+} while (0)
+
+static uint32_t rng_state = 1;
+
+static uint32_t rnd(void)
+{
+	rng_state ^= rng_state << 13;
+	rng_state ^= rng_state >> 17;
+	rng_state ^= rng_state << 5;
+	return rng_state;
+}
+
+/* The frame buffer in lcd-spi.c */
+extern uint16_t *cur_frame;
+
+/* lcd-spi.c logs the init sequence and waits after some commands */
+void console_puts(char *s)
+{
+	(void)s;
+}
+
+void console_putc(char c)
+{
+	(void)c;
+}
+
+void msleep(uint32_t ms)
+{
+	(void)ms;
+}
+
+/* --- The ILI9341 --- */
+
+static struct {
+	int cs, dc;			/* pin levels */
+	uint8_t cmd, madctl;
+	int nargs;
+	uint8_t args[4];
+	uint16_t sc, ec, sp, ep;	/* column and page window */
+	uint16_t col, row;
+	int half;			/* first byte of a pixel came */
+	uint8_t first;
+	uint32_t bytes, windows;
+	uint32_t deselected, bad_windows, split_pixels;
+} ili = { .cs = 1 };
+
+/* Display memory, in the byte order it came over the wire */
+static uint8_t gram[LCD_HEIGHT][LCD_WIDTH][2];
+
+void gpio_set(uint32_t port, uint16_t gpios)
+{
+	if (port == GPIOC && (gpios & GPIO2)) {
+		ili.cs = 1;
+		if (ili.half)
+			ili.split_pixels++;
+		ili.half = 0;
+	}
+	if (port == GPIOD && (gpios & GPIO13))
+		ili.dc = 1;
+}
+
+void gpio_clear(uint32_t port, uint16_t gpios)
+{
+	if (port == GPIOC && (gpios & GPIO2))
+		ili.cs = 0;
+	if (port == GPIOD && (gpios & GPIO13))
+		ili.dc = 0;
+}
+
+static void write_pixel(uint8_t lo)
+{
+	if (ili.sc > ili.ec || ili.ec >= LCD_WIDTH ||
+	    ili.sp > ili.ep || ili.ep >= LCD_HEIGHT) {
+		ili.bad_windows++;
+		return;
+	}
+	gram[ili.row][ili.col][0] = ili.first;
+	gram[ili.row][ili.col][1] = lo;
+	if (++ili.col > ili.ec) {
+		ili.col = ili.sc;
+		if (++ili.row > ili.ep)
+			ili.row = ili.sp;
+	}
+}
+
+uint16_t spi_xfer(uint32_t spi, uint16_t data)
+{
+	(void)spi;
+
+	ili.bytes++;
+	if (ili.cs) {
+		ili.deselected++;
+		return 0;
+	}
+	if (!ili.dc) {
+		ili.cmd = data;
+		ili.nargs = 0;
+		ili.half = 0;
+		if (ili.cmd == 0x2C) {
+			ili.col = ili.sc;
+			ili.row = ili.sp;
+			ili.windows++;
+		}
+		return 0;
+	}
+
+	switch (ili.cmd) {
+	case 0x2A:
+	case 0x2B:
+		if (ili.nargs < 4)
+			ili.args[ili.nargs++] = data;
+		if (ili.nargs < 4)
+			break;
+		if (ili.cmd == 0x2A) {
+			ili.sc = ili.args[0] << 8 | ili.args[1];
+			ili.ec = ili.args[2] << 8 | ili.args[3];
+		} else {
+			ili.sp = ili.args[0] << 8 | ili.args[1];
+			ili.ep = ili.args[2] << 8 | ili.args[3];
+		}
+		break;
+	case 0x36:
+		ili.madctl = data;
+		break;
+	case 0x2C:
+		if (ili.half)
+			write_pixel(data);
+		else
+			ili.first = data;
+		ili.half = !ili.half;
+		break;
+	}
+	return 0;
+}
+
+/* The display shows what is in the frame buffer */
+static void in_sync(const char *what)
+{
+	const uint8_t *fb = (const uint8_t *)cur_frame;
+	const uint8_t *g = &gram[0][0][0];
+	size_t i;
+
+	for (i = 0; i < sizeof(gram) && fb[i] == g[i]; i++)
+		continue;
+	CHECK(i == sizeof(gram), "%s: display differs at %zu,%zu", what,
+	      i / 2 % LCD_WIDTH, i / 2 / LCD_WIDTH);
+	CHECK(!ili.deselected && !ili.bad_windows && !ili.split_pixels,
+	      "%s: %u bytes without chip select, %u bad windows, %u split "
+	      "pixels", what, ili.deselected, ili.bad_windows,
+	      ili.split_pixels);
+}
+
+/* --- The workloads --- */
+
+static uint32_t full_frame;		/* bytes lcd_show_frame() sends */
+
+#define MAX_UPDATES	8192
+
+static struct {
+	uint32_t updates, max;
+	uint64_t total;
+	uint32_t bytes[MAX_UPDATES];
+} stats;
+
+static int by_size(const void *a, const void *b)
+{
+	uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static void update(const char *what)
+{
+	uint32_t before = ili.bytes, n = lcd_update();
+
+	CHECK(ili.bytes - before == n, "%s: lcd_update() says %u bytes, "
+	      "%u were sent", what, n, ili.bytes - before);
+	in_sync(what);
+	if (stats.updates < MAX_UPDATES)
+		stats.bytes[stats.updates] = n;
+	stats.updates++;
+	stats.total += n;
+	if (n > stats.max)
+		stats.max = n;
+}
+
+static void report(const char *what)
+{
+	double avg = (double)stats.total / stats.updates;
+	uint32_t n = stats.updates < MAX_UPDATES ? stats.updates : MAX_UPDATES;
+
+	qsort(stats.bytes, n, sizeof(stats.bytes[0]), by_size);
+	printf("%-24s %7u %9.0f %8u %8u %7.0fx\n", what, stats.updates, avg,
+	       stats.bytes[n / 2], stats.max, full_frame / avg);
+	memset(&stats, 0, sizeof(stats));
+}
+
+/* The first screen main() draws, sent as a partial update */
+static void demo_screen(void)
+{
+	gfx_fillScreen(LCD_GREY);
+	gfx_fillRoundRect(10, 10, 220, 220, 5, LCD_WHITE);
+	gfx_drawRoundRect(10, 10, 220, 220, 5, LCD_RED);
+	gfx_fillCircle(20, 250, 10, LCD_RED);
+	gfx_fillCircle(120, 250, 10, LCD_GREEN);
+	gfx_fillCircle(220, 250, 10, LCD_BLUE);
+	gfx_setTextSize(2);
+	gfx_setCursor(15, 25);
+	gfx_puts("STM32F4-DISCO");
+	gfx_setTextSize(1);
+	gfx_setCursor(15, 49);
+	gfx_puts("Simple example to put some");
+	gfx_setCursor(15, 60);
+	gfx_puts("stuff on the LCD screen.");
+	update("demo screen");
+	report("demo screen");
+}
+
+/* The loop at the end of main() */
+static void planets(void)
+{
+	static const int orbit[3] = { 55, 75, 100 };
+	static const int radius[3] = { 5, 10, 8 };
+	static const uint16_t color[3] = { LCD_RED, LCD_WHITE, LCD_BLUE };
+	static const int speed[3] = { 3, 2, 1 };
+	int angle[3] = { 0, 45, 90 };
+	int px[3] = { -100, -100, -100 };
+	int py[3] = { -100, -100, -100 };
+	int i, frame;
+
+	gfx_setTextColor(LCD_YELLOW, LCD_BLACK);
+	gfx_setTextSize(3);
+	gfx_fillScreen(LCD_BLACK);
+	update("planets, clear");
+	memset(&stats, 0, sizeof(stats));
+
+	for (frame = 0; frame < 360; frame++) {
+		for (i = 0; i < 3; i++)
+			gfx_fillCircle(px[i], py[i], radius[i], LCD_BLACK);
+		gfx_setCursor(15, 36);
+		gfx_puts("PLANETS!");
+		gfx_fillCircle(120, 160, 40, LCD_YELLOW);
+		for (i = 0; i < 3; i++)
+			gfx_drawCircle(120, 160, orbit[i], LCD_GREY);
+		for (i = 0; i < 3; i++) {
+			px[i] = 120 + (sin(angle[i] * 6.2831853 / 360.0) *
+				       orbit[i]);
+			py[i] = 160 + (cos(angle[i] * 6.2831853 / 360.0) *
+				       orbit[i]);
+			gfx_fillCircle(px[i], py[i], radius[i], color[i]);
+			angle[i] = (angle[i] + speed[i]) % 360;
+		}
+		update("planets");
+	}
+	report("planets");
+}
+
+/*
+ * A text console of 8x12 cells that scrolls by redrawing every row
+ * one line up, as a console without hardware scrolling has to.
+ */
+#define COLS	(LCD_WIDTH / 8)
+#define ROWS	(LCD_HEIGHT / 12)
+
+static char text[ROWS][COLS + 1];
+static int row, col;
+
+static void console_row(int r)
+{
+	int c;
+
+	for (c = 0; c < COLS; c++)
+		gfx_drawChar(c * 8, r * 12, text[r][c] ? text[r][c] : ' ',
+			     LCD_GREEN, LCD_BLACK, 1);
+}
+
+static void console_newline(void)
+{
+	int r;
+
+	col = 0;
+	if (row < ROWS - 1) {
+		row++;
+		return;
+	}
+	memmove(text[0], text[1], sizeof(text) - sizeof(text[0]));
+	memset(text[ROWS - 1], 0, sizeof(text[0]));
+	for (r = 0; r < ROWS; r++)
+		console_row(r);
+}
+
+static void console_char(char c)
+{
+	if (c == '\n' || col == COLS) {
+		console_newline();
+		if (c == '\n')
+			return;
+	}
+	text[row][col] = c;
+	gfx_drawChar(col * 8, row * 12, c, LCD_GREEN, LCD_BLACK, 1);
+	col++;
+}
+
+/* Log lines of the kind a console shows */
+static void log_line(char *buf, size_t len, uint32_t n)
+{
+	snprintf(buf, len, "%5u adc %4u temp %2u.%u %s\n", n, rnd() % 4096,
+		 20 + rnd() % 10, rnd() % 10, rnd() % 8 ? "ok" : "RETRY");
+}
+
+static void console_reset(void)
+{
+	memset(text, 0, sizeof(text));
+	row = col = 0;
+	gfx_fillScreen(LCD_BLACK);
+	update("console, clear");
+	memset(&stats, 0, sizeof(stats));
+}
+
+static void console(void)
+{
+	char line[COLS + 2], *p;
+	uint32_t n;
+
+	console_reset();
+	for (n = 0; n < 200; n++) {
+		log_line(line, sizeof(line), n);
+		for (p = line; *p; p++) {
+			console_char(*p);
+			update("console, per character");
+		}
+	}
+	report("console, per character");
+
+	console_reset();
+	for (n = 0; n < 200; n++) {
+		log_line(line, sizeof(line), n);
+		for (p = line; *p; p++)
+			console_char(*p);
+		update("console, per line");
+	}
+	report("console, per line");
+}
+
+/* Random rectangles, to reach the merging with many dirty areas */
+static void scatter(void)
+{
+	int i, j;
+
+	for (i = 0; i < 300; i++) {
+		for (j = rnd() % 20; j >= 0; j--)
+			gfx_fillRect(rnd() % LCD_WIDTH - 8,
+				     rnd() % LCD_HEIGHT - 8,
+				     1 + rnd() % 24, 1 + rnd() % 24, rnd());
+		update("scattered rectangles");
+	}
+	report("scattered rectangles");
+}
+
+/* A 16x16 image moved across the screen, through the blit spans */
+static void sprite(void)
+{
+	static uint16_t image[16 * 16];
+	int i, x = 0, y = 0, dx = 3, dy = 2;
+
+	for (i = 0; i < 16 * 16; i++)
+		image[i] = (i / 16 + i % 16) % 3 ? LCD_CYAN : LCD_MAGENTA;
+	gfx_fillScreen(LCD_BLACK);
+	update("sprite, clear");
+	memset(&stats, 0, sizeof(stats));
+
+	for (i = 0; i < 300; i++) {
+		gfx_fillRect(x, y, 16, 16, LCD_BLACK);
+		x += dx;
+		y += dy;
+		if (x < -8 || x > LCD_WIDTH - 8)
+			dx = -dx;
+		if (y < -8 || y > LCD_HEIGHT - 8)
+			dy = -dy;
+		gfx_drawImage(x, y, 16, 16, image);
+		update("sprite");
+	}
+	report("sprite");
+}
+
+/* Asked for fewer rectangles than it holds, the last one covers the rest */
+static void take_fewer(void)
+{
+	struct gfx_rect r[GFX_DIRTY_RECTS];
+	int i, n;
+
+	gfx_clearDirty();
+	for (i = 0; i < GFX_DIRTY_RECTS; i++)
+		gfx_markDirty(i * 30, i * 40, 2, 2);
+	n = gfx_takeDirty(r, 2);
+	CHECK(n == 2 && r[1].x <= 30 && r[1].y <= 40 &&
+	      r[1].x + r[1].w >= 7 * 30 + 2 && r[1].y + r[1].h >= 7 * 40 + 2,
+	      "gfx_takeDirty(2) returned %d, the last %d,%d %dx%d", n,
+	      r[1].x, r[1].y, r[1].w, r[1].h);
+	CHECK(gfx_takeDirty(r, GFX_DIRTY_RECTS) == 0, "marks left over");
+}
+
+int main(void)
+{
+	void *fb = mmap(SDRAM_BASE_ADDRESS, FRAME_SIZE_BYTES,
+			PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+			-1, 0);
+	uint32_t before;
+
+	if (fb != SDRAM_BASE_ADDRESS) {
+		printf("can't map the frame buffer at %p\n",
+		       (void *)SDRAM_BASE_ADDRESS);
+		return EXIT_FAILURE;
+	}
+	/* nothing sent yet, so the display holds noise */
+	for (before = 0; before < sizeof(gram); before++)
+		(&gram[0][0][0])[before] = rnd();
+
+	before = ili.bytes;
+	lcd_spi_init();
+	CHECK(!(ili.madctl & 0xE0), "MADCTL 0x%02x rotates the display, the "
+	      "model doesn't", ili.madctl);
+	in_sync("lcd_spi_init()");
+
+	before = ili.bytes;
+	lcd_show_frame();
+	full_frame = ili.bytes - before;
+	CHECK(full_frame == FRAME_SIZE_BYTES + LCD_WINDOW_OVERHEAD,
+	      "a full frame is %u bytes", full_frame);
+	printf("full frame: %u bytes\n", full_frame);
+
+	gfx_init(lcd_draw_pixel, LCD_WIDTH, LCD_HEIGHT);
+	gfx_setSpanFuncs(lcd_fill_span, lcd_blit_span);
+
+	printf("%-24s %7s %9s %8s %8s %8s\n", "workload", "updates", "average",
+	       "median", "max", "saved");
+	demo_screen();
+	planets();
+	console();
+	sprite();
+	scatter();
+	take_fewer();
+
+	if (failures) {
+		printf("%d failures\n", failures);
+		return EXIT_FAILURE;
+	}
+	printf("all passed\n");
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,59 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Host stand-in, see lcd_spi_test.c. */
+
+#ifndef HOST_GPIO_H
+#define HOST_GPIO_H
+
+#include <stdint.h>
+
+#define GPIOC			2
+#define GPIOD			3
+#define GPIOF			5
+
+#define GPIO2			(1 << 2)
+#define GPIO7			(1 << 7)
+#define GPIO9			(1 << 9)
+#define GPIO13			(1 << 13)
+
+#define GPIO_MODE_OUTPUT	1
+#define GPIO_MODE_AF		2
+#define GPIO_PUPD_NONE		0
+#define GPIO_AF5		5
+
+static inline void gpio_mode_setup(uint32_t port, uint8_t mode, uint8_t pupd,
+				   uint16_t gpios)
+{
+	(void)port;
+	(void)mode;
+	(void)pupd;
+	(void)gpios;
+}
+
+static inline void gpio_set_af(uint32_t port, uint8_t af, uint16_t gpios)
+{
+	(void)port;
+	(void)af;
+	(void)gpios;
+}
+
+/* Chip select and D/CX go to the display model */
+void gpio_set(uint32_t port, uint16_t gpios);
+void gpio_clear(uint32_t port, uint16_t gpios);
+
+#endif
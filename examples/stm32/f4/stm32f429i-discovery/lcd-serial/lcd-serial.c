@@ -34,7 +34,14 @@
  */
 int main(void)
 {
-	int p1, p2, p3;
+	static const int orbit[3] = { 55, 75, 100 };
+	static const int radius[3] = { 5, 10, 8 };
+	static const uint16_t color[3] = { LCD_RED, LCD_WHITE, LCD_BLUE };
+	static const int speed[3] = { 3, 2, 1 };
+	int angle[3] = { 0, 45, 90 };
+	int px[3] = { -100, -100, -100 };
+	int py[3] = { -100, -100, -100 };
+	int i;
 
 	clock_setup();
 	console_setup(115200);
@@ -45,6 +52,7 @@ int main(void)
 	msleep(2000);
 /*	(void) console_getc(1); */
 	gfx_init(lcd_draw_pixel, 240, 320);
+	gfx_setSpanFuncs(lcd_fill_span, lcd_blit_span);
 	gfx_fillScreen(LCD_GREY);
 	gfx_fillRoundRect(10, 10, 220, 220, 5, LCD_WHITE);
 	gfx_drawRoundRect(10, 10, 220, 220, 5, LCD_RED);
@@ -66,27 +74,31 @@ int main(void)
 /*	(void) console_getc(1); */
 	gfx_setTextColor(LCD_YELLOW, LCD_BLACK);
 	gfx_setTextSize(3);
-	p1 = 0;
-	p2 = 45;
-	p3 = 90;
+	gfx_fillScreen(LCD_BLACK);
+
+	/*
+	 * Rather than clearing the screen every frame, erase the
+	 * planets where they were, redraw the scenery over the holes
+	 * and draw the planets in their new places. Only the pixels
+	 * that end up different are marked dirty, so lcd_update()
+	 * sends a few small windows instead of the whole frame.
+	 */
 	while (1) {
-		gfx_fillScreen(LCD_BLACK);
+		for (i = 0; i < 3; i++) {
+			gfx_fillCircle(px[i], py[i], radius[i], LCD_BLACK);
+		}
 		gfx_setCursor(15, 36);
 		gfx_puts("PLANETS!");
 		gfx_fillCircle(120, 160, 40, LCD_YELLOW);
-		gfx_drawCircle(120, 160, 55, LCD_GREY);
-		gfx_drawCircle(120, 160, 75, LCD_GREY);
-		gfx_drawCircle(120, 160, 100, LCD_GREY);
-
-		gfx_fillCircle(120 + (sin(d2r(p1)) * 55),
-			       160 + (cos(d2r(p1)) * 55), 5, LCD_RED);
-		gfx_fillCircle(120 + (sin(d2r(p2)) * 75),
-			       160 + (cos(d2r(p2)) * 75), 10, LCD_WHITE);
-		gfx_fillCircle(120 + (sin(d2r(p3)) * 100),
-			       160 + (cos(d2r(p3)) * 100), 8, LCD_BLUE);
-		p1 = (p1 + 3) % 360;
-		p2 = (p2 + 2) % 360;
-		p3 = (p3 + 1) % 360;
-		lcd_show_frame();
+		for (i = 0; i < 3; i++) {
+			gfx_drawCircle(120, 160, orbit[i], LCD_GREY);
+		}
+		for (i = 0; i < 3; i++) {
+			px[i] = 120 + (sin(d2r(angle[i])) * orbit[i]);
+			py[i] = 160 + (cos(d2r(angle[i])) * orbit[i]);
+			gfx_fillCircle(px[i], py[i], radius[i], color[i]);
+			angle[i] = (angle[i] + speed[i]) % 360;
+		}
+		(void) lcd_update();
 	}
 }
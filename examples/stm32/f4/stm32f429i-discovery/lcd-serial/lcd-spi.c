@@ -29,28 +29,98 @@
 #include "clock.h"
 #include "sdram.h"
 #include "lcd-spi.h"
+#include "gfx.h"
 
 
 /* forward prototypes for some helper functions */
 static int print_decimal(int v);
 static int print_hex(int v);
 
-/* Simple double buffering, one frame is displayed, the
- * other being built.
+/*
+ * The frame buffer in SDRAM is a copy of what the display holds.
+ * The SPI transfer is synchronous, so a second buffer would buy
+ * nothing, and with a single buffer anything not marked dirty is
+ * known to match the display already.
  */
 uint16_t *cur_frame;
-uint16_t *display_frame;
 
 
 /*
  * Drawing a pixel consists of storing a 16 bit value in the
  * memory used to hold the frame. This code computes the address
  * of the word to store, and puts in the value we pass to it.
+ * Pixels that really change are reported to the gfx layer so
+ * lcd_update() knows which windows to send.
  */
 void
 lcd_draw_pixel(int x, int y, uint16_t color)
 {
-	*(cur_frame + x + y * LCD_WIDTH) = color;
+	uint16_t *p = cur_frame + x + y * LCD_WIDTH;
+
+	if (*p != color) {
+		*p = color;
+		gfx_markDirty(x, y, 1, 1);
+	}
+}
+
+/*
+ * Span versions of lcd_draw_pixel for the gfx layer. The fill
+ * stores two pixels per 32 bit word. Both mark only the part of
+ * the span that changed as dirty (to the word, for the fill).
+ */
+void
+lcd_fill_span(int x0, int x1, int y, uint16_t color)
+{
+	uint16_t *row = cur_frame + y * LCD_WIDTH;
+	uint32_t pair = color | ((uint32_t)color << 16);
+	uint32_t *w;
+	int x = x0, first = -1, last = 0;
+
+	/* the frame and its rows start word aligned */
+	if ((x & 1) && (row[x] != color)) {
+		row[x] = color;
+		first = last = x;
+	}
+	x += x & 1;
+	for (w = (uint32_t *)(row + x); x < x1; x += 2, w++) {
+		if (*w != pair) {
+			*w = pair;
+			if (first < 0) {
+				first = x;
+			}
+			last = x + 1;
+		}
+	}
+	if ((x == x1) && (row[x] != color)) {
+		row[x] = color;
+		if (first < 0) {
+			first = x;
+		}
+		last = x;
+	}
+	if (first >= 0) {
+		gfx_markDirty(first, y, last - first + 1, 1);
+	}
+}
+
+void
+lcd_blit_span(int x, int y, int w, const uint16_t *pixels)
+{
+	uint16_t *row = cur_frame + y * LCD_WIDTH;
+	int i, first = -1, last = 0;
+
+	for (i = 0; i < w; i++) {
+		if (row[x + i] != pixels[i]) {
+			row[x + i] = pixels[i];
+			if (first < 0) {
+				first = i;
+			}
+			last = i;
+		}
+	}
+	if (first >= 0) {
+		gfx_markDirty(x + first, y, last - first + 1, 1);
+	}
 }
 
 /*
@@ -257,6 +327,66 @@ test_image(void)
 	}
 }
 
+/*
+ * void lcd_show_rect(x, y, w, h)
+ *
+ * Send one window of the frame buffer. The column address set
+ * (0x2A) and page address set (0x2B) commands restrict the
+ * memory write (0x2C) to the window, so only its w * h pixels
+ * go over the wire, one row at a time out of the frame buffer.
+ */
+void lcd_show_rect(int x, int y, int w, int h)
+{
+	uint8_t size[4];
+	const uint8_t *row;
+	int i, j;
+
+	size[0] = (x >> 8) & 0xff;
+	size[1] = x & 0xff;
+	size[2] = ((x + w - 1) >> 8) & 0xff;
+	size[3] = (x + w - 1) & 0xff;
+	lcd_command(0x2A, 0, 4, (const uint8_t *)&size[0]);
+	size[0] = (y >> 8) & 0xff;
+	size[1] = y & 0xff;
+	size[2] = ((y + h - 1) >> 8) & 0xff;
+	size[3] = (y + h - 1) & 0xff;
+	lcd_command(0x2B, 0, 4, (const uint8_t *)&size[0]);
+
+	gpio_clear(GPIOC, GPIO2);	/* Select the LCD */
+	(void) spi_xfer(LCD_SPI, 0x2C);
+	gpio_set(GPIOD, GPIO13);	/* Set the D/CX pin */
+	for (i = 0; i < h; i++) {
+		row = (const uint8_t *)(cur_frame + x + (y + i) * LCD_WIDTH);
+		for (j = 0; j < w * 2; j++) {
+			(void) spi_xfer(LCD_SPI, row[j]);
+		}
+	}
+	gpio_set(GPIOC, GPIO2);		/* Turn off chip select */
+	gpio_clear(GPIOD, GPIO13);	/* always reset D/CX */
+}
+
+/*
+ * uint32_t lcd_update(void)
+ *
+ * Send just the parts of the frame that changed since the last
+ * update. Returns the number of bytes that went over SPI, so a
+ * caller can see what the partial update saves over
+ * FRAME_SIZE_BYTES.
+ */
+uint32_t lcd_update(void)
+{
+	struct gfx_rect rects[GFX_DIRTY_RECTS];
+	uint32_t bytes = 0;
+	int i, n;
+
+	n = gfx_takeDirty(rects, GFX_DIRTY_RECTS);
+	for (i = 0; i < n; i++) {
+		lcd_show_rect(rects[i].x, rects[i].y, rects[i].w, rects[i].h);
+		bytes += LCD_WINDOW_OVERHEAD + rects[i].w * rects[i].h * 2;
+	}
+	return bytes;
+}
+
 /*
  * void lcd_show_frame(void)
  *
@@ -267,24 +397,8 @@ test_image(void)
  */
 void lcd_show_frame(void)
 {
-	uint16_t	*t;
-	uint8_t size[4];
-
-	t = display_frame;
-	display_frame = cur_frame;
-	cur_frame = t;
-	/*  */
-	size[0] = 0;
-	size[1] = 0;
-	size[2] = (LCD_WIDTH >> 8) & 0xff;
-	size[3] = (LCD_WIDTH) & 0xff;
-	lcd_command(0x2A, 0, 4, (const uint8_t *)&size[0]);
-	size[0] = 0;
-	size[1] = 0;
-	size[2] = (LCD_HEIGHT >> 8) & 0xff;
-	size[3] = LCD_HEIGHT & 0xff;
-	lcd_command(0x2B, 0, 4, (const uint8_t *)&size[0]);
-	lcd_command(0x2C, 0, FRAME_SIZE_BYTES, (const uint8_t *)display_frame);
+	gfx_clearDirty();
+	lcd_show_rect(0, 0, LCD_WIDTH, LCD_HEIGHT);
 }
 
 /*
@@ -323,7 +437,6 @@ lcd_spi_init(void)
 	gpio_set_af(GPIOF, GPIO_AF5, GPIO7 | GPIO9);
 
 	cur_frame = (uint16_t *)(SDRAM_BASE_ADDRESS);
-	display_frame = cur_frame + (LCD_WIDTH * LCD_HEIGHT);
 
 	rcc_periph_clock_enable(RCC_SPI5);
 	spi_init_master(LCD_SPI, SPI_CR1_BAUDRATE_FPCLK_DIV_4,
@@ -29,7 +29,11 @@
 
 void lcd_spi_init(void);
 void lcd_show_frame(void);
+void lcd_show_rect(int x, int y, int w, int h);
+uint32_t lcd_update(void);
 void lcd_draw_pixel(int x, int y, uint16_t color);
+void lcd_fill_span(int x0, int x1, int y, uint16_t color);
+void lcd_blit_span(int x, int y, int w, const uint16_t *pixels);
 
 /* Color definitions */
 #define	LCD_BLACK   0x0000
@@ -58,4 +62,7 @@ void lcd_draw_pixel(int x, int y, uint16_t color);
 
 #define FRAME_SIZE  (LCD_WIDTH * LCD_HEIGHT)
 #define FRAME_SIZE_BYTES    (FRAME_SIZE * 2)
+
+/* Command bytes around each window: 0x2A + 4, 0x2B + 4, 0x2C */
+#define LCD_WINDOW_OVERHEAD 11
 #endif
@@ -0,0 +1,466 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/*
+ * Host test for lcd.c: the SPI port, the DMA stream and an ILI9341 are
+ * simulated, and every byte the display receives goes through a model of
+ * its command set (column and page address, memory write), so the test
+ * sees the picture the panel would show.
+ *
+ * Checked: the initialization and test image, then frames drawn while
+ * the previous one is still going out by DMA in random steps.  Each must
+ * show up on the panel exactly as drawn, with chip select held and D/CX
+ * set for the whole frame, the stream only reprogrammed while disabled,
+ * no chunk over 65535 bytes and the frame done callback called once.
+ */
+
+#define _DEFAULT_SOURCE		/* MAP_ANONYMOUS */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include <libopencm3/stm32/dma.h>
+#include <libopencm3/stm32/gpio.h>
+#include <libopencm3/stm32/spi.h>
+#include <libopencm3/cm3/nvic.h>
+
+#include "clock.h"
+#include "sdram.h"
+#include "lcd.h"
+
+#define FRAME_BYTES	(LCD_WIDTH * LCD_HEIGHT * 2)
+#define SPI_HZ		21000000	/* SPI5 at APB2 84MHz / 4 */
+
+static int failures;
+
+#define CHECK(cond, ...) do {						\
+	if (!(cond)) {							\
+		if (failures++ < 10) {					\
+			printf("FAIL %s:%d: ", __FILE__, __LINE__);	\
+			printf(__VA_ARGS__);				\
+			printf("\n");					\
+		}							\
+	}								\
+} while (0)
+
+static uint32_t rng_state = 1;
+
+static uint32_t rnd(void)
+{
+	rng_state ^= rng_state << 13;
+	rng_state ^= rng_state >> 17;
+	rng_state ^= rng_state << 5;
+	return rng_state;
+}
+
+extern uint16_t *cur_frame;
+
+/* --- The ILI9341 --- */
+
+static bool cs = true, dcx;		/* pin levels */
+static uint8_t cmd;
+static uint8_t args[4];
+static unsigned nargs;
+static unsigned sc, ec = LCD_WIDTH - 1, sp, ep = LCD_HEIGHT - 1;
+static unsigned col, page, pixel_hi, half;
+static uint16_t panel[LCD_HEIGHT][LCD_WIDTH];
+static unsigned long window_errors, overflow;
+
+static void panel_byte(uint8_t b)
+{
+	if (cs)
+		return;
+	if (!dcx) {
+		cmd = b;
+		nargs = 0;
+		if (cmd == 0x2c) {
+			col = sc;
+			page = sp;
+			half = 0;
+		}
+		return;
+	}
+
+	switch (cmd) {
+	case 0x2a:
+	case 0x2b:
+		if (nargs < 4)
+			args[nargs++] = b;
+		if (nargs != 4)
+			break;
+		if (cmd == 0x2a) {
+			sc = args[0] << 8 | args[1];
+			ec = args[2] << 8 | args[3];
+			window_errors += sc > ec || ec >= LCD_WIDTH;
+		} else {
+			sp = args[0] << 8 | args[1];
+			ep = args[2] << 8 | args[3];
+			window_errors += sp > ep || ep >= LCD_HEIGHT;
+		}
+		break;
+	case 0x2c:
+		/* 16 bit pixels, high byte first. */
+		if (!half++) {
+			pixel_hi = b;
+			break;
+		}
+		half = 0;
+		if (page > ep || ec >= LCD_WIDTH || ep >= LCD_HEIGHT) {
+			overflow++;
+			break;
+		}
+		panel[page][col] = pixel_hi << 8 | b;
+		if (++col > ec) {
+			col = sc;
+			page++;
+		}
+		break;
+	}
+}
+
+/* --- SPI5, GPIO --- */
+
+volatile uint32_t sim_spi_dr, sim_spi_sr = SPI_SR_TXE;
+static bool spi_on, spi_tx_dma;
+static unsigned long cpu_bytes;
+static unsigned long ms_slept;
+
+int spi_init_master(uint32_t spi, uint32_t br, uint32_t cpol, uint32_t cpha,
+		    uint32_t dff, uint32_t lsbfirst)
+{
+	(void)spi; (void)br; (void)cpol; (void)cpha; (void)dff; (void)lsbfirst;
+	return 0;
+}
+
+void spi_enable(uint32_t spi)
+{
+	(void)spi;
+	spi_on = true;
+}
+
+void spi_enable_ss_output(uint32_t spi)
+{
+	(void)spi;
+}
+
+void spi_enable_tx_dma(uint32_t spi)
+{
+	(void)spi;
+	spi_tx_dma = true;
+}
+
+static bool dma_on;
+
+uint16_t spi_xfer(uint32_t spi, uint16_t data)
+{
+	CHECK(spi == SPI5 && spi_on, "SPI off");
+	CHECK(!dma_on, "CPU writes while the DMA runs");
+	cpu_bytes++;
+	panel_byte(data);
+	return 0;
+}
+
+void gpio_mode_setup(uint32_t gpioport, uint8_t mode, uint8_t pull_up_down,
+		     uint16_t gpios)
+{
+	(void)gpioport; (void)mode; (void)pull_up_down; (void)gpios;
+}
+
+void gpio_set_af(uint32_t gpioport, uint8_t alt_func_num, uint16_t gpios)
+{
+	(void)gpioport; (void)alt_func_num; (void)gpios;
+}
+
+static void gpio_write(uint32_t gpioport, uint16_t gpios, bool level)
+{
+	if (gpioport == GPIOC && gpios & GPIO2) {
+		CHECK(!dma_on || !level, "chip select off during the DMA");
+		if (level && !cs)
+			cmd = 0;	/* the command ends */
+		cs = level;
+	}
+	if (gpioport == GPIOD && gpios & GPIO13) {
+		CHECK(!dma_on, "D/CX changed during the DMA");
+		dcx = level;
+	}
+}
+
+void gpio_set(uint32_t gpioport, uint16_t gpios)
+{
+	gpio_write(gpioport, gpios, true);
+}
+
+void gpio_clear(uint32_t gpioport, uint16_t gpios)
+{
+	gpio_write(gpioport, gpios, false);
+}
+
+void msleep(uint32_t ms)
+{
+	ms_slept += ms;
+}
+
+/* --- DMA2 stream 4 --- */
+
+static struct {
+	uint32_t paddr, maddr, channel, dir, msize, psize;
+	uint16_t ndtr;
+	bool minc, tcie, tcif;
+} stream;
+static bool irq_enabled;
+static unsigned long chunks, isr_calls;
+
+static void check_stream(uint32_t dma, uint8_t s)
+{
+	CHECK(dma == DMA2 && s == DMA_STREAM4, "DMA%u stream %u", dma, s);
+	CHECK(!dma_on, "stream programmed while enabled");
+}
+
+void nvic_enable_irq(uint8_t irqn)
+{
+	CHECK(irqn == NVIC_DMA2_STREAM4_IRQ, "IRQ %u", irqn);
+	irq_enabled = true;
+}
+
+void dma_stream_reset(uint32_t dma, uint8_t s)
+{
+	check_stream(dma, s);
+	memset(&stream, 0, sizeof(stream));
+}
+
+void dma_set_priority(uint32_t dma, uint8_t s, uint32_t prio)
+{
+	check_stream(dma, s);
+	(void)prio;
+}
+
+void dma_set_memory_size(uint32_t dma, uint8_t s, uint32_t mem_size)
+{
+	check_stream(dma, s);
+	stream.msize = mem_size;
+}
+
+void dma_set_peripheral_size(uint32_t dma, uint8_t s, uint32_t peripheral_size)
+{
+	check_stream(dma, s);
+	stream.psize = peripheral_size;
+}
+
+void dma_enable_memory_increment_mode(uint32_t dma, uint8_t s)
+{
+	check_stream(dma, s);
+	stream.minc = true;
+}
+
+void dma_set_transfer_mode(uint32_t dma, uint8_t s, uint32_t direction)
+{
+	check_stream(dma, s);
+	stream.dir = direction;
+}
+
+void dma_set_peripheral_address(uint32_t dma, uint8_t s, uint32_t address)
+{
+	check_stream(dma, s);
+	stream.paddr = address;
+}
+
+void dma_set_memory_address(uint32_t dma, uint8_t s, uint32_t address)
+{
+	check_stream(dma, s);
+	stream.maddr = address;
+}
+
+void dma_set_number_of_data(uint32_t dma, uint8_t s, uint16_t number)
+{
+	check_stream(dma, s);
+	stream.ndtr = number;
+}
+
+void dma_enable_transfer_complete_interrupt(uint32_t dma, uint8_t s)
+{
+	check_stream(dma, s);
+	stream.tcie = true;
+}
+
+void dma_channel_select(uint32_t dma, uint8_t s, uint32_t channel)
+{
+	check_stream(dma, s);
+	stream.channel = channel;
+}
+
+void dma_enable_stream(uint32_t dma, uint8_t s)
+{
+	check_stream(dma, s);
+	CHECK(stream.channel == DMA_SxCR_CHSEL_2 &&
+	      stream.dir == DMA_SxCR_DIR_MEM_TO_PERIPHERAL &&
+	      stream.msize == DMA_SxCR_MSIZE_8BIT &&
+	      stream.psize == DMA_SxCR_PSIZE_8BIT && stream.minc &&
+	      stream.paddr == (uint32_t)(uintptr_t)&sim_spi_dr,
+	      "stream set up wrong");
+	CHECK(spi_tx_dma, "SPI5 doesn't request the DMA");
+	CHECK(stream.ndtr > 0, "empty transfer");
+	CHECK(!cs && dcx, "chip select %d, D/CX %d", cs, dcx);
+	chunks++;
+	dma_on = true;
+}
+
+bool dma_get_interrupt_flag(uint32_t dma, uint8_t s, uint32_t interrupts)
+{
+	(void)dma; (void)s;
+	return interrupts == DMA_TCIF && stream.tcif;
+}
+
+void dma_clear_interrupt_flags(uint32_t dma, uint8_t s, uint32_t interrupts)
+{
+	(void)dma; (void)s;
+	if (interrupts & DMA_TCIF)
+		stream.tcif = false;
+}
+
+/* Move up to `n' bytes; the stream disables itself when it is done. */
+static void dma_run(unsigned long n)
+{
+	const uint8_t *p;
+
+	while (dma_on && n--) {
+		p = (const uint8_t *)(uintptr_t)stream.maddr++;
+		panel_byte(*p);
+		if (--stream.ndtr)
+			continue;
+		dma_on = false;
+		stream.tcif = true;
+		if (stream.tcie && irq_enabled) {
+			isr_calls++;
+			dma2_stream4_isr();
+		}
+	}
+}
+
+/* --- The frames --- */
+
+static uint16_t expected[LCD_HEIGHT][LCD_WIDTH];
+static unsigned frames_done;
+
+static void frame_done(void)
+{
+	frames_done++;
+}
+
+/* Pixels are stored byte swapped, the panel gets the high byte first. */
+static uint16_t on_panel(uint16_t color)
+{
+	return color >> 8 | color << 8;
+}
+
+static void draw_frame(unsigned n)
+{
+	uint16_t color;
+	int x, y;
+
+	for (y = 0; y < LCD_HEIGHT; y++) {
+		for (x = 0; x < LCD_WIDTH; x++) {
+			color = n % 4 == 0 ? LCD_RED : rnd();
+			lcd_draw_pixel(x, y, color);
+			expected[y][x] = on_panel(color);
+		}
+	}
+}
+
+/* Scribble over the frame being built, while the other one goes out. */
+static void draw_some(void)
+{
+	int i;
+
+	for (i = 0; i < 1000; i++)
+		lcd_draw_pixel(rnd() % LCD_WIDTH, rnd() % LCD_HEIGHT, rnd());
+}
+
+static void check_panel(const char *what)
+{
+	int x, y, wrong = 0;
+
+	for (y = 0; y < LCD_HEIGHT; y++)
+		for (x = 0; x < LCD_WIDTH; x++)
+			wrong += panel[y][x] != expected[y][x];
+	CHECK(!wrong && !overflow && !window_errors,
+	      "%s: %d pixels wrong, %lu past the window, %lu bad windows",
+	      what, wrong, overflow, window_errors);
+}
+
+int main(void)
+{
+	unsigned long cpu_before, chunks_before;
+	unsigned i;
+	void *map;
+	int x, y;
+
+	/* lcd.c draws into the SDRAM, at its real address. */
+	map = mmap(SDRAM_BASE_ADDRESS, 2 * FRAME_BYTES, PROT_READ | PROT_WRITE,
+		   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (map != SDRAM_BASE_ADDRESS) {
+		printf("can't map the SDRAM at %p\n", SDRAM_BASE_ADDRESS);
+		return EXIT_FAILURE;
+	}
+
+	/* The test image: a 16 pixel grid. */
+	lcd_set_frame_done_callback(frame_done);
+	lcd_init();
+	CHECK(lcd_frame_busy(), "test image not going out");
+	dma_run(-1);
+	CHECK(!lcd_frame_busy() && frames_done == 1 && cs,
+	      "test image not finished");
+	for (y = 0; y < LCD_HEIGHT; y++)
+		for (x = 0; x < LCD_WIDTH; x++)
+			expected[y][x] = x % 16 == 0 || y % 16 == 0 ?
+					 0xffff : 0;
+	check_panel("test image");
+	printf("init: %lu bytes by the CPU, %lu ms of delays\n", cpu_bytes,
+	       ms_slept);
+
+	/* Frames drawn while the one before goes out. */
+	cpu_before = cpu_bytes;
+	chunks_before = chunks;
+	for (i = 1; i <= 20; i++) {
+		draw_frame(i);
+		lcd_show_frame();
+		CHECK((uint16_t *)SDRAM_BASE_ADDRESS + (i % 2 ? 0 :
+		      LCD_WIDTH * LCD_HEIGHT) == cur_frame, "no flip");
+		while (lcd_frame_busy()) {
+			draw_some();
+			dma_run(rnd() % 40000);
+		}
+		CHECK(frames_done == i + 1, "frame %u: callback", i);
+		check_panel("frame");
+	}
+	printf("per frame: %lu bytes by the CPU, %lu DMA chunks, %lu "
+	       "interrupts\n", (cpu_bytes - cpu_before) / 20,
+	       (chunks - chunks_before) / 20, isr_calls / 21);
+	printf("%.1f ms on the wire at %u MHz, %.1f frames/s\n",
+	       FRAME_BYTES * 8 * 1e3 / SPI_HZ, SPI_HZ / 1000000,
+	       SPI_HZ / (FRAME_BYTES * 8.0));
+
+	if (failures) {
+		printf("%d failures\n", failures);
+		return EXIT_FAILURE;
+	}
+	printf("all passed\n");
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,61 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Host stand-in for the DMA parts lcd.c uses; the stream is simulated in
+ * lcd_test.c.
+ */
+
+#ifndef HOST_DMA_H
+#define HOST_DMA_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define DMA2				2
+#define DMA_STREAM4			4
+
+#define DMA_TCIF			(1 << 5)
+
+#define DMA_SxCR_CHSEL_2		(2 << 25)
+#define DMA_SxCR_PL_HIGH		(2 << 16)
+#define DMA_SxCR_MSIZE_8BIT		(0 << 13)
+#define DMA_SxCR_MSIZE_16BIT		(1 << 13)
+#define DMA_SxCR_PSIZE_8BIT		(0 << 11)
+#define DMA_SxCR_PSIZE_16BIT		(1 << 11)
+#define DMA_SxCR_DIR_MEM_TO_PERIPHERAL	(1 << 6)
+
+void dma_stream_reset(uint32_t dma, uint8_t stream);
+void dma_set_priority(uint32_t dma, uint8_t stream, uint32_t prio);
+void dma_set_memory_size(uint32_t dma, uint8_t stream, uint32_t mem_size);
+void dma_set_peripheral_size(uint32_t dma, uint8_t stream,
+			     uint32_t peripheral_size);
+void dma_enable_memory_increment_mode(uint32_t dma, uint8_t stream);
+void dma_set_transfer_mode(uint32_t dma, uint8_t stream, uint32_t direction);
+void dma_set_peripheral_address(uint32_t dma, uint8_t stream,
+				uint32_t address);
+void dma_set_memory_address(uint32_t dma, uint8_t stream, uint32_t address);
+void dma_set_number_of_data(uint32_t dma, uint8_t stream, uint16_t number);
+void dma_enable_transfer_complete_interrupt(uint32_t dma, uint8_t stream);
+void dma_channel_select(uint32_t dma, uint8_t stream, uint32_t channel);
+void dma_enable_stream(uint32_t dma, uint8_t stream);
+bool dma_get_interrupt_flag(uint32_t dma, uint8_t stream,
+			    uint32_t interrupts);
+void dma_clear_interrupt_flags(uint32_t dma, uint8_t stream,
+			       uint32_t interrupts);
+
+#endif
@@ -0,0 +1,36 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Host stand-in: clocks are always on. */
+
+#ifndef HOST_RCC_H
+#define HOST_RCC_H
+
+#include <stdint.h>
+
+#define RCC_GPIOC		(1 << 2)
+#define RCC_GPIOD		(1 << 3)
+#define RCC_GPIOF		(1 << 5)
+#define RCC_DMA2		(1 << 22)
+#define RCC_SPI5		(1 << 20)
+
+static inline void rcc_periph_clock_enable(uint32_t clken)
+{
+	(void)clken;
+}
+
+#endif
@@ -0,0 +1,50 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Host stand-in for the SPI parts lcd.c uses; the registers and functions
+ * are implemented by the simulation in lcd_test.c.
+ */
+
+#ifndef HOST_SPI_H
+#define HOST_SPI_H
+
+#include <stdint.h>
+
+#define SPI5				5
+
+extern volatile uint32_t sim_spi_dr, sim_spi_sr;
+
+#define SPI_DR(spi)			(sim_spi_dr)
+#define SPI_SR(spi)			(sim_spi_sr)
+#define SPI_SR_TXE			(1 << 1)
+#define SPI_SR_BSY			(1 << 7)
+
+#define SPI_CR1_BAUDRATE_FPCLK_DIV_4	(1 << 3)
+#define SPI_CR1_CPOL_CLK_TO_0_WHEN_IDLE	0
+#define SPI_CR1_CPHA_CLK_TRANSITION_1	0
+#define SPI_CR1_DFF_8BIT		0
+#define SPI_CR1_MSBFIRST		0
+
+int spi_init_master(uint32_t spi, uint32_t br, uint32_t cpol, uint32_t cpha,
+		    uint32_t dff, uint32_t lsbfirst);
+void spi_enable(uint32_t spi);
+void spi_enable_ss_output(uint32_t spi);
+void spi_enable_tx_dma(uint32_t spi);
+uint16_t spi_xfer(uint32_t spi, uint16_t data);
+
+#endif
@@ -0,0 +1,170 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Renders views at odd sizes with mandel_render() and checks that every
+ * pixel was calculated, that the painted image ends up equal to the
+ * iteration buffer and that both match mandel_iterate() called on every
+ * pixel, then times the two on the examples' sizes.
+ *
+ * Filling a tile from its border can miss detail finer than a pixel, so
+ * the random views allow a few stray pixels; the fixed ones must match.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "mandel-render.h"
+
+#define MAX_W	256
+#define MAX_H	320
+
+static uint8_t iter_buf[MAX_W * MAX_H];
+static int image[MAX_W * MAX_H];
+static int ref[MAX_W * MAX_H];
+static int image_w;
+
+static void fill(int x, int y, int w, int h, int iter)
+{
+	int i, j;
+
+	for (j = y; j < y + h; j++) {
+		for (i = x; i < x + w; i++) {
+			image[j * image_w + i] = iter;
+		}
+	}
+}
+
+static void plain_render(const struct mandel_view *v)
+{
+	int x, y;
+
+	for (y = 0; y < v->height; y++) {
+		for (x = 0; x < v->width; x++) {
+			ref[y * v->width + x] =
+				mandel_iterate(v->cx + (x - v->width / 2) * v->scale,
+					       v->cy + (y - v->height / 2) * v->scale);
+		}
+	}
+}
+
+static int check(const struct mandel_view *v, int tolerance)
+{
+	int i, n = v->width * v->height, bad = 0, differ = 0;
+
+	image_w = v->width;
+	for (i = 0; i < v->width * v->height; i++) {
+		image[i] = -1;
+	}
+	plain_render(v);
+	mandel_render(v, iter_buf, fill);
+
+	for (i = 0; i < n; i++) {
+		if ((iter_buf[i] == MANDEL_UNKNOWN) || (image[i] != iter_buf[i])) {
+			bad++;
+		} else if (iter_buf[i] != ref[i]) {
+			differ++;
+		}
+	}
+	if (bad || (differ > n * tolerance / 1000)) {
+		printf("FAIL %dx%d at (%g, %g) scale %g: %d pixels not "
+		       "rendered, %d differ\n", v->width, v->height,
+		       v->cx, v->cy, v->scale, bad, differ);
+		return 1;
+	}
+	return 0;
+}
+
+static double seconds(void)
+{
+	return (double)clock() / CLOCKS_PER_SEC;
+}
+
+static void bench(const struct mandel_view *v)
+{
+	double t0, t1, t2;
+	int i, n = 20;
+
+	t0 = seconds();
+	for (i = 0; i < n; i++) {
+		plain_render(v);
+	}
+	t1 = seconds();
+	for (i = 0; i < n; i++) {
+		mandel_render(v, iter_buf, NULL);
+	}
+	t2 = seconds();
+	printf("%dx%d: per pixel %.2f ms, tiled %.2f ms\n", v->width,
+	       v->height, (t1 - t0) * 1e3 / n, (t2 - t1) * 1e3 / n);
+}
+
+int main(void)
+{
+	static const int sizes[][2] = {
+		{ 120, 100 }, { 240, 320 }, { 1, 1 }, { 2, 3 }, { 7, 5 },
+		{ 33, 17 }, { 34, 66 }, { 45, 30 }, { 97, 131 }, { 254, 318 },
+	};
+	static const float views[][3] = {
+		{ -0.5f, 0.0f, 3.0f },		/* whole set, across the image */
+		{ -0.743f, 0.131f, 0.02f },	/* seahorse valley */
+		{ -1.25f, 0.0f, 0.5f },
+	};
+	struct mandel_view v;
+	unsigned i, j;
+	int failed = 0, runs = 0;
+
+	for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+		for (j = 0; j < sizeof(views) / sizeof(views[0]); j++) {
+			v.width = sizes[i][0];
+			v.height = sizes[i][1];
+			v.cx = views[j][0];
+			v.cy = views[j][1];
+			v.scale = views[j][2] / v.width;
+			failed += check(&v, 0);
+			runs++;
+		}
+	}
+
+	/* random sizes and views */
+	srand(1);
+	for (i = 0; i < 200; i++) {
+		v.width = 1 + rand() % MAX_W;
+		v.height = 1 + rand() % MAX_H;
+		v.cx = -2.0f + 2.5f * rand() / RAND_MAX;
+		v.cy = -1.0f + 2.0f * rand() / RAND_MAX;
+		/* stay well inside the fixed-point range */
+		v.scale = (0.001f + 3.0f * rand() / RAND_MAX) /
+			  (v.width > v.height ? v.width : v.height);
+		failed += check(&v, 1);	/* 0.1% */
+		runs++;
+	}
+	printf("%d of %d renders match the per pixel reference\n",
+	       runs - failed, runs);
+
+	v.cx = -0.5f;
+	v.cy = 0.0f;
+	v.width = 120;
+	v.height = 100;
+	v.scale = 3.0f / v.width;
+	bench(&v);
+	v.width = 240;
+	v.height = 320;
+	v.scale = 3.0f / v.width;
+	bench(&v);
+
+	return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
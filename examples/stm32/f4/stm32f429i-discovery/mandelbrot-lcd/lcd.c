@@ -25,6 +25,7 @@
 #include <libopencm3/stm32/spi.h>
 #include <libopencm3/stm32/rcc.h>
 #include <libopencm3/stm32/gpio.h>
+#include <libopencm3/stm32/dma.h>
 #include <libopencm3/cm3/nvic.h>
 #include "clock.h"
 #include "sdram.h"
@@ -45,12 +46,28 @@
 #define FRAME_SIZE  (LCD_WIDTH * LCD_HEIGHT)
 #define FRAME_SIZE_BYTES    (FRAME_SIZE * 2)
 
+/*
+ * SPI5_TX is serviced by DMA2 Stream 4 Channel 2. A DMA stream can
+ * only move 65535 items per transfer, so the 153600 byte frame is
+ * sent as three equal chunks which the ISR chains together.
+ */
+#define LCD_DMA         DMA2
+#define LCD_DMA_STREAM  DMA_STREAM4
+#define LCD_DMA_CHANNEL DMA_SxCR_CHSEL_2
+#define LCD_DMA_CHUNK   (FRAME_SIZE_BYTES / 3)
+
 /* Simple double buffering, one frame is displayed, the
  * other being built.
  */
 uint16_t *cur_frame;
 uint16_t *display_frame;
 
+/* State of the frame currently being clocked out by DMA */
+static volatile int dma_busy;
+static const uint8_t *dma_next;
+static volatile uint32_t dma_remaining;
+static void (*frame_done_cb)(void);
+
 
 /*
  * Drawing a pixel consists of storing a 16 bit value in the
@@ -255,34 +272,142 @@ test_image(void)
 	}
 }
 
+/*
+ * Start the DMA for the next chunk of the frame, the stream must
+ * be disabled when this is called.
+ */
+static void
+lcd_dma_next_chunk(void)
+{
+	uint32_t len;
+
+	len = (dma_remaining > LCD_DMA_CHUNK) ? LCD_DMA_CHUNK : dma_remaining;
+	dma_set_memory_address(LCD_DMA, LCD_DMA_STREAM, (uint32_t) dma_next);
+	dma_set_number_of_data(LCD_DMA, LCD_DMA_STREAM, len);
+	dma_next += len;
+	dma_remaining -= len;
+	dma_enable_stream(LCD_DMA, LCD_DMA_STREAM);
+}
+
+/*
+ * The transfer complete interrupt either chains the next chunk
+ * of the frame or, once the whole frame has been handed to the
+ * SPI port, waits for the last byte to leave the shift register
+ * and releases the display.
+ */
+void
+dma2_stream4_isr(void)
+{
+	if (dma_get_interrupt_flag(LCD_DMA, LCD_DMA_STREAM, DMA_TCIF)) {
+		dma_clear_interrupt_flags(LCD_DMA, LCD_DMA_STREAM, DMA_TCIF);
+		if (dma_remaining) {
+			lcd_dma_next_chunk();
+			return;
+		}
+		while ((SPI_SR(LCD_SPI) & SPI_SR_TXE) == 0);
+		while (SPI_SR(LCD_SPI) & SPI_SR_BSY);
+		/* nobody read RX during the transfer, clear the overrun */
+		(void) SPI_DR(LCD_SPI);
+		(void) SPI_SR(LCD_SPI);
+		gpio_set(GPIOC, GPIO2);		/* Turn off chip select */
+		gpio_clear(GPIOD, GPIO13);	/* always reset D/CX */
+		dma_busy = 0;
+		if (frame_done_cb) {
+			frame_done_cb();
+		}
+	}
+}
+
+/*
+ * void lcd_set_frame_done_callback(void (*cb)(void))
+ *
+ * Register a function to be called (from interrupt context)
+ * when a frame has been completely sent to the display.
+ */
+void
+lcd_set_frame_done_callback(void (*cb)(void))
+{
+	frame_done_cb = cb;
+}
+
+/*
+ * int lcd_frame_busy(void)
+ *
+ * Returns non-zero while the display frame is still being
+ * clocked out to the LCD.
+ */
+int
+lcd_frame_busy(void)
+{
+	return dma_busy;
+}
+
 /*
  * void lcd_show_frame(void)
  *
- * Dump an entire frame to the LCD all at once. In theory you
- * could call this with DMA but that is made more difficult by
- * the implementation of SPI and the modules interpretation of
- * D/CX line.
+ * Dump an entire frame to the LCD. The frame that was just drawn
+ * becomes the display frame and is streamed to the display by DMA
+ * in the background, so the caller may start building the next
+ * frame in cur_frame right away. If the previous frame is still
+ * being sent we wait for it, as that is the buffer we are about
+ * to hand back for drawing.
+ *
+ * The command and address bytes are sent by the CPU, the D/CX
+ * line is then held in 'data' and chip select stays asserted
+ * until the DMA ISR sees the last byte go out.
  */
 void lcd_show_frame(void)
 {
 	uint16_t	*t;
 	uint8_t size[4];
 
+	while (dma_busy);
 	t = display_frame;
 	display_frame = cur_frame;
 	cur_frame = t;
-	/*  */
+	/* The window is given by its first and last column and page */
 	size[0] = 0;
 	size[1] = 0;
-	size[2] = (LCD_WIDTH >> 8) & 0xff;
-	size[3] = (LCD_WIDTH) & 0xff;
+	size[2] = ((LCD_WIDTH - 1) >> 8) & 0xff;
+	size[3] = (LCD_WIDTH - 1) & 0xff;
 	lcd_command(0x2A, 0, 4, (const uint8_t *)&size[0]);
 	size[0] = 0;
 	size[1] = 0;
-	size[2] = (LCD_HEIGHT >> 8) & 0xff;
-	size[3] = LCD_HEIGHT & 0xff;
+	size[2] = ((LCD_HEIGHT - 1) >> 8) & 0xff;
+	size[3] = (LCD_HEIGHT - 1) & 0xff;
 	lcd_command(0x2B, 0, 4, (const uint8_t *)&size[0]);
-	lcd_command(0x2C, 0, FRAME_SIZE_BYTES, (const uint8_t *)display_frame);
+
+	dma_busy = 1;
+	dma_next = (const uint8_t *)display_frame;
+	dma_remaining = FRAME_SIZE_BYTES;
+	gpio_clear(GPIOC, GPIO2);	/* Select the LCD */
+	(void) spi_xfer(LCD_SPI, 0x2C);
+	gpio_set(GPIOD, GPIO13);	/* Set the D/CX pin */
+	lcd_dma_next_chunk();
+}
+
+/*
+ * Set up the DMA stream which feeds SPI5. Everything but the
+ * memory address and count is fixed, those are filled in for
+ * each chunk by lcd_dma_next_chunk().
+ */
+static void
+lcd_dma_init(void)
+{
+	rcc_periph_clock_enable(RCC_DMA2);
+	nvic_enable_irq(NVIC_DMA2_STREAM4_IRQ);
+	dma_stream_reset(LCD_DMA, LCD_DMA_STREAM);
+	dma_set_priority(LCD_DMA, LCD_DMA_STREAM, DMA_SxCR_PL_HIGH);
+	dma_set_memory_size(LCD_DMA, LCD_DMA_STREAM, DMA_SxCR_MSIZE_8BIT);
+	dma_set_peripheral_size(LCD_DMA, LCD_DMA_STREAM, DMA_SxCR_PSIZE_8BIT);
+	dma_enable_memory_increment_mode(LCD_DMA, LCD_DMA_STREAM);
+	dma_set_transfer_mode(LCD_DMA, LCD_DMA_STREAM,
+				DMA_SxCR_DIR_MEM_TO_PERIPHERAL);
+	dma_set_peripheral_address(LCD_DMA, LCD_DMA_STREAM,
+				(uint32_t) &SPI_DR(LCD_SPI));
+	dma_enable_transfer_complete_interrupt(LCD_DMA, LCD_DMA_STREAM);
+	dma_channel_select(LCD_DMA, LCD_DMA_STREAM, LCD_DMA_CHANNEL);
+	spi_enable_tx_dma(LCD_SPI);
 }
 
 /*
@@ -335,6 +460,9 @@ lcd_init(void)
 	/* Set up the display */
 	initialize_display(initialization);
 
+	/* Frames are pushed to the display by DMA */
+	lcd_dma_init();
+
 	/* create a test image */
 	test_image();
 
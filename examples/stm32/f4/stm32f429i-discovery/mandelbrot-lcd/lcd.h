@@ -25,10 +25,14 @@
  *
  * This is a very basic API, initialize, a function which will show the
  * frame, and a function which will draw a pixel in the framebuffer.
+ * Frames are sent by DMA, lcd_frame_busy() and the frame done callback
+ * tell you when the display frame has been completely sent.
  */
 
 void lcd_init(void);
 void lcd_show_frame(void);
+int lcd_frame_busy(void);
+void lcd_set_frame_done_callback(void (*cb)(void));
 void lcd_draw_pixel(int x, int y, uint16_t color);
 
 /* Color definitions */
@@ -0,0 +1,61 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MANDEL_RENDER_H
+#define MANDEL_RENDER_H
+
+#include <stdint.h>
+
+/*
+ * Tiled Mandelbrot renderer shared by the mandelbrot examples.
+ *
+ * The escape-time kernel is single precision float by default, build
+ * with -DMANDEL_FIXED_POINT to use the Q5.26 fixed-point kernel instead
+ * (useful on parts without an FPU, and to compare the two).
+ *
+ * Iteration counts are 0 for points inside the set and 1..MANDEL_MAX_ITER-1
+ * for points that escape, exactly like the old per-example iterate().
+ */
+
+/* Maximum number of iterations for the escape-time calculation */
+#define MANDEL_MAX_ITER		32
+
+/* Tiles start at this size and are split down to MANDEL_MIN_TILE */
+#define MANDEL_TILE		32
+#define MANDEL_MIN_TILE		4
+
+/* Marks a pixel in the iteration buffer that has not been computed */
+#define MANDEL_UNKNOWN		0xff
+
+struct mandel_view {
+	float cx, cy;		/* point at the centre of the image */
+	float scale;		/* distance between two pixels */
+	int width, height;	/* image size in pixels */
+};
+
+/*
+ * Called to paint a w x h rectangle at (x, y) with the colour for
+ * 'iter'. Coarse previews are painted first and then overwritten
+ * as the tiles are refined.
+ */
+typedef void (*mandel_fill_fn)(int x, int y, int w, int h, int iter);
+
+int mandel_iterate(float px, float py);
+void mandel_render(const struct mandel_view *view, uint8_t *iter_buf,
+		   mandel_fill_fn fill);
+
+#endif
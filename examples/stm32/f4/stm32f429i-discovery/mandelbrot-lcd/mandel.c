@@ -30,6 +30,7 @@
 #include "clock.h"
 #include "sdram.h"
 #include "lcd.h"
+#include "mandel-render.h"
 
 /* utility functions */
 void uart_putc(char c);
@@ -58,8 +59,6 @@ static void gpio_setup(void)
 	usart_enable(USART1);
 }
 
-/* Maximum number of iterations for the escape-time calculation */
-#define max_iter 32
 uint16_t lcd_colors[] = {
 	0x0,
 	0x1f00,
@@ -102,41 +101,25 @@ uint16_t lcd_colors[] = {
 };
 
 
-static int iterate(float, float);
-/* Main mandelbrot calculation */
-static int iterate(float px, float py)
+/* Iteration counts of the frame being rendered */
+static uint8_t iters[LCD_WIDTH * LCD_HEIGHT];
+
+static void fill_rect(int x, int y, int w, int h, int iter)
 {
-	int it = 0;
-	float x = 0, y = 0;
-	while (it < max_iter) {
-		float nx = x*x;
-		float ny = y*y;
-		if ((nx + ny) > 4) {
-			return it;
+	int i, j;
+
+	for (j = y; j < y + h; j++) {
+		for (i = x; i < x + w; i++) {
+			lcd_draw_pixel(i, j, lcd_colors[iter]);
 		}
-		/* Zn+1 = Zn^2 + P */
-		y = 2*x*y + py;
-		x = nx - ny + px;
-		it++;
 	}
-	return 0;
 }
 
 void mandel(float cx, float cy, float scale)
 {
-	int x, y;
-	int change = 0;
-	for (x = -120; x < 120; x++) {
-		for (y = -160; y < 160; y++) {
-			int i = iterate(cx + x*scale, cy + y*scale);
-			if (i >= max_iter) {
-				i = max_iter;
-			} else {
-				change++;
-			}
-			lcd_draw_pixel(x+120, y+160, lcd_colors[i]);
-		}
-	}
+	struct mandel_view view = { cx, cy, scale, LCD_WIDTH, LCD_HEIGHT };
+
+	mandel_render(&view, iters, fill_rect);
 }
 
 int main(void)
@@ -22,6 +22,9 @@
 #include <libopencm3/stm32/rcc.h>
 #include <libopencm3/stm32/gpio.h>
 #include <libopencm3/stm32/f4/rng.h>
+#include <libopencm3/cm3/nvic.h>
+
+#include "entropy.h"
 
 static void rcc_setup(void)
 {
@@ -36,9 +39,11 @@ static void rcc_setup(void)
 
 static void rng_setup(void)
 {
-	/* Enable interupt */
-	/* Set the IE bit in the RNG_CR register. */
-	RNG_CR |= RNG_CR_IE;
+	entropy_init();
+
+	/* Each word is handed to the entropy pool from hash_rng_isr(). */
+	nvic_enable_irq(NVIC_HASH_RNG_IRQ);
+
 	/* Enable the random number generation by setting the RNGEN bit in
 	   the RNG_CR register. This activates the analog part, the RNG_LFSR
 	   and the error detector.
@@ -46,6 +51,36 @@ static void rng_setup(void)
 	RNG_CR |= RNG_CR_RNGEN;
 }
 
+/* Called by the entropy pool when it wants more words. */
+void entropy_request(void)
+{
+	/* Set the IE bit in the RNG_CR register. */
+	RNG_CR |= RNG_CR_IE;
+}
+
+void hash_rng_isr(void)
+{
+	uint32_t sr = RNG_SR;
+
+	if (sr & (RNG_SR_SEIS | RNG_SR_CEIS)) {
+		/* A seed error needs the generator restarted, see the
+		   reference manual. Either way the pool starts over.
+		*/
+		RNG_SR &= ~(RNG_SR_SEIS | RNG_SR_CEIS);
+		if (sr & RNG_SR_SEIS) {
+			RNG_CR &= ~RNG_CR_RNGEN;
+			RNG_CR |= RNG_CR_RNGEN;
+		}
+		entropy_source_error();
+		return;
+	}
+
+	if ((sr & RNG_SR_DRDY) && !entropy_add_word(RNG_DR)) {
+		/* Pool full, stay quiet until it has been used. */
+		RNG_CR &= ~RNG_CR_IE;
+	}
+}
+
 static void gpio_setup(void)
 {
 	/* Setup onboard led */
@@ -53,23 +88,17 @@ static void gpio_setup(void)
 			GPIO13 | GPIO14);
 }
 
-/* Tried to folow the guidelines in the stm32f4 user manual.*/
+/* Green shows the random bits, red that there are none to show. */
 static uint32_t random_int(void)
 {
-	static uint32_t last_value;
-	static uint32_t new_value;
-
-	uint32_t error_bits = 0;
-	error_bits = RNG_SR_SEIS | RNG_SR_CEIS;
-	while (new_value == last_value) {
-		/* Check for error flags and if data is ready. */
-		if (((RNG_SR & error_bits) == 0) &&
-		    ((RNG_SR & RNG_SR_DRDY) == 1)) {
-			new_value = RNG_DR;
-		}
+	uint32_t value = 0;
+
+	if (entropy_read(&value, sizeof(value)) != ENTROPY_OK) {
+		gpio_set(GPIOG, GPIO14);
+	} else {
+		gpio_clear(GPIOG, GPIO14);
 	}
-	last_value = new_value;
-	return new_value;
+	return value;
 }
 
 
@@ -0,0 +1,339 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/*
+ * Stress test for ring.h with both ends running at once.
+ *
+ * The interrupt runs have the shape of the console: a signal stands in
+ * for the USART interrupt and preempts the main loop, writing into one
+ * ring and reading from another while the main loop does the opposite.
+ * The thread run puts producer and consumer
+ * on two threads, which run truly in parallel when the host has more than
+ * one core (x86 keeps stores in order, like a single Cortex-M core).
+ *
+ * Each side uses every read or write call in random sizes, and the bytes
+ * follow a sequence the reader checks.  The indices start just below
+ * 2^32 so they wrap during the run.
+ */
+
+#define _DEFAULT_SOURCE		/* setitimer(), sigaction(), sched_yield() */
+
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <time.h>
+
+#include "ring.h"
+
+#define RING_SIZE	256
+#define RUN_BYTES	(4u << 20)
+
+static int failures;
+
+#define CHECK(cond, ...) do {						\
+	if (!(cond)) {							\
+		if (failures++ < 10) {					\
+			printf("FAIL %s:%d: ", __FILE__, __LINE__);	\
+			printf(__VA_ARGS__);				\
+			printf("\n");					\
+		}							\
+	}								\
+} while (0)
+
+/* A random number generator per side, so the sides don't share state. */
+static uint32_t rnd(uint32_t *state)
+{
+	*state ^= *state << 13;
+	*state ^= *state >> 17;
+	*state ^= *state << 5;
+	return *state;
+}
+
+/* Byte number i of a stream. */
+static uint8_t seq(uint32_t i)
+{
+	return (i * 2654435761u) >> 24;
+}
+
+struct side {
+	struct ring *ring;
+	uint32_t count;		/* bytes moved */
+	uint32_t rng;
+	uint32_t errors;
+};
+
+/* Start the indices so they wrap halfway through a run. */
+static void ring_start(struct ring *ring, uint8_t *buf, uint32_t bytes)
+{
+	ring_init(ring, buf, RING_SIZE);
+	ring->begin = ring->end = 0u - bytes / 2;
+}
+
+/* Write up to `max' bytes of the stream, with a random write call. */
+static uint32_t produce(struct side *s, uint32_t max)
+{
+	uint8_t buf[RING_SIZE];
+	uint32_t i, got, n = rnd(&s->rng) % (RING_SIZE / 2) + 1;
+
+	if (n > max)
+		n = max;
+
+	if (rnd(&s->rng) % 2) {
+		for (i = 0; i < n; i++)
+			buf[i] = seq(s->count + i);
+		got = ring_write(s->ring, buf, n);
+	} else {
+		for (got = 0; got < n; got++)
+			if (ring_write_ch(s->ring, seq(s->count + got)) < 0)
+				break;
+	}
+	s->count += got;
+	return got;
+}
+
+/* Read up to `max' bytes with a random read call and check them. */
+static uint32_t consume(struct side *s, uint32_t max)
+{
+	uint8_t buf[RING_SIZE], *p, ch;
+	uint32_t i, got = 0, n = rnd(&s->rng) % (RING_SIZE / 2) + 1;
+
+	if (n > max)
+		n = max;
+
+	switch (rnd(&s->rng) % 3) {
+	case 0:
+		got = ring_read(s->ring, buf, n);
+		p = buf;
+		break;
+	case 1:
+		got = ring_peek(s->ring, &p);
+		if (got > n)
+			got = n;
+		for (i = 0; i < got; i++)
+			buf[i] = p[i];
+		ring_skip(s->ring, got);
+		p = buf;
+		break;
+	default:
+		for (p = buf; got < n && ring_read_ch(s->ring, &ch) >= 0; got++)
+			buf[got] = ch;
+		break;
+	}
+
+	for (i = 0; i < got; i++)
+		s->errors += p[i] != seq(s->count + i);
+	s->count += got;
+	return got;
+}
+
+/*
+ * --- The interrupt runs ---
+ *
+ * The timer run lets the interrupt come every 20 us, wherever the main
+ * loop is.  On x86 the step run sets the trap flag so the CPU raises
+ * SIGTRAP after every instruction of the main loop, and the interrupt is
+ * taken at a random quarter of them: that reaches the one or two
+ * instruction windows the timer run would only hit by luck.
+ */
+
+#define STEP_BYTES	(16u << 10)
+
+static uint8_t rx_buf[RING_SIZE], tx_buf[RING_SIZE];
+static struct ring rx, tx;
+static struct side isr_rx, isr_tx, main_rx, main_tx;
+static uint32_t run_bytes, isr_rng;
+static volatile uint32_t interrupts;
+
+/* The "USART interrupt": receive a few bytes, send a few. */
+static void usart_isr(int sig)
+{
+	if (sig == SIGTRAP && rnd(&isr_rng) % 4)
+		return;
+	interrupts++;
+	produce(&isr_rx, run_bytes - isr_rx.count);
+	consume(&isr_tx, run_bytes - isr_tx.count);
+}
+
+#if defined(__x86_64__)
+#define HAVE_STEP	1
+/* Step over the red zone, the compiler may keep locals there. */
+#define EFLAGS_OP(op)	"lea -128(%%rsp), %%rsp; pushf; " op " (%%rsp); " \
+			"popf; lea 128(%%rsp), %%rsp"
+#elif defined(__i386__)
+#define HAVE_STEP	1
+#define EFLAGS_OP(op)	"pushf; " op " (%%esp); popf"
+#endif
+
+#if HAVE_STEP
+static void trap_flag(int on)
+{
+	if (on)
+		__asm__ volatile (EFLAGS_OP("orl $0x100,") ::: "memory", "cc");
+	else
+		__asm__ volatile (EFLAGS_OP("andl $~0x100,") ::: "memory", "cc");
+}
+#else
+#define HAVE_STEP	0
+static void trap_flag(int on)
+{
+	(void)on;
+}
+#endif
+
+static void interrupt_run(int step)
+{
+	struct itimerval it = { { 0, 20 }, { 0, 20 } };
+	struct sigaction sa;
+	clock_t start = clock();
+	double secs;
+
+	run_bytes = step ? STEP_BYTES : RUN_BYTES;
+	ring_start(&rx, rx_buf, run_bytes);
+	ring_start(&tx, tx_buf, run_bytes);
+	isr_rx = (struct side){ &rx, 0, 1, 0 };
+	isr_tx = (struct side){ &tx, 0, 2, 0 };
+	main_rx = (struct side){ &rx, 0, 3, 0 };
+	main_tx = (struct side){ &tx, 0, 4, 0 };
+	isr_rng = 5;
+	interrupts = 0;
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = usart_isr;
+	sigaction(step ? SIGTRAP : SIGALRM, &sa, NULL);
+	if (step)
+		trap_flag(1);
+	else
+		setitimer(ITIMER_REAL, &it, NULL);
+
+	while (main_rx.count < run_bytes || isr_tx.count < run_bytes) {
+		consume(&main_rx, run_bytes - main_rx.count);
+		produce(&main_tx, run_bytes - main_tx.count);
+	}
+
+	if (step) {
+		trap_flag(0);
+	} else {
+		memset(&it, 0, sizeof(it));
+		setitimer(ITIMER_REAL, &it, NULL);
+	}
+	secs = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+	CHECK(!main_rx.errors && !isr_tx.errors,
+	      "%s run: %u bytes wrong received, %u sent",
+	      step ? "step" : "timer", main_rx.errors, isr_tx.errors);
+	CHECK(rx.begin == rx.end && tx.begin == tx.end &&
+	      rx.end == run_bytes / 2,
+	      "%s run: rings not empty at the end", step ? "step" : "timer");
+	printf("%s: %u KB each way in %u interrupts, %.1f s\n",
+	       step ? "step   " : "timer  ", run_bytes >> 10, interrupts, secs);
+}
+
+/*
+ * --- The thread run ---
+ *
+ * A side that finds the ring full or empty yields, otherwise on a single
+ * core it would spin for its whole time slice.
+ */
+
+static uint8_t thread_buf[RING_SIZE];
+static struct ring thread_ring;
+static struct side producer = { &thread_ring, 0, 5, 0 };
+static struct side consumer = { &thread_ring, 0, 6, 0 };
+
+static void *producer_thread(void *arg)
+{
+	(void)arg;
+	while (producer.count < RUN_BYTES)
+		if (!produce(&producer, RUN_BYTES - producer.count))
+			sched_yield();
+	return NULL;
+}
+
+static void thread_run(void)
+{
+	struct timespec t0, t1;
+	pthread_t thread;
+	double secs;
+
+	ring_start(&thread_ring, thread_buf, RUN_BYTES);
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	pthread_create(&thread, NULL, producer_thread, NULL);
+	while (consumer.count < RUN_BYTES)
+		if (!consume(&consumer, RUN_BYTES - consumer.count))
+			sched_yield();
+	pthread_join(thread, NULL);
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	secs = t1.tv_sec - t0.tv_sec + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+
+	CHECK(!consumer.errors, "thread run: %u bytes wrong",
+	      consumer.errors);
+	printf("threads: %u KB in %.2f s, %.0f MB/s\n", RUN_BYTES >> 10, secs,
+	       (RUN_BYTES >> 20) / secs);
+}
+
+/* --- Without a second side --- */
+
+static void edge_cases(void)
+{
+	uint8_t buf[RING_SIZE], data[RING_SIZE + 1], *p;
+	struct ring r;
+	uint32_t i;
+
+	ring_init(&r, buf, RING_SIZE);
+	r.begin = r.end = 0xffffffff - 10;
+
+	/* Every byte of the buffer can be used. */
+	for (i = 0; i <= RING_SIZE; i++)
+		data[i] = i;
+	CHECK(ring_write(&r, data, RING_SIZE + 1) == RING_SIZE &&
+	      ring_used(&r) == RING_SIZE && ring_free(&r) == 0,
+	      "full ring");
+	CHECK(ring_write_ch(&r, 0) == -1, "write to a full ring");
+
+	/* peek stops at the end of the buffer. */
+	CHECK(ring_peek(&r, &p) == 11 && p == buf + RING_SIZE - 11,
+	      "peek before the wrap");
+	ring_skip(&r, 11);
+	CHECK(ring_peek(&r, &p) == RING_SIZE - 11 && p == buf &&
+	      p[0] == 11, "peek after the wrap");
+
+	CHECK(ring_read(&r, data, RING_SIZE) == RING_SIZE - 11 &&
+	      data[0] == 11 && ring_used(&r) == 0, "read the rest");
+	CHECK(ring_read_ch(&r, NULL) == -1 && ring_peek(&r, &p) == 0,
+	      "read from an empty ring");
+}
+
+int main(void)
+{
+	edge_cases();
+	interrupt_run(0);
+	if (HAVE_STEP)
+		interrupt_run(1);
+	thread_run();
+
+	if (failures) {
+		printf("%d failures\n", failures);
+		return EXIT_FAILURE;
+	}
+	printf("all passed\n");
+	return EXIT_SUCCESS;
+}
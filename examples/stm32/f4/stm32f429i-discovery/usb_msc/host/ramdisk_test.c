@@ -0,0 +1,692 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/*
+ * Host test for ramdisk.c and the FAT volume it generates.
+ *
+ * The whole disk is read out through ramdisk_read_blocks() into an image
+ * file, the way the USB host sees it.  Every file is written with random
+ * data, in runs of random length through both the block and the sector
+ * calls, and the image is read out again and compared with the memory
+ * behind the files.
+ *
+ * The image is then checked the way fsck.fat would: boot sector fields,
+ * FAT type from the cluster count, both FAT copies equal, directory
+ * entries, every chain the length of its file, no cross-linked or lost
+ * clusters.  The files are read through their chains, written through
+ * them, and read back.  Writes to the metadata must change nothing,
+ * single sector and multi-block reads must agree, and requests past the
+ * end must fail.  Then the throughput of each kind of request is
+ * measured.
+ *
+ * The Makefile builds this once per disk layout and, when fsck.fat or
+ * mtools are installed, runs them on the images too.
+ */
+
+#define _DEFAULT_SOURCE		/* MAP_ANONYMOUS */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+
+#include "ramdisk.c"
+
+static int failures;
+
+#define CHECK(cond, ...) do {						\
+	if (!(cond)) {							\
+		if (failures++ < 10) {					\
+			printf("FAIL %s:%d: ", __FILE__, __LINE__);	\
+			printf(__VA_ARGS__);				\
+			printf("\n");					\
+		}							\
+	}								\
+} while (0)
+
+static uint32_t rng_state = 1;
+
+static uint32_t rnd(void)
+{
+	rng_state ^= rng_state << 13;
+	rng_state ^= rng_state >> 17;
+	rng_state ^= rng_state << 5;
+	return rng_state;
+}
+
+#ifdef RAMDISK_SDRAM
+/* Room for the largest layout the Makefile builds, and a guard after it */
+#define SDRAM_MAP_SIZE	(64u << 20)
+#define DISK_END	(FILEDATA_SIZE + LOGDATA_SIZE)
+
+void sdram_init(void)
+{
+}
+
+static void map_sdram(void)
+{
+	void *p = mmap(SDRAM_BASE_ADDRESS, SDRAM_MAP_SIZE,
+		       PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+		       -1, 0);
+
+	if (p != SDRAM_BASE_ADDRESS || DISK_END + 4096 > SDRAM_MAP_SIZE) {
+		printf("can't map the SDRAM at %p\n", SDRAM_BASE_ADDRESS);
+		exit(EXIT_FAILURE);
+	}
+	memset(SDRAM_BASE_ADDRESS + DISK_END, 0xA5, 4096);
+}
+
+static int guard_intact(void)
+{
+	uint32_t i;
+
+	for (i = 0; i < 4096; i++)
+		if (SDRAM_BASE_ADDRESS[DISK_END + i] != 0xA5)
+			return 0;
+	return 1;
+}
+#else
+static void map_sdram(void)
+{
+}
+
+static int guard_intact(void)
+{
+	return 1;
+}
+#endif
+
+/* --- The image file --- */
+
+static FILE *image;
+
+static int image_read(uint32_t lba, uint8_t *buf, uint32_t count)
+{
+	if (fseek(image, (long)lba * SECTOR_SIZE, SEEK_SET) ||
+	    fread(buf, SECTOR_SIZE, count, image) != count)
+		return -1;
+	return 0;
+}
+
+/* Read the disk out the way the USB host would, in 64 sector requests. */
+static void dump_image(const char *path)
+{
+	static uint8_t buf[64 * SECTOR_SIZE];
+	uint32_t lba, n, total = ramdisk_blocks();
+
+	image = fopen(path, "w+b");
+	if (!image) {
+		perror(path);
+		exit(EXIT_FAILURE);
+	}
+	for (lba = 0; lba < total; lba += n) {
+		n = total - lba < 64 ? total - lba : 64;
+		CHECK(ramdisk_read_blocks(lba, buf, n) == 0, "read %u", lba);
+		fwrite(buf, SECTOR_SIZE, n, image);
+	}
+	fflush(image);
+}
+
+/* --- The checker --- */
+
+typedef int (*read_fn)(uint32_t lba, uint8_t *buf, uint32_t count);
+
+struct fat {
+	uint32_t sectors_per_cluster, reserved, fats, root_entries;
+	uint32_t sectors, sectors_per_fat, root_sector, data_sector;
+	uint32_t clusters, fat16, cluster_size;
+	uint8_t media;
+	uint8_t *table;			/* the first FAT copy */
+	uint8_t *used;			/* clusters reached from a file */
+};
+
+static uint16_t get16(const uint8_t *p)
+{
+	return p[0] | (p[1] << 8);
+}
+
+static uint32_t get32(const uint8_t *p)
+{
+	return get16(p) | ((uint32_t)get16(p + 2) << 16);
+}
+
+static uint32_t fat_get(const struct fat *f, uint32_t n)
+{
+	const uint8_t *p;
+
+	if (f->fat16)
+		return get16(f->table + 2 * n);
+	p = f->table + n * 3 / 2;
+	return n & 1 ? get16(p) >> 4 : get16(p) & 0xFFF;
+}
+
+static int fat_eoc(const struct fat *f, uint32_t e)
+{
+	return e >= (f->fat16 ? 0xFFF8u : 0xFF8u);
+}
+
+static int check_boot(struct fat *f, const uint8_t *s)
+{
+	uint32_t spc = s[13];
+
+	CHECK((s[0] == 0xEB && s[2] == 0x90) || s[0] == 0xE9,
+	      "boot: no jump");
+	CHECK(s[510] == 0x55 && s[511] == 0xAA, "boot: no signature");
+	CHECK(get16(s + 11) == SECTOR_SIZE, "boot: %u bytes per sector",
+	      get16(s + 11));
+	CHECK(spc && !(spc & (spc - 1)), "boot: %u sectors per cluster", spc);
+
+	f->sectors_per_cluster = spc;
+	f->cluster_size = spc * SECTOR_SIZE;
+	f->reserved = get16(s + 14);
+	f->fats = s[16];
+	f->root_entries = get16(s + 17);
+	f->sectors = get16(s + 19) ? get16(s + 19) : get32(s + 32);
+	f->media = s[21];
+	f->sectors_per_fat = get16(s + 22);
+
+	CHECK(f->reserved >= 1 && f->fats >= 1 && f->sectors_per_fat,
+	      "boot: %u reserved, %u FATs of %u sectors", f->reserved,
+	      f->fats, f->sectors_per_fat);
+	CHECK(f->root_entries && (f->root_entries * 32) % SECTOR_SIZE == 0,
+	      "boot: %u root entries", f->root_entries);
+	CHECK(!get16(s + 19) != !get32(s + 32),
+	      "boot: both or neither sector counts set");
+	CHECK(get16(s + 19) || f->sectors >= 0x10000,
+	      "boot: 32 bit sector count for a small disk");
+	CHECK(f->media == 0xF0 || f->media >= 0xF8, "boot: media %02x",
+	      f->media);
+	if (failures)
+		return -1;
+
+	f->root_sector = f->reserved + f->fats * f->sectors_per_fat;
+	f->data_sector = f->root_sector + f->root_entries * 32 / SECTOR_SIZE;
+	CHECK(f->data_sector < f->sectors, "boot: no data area");
+	if (failures)
+		return -1;
+
+	/* The type follows from the cluster count alone */
+	f->clusters = (f->sectors - f->data_sector) / spc;
+	f->fat16 = f->clusters >= 4085;
+	CHECK(f->clusters < 65525, "boot: %u clusters is FAT32",
+	      f->clusters);
+	CHECK(s[38] != 0x29 || !memcmp(s + 54, f->fat16 ? "FAT16   " :
+				       "FAT12   ", 8),
+	      "boot: %u clusters but labelled %.8s", f->clusters, s + 54);
+	CHECK(f->sectors_per_fat * SECTOR_SIZE * 8 / (f->fat16 ? 16 : 12) >=
+	      f->clusters + 2, "boot: FAT too small for %u clusters",
+	      f->clusters);
+	return failures ? -1 : 0;
+}
+
+static int check_name(const uint8_t *d)
+{
+	static const char ok[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789"
+				 "$%'-_@~`!(){}^#& ";
+	int i;
+
+	if (d[0] == ' ')
+		return 0;
+	for (i = 0; i < 11; i++)
+		if (!d[i] || !strchr(ok, d[i]))
+			return 0;
+	return 1;
+}
+
+/* Follow a file's chain, return its length in clusters or -1. */
+static int check_chain(struct fat *f, const uint8_t *d)
+{
+	uint32_t c = get16(d + 26), n = 0, limit = f->clusters + 2;
+
+	if (c == 0)
+		return 0;
+	while (1) {
+		CHECK(c >= 2 && c < limit, "%.11s: cluster %u out of range",
+		      d, c);
+		if (c < 2 || c >= limit)
+			return -1;
+		CHECK(!f->used[c], "%.11s: cluster %u cross-linked", d, c);
+		if (f->used[c])
+			return -1;
+		f->used[c] = 1;
+		n++;
+		c = fat_get(f, c);
+		if (fat_eoc(f, c))
+			return n;
+		CHECK(c != 0 && c != (f->fat16 ? 0xFFF7u : 0xFF7u),
+		      "%.11s: chain runs into a free or bad cluster", d);
+		if (c == 0 || c == (f->fat16 ? 0xFFF7u : 0xFF7u))
+			return -1;
+	}
+}
+
+/*
+ * Check the volume on 'rd'.  Fills 'f', the caller frees f->table.
+ * Returns the number of files found.
+ */
+static int fsck(read_fn rd, struct fat *f)
+{
+	uint8_t sector[SECTOR_SIZE], *copy;
+	uint32_t i, c, fat_bytes, files_found = 0, lost = 0;
+	const uint8_t *d;
+	char names[ROOT_ENTRIES][11];
+	int n;
+
+	memset(f, 0, sizeof(*f));
+	CHECK(rd(0, sector, 1) == 0, "can't read the boot sector");
+	if (check_boot(f, sector))
+		return -1;
+
+	fat_bytes = f->sectors_per_fat * SECTOR_SIZE;
+	f->table = malloc(fat_bytes);
+	copy = malloc(fat_bytes);
+	f->used = calloc(f->clusters + 2, 1);
+	rd(f->reserved, f->table, f->sectors_per_fat);
+	for (i = 1; i < f->fats; i++) {
+		rd(f->reserved + i * f->sectors_per_fat, copy,
+		   f->sectors_per_fat);
+		CHECK(!memcmp(f->table, copy, fat_bytes), "FAT copy %u differs",
+		      i);
+	}
+	free(copy);
+
+	CHECK((fat_get(f, 0) & 0xFF) == f->media &&
+	      (fat_get(f, 0) | 0xFF) == (f->fat16 ? 0xFFFFu : 0xFFFu),
+	      "FAT[0] is %x", fat_get(f, 0));
+	CHECK(fat_eoc(f, fat_get(f, 1)), "FAT[1] is %x", fat_get(f, 1));
+
+	for (i = 0; i < f->root_entries; i++) {
+		if (i % (SECTOR_SIZE / 32) == 0)
+			rd(f->root_sector + i / (SECTOR_SIZE / 32), sector, 1);
+		d = sector + (i % (SECTOR_SIZE / 32)) * 32;
+		if (d[0] == 0)
+			break;
+		if (d[0] == 0xE5)
+			continue;
+		CHECK(check_name(d), "entry %u: bad name %.11s", i, d);
+		CHECK(!(d[11] & 0xD8), "%.11s: attributes %02x", d, d[11]);
+		for (c = 0; c < files_found; c++)
+			CHECK(memcmp(names[c], d, 11), "%.11s twice", d);
+		if (files_found < ROOT_ENTRIES)
+			memcpy(names[files_found], d, 11);
+		files_found++;
+
+		n = check_chain(f, d);
+		if (n >= 0)
+			CHECK((uint32_t)n == (get32(d + 28) + f->cluster_size - 1) /
+			      f->cluster_size,
+			      "%.11s: %u bytes in %d clusters", d,
+			      get32(d + 28), n);
+	}
+
+	for (c = 2; c < f->clusters + 2; c++)
+		lost += fat_get(f, c) != 0 && !f->used[c];
+	CHECK(!lost, "%u lost clusters", lost);
+	for (c = f->clusters + 2; c < fat_bytes * 8 / (f->fat16 ? 16 : 12);
+	     c++)
+		CHECK(fat_get(f, c) == 0, "FAT entry %u past the end is %x", c,
+		      fat_get(f, c));
+	free(f->used);
+	f->used = NULL;
+	return files_found;
+}
+
+/* Find a file's directory entry, returns 0 if it is there. */
+static int lookup(read_fn rd, const struct fat *f, const char *name,
+		  uint32_t *cluster, uint32_t *size)
+{
+	uint8_t sector[SECTOR_SIZE];
+	uint32_t i;
+	const uint8_t *d;
+
+	for (i = 0; i < f->root_entries; i++) {
+		if (i % (SECTOR_SIZE / 32) == 0)
+			rd(f->root_sector + i / (SECTOR_SIZE / 32), sector, 1);
+		d = sector + (i % (SECTOR_SIZE / 32)) * 32;
+		if (!memcmp(d, name, 11)) {
+			*cluster = get16(d + 26);
+			*size = get32(d + 28);
+			return 0;
+		}
+	}
+	return -1;
+}
+
+/* Read or write a whole file through its chain, a cluster at a time. */
+static void file_io(read_fn rd, const struct fat *f, const char *name,
+		    uint8_t *buf, int write)
+{
+	static uint8_t cluster_buf[SECTORS_PER_CLUSTER * SECTOR_SIZE];
+	uint32_t c, size, pos, n, lba, k;
+
+	CHECK(lookup(rd, f, name, &c, &size) == 0, "%.11s not found", name);
+	for (pos = 0; pos < size; pos += n, c = fat_get(f, c)) {
+		lba = f->data_sector + (c - 2) * f->sectors_per_cluster;
+		n = size - pos < f->cluster_size ? size - pos : f->cluster_size;
+		if (!write) {
+			rd(lba, cluster_buf, f->sectors_per_cluster);
+			memcpy(buf + pos, cluster_buf, n);
+			/* the slack after the end of the file reads as 0 */
+			for (k = n; k < f->cluster_size; k++)
+				if (cluster_buf[k])
+					break;
+			CHECK(k == f->cluster_size, "%.11s: data in the slack",
+			      name);
+			continue;
+		}
+
+		/* what a host writes past the end is undefined */
+		memset(cluster_buf, rnd(), sizeof(cluster_buf));
+		memcpy(cluster_buf, buf + pos, n);
+		/* alternate between the block and sector calls */
+		if (rnd() % 2) {
+			ramdisk_write_blocks(lba, cluster_buf,
+					     f->sectors_per_cluster);
+		} else {
+			for (k = 0; k < f->sectors_per_cluster; k++)
+				ramdisk_write(lba + k,
+					      cluster_buf + k * SECTOR_SIZE);
+		}
+	}
+}
+
+/* --- The tests --- */
+
+static const char *image_path;
+static struct fat fat;
+
+/* First sector of file 'i' */
+static uint32_t file_lba(uint32_t i)
+{
+	return vol.data_sector +
+	       (vol.first_cluster[i] - 2) * SECTORS_PER_CLUSTER;
+}
+
+/* The image holds each file's contents, and zeros after the end. */
+static void check_image(const char *when)
+{
+	static uint8_t sector[SECTOR_SIZE];
+	uint32_t i, pos, n, k;
+
+	for (i = 0; i < FILE_COUNT; i++) {
+		for (pos = 0; pos < files[i].size; pos += n) {
+			image_read(file_lba(i) + pos / SECTOR_SIZE, sector, 1);
+			n = files[i].size - pos < SECTOR_SIZE ?
+			    files[i].size - pos : SECTOR_SIZE;
+			CHECK(!memcmp(sector, files[i].data + pos, n),
+			      "%s: %.11s differs at %u", when, files[i].name,
+			      pos);
+			for (k = n; k < SECTOR_SIZE && !sector[k]; k++)
+				;
+			CHECK(k == SECTOR_SIZE, "%s: %.11s: data in the slack",
+			      when, files[i].name);
+		}
+	}
+}
+
+/* Write random data over every file, in runs of random length. */
+static void write_files(void)
+{
+	static uint8_t buf[64 * SECTOR_SIZE];
+	uint32_t i, k, lba, end, n;
+	uint8_t *expect;
+
+	for (i = 0; i < FILE_COUNT; i++) {
+		expect = malloc(files[i].size + 64 * SECTOR_SIZE);
+		lba = file_lba(i);
+		end = lba + (files[i].size + SECTOR_SIZE - 1) / SECTOR_SIZE;
+		for (; lba < end; lba += n) {
+			n = rnd() % 64 + 1;
+			if (n > end - lba)
+				n = end - lba;
+			for (k = 0; k < n * SECTOR_SIZE; k++)
+				buf[k] = rnd();
+			memcpy(expect + (lba - file_lba(i)) * SECTOR_SIZE, buf,
+			       n * SECTOR_SIZE);
+			if (rnd() % 2) {
+				CHECK(ramdisk_write_blocks(lba, buf, n) == 0,
+				      "write %u+%u", lba, n);
+			} else {
+				for (k = 0; k < n; k++)
+					ramdisk_write(lba + k,
+						      buf + k * SECTOR_SIZE);
+			}
+		}
+		CHECK(!memcmp(expect, files[i].data, files[i].size),
+		      "%.11s not written", files[i].name);
+		free(expect);
+	}
+	CHECK(guard_intact(), "write ran past the last file");
+}
+
+static void round_trip(void)
+{
+	dump_image(image_path);
+	check_image("first image");
+	write_files();
+	fclose(image);
+	dump_image(image_path);
+	check_image("after writing");
+}
+
+/* Check the image after round_trip(), then go through the chains. */
+static void check_volume(void)
+{
+	uint8_t *buf;
+	uint32_t i, j, size = 0;
+
+	CHECK(fsck(image_read, &fat) == (int)FILE_COUNT,
+	      "%u files expected", (unsigned)FILE_COUNT);
+	if (failures)
+		return;
+
+	for (i = 0; i < FILE_COUNT; i++)
+		if (files[i].size > size)
+			size = files[i].size;
+	buf = malloc(size);
+
+	/* Contents, through the image */
+	for (i = 0; i < FILE_COUNT; i++) {
+		file_io(image_read, &fat, files[i].name, buf, 0);
+		CHECK(!memcmp(buf, files[i].data, files[i].size),
+		      "%.11s differs from its memory", files[i].name);
+	}
+
+	/* Write random contents to each file, through the disk */
+	for (i = 0; i < FILE_COUNT; i++) {
+		for (j = 0; j < files[i].size; j++)
+			buf[j] = rnd();
+		file_io(ramdisk_read_blocks, &fat, files[i].name, buf, 1);
+		CHECK(!memcmp(buf, files[i].data, files[i].size),
+		      "%.11s not written", files[i].name);
+	}
+	CHECK(guard_intact(), "write ran past the last file");
+
+	/* and read them back through a new image */
+	fclose(image);
+	dump_image(image_path);
+	free(fat.table);
+	CHECK(fsck(image_read, &fat) == (int)FILE_COUNT, "after writing");
+	for (i = 0; i < FILE_COUNT && !failures; i++) {
+		file_io(image_read, &fat, files[i].name, buf, 0);
+		CHECK(!memcmp(buf, files[i].data, files[i].size),
+		      "%.11s differs after writing", files[i].name);
+	}
+	free(buf);
+}
+
+/* FNV-1a over the contents of all files */
+static uint32_t files_hash(void)
+{
+	uint32_t i, j, h = 2166136261u;
+
+	for (i = 0; i < FILE_COUNT; i++)
+		for (j = 0; j < files[i].size; j++)
+			h = (h ^ files[i].data[j]) * 16777619u;
+	return h;
+}
+
+/* Writes to the boot sector, FATs and directory are dropped. */
+static void metadata_writes(void)
+{
+	uint8_t before[SECTOR_SIZE], after[SECTOR_SIZE], junk[SECTOR_SIZE];
+	uint32_t lba, hash = files_hash();
+
+	for (lba = 0; lba < vol.data_sector; lba++) {
+		ramdisk_read(lba, before);
+		memset(junk, rnd(), sizeof(junk));
+		CHECK(ramdisk_write(lba, junk) == 0, "write %u", lba);
+		ramdisk_read(lba, after);
+		CHECK(!memcmp(before, after, SECTOR_SIZE),
+		      "sector %u changed", lba);
+	}
+	CHECK(files_hash() == hash, "metadata writes changed a file");
+}
+
+/* Single sector and multi-block reads give the same bytes. */
+static void single_vs_multi(void)
+{
+	uint8_t one[SECTOR_SIZE], run[8 * SECTOR_SIZE];
+	uint32_t i, j, lba, n, total = ramdisk_blocks();
+	uint32_t head = vol.data_sector + 256 < total ? vol.data_sector + 256 :
+			total;
+
+	for (i = 0; i < 20000; i++) {
+		/* half of them around the metadata and the first files */
+		lba = rnd() % (i % 2 ? total : head);
+		n = rnd() % 8 + 1;
+		if (n > total - lba)
+			n = total - lba;
+		ramdisk_read_blocks(lba, run, n);
+		for (j = 0; j < n; j++) {
+			ramdisk_read(lba + j, one);
+			CHECK(!memcmp(one, run + j * SECTOR_SIZE, SECTOR_SIZE),
+			      "sector %u differs in a run", lba + j);
+		}
+	}
+}
+
+static void out_of_range(void)
+{
+	uint8_t buf[2 * SECTOR_SIZE];
+	uint32_t total = ramdisk_blocks();
+
+	CHECK(ramdisk_read_blocks(total, buf, 1) == -1 &&
+	      ramdisk_write_blocks(total, buf, 1) == -1 &&
+	      ramdisk_read_blocks(total - 1, buf, 2) == -1 &&
+	      ramdisk_read_blocks(total - 1, buf, 1) == 0 &&
+	      ramdisk_write_blocks(total - 1, buf, 0xffffffff) == -1,
+	      "requests past the end");
+}
+
+/* Each case moves at least this much, so small disks are timed too */
+#define BENCH_BYTES	(64u << 20)
+
+enum bench {
+	SEQ_READ_RUN, SEQ_READ, SEQ_WRITE_RUN, RANDOM_READ, RANDOM_WRITE,
+	METADATA_READ,
+};
+
+static const char *const bench_names[] = {
+	"sequential read, 64 sectors",
+	"sequential read, 1 sector",
+	"sequential write, 64 sectors",
+	"random read",
+	"random write",
+	"FAT and directory read",
+};
+
+/* MB/s for one kind of request */
+static double bench(enum bench b)
+{
+	static uint8_t buf[64 * SECTOR_SIZE];
+	uint32_t total = ramdisk_blocks(), data = total - vol.data_sector;
+	uint32_t moved = 0, pos = 0, n;
+	clock_t start = clock();
+
+	while (moved < BENCH_BYTES) {
+		switch (b) {
+		case SEQ_READ_RUN:
+			n = total - pos < 64 ? total - pos : 64;
+			ramdisk_read_blocks(pos, buf, n);
+			pos = (pos + n) % total;
+			break;
+		case SEQ_READ:
+			n = 1;
+			ramdisk_read(pos, buf);
+			pos = (pos + 1) % total;
+			break;
+		case SEQ_WRITE_RUN:
+			n = data - pos < 64 ? data - pos : 64;
+			ramdisk_write_blocks(vol.data_sector + pos, buf, n);
+			pos = (pos + n) % data;
+			break;
+		case RANDOM_READ:
+			n = 1;
+			ramdisk_read(rnd() % total, buf);
+			break;
+		case RANDOM_WRITE:
+			n = 1;
+			ramdisk_write(vol.data_sector + rnd() % data, buf);
+			break;
+		default:
+			n = 1;
+			ramdisk_read(1 + rnd() % (vol.data_sector - 1), buf);
+			break;
+		}
+		moved += n * SECTOR_SIZE;
+	}
+	return moved / 1e6 / ((double)(clock() - start) / CLOCKS_PER_SEC);
+}
+
+static void throughput(void)
+{
+	int b;
+
+	for (b = SEQ_READ_RUN; b <= METADATA_READ; b++)
+		printf("  %-30s %6.0f MB/s\n", bench_names[b],
+		       bench((enum bench)b));
+}
+
+int main(int argc, char **argv)
+{
+	image_path = argc > 1 ? argv[1] : "ramdisk.img";
+
+	map_sdram();
+	ramdisk_init();
+	printf("%s: %u sectors, %u clusters, FAT%s, %u files\n", image_path,
+	       ramdisk_blocks(), vol.clusters, vol.fat16 ? "16" : "12",
+	       (unsigned)FILE_COUNT);
+
+	round_trip();
+	check_volume();
+	metadata_writes();
+	single_vs_multi();
+	out_of_range();
+	if (!failures)
+		throughput();
+	fclose(image);
+
+	if (failures) {
+		printf("%d failures\n", failures);
+		return EXIT_FAILURE;
+	}
+	printf("all passed\n");
+	return EXIT_SUCCESS;
+}
@@ -20,165 +20,352 @@
 
 #include <string.h>
 #include "ramdisk.h"
+#ifdef RAMDISK_SDRAM
+#include "sdram.h"
+#endif
 
-#define WBVAL(x) ((x) & 0xFF), (((x) >> 8) & 0xFF)
-#define QBVAL(x) ((x) & 0xFF), (((x) >> 8) & 0xFF), \
-		 (((x) >> 16) & 0xFF), (((x) >> 24) & 0xFF)
+/*
+ * The exported volume is generated, not stored. Only the file contents
+ * live in memory; the boot sector, both FAT copies and the root
+ * directory are synthesized from the file table below whenever the
+ * host reads them, so exporting a multi-megabyte file costs no RAM
+ * for metadata.
+ *
+ * Every file gets a contiguous run of clusters, in table order,
+ * starting at cluster 2. The volume is FAT12 or FAT16 depending on
+ * how many clusters that adds up to. The host may rewrite the
+ * contents of the files in place; writes to the metadata (creating,
+ * renaming or growing files) are ignored as there is nowhere to keep
+ * them.
+ */
 
-/* filesystem size is 512kB (1024 * SECTOR_SIZE) */
-#define SECTOR_COUNT		1024
 #define SECTOR_SIZE		512
-#define BYTES_PER_SECTOR	512
-#define SECTORS_PER_CLUSTER	4
+#define SECTORS_PER_CLUSTER	8
+#define CLUSTER_SIZE		(SECTORS_PER_CLUSTER * SECTOR_SIZE)
 #define RESERVED_SECTORS	1
 #define FAT_COPIES		2
-#define ROOT_ENTRIES		512
+#define ROOT_ENTRIES		64
 #define ROOT_ENTRY_LENGTH	32
-#define FILEDATA_START_CLUSTER	3
-#define DATA_REGION_SECTOR	(RESERVED_SECTORS + FAT_COPIES + \
-			(ROOT_ENTRIES * ROOT_ENTRY_LENGTH) / BYTES_PER_SECTOR)
-#define FILEDATA_START_SECTOR	(DATA_REGION_SECTOR + \
-			(FILEDATA_START_CLUSTER - 2) * SECTORS_PER_CLUSTER)
+#define ROOT_SECTORS		((ROOT_ENTRIES * ROOT_ENTRY_LENGTH) / \
+				 SECTOR_SIZE)
+/* FAT12 can address at most 4084 clusters, beyond that it is FAT16 */
+#define FAT12_MAX_CLUSTERS	4084
+
+#ifdef RAMDISK_SDRAM
+#ifndef LOGDATA_SIZE
+#define LOGDATA_SIZE		(4 * 1024 * 1024)
+#endif
+#define FILEDATA		SDRAM_BASE_ADDRESS
+#define LOGDATA			(SDRAM_BASE_ADDRESS + FILEDATA_SIZE)
+#endif
 
 /* filesize is 64kB (128 * SECTOR_SIZE) */
-#define FILEDATA_SECTOR_COUNT	128
-
-uint8_t BootSector[] = {
-	0xEB, 0x3C, 0x90,		/* code to jump to the bootstrap code */
-	'm', 'k', 'd', 'o', 's', 'f', 's', 0x00, /* OEM ID */
-	WBVAL(BYTES_PER_SECTOR),	/* bytes per sector */
-	SECTORS_PER_CLUSTER,		/* sectors per cluster */
-	WBVAL(RESERVED_SECTORS),	/* # of reserved sectors (1 boot sector) */
-	FAT_COPIES,			/* FAT copies (2) */
-	WBVAL(ROOT_ENTRIES),		/* root entries (512) */
-	WBVAL(SECTOR_COUNT),		/* total number of sectors */
-	0xF8,				/* media descriptor (0xF8 = Fixed disk) */
-	0x01, 0x00,			/* sectors per FAT (1) */
-	0x20, 0x00,			/* sectors per track (32) */
-	0x40, 0x00,			/* number of heads (64) */
-	0x00, 0x00, 0x00, 0x00,		/* hidden sectors (0) */
-	0x00, 0x00, 0x00, 0x00,		/* large number of sectors (0) */
-	0x00,				/* drive number (0) */
-	0x00,				/* reserved */
-	0x29,				/* extended boot signature */
-	0x69, 0x17, 0xAD, 0x53,		/* volume serial number */
-	'R', 'A', 'M', 'D', 'I', 'S', 'K', ' ', ' ', ' ', ' ', /* volume label */
-	'F', 'A', 'T', '1', '2', ' ', ' ', ' '	/* filesystem type */
-};
+#define FILEDATA_SIZE		(128 * SECTOR_SIZE)
 
-uint8_t FatSector[] = {
-	0xF8, 0xFF, 0xFF, 0x00, 0x40, 0x00, 0x05, 0x60, 0x00, 0x07, 0x80, 0x00,
-	0x09, 0xA0, 0x00, 0x0B, 0xC0, 0x00, 0x0D, 0xE0, 0x00, 0x0F, 0x00, 0x01,
-	0x11, 0x20, 0x01, 0x13, 0x40, 0x01, 0x15, 0x60, 0x01, 0x17, 0x80, 0x01,
-	0x19, 0xA0, 0x01, 0x1B, 0xC0, 0x01, 0x1D, 0xE0, 0x01, 0x1F, 0x00, 0x02,
-	0x21, 0x20, 0x02, 0x23, 0x40, 0x02, 0x25, 0x60, 0x02, 0x27, 0x80, 0x02,
-	0x29, 0xA0, 0x02, 0x2B, 0xC0, 0x02, 0x2D, 0xE0, 0x02, 0x2F, 0x00, 0x03,
-	0x31, 0x20, 0x03, 0x33, 0x40, 0x03, 0x35, 0x60, 0x03, 0x37, 0x80, 0x03,
-	0x39, 0xA0, 0x03, 0x3B, 0xC0, 0x03, 0x3D, 0xE0, 0x03, 0x3F, 0x00, 0x04,
-	0x41, 0x20, 0x04, 0x43, 0x40, 0x04, 0x45, 0x60, 0x04, 0x47, 0x80, 0x04,
-	0x49, 0xA0, 0x04, 0x4B, 0xC0, 0x04, 0x4D, 0xE0, 0x04, 0x4F, 0x00, 0x05,
-	0x51, 0x20, 0x05, 0x53, 0x40, 0x05, 0x55, 0x60, 0x05, 0x57, 0x80, 0x05,
-	0x59, 0xA0, 0x05, 0x5B, 0xC0, 0x05, 0x5D, 0xE0, 0x05, 0x5F, 0x00, 0x06,
-	0x61, 0x20, 0x06, 0x63, 0x40, 0x06, 0x65, 0x60, 0x06, 0x67, 0x80, 0x06,
-	0x69, 0xA0, 0x06, 0x6B, 0xC0, 0x06, 0x6D, 0xE0, 0x06, 0x6F, 0x00, 0x07,
-	0x71, 0x20, 0x07, 0x73, 0x40, 0x07, 0x75, 0x60, 0x07, 0x77, 0x80, 0x07,
-	0x79, 0xA0, 0x07, 0x7B, 0xC0, 0x07, 0x7D, 0xE0, 0x07, 0x7F, 0x00, 0x08,
-	0x81, 0x20, 0x08, 0xFF, 0x0F, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-	0x00, 0x00, 0x00, 0x00
+#ifndef RAMDISK_SDRAM
+static uint8_t filedata[FILEDATA_SIZE];
+#define FILEDATA		filedata
+#endif
+
+struct ramdisk_file {
+	char name[11] __attribute__((nonstring));	/* 8.3, space padded */
+	uint32_t size;		/* in bytes */
+	uint8_t *data;
 };
 
-uint8_t DirSector[] = {
-	/* long filename entry */
-	0x41,						/* sequence number */
-	WBVAL('r'), WBVAL('a'), WBVAL('m'), WBVAL('d'), WBVAL('i'), /* five name characters in UTF-16 */
-	0x0F,						/* attributes */
-	0x00,						/* type */
-	0x00,						/* checksum of DOS filename (computed in ramdisk_init) */
-	WBVAL('s'), WBVAL('k'), WBVAL('.'), WBVAL('d'), WBVAL('a'), WBVAL('t'),	/* six name characters in UTF-16 */
-	0x00, 0x00,					/* first cluster */
-	WBVAL(0), WBVAL(0),				/* two name characters in UTF-16 */
-	/* actual entry */
-	'R', 'A', 'M', 'D', 'I', 'S', 'K', ' ',		/* filename */
-	'D', 'A', 'T',					/* extension */
-	0x20,						/* attribute byte */
-	0x00,						/* reserved for Windows NT */
-	0x00,						/* creation millisecond */
-	0xCE, 0x01,					/* creation time */
-	0x86, 0x41,					/* creation date */
-	0x86, 0x41,					/* last access date */
-	0x00, 0x00,					/* reserved for FAT32 */
-	0xCE, 0x01,					/* last write time */
-	0x86, 0x41,					/* last write date */
-	WBVAL(FILEDATA_START_CLUSTER),			/* start cluster */
-	QBVAL(FILEDATA_SECTOR_COUNT * SECTOR_SIZE)	/* file size in bytes */
+static const struct ramdisk_file files[] = {
+	{ "RAMDISK DAT", FILEDATA_SIZE, FILEDATA },
+#ifdef RAMDISK_SDRAM
+	{ "LOG     TXT", LOGDATA_SIZE, LOGDATA },
+#endif
 };
 
-static uint8_t ramdata[FILEDATA_SECTOR_COUNT * SECTOR_SIZE];
+#define FILE_COUNT	(sizeof(files) / sizeof(files[0]))
+
+/* Volume layout, worked out by ramdisk_init() */
+static struct {
+	uint32_t first_cluster[FILE_COUNT];
+	uint32_t clusters;
+	uint32_t fat16;
+	uint32_t sectors_per_fat;
+	uint32_t root_sector;
+	uint32_t data_sector;
+	uint32_t sector_count;
+} vol;
+
+#define WBSET(p, x)	do { (p)[0] = (x) & 0xFF; \
+			     (p)[1] = ((x) >> 8) & 0xFF; } while (0)
+#define QBSET(p, x)	do { WBSET(p, x); WBSET((p) + 2, (x) >> 16); } while (0)
+
+static uint32_t file_clusters(const struct ramdisk_file *f)
+{
+	return (f->size + CLUSTER_SIZE - 1) / CLUSTER_SIZE;
+}
+
+/* The file owning 'cluster', or -1 if the cluster is free */
+static int cluster_file(uint32_t cluster)
+{
+	uint32_t i;
+
+	for (i = 0; i < FILE_COUNT; i++) {
+		if ((cluster >= vol.first_cluster[i]) &&
+		    (cluster < vol.first_cluster[i] + file_clusters(&files[i]))) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+static uint32_t fat_entry(uint32_t n)
+{
+	uint32_t eoc = vol.fat16 ? 0xFFFF : 0xFFF;
+	int i;
+
+	if (n == 0) {
+		return eoc & 0xFFF8;	/* media descriptor */
+	}
+	if (n == 1) {
+		return eoc;
+	}
+	i = cluster_file(n);
+	if (i < 0) {
+		return 0;
+	}
+	if (n == vol.first_cluster[i] + file_clusters(&files[i]) - 1) {
+		return eoc;
+	}
+	return n + 1;
+}
+
+static void make_boot_sector(uint8_t *s)
+{
+	static const uint8_t jump_oem[] = {
+		0xEB, 0x3C, 0x90,	/* code to jump to the bootstrap code */
+		'm', 'k', 'd', 'o', 's', 'f', 's', 0x00 /* OEM ID */
+	};
+
+	memcpy(s, jump_oem, sizeof(jump_oem));
+	WBSET(s + 11, SECTOR_SIZE);		/* bytes per sector */
+	s[13] = SECTORS_PER_CLUSTER;		/* sectors per cluster */
+	WBSET(s + 14, RESERVED_SECTORS);	/* # of reserved sectors */
+	s[16] = FAT_COPIES;			/* FAT copies */
+	WBSET(s + 17, ROOT_ENTRIES);		/* root entries */
+	if (vol.sector_count < 0x10000) {
+		WBSET(s + 19, vol.sector_count); /* total number of sectors */
+	} else {
+		QBSET(s + 32, vol.sector_count); /* large number of sectors */
+	}
+	s[21] = 0xF8;				/* media descriptor (fixed disk) */
+	WBSET(s + 22, vol.sectors_per_fat);	/* sectors per FAT */
+	WBSET(s + 24, 32);			/* sectors per track */
+	WBSET(s + 26, 64);			/* number of heads */
+	s[38] = 0x29;				/* extended boot signature */
+	QBSET(s + 39, 0x53AD1769);		/* volume serial number */
+	memcpy(s + 43, "RAMDISK    ", 11);	/* volume label */
+	memcpy(s + 54, vol.fat16 ? "FAT16   " : "FAT12   ", 8);
+	s[SECTOR_SIZE - 2] = 0x55;
+	s[SECTOR_SIZE - 1] = 0xAA;
+}
+
+/* sector 'n' of the FAT */
+static void make_fat_sector(uint8_t *s, uint32_t n)
+{
+	uint32_t i, b, e0, e1;
+
+	if (vol.fat16) {
+		for (i = 0; i < SECTOR_SIZE / 2; i++) {
+			WBSET(s + 2 * i, fat_entry(n * SECTOR_SIZE / 2 + i));
+		}
+		return;
+	}
+	/* FAT12 packs two entries in three bytes, which straddle sectors */
+	for (i = 0; i < SECTOR_SIZE; i++) {
+		b = n * SECTOR_SIZE + i;
+		e0 = fat_entry((b / 3) * 2);
+		e1 = fat_entry((b / 3) * 2 + 1);
+		switch (b % 3) {
+		case 0:
+			s[i] = e0 & 0xFF;
+			break;
+		case 1:
+			s[i] = ((e0 >> 8) & 0x0F) | ((e1 << 4) & 0xF0);
+			break;
+		default:
+			s[i] = e1 >> 4;
+			break;
+		}
+	}
+}
+
+/* sector 'n' of the root directory */
+static void make_dir_sector(uint8_t *s, uint32_t n)
+{
+	uint32_t i, e;
+	uint8_t *d;
+
+	for (i = 0; i < SECTOR_SIZE / ROOT_ENTRY_LENGTH; i++) {
+		e = n * (SECTOR_SIZE / ROOT_ENTRY_LENGTH) + i;
+		if (e >= FILE_COUNT) {
+			break;
+		}
+		d = s + i * ROOT_ENTRY_LENGTH;
+		memcpy(d, files[e].name, 11);		/* filename, extension */
+		d[11] = 0x20;				/* attribute byte */
+		WBSET(d + 14, 0x01CE);			/* creation time */
+		WBSET(d + 16, 0x4186);			/* creation date */
+		WBSET(d + 18, 0x4186);			/* last access date */
+		WBSET(d + 22, 0x01CE);			/* last write time */
+		WBSET(d + 24, 0x4186);			/* last write date */
+		if (files[e].size) {
+			WBSET(d + 26, vol.first_cluster[e]); /* start cluster */
+		}
+		QBSET(d + 28, files[e].size);		/* file size in bytes */
+	}
+}
 
 int ramdisk_init(void)
 {
-	uint32_t i = 0;
+	uint32_t i, cluster = 2, fat_bytes;
 
-	/* compute checksum in the directory entry */
-	uint8_t chk = 0;
-	for (i = 32; i < 43; i++) {
-		chk = (((chk & 1) << 7) | ((chk & 0xFE) >> 1)) + DirSector[i];
+#ifdef RAMDISK_SDRAM
+	sdram_init();
+#endif
+	for (i = 0; i < FILE_COUNT; i++) {
+		vol.first_cluster[i] = cluster;
+		cluster += file_clusters(&files[i]);
 	}
-	DirSector[13] = chk;
+	vol.clusters = cluster - 2;
+	vol.fat16 = vol.clusters > FAT12_MAX_CLUSTERS;
+	fat_bytes = vol.fat16 ? (cluster * 2) : ((cluster * 3 + 1) / 2);
+	vol.sectors_per_fat = (fat_bytes + SECTOR_SIZE - 1) / SECTOR_SIZE;
+	vol.root_sector = RESERVED_SECTORS + FAT_COPIES * vol.sectors_per_fat;
+	vol.data_sector = vol.root_sector + ROOT_SECTORS;
+	vol.sector_count = vol.data_sector +
+			   vol.clusters * SECTORS_PER_CLUSTER;
 
-	/* fill ramdata */
+	/* fill the files */
 	const uint8_t text[] = "USB Mass Storage Class example. ";
-	i = 0;
-	while (i < sizeof(ramdata)) {
-		ramdata[i] = text[i % (sizeof(text) - 1)];
-		i++;
+	for (i = 0; i < FILEDATA_SIZE; i++) {
+		FILEDATA[i] = text[i % (sizeof(text) - 1)];
 	}
+#ifdef RAMDISK_SDRAM
+	memset(LOGDATA, ' ', LOGDATA_SIZE);
+#endif
 	return 0;
 }
 
-int ramdisk_read(uint32_t lba, uint8_t *copy_to)
+/*
+ * Find the file data behind data region sector 'lba'. Returns the
+ * file index and sets '*offset' to the byte offset in the file, or
+ * -1 if the sector is not part of any file.
+ */
+static int data_file(uint32_t lba, uint32_t *offset)
 {
-	memset(copy_to, 0, SECTOR_SIZE);
-	switch (lba) {
-	case 0: /* sector 0 is the boot sector */
-		memcpy(copy_to, BootSector, sizeof(BootSector));
-		copy_to[SECTOR_SIZE - 2] = 0x55;
-		copy_to[SECTOR_SIZE - 1] = 0xAA;
-		break;
-	case 1: /* sector 1 is FAT 1st copy */
-	case 2: /* sector 2 is FAT 2nd copy */
-		memcpy(copy_to, FatSector, sizeof(FatSector));
-		break;
-	case 3: /* sector 3 is the directory entry */
-		memcpy(copy_to, DirSector, sizeof(DirSector));
-		break;
-	default:
-		/* ignore reads outside of the data section */
-		if (lba >= FILEDATA_START_SECTOR &&
-		    lba < FILEDATA_START_SECTOR + FILEDATA_SECTOR_COUNT) {
-			memcpy(copy_to, ramdata +
-					(lba - FILEDATA_START_SECTOR) *
-					SECTOR_SIZE,
-			       SECTOR_SIZE);
+	uint32_t cluster;
+	int i;
+
+	cluster = (lba - vol.data_sector) / SECTORS_PER_CLUSTER + 2;
+	i = cluster_file(cluster);
+	if (i >= 0) {
+		*offset = (lba - vol.data_sector -
+			   (vol.first_cluster[i] - 2) * SECTORS_PER_CLUSTER) *
+			  SECTOR_SIZE;
+		if (*offset >= files[i].size) {
+			i = -1;		/* slack at the end of the last cluster */
 		}
-		break;
+	}
+	return i;
+}
+
+/*
+ * Multi-block access. A run of consecutive sectors inside one file is
+ * a single memcpy, only metadata and partial sectors are generated
+ * one sector at a time. Returns -1 for requests that run past the
+ * end of the disk.
+ */
+int ramdisk_read_blocks(uint32_t lba, uint8_t *copy_to, uint32_t count)
+{
+	uint32_t offset, n;
+	int i;
+
+	if ((lba >= vol.sector_count) || (count > vol.sector_count - lba)) {
+		return -1;
+	}
+	while (count) {
+		n = 1;
+		i = (lba >= vol.data_sector) ? data_file(lba, &offset) : -1;
+		if (i >= 0) {
+			/* whole sectors left in this file */
+			n = (files[i].size - offset) / SECTOR_SIZE;
+			if (n > count) {
+				n = count;
+			}
+			if (n) {
+				memcpy(copy_to, files[i].data + offset,
+				       n * SECTOR_SIZE);
+			} else {
+				n = 1;
+				memset(copy_to, 0, SECTOR_SIZE);
+				memcpy(copy_to, files[i].data + offset,
+				       files[i].size - offset);
+			}
+		} else {
+			memset(copy_to, 0, SECTOR_SIZE);
+			if (lba == 0) {
+				make_boot_sector(copy_to);
+			} else if (lba < vol.root_sector) {
+				make_fat_sector(copy_to, (lba - RESERVED_SECTORS) %
+						vol.sectors_per_fat);
+			} else if (lba < vol.data_sector) {
+				make_dir_sector(copy_to, lba - vol.root_sector);
+			}
+		}
+		lba += n;
+		count -= n;
+		copy_to += n * SECTOR_SIZE;
 	}
 	return 0;
 }
 
-int ramdisk_write(uint32_t lba, const uint8_t *copy_from)
+int ramdisk_write_blocks(uint32_t lba, const uint8_t *copy_from,
+			 uint32_t count)
 {
-	(void)lba;
-	(void)copy_from;
-	/* ignore writes */
+	uint32_t offset, n;
+	int i;
+
+	if ((lba >= vol.sector_count) || (count > vol.sector_count - lba)) {
+		return -1;
+	}
+	while (count) {
+		i = (lba >= vol.data_sector) ? data_file(lba, &offset) : -1;
+		if (i >= 0) {
+			n = files[i].size - offset;
+			if (n > count * SECTOR_SIZE) {
+				n = count * SECTOR_SIZE;
+			}
+			memcpy(files[i].data + offset, copy_from, n);
+			n = (n + SECTOR_SIZE - 1) / SECTOR_SIZE;
+		} else {
+			n = 1;		/* metadata is generated, drop it */
+		}
+		lba += n;
+		count -= n;
+		copy_from += n * SECTOR_SIZE;
+	}
 	return 0;
 }
 
+int ramdisk_read(uint32_t lba, uint8_t *copy_to)
+{
+	return ramdisk_read_blocks(lba, copy_to, 1);
+}
+
+int ramdisk_write(uint32_t lba, const uint8_t *copy_from)
+{
+	return ramdisk_write_blocks(lba, copy_from, 1);
+}
+
 int ramdisk_blocks(void)
 {
-	return SECTOR_COUNT;
+	return vol.sector_count;
 }
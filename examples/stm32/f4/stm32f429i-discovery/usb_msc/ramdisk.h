@@ -26,6 +26,9 @@
 extern int ramdisk_init(void);
 extern int ramdisk_read(uint32_t lba, uint8_t *copy_to);
 extern int ramdisk_write(uint32_t lba, const uint8_t *copy_from);
+extern int ramdisk_read_blocks(uint32_t lba, uint8_t *copy_to, uint32_t count);
+extern int ramdisk_write_blocks(uint32_t lba, const uint8_t *copy_from,
+				uint32_t count);
 extern int ramdisk_blocks(void);
 
 #endif
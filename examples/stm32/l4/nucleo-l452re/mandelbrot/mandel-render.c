@@ -0,0 +1,239 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Tiled, progressive Mandelbrot renderer.
+ *
+ * The image is cut into MANDEL_TILE sized tiles. For each tile only
+ * the border is calculated; since the set is connected, a tile whose
+ * border is all one iteration count can be filled without looking
+ * inside (Mariani-Silver). Tiles with a mixed border are painted with
+ * a coarse preview and split into four, one level at a time, so the
+ * whole image sharpens from coarse to fine. Tiles of MANDEL_MIN_TILE
+ * are simply calculated pixel by pixel.
+ *
+ * Every calculated pixel is kept in the caller supplied iteration
+ * buffer (width * height bytes), so borders shared by neighbouring
+ * tiles are only calculated once.
+ */
+
+#include <stdint.h>
+#include "mandel-render.h"
+
+#ifdef MANDEL_FIXED_POINT
+
+/*
+ * Q5.26 fixed point, enough headroom for |z| up to 32 and a pixel
+ * step down to about 1.5e-8, which is below what the float centre
+ * can resolve anyway. Products are taken in 64 bits.
+ */
+#define FRAC_BITS	26
+#define FIX(f)		((int32_t)((f) * (float)(1L << FRAC_BITS)))
+
+static int in_main_bulbs(int32_t px, int32_t py)
+{
+	int64_t yy = (int64_t)py * py;
+	int64_t xq = px - (1L << (FRAC_BITS - 2));	/* x - 1/4 */
+	int64_t q = (xq * xq + yy) >> FRAC_BITS;
+	int64_t xb = px + (1L << FRAC_BITS);		/* x + 1 */
+
+	/* main cardioid */
+	if (q * (q + xq) <= (yy >> 2)) {
+		return 1;
+	}
+	/* period-2 bulb, radius 1/4 around -1 */
+	return (xb * xb + yy) <= ((int64_t)1 << (2 * FRAC_BITS - 4));
+}
+
+static int iterate_fixed(int32_t px, int32_t py)
+{
+	int it = 0;
+	int32_t x = 0, y = 0;
+
+	if (in_main_bulbs(px, py)) {
+		return 0;
+	}
+	while (it < MANDEL_MAX_ITER) {
+		int64_t nx = (int64_t)x * x;
+		int64_t ny = (int64_t)y * y;
+		if ((nx + ny) > ((int64_t)4 << (2 * FRAC_BITS))) {
+			return it;
+		}
+		/* Zn+1 = Zn^2 + P */
+		y = (int32_t)(((int64_t)x * y) >> (FRAC_BITS - 1)) + py;
+		x = (int32_t)((nx - ny) >> FRAC_BITS) + px;
+		it++;
+	}
+	return 0;
+}
+
+int mandel_iterate(float px, float py)
+{
+	return iterate_fixed(FIX(px), FIX(py));
+}
+
+#else
+
+static int in_main_bulbs(float px, float py)
+{
+	float yy = py * py;
+	float xq = px - 0.25f;
+	float q = xq * xq + yy;
+	float xb = px + 1.0f;
+
+	/* main cardioid */
+	if (q * (q + xq) <= 0.25f * yy) {
+		return 1;
+	}
+	/* period-2 bulb, radius 1/4 around -1 */
+	return (xb * xb + yy) <= 0.0625f;
+}
+
+int mandel_iterate(float px, float py)
+{
+	int it = 0;
+	float x = 0, y = 0;
+
+	if (in_main_bulbs(px, py)) {
+		return 0;
+	}
+	while (it < MANDEL_MAX_ITER) {
+		float nx = x*x;
+		float ny = y*y;
+		if ((nx + ny) > 4) {
+			return it;
+		}
+		/* Zn+1 = Zn^2 + P */
+		y = 2*x*y + py;
+		x = nx - ny + px;
+		it++;
+	}
+	return 0;
+}
+
+#endif
+
+/* Iteration count of one pixel, calculated at most once per render */
+static int pixel(const struct mandel_view *v, uint8_t *buf, int x, int y)
+{
+	uint8_t *p = &buf[y * v->width + x];
+
+	if (*p == MANDEL_UNKNOWN) {
+		*p = mandel_iterate(v->cx + (x - v->width / 2) * v->scale,
+				    v->cy + (y - v->height / 2) * v->scale);
+	}
+	return *p;
+}
+
+/*
+ * Calculate the border of a tile, returns the common iteration
+ * count if the whole border has the same value, otherwise -1.
+ */
+static int tile_border(const struct mandel_view *v, uint8_t *buf,
+		       int x0, int y0, int w, int h)
+{
+	int i, it, uniform = 1;
+
+	it = pixel(v, buf, x0, y0);
+	for (i = 0; i < w; i++) {
+		uniform &= (pixel(v, buf, x0 + i, y0) == it);
+		uniform &= (pixel(v, buf, x0 + i, y0 + h - 1) == it);
+	}
+	for (i = 1; i < h - 1; i++) {
+		uniform &= (pixel(v, buf, x0, y0 + i) == it);
+		uniform &= (pixel(v, buf, x0 + w - 1, y0 + i) == it);
+	}
+	return uniform ? it : -1;
+}
+
+/*
+ * Process one tile at the current level. Returns 1 if the tile
+ * still needs to be refined at the next (smaller) level.
+ */
+static int tile(const struct mandel_view *v, uint8_t *buf,
+		mandel_fill_fn fill, int x0, int y0, int w, int h, int size)
+{
+	int x, y, it;
+
+	it = tile_border(v, buf, x0, y0, w, h);
+	if (it >= 0) {
+		for (y = y0 + 1; y < y0 + h - 1; y++) {
+			for (x = x0 + 1; x < x0 + w - 1; x++) {
+				buf[y * v->width + x] = it;
+			}
+		}
+		if (fill) {
+			fill(x0, y0, w, h, it);
+		}
+		return 0;
+	}
+
+	/* small or edge tiles are all border, nothing to split */
+	if ((size <= MANDEL_MIN_TILE) || (w <= 2) || (h <= 2)) {
+		for (y = y0; y < y0 + h; y++) {
+			for (x = x0; x < x0 + w; x++) {
+				it = pixel(v, buf, x, y);
+				if (fill) {
+					fill(x, y, 1, 1, it);
+				}
+			}
+		}
+		return 0;
+	}
+
+	/* coarse preview, refined by the next level */
+	if (fill) {
+		fill(x0, y0, w, h, buf[y0 * v->width + x0]);
+	}
+	return 1;
+}
+
+void mandel_render(const struct mandel_view *v, uint8_t *buf,
+		   mandel_fill_fn fill)
+{
+	int i, x, y, w, h, size, pending;
+
+	for (i = 0; i < v->width * v->height; i++) {
+		buf[i] = MANDEL_UNKNOWN;
+	}
+
+	/*
+	 * A tile at one level needs work only if its parent was split,
+	 * which is exactly when its first interior pixel is still
+	 * unknown (filled tiles write their whole interior). Tiles of
+	 * 2 pixels or less across have no interior of their own, that
+	 * pixel may be on the parent's border, so they are always done.
+	 */
+	for (size = MANDEL_TILE; size >= MANDEL_MIN_TILE; size /= 2) {
+		pending = 0;
+		for (y = 0; y < v->height; y += size) {
+			h = (y + size > v->height) ? v->height - y : size;
+			for (x = 0; x < v->width; x += size) {
+				w = (x + size > v->width) ? v->width - x : size;
+				if ((size != MANDEL_TILE) && (w > 2) && (h > 2) &&
+				    (buf[(y + 1) * v->width + x + 1] !=
+				     MANDEL_UNKNOWN)) {
+					continue;
+				}
+				pending |= tile(v, buf, fill, x, y, w, h, size);
+			}
+		}
+		if (!pending) {
+			break;
+		}
+	}
+}
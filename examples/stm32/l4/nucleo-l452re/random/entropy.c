@@ -0,0 +1,251 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+
+#include "entropy.h"
+
+/*
+ * Health tests, NIST SP 800-90B section 4.4, run on each byte of the
+ * source words.  The cutoffs assume at least 4 bits of entropy per byte
+ * and give a false alarm rate of 2^-20.
+ */
+#define RCT_CUTOFF		6	/* 1 + 20 / 4 */
+#define APT_WINDOW		512
+#define APT_CUTOFF		62	/* 1 + critbinom(512, 2^-4, 1 - 2^-20) */
+
+/*
+ * The generator is ChaCha20 with fast key erasure: each refill of out[]
+ * starts from counter 0, and its first 32 bytes become the key for the
+ * next refill and are never output.  Output bytes are cleared as they are
+ * handed out, so nothing in RAM leads back to earlier output.
+ */
+#define OUT_BLOCKS		8
+
+static uint32_t pool[ENTROPY_POOL_WORDS];
+static volatile unsigned pool_fill;
+static volatile int pool_ready;
+static volatile int status = ENTROPY_ERR_NOT_SEEDED;
+
+static uint8_t rct_last;
+static unsigned rct_count;
+static uint8_t apt_ref;
+static unsigned apt_count, apt_seen;
+static int window_failed;
+
+static uint32_t key[8];
+static uint32_t out[OUT_BLOCKS * 16];
+static unsigned out_left;	/* bytes at the end of out[] */
+static size_t since_reseed;
+
+static struct entropy_stats stats;
+
+#define ROTL(x, n)	(((x) << (n)) | ((x) >> (32 - (n))))
+#define QR(a, b, c, d) do { \
+	a += b; d ^= a; d = ROTL(d, 16); \
+	c += d; b ^= c; b = ROTL(b, 12); \
+	a += b; d ^= a; d = ROTL(d, 8); \
+	c += d; b ^= c; b = ROTL(b, 7); \
+} while (0)
+
+/* RFC 7539 block function, nonce zero. */
+static void chacha20_block(uint32_t counter, uint32_t *block)
+{
+	uint32_t x[16];
+	int i;
+
+	x[0] = 0x61707865;
+	x[1] = 0x3320646e;
+	x[2] = 0x79622d32;
+	x[3] = 0x6b206574;
+	memcpy(&x[4], key, sizeof(key));
+	x[12] = counter;
+	x[13] = x[14] = x[15] = 0;
+	memcpy(block, x, sizeof(x));
+
+	for (i = 0; i < 10; i++) {
+		QR(x[0], x[4], x[8], x[12]);
+		QR(x[1], x[5], x[9], x[13]);
+		QR(x[2], x[6], x[10], x[14]);
+		QR(x[3], x[7], x[11], x[15]);
+		QR(x[0], x[5], x[10], x[15]);
+		QR(x[1], x[6], x[11], x[12]);
+		QR(x[2], x[7], x[8], x[13]);
+		QR(x[3], x[4], x[9], x[14]);
+	}
+
+	for (i = 0; i < 16; i++)
+		block[i] += x[i];
+}
+
+static void refill(void)
+{
+	uint32_t i;
+
+	for (i = 0; i < OUT_BLOCKS; i++)
+		chacha20_block(i, &out[i * 16]);
+
+	memcpy(key, out, sizeof(key));
+	memset(out, 0, sizeof(key));
+	out_left = sizeof(out) - sizeof(key);
+}
+
+static void reseed(void)
+{
+	int i;
+
+	for (i = 0; i < ENTROPY_POOL_WORDS; i++)
+		key[i % 8] ^= pool[i];
+	memset(pool, 0, sizeof(pool));
+
+	/* Nothing made with the old key is handed out any more. */
+	refill();
+
+	stats.reseeds++;
+	since_reseed = 0;
+	status = ENTROPY_OK;
+	pool_fill = 0;
+	pool_ready = 0;
+	entropy_request();
+}
+
+/* Returns 0 if the byte fails either test. */
+static int health_test(uint8_t b)
+{
+	int ok = 1;
+
+	if (b == rct_last) {
+		if (++rct_count >= RCT_CUTOFF) {
+			stats.rct_failures++;
+			rct_count = 1;
+			ok = 0;
+		}
+	} else {
+		rct_last = b;
+		rct_count = 1;
+	}
+
+	if (apt_seen == 0) {
+		apt_ref = b;
+		apt_count = 1;
+	} else if (b == apt_ref && ++apt_count == APT_CUTOFF) {
+		stats.apt_failures++;
+		ok = 0;
+	}
+	if (++apt_seen == APT_WINDOW)
+		apt_seen = 0;
+
+	return ok;
+}
+
+void entropy_init(void)
+{
+	rct_count = 0;
+	apt_seen = 0;
+	window_failed = 0;
+	out_left = 0;
+	pool_fill = 0;
+	pool_ready = 0;
+	status = ENTROPY_ERR_NOT_SEEDED;
+	memset(&stats, 0, sizeof(stats));
+	entropy_request();
+}
+
+int entropy_add_word(uint32_t word)
+{
+	int i, ok = 1, window_passed = 0;
+
+	/* Every byte goes through the tests, to keep them continuous. */
+	for (i = 0; i < 4; i++)
+		ok &= health_test(word >> (i * 8));
+	stats.words++;
+
+	/* Did this word end an adaptive proportion window without failures? */
+	if (apt_seen == 0) {
+		window_passed = ok && !window_failed;
+		window_failed = 0;
+	} else if (!ok) {
+		window_failed = 1;
+	}
+
+	if (pool_ready)
+		return 0;
+
+	if (!ok) {
+		/* What is in the pool can't be trusted either. */
+		pool_fill = 0;
+		status = ENTROPY_ERR_HEALTH;
+		return 1;
+	}
+
+	if (pool_fill < ENTROPY_POOL_WORDS)
+		pool[pool_fill++] = word;
+
+	/*
+	 * A source stuck on one word takes a few dozen words to trip the
+	 * adaptive proportion test and keeps filling the pool after that, so
+	 * the pool is only used once the whole window it ends in has passed.
+	 */
+	if (apt_seen == 0 && !window_passed)
+		pool_fill = 0;
+	if (!window_passed || pool_fill < ENTROPY_POOL_WORDS)
+		return 1;
+
+	pool_ready = 1;
+	return 0;
+}
+
+void entropy_source_error(void)
+{
+	stats.source_errors++;
+	if (!pool_ready)
+		pool_fill = 0;
+}
+
+int entropy_read(void *buf, size_t len)
+{
+	uint8_t *p = buf;
+	uint8_t *src;
+	size_t n;
+
+	if (pool_ready &&
+	    (status != ENTROPY_OK || since_reseed >= ENTROPY_RESEED_BYTES))
+		reseed();
+	if (status != ENTROPY_OK)
+		return status;
+	since_reseed += len;
+
+	while (len) {
+		if (out_left == 0)
+			refill();
+
+		n = len < out_left ? len : out_left;
+		src = (uint8_t *)out + sizeof(out) - out_left;
+		memcpy(p, src, n);
+		memset(src, 0, n);
+		out_left -= n;
+		p += n;
+		len -= n;
+	}
+
+	return ENTROPY_OK;
+}
+
+const struct entropy_stats *entropy_get_stats(void)
+{
+	return &stats;
+}
@@ -24,7 +24,9 @@
 #include <libopencm3/stm32/gpio.h>
 #include <libopencm3/stm32/l4/rng.h>
 #include <libopencm3/cm3/systick.h>
+#include <libopencm3/cm3/nvic.h>
 #include "../nucleo-l452re.h"
+#include "entropy.h"
 
 /* Set STM32 to 80 MHz */
 static void clock_setup(void)
@@ -53,16 +55,50 @@ static void led_setup(void)
 
 static void rng_setup(void)
 {
+    entropy_init();
+
+    /* Each word is handed to the entropy pool from rng_isr(). */
+    nvic_enable_irq(NVIC_RNG_IRQ);
+
     /*
-     * Enable interupt by setting the IE bit in the RNG_CR register.
      * Enable the random number generation by setting the RNGEN bit in
      * the RNG_CR register. This activates the analog part, the RNG_LFSR
      * and the error detector.
      */
     rng_enable();
+}
+
+/* Called by the entropy pool when it wants more words. */
+void entropy_request(void)
+{
+    /* Set the IE bit in the RNG_CR register. */
     rng_interrupt_enable();
 }
 
+void rng_isr(void)
+{
+    uint32_t u32_sr = RNG_SR;
+
+    if (u32_sr & (RNG_SR_SEIS | RNG_SR_CEIS)) {
+        /*
+         * A seed error needs the generator restarted, see the
+         * reference manual. Either way the pool starts over.
+         */
+        RNG_SR &= ~(RNG_SR_SEIS | RNG_SR_CEIS);
+        if (u32_sr & RNG_SR_SEIS) {
+            rng_disable();
+            rng_enable();
+        }
+        entropy_source_error();
+        return;
+    }
+
+    if ((u32_sr & RNG_SR_DRDY) && !entropy_add_word(RNG_DR)) {
+        /* Pool full, stay quiet until it has been used. */
+        rng_interrupt_disable();
+    }
+}
+
 int main(void)
 {
     uint32_t u32_i, u32_j;
@@ -74,10 +110,13 @@ int main(void)
     while (1) {
 
         /*
-         * Generates a random 32-bit value using the built-in
-         * true random number generator (RNG)
+         * Takes a random 32-bit value from the entropy pool, which
+         * is fed by the built-in true random number generator (RNG).
+         * LD2 stays off while there is none to be had.
          */
-        u32_rnd = rng_get_random_blocking();
+        if (entropy_read(&u32_rnd, sizeof(u32_rnd)) != ENTROPY_OK) {
+            u32_rnd = 0;
+        }
 
         /*
          * Blink LD2 on and off according to the randomized
@@ -0,0 +1,299 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * \addtogroup Examples
+ *
+ */
+/*
+ * USB <-> UART data path.
+ *
+ * Data moves in packet sized buffers which are handed between the USB
+ * endpoints and the UART uDMA channels by pointer; nothing is copied on the
+ * way.  Each direction owns a pool of buffers, kept on a free and a full
+ * queue:
+ *
+ *   down (USB -> UART): an OUT packet is read into a free buffer, which is
+ *   queued full and later sent by the UART TX channel.  When every buffer is
+ *   full the packet is left unread in the endpoint FIFO and the USB
+ *   controller NAKs the host until a buffer comes back.
+ *
+ *   up (UART -> USB): the UART RX channel fills a free buffer, which is
+ *   queued full and later written to the IN endpoint.  A buffer is handed
+ *   over when it is full, when the line has been idle for a tick, or two
+ *   ticks after it got data if nothing else waits for the host.  When
+ *   RTS_HIGH_WATER buffers are waiting for the host, RTS is dropped to
+ *   stop the other end, and raised again at RTS_LOW_WATER.
+ *
+ * Everything here runs from the USB, UART1 and SysTick interrupts.  They
+ * all sit at the reset priority and so never preempt one another, which is
+ * what keeps the queues consistent without locking.
+ */
+
+#include "usb_to_serial_cdcacm.h"
+
+#include <stddef.h>
+
+#define BRIDGE_PKT_SIZE		64
+#define BRIDGE_BUFS		8	/* per direction */
+#define RTS_HIGH_WATER		6
+#define RTS_LOW_WATER		2
+
+struct pkt {
+	uint8_t data[BRIDGE_PKT_SIZE];
+	uint16_t len;
+};
+
+struct pktq {
+	struct pkt *slot[BRIDGE_BUFS];
+	uint8_t head;
+	uint8_t count;
+};
+
+struct direction {
+	struct pkt bufs[BRIDGE_BUFS];
+	struct pktq free;
+	struct pktq full;
+	struct pkt *active;	/* buffer the uDMA is working on */
+};
+
+static struct direction down;
+static struct direction up;
+
+static uint8_t usb_rx_pending;	/* OUT packet waiting in the endpoint */
+static uint8_t usb_tx_busy;	/* IN endpoint holds a packet */
+static uint8_t usb_tx_zlp;	/* last IN packet was full size */
+static uint16_t rx_seen;	/* RX count at the previous tick */
+static uint8_t host_dtr, host_rts;
+static uint8_t throttled;
+
+static void pktq_put(struct pktq *q, struct pkt *p)
+{
+	q->slot[(q->head + q->count) % BRIDGE_BUFS] = p;
+	q->count++;
+}
+
+static struct pkt *pktq_peek(struct pktq *q)
+{
+	return q->count ? q->slot[q->head] : NULL;
+}
+
+static struct pkt *pktq_get(struct pktq *q)
+{
+	struct pkt *p = pktq_peek(q);
+
+	if (p) {
+		q->head = (q->head + 1) % BRIDGE_BUFS;
+		q->count--;
+	}
+	return p;
+}
+
+static void direction_init(struct direction *d)
+{
+	int i;
+
+	d->free.head = d->free.count = 0;
+	d->full.head = d->full.count = 0;
+	d->active = NULL;
+	for (i = 0; i < BRIDGE_BUFS; i++)
+		pktq_put(&d->free, &d->bufs[i]);
+}
+
+static void rts_update(void)
+{
+	uint8_t t = throttled;
+
+	if (up.full.count >= RTS_HIGH_WATER)
+		t = 1;
+	else if (up.full.count <= RTS_LOW_WATER)
+		t = 0;
+
+	if (t != throttled) {
+		throttled = t;
+		uart_set_ctl_line_state(host_dtr, host_rts && !throttled);
+	}
+}
+
+/* ---- USB -> UART -------------------------------------------------------- */
+
+static void uart_tx_kick(void)
+{
+	struct pkt *p;
+
+	if (down.active)
+		return;
+	p = pktq_get(&down.full);
+	if (p) {
+		down.active = p;
+		uart_tx_start(p->data, p->len);
+	}
+}
+
+static void usb_rx_drain(void)
+{
+	struct pkt *p;
+
+	while (usb_rx_pending && (p = pktq_get(&down.free))) {
+		usb_rx_pending = 0;
+		p->len = cdcacm_read_packet(p->data);
+		if (p->len)
+			pktq_put(&down.full, p);
+		else
+			pktq_put(&down.free, p);
+	}
+	uart_tx_kick();
+}
+
+void glue_usb_rx_cb(void)
+{
+	usb_rx_pending = 1;
+	usb_rx_drain();
+}
+
+void glue_uart_tx_done_cb(void)
+{
+	pktq_put(&down.free, down.active);
+	down.active = NULL;
+	uart_tx_kick();
+	usb_rx_drain();
+}
+
+/* ---- UART -> USB -------------------------------------------------------- */
+
+static void uart_rx_arm(void)
+{
+	struct pkt *p;
+
+	if (up.active)
+		return;
+	p = pktq_get(&up.free);
+	if (p) {
+		up.active = p;
+		rx_seen = 0;
+		uart_rx_start(p->data, BRIDGE_PKT_SIZE);
+	}
+}
+
+static void usb_tx_kick(void)
+{
+	struct pkt *p;
+
+	if (usb_tx_busy)
+		return;
+
+	p = pktq_peek(&up.full);
+	if (p) {
+		/* The driver copies into the endpoint FIFO; the buffer is free. */
+		if (cdcacm_write_packet(p->data, p->len) != p->len)
+			return;
+		usb_tx_zlp = (p->len == BRIDGE_PKT_SIZE);
+		pktq_get(&up.full);
+		pktq_put(&up.free, p);
+		uart_rx_arm();
+		rts_update();
+	} else if (usb_tx_zlp) {
+		/* End the transfer so the host doesn't wait for more. */
+		cdcacm_write_packet(NULL, 0);
+		usb_tx_zlp = 0;
+	} else {
+		return;
+	}
+	usb_tx_busy = 1;
+}
+
+static void uart_rx_hand_over(uint16_t len)
+{
+	struct pkt *p = up.active;
+
+	up.active = NULL;
+	p->len = len;
+	pktq_put(&up.full, p);
+	rts_update();
+	uart_rx_arm();
+	usb_tx_kick();
+}
+
+void glue_uart_rx_done_cb(void)
+{
+	uart_rx_hand_over(BRIDGE_PKT_SIZE);
+}
+
+void glue_usb_tx_cb(void)
+{
+	usb_tx_busy = 0;
+	usb_tx_kick();
+}
+
+/*
+ * Called every millisecond.  A partly filled RX buffer that already had
+ * data at the previous tick is handed over if it did not grow since, or
+ * if nothing else is waiting for the host.  While the host keeps up that
+ * bounds the latency to two ticks, even on a line that never stays quiet
+ * for a whole tick; while it doesn't, the buffer is filled further.
+ */
+void bridge_tick(void)
+{
+	uint16_t n;
+
+	if (!up.active) {
+		uart_rx_arm();
+		return;
+	}
+
+	n = uart_rx_count();
+	if (n && rx_seen && (n == rx_seen || !up.full.count))
+		uart_rx_hand_over(uart_rx_stop());
+	else
+		rx_seen = n;
+}
+
+/* ---- Control ------------------------------------------------------------ */
+
+void glue_usb_configured_cb(void)
+{
+	usb_rx_pending = 0;
+	usb_tx_busy = 0;
+	usb_tx_zlp = 0;
+	usb_tx_kick();
+}
+
+void bridge_set_line_state(uint8_t dtr, uint8_t rts)
+{
+	host_dtr = dtr;
+	host_rts = rts;
+	uart_set_ctl_line_state(host_dtr, host_rts && !throttled);
+}
+
+uint8_t bridge_uart_tx_busy(void)
+{
+	return down.active != NULL;
+}
+
+uint8_t bridge_uart_rx_busy(void)
+{
+	return up.full.count != 0;
+}
+
+/* Call after uart_init(), before interrupts start flowing. */
+void bridge_init(void)
+{
+	direction_init(&down);
+	direction_init(&up);
+	throttled = 0;
+	uart_rx_arm();
+}
@@ -0,0 +1,716 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Host simulation of the data path in bridge.c.
+ *
+ * The functions bridge.c calls in uart.c and usb_cdcacm.c are replaced by
+ * models that run in simulated time.  UART1 has a 16 byte FIFO each way.
+ * The TX uDMA channel tops its FIFO up from the buffer and completes once
+ * the last byte is in the FIFO; the RX channel moves bytes from its FIFO
+ * into the buffer as they arrive, and a byte that finds the RX FIFO full
+ * is an overrun.  The device at the other end of the line sends while RTS
+ * is high, stopping at a character boundary.  Characters are 10 bits.
+ *
+ * The USB side is a full speed bus carrying one transaction at a time: a
+ * data packet takes 52.6us, a NAK or a zero length packet 3us.  The OUT
+ * endpoint holds one packet and NAKs until the bridge reads it, the IN
+ * endpoint takes one packet.  Interrupts run one at a time to completion,
+ * as on the target where they share a priority, and SysTick calls
+ * bridge_tick() every 1ms.
+ *
+ * Each baud rate gets three loads: both directions streaming with the host
+ * always reading, the same with a host that stops reading for up to 50ms
+ * at a time and the other end sending in bursts, and messages of 1 to 128
+ * bytes both ways.  Throughput is
+ * given as a share of the line rate, latency as the time a message takes
+ * beyond its own time on the line.  Both streams are checked byte for
+ * byte, and for overruns, for RTS following the water marks, and for IN
+ * transfers that end without a short packet.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bridge.c"
+
+static int failures;
+
+#define CHECK(cond, ...) do {						\
+	if (!(cond)) {							\
+		if (failures++ < 10) {					\
+			printf("FAIL %s:%d: ", __FILE__, __LINE__);	\
+			printf(__VA_ARGS__);				\
+			printf("\n");					\
+		}							\
+	}								\
+} while (0)
+
+static uint32_t rng_state = 1;
+
+static uint32_t rnd(void)
+{
+	rng_state ^= rng_state << 13;
+	rng_state ^= rng_state >> 17;
+	rng_state ^= rng_state << 5;
+	return rng_state;
+}
+
+#define MS		1000000ULL
+#define PACKET_NS	52632		/* 1ms / 19 */
+#define NAK_NS		3000
+#define FIFO_SIZE	16
+#define MAX_MSGS	256
+
+#define DOWN_SALT	0x00
+#define UP_SALT		0xa5
+
+enum load { LOAD_STREAM, LOAD_PAUSING, LOAD_MESSAGES };
+
+static uint64_t now;
+static uint64_t char_ns;
+static uint64_t next_tick;
+
+static uint8_t pattern(uint32_t i, uint8_t salt)
+{
+	return (uint8_t)((i * 2654435761u) >> 24) ^ salt;
+}
+
+static uint64_t line_ns(uint32_t len)
+{
+	return len * char_ns;
+}
+
+/* --- Messages in flight, per direction --- */
+
+struct latency {
+	struct {
+		uint32_t end;		/* stream offset after the message */
+		uint32_t len;
+		uint64_t t;		/* when it was written */
+	} q[MAX_MSGS];
+	unsigned head, n;
+	uint64_t bound;			/* allowed beyond the line time */
+	uint64_t sum, max;
+	unsigned count;
+};
+
+static struct latency down_lat, up_lat;
+
+static void latency_start(struct latency *l, uint32_t end, uint32_t len)
+{
+	CHECK(l->n < MAX_MSGS, "too many messages in flight");
+	if (l->n == MAX_MSGS)
+		return;
+	l->q[(l->head + l->n) % MAX_MSGS].end = end;
+	l->q[(l->head + l->n) % MAX_MSGS].len = len;
+	l->q[(l->head + l->n) % MAX_MSGS].t = now;
+	l->n++;
+}
+
+/* @got bytes of the stream have reached the far end. */
+static void latency_seen(struct latency *l, uint32_t got)
+{
+	uint64_t d;
+
+	while (l->n && l->q[l->head].end <= got) {
+		d = now - l->q[l->head].t - line_ns(l->q[l->head].len);
+		CHECK(d <= l->bound, "%u byte message %.3fms late",
+		      l->q[l->head].len, d / 1e6);
+		l->sum += d;
+		if (d > l->max)
+			l->max = d;
+		l->count++;
+		l->head = (l->head + 1) % MAX_MSGS;
+		l->n--;
+	}
+}
+
+/* --- UART1 and its uDMA channels --- */
+
+static struct {
+	const uint8_t *tx_src;
+	uint16_t tx_left;
+	int tx_done;			/* channel 9 completion pending */
+	uint8_t tx_fifo[FIFO_SIZE];
+	unsigned tx_head, tx_n;
+	int shifting;
+	uint8_t shift;
+	uint64_t shift_end;
+
+	uint8_t *rx_dst;
+	uint16_t rx_len;		/* as in uart.c, 0 when not armed */
+	uint16_t rx_count;
+	int rx_enabled;
+	int rx_done;			/* channel 8 completion pending */
+	uint8_t rx_fifo[FIFO_SIZE];
+	unsigned rx_head, rx_n;
+	uint32_t overruns;
+
+	uint8_t dtr, rts;
+	uint32_t rts_stops;
+} uart;
+
+/* The device at the other end of the line. */
+static struct {
+	uint32_t sent, want;		/* bytes put on the line, to put */
+	int sending;
+	uint64_t char_end;
+	uint32_t got, bad;		/* bytes taken off the line */
+} peer;
+
+static void uart_tx_feed(void)
+{
+	for (;;) {
+		while (uart.tx_left && uart.tx_n < FIFO_SIZE) {
+			uart.tx_fifo[(uart.tx_head + uart.tx_n++) % FIFO_SIZE] =
+				*uart.tx_src++;
+			if (!--uart.tx_left)
+				uart.tx_done = 1;
+		}
+		if (uart.shifting || !uart.tx_n)
+			return;
+		uart.shift = uart.tx_fifo[uart.tx_head];
+		uart.tx_head = (uart.tx_head + 1) % FIFO_SIZE;
+		uart.tx_n--;
+		uart.shifting = 1;
+		uart.shift_end = now + char_ns;
+	}
+}
+
+static void uart_shift_done(void)
+{
+	if (uart.shift != pattern(peer.got, DOWN_SALT))
+		peer.bad++;
+	peer.got++;
+	latency_seen(&down_lat, peer.got);
+	uart.shifting = 0;
+	uart_tx_feed();
+}
+
+static void uart_rx_feed(void)
+{
+	while (uart.rx_enabled && uart.rx_n) {
+		uart.rx_dst[uart.rx_count++] = uart.rx_fifo[uart.rx_head];
+		uart.rx_head = (uart.rx_head + 1) % FIFO_SIZE;
+		uart.rx_n--;
+		if (uart.rx_count == uart.rx_len) {
+			uart.rx_enabled = 0;
+			uart.rx_done = 1;
+		}
+	}
+}
+
+static void peer_start(void)
+{
+	if (!peer.sending && peer.sent < peer.want && uart.rts) {
+		peer.sending = 1;
+		peer.char_end = now + char_ns;
+	}
+}
+
+static void peer_char_done(void)
+{
+	if (uart.rx_n == FIFO_SIZE)
+		uart.overruns++;
+	else
+		uart.rx_fifo[(uart.rx_head + uart.rx_n++) % FIFO_SIZE] =
+			pattern(peer.sent, UP_SALT);
+	peer.sent++;
+	peer.sending = 0;
+	uart_rx_feed();
+}
+
+void uart_set_ctl_line_state(uint8_t dtr, uint8_t rts)
+{
+	rts = !!rts;
+	/* The tests only change the host's RTS with nothing queued. */
+	if (host_rts && rts != uart.rts) {
+		if (!rts) {
+			CHECK(up.full.count >= RTS_HIGH_WATER,
+			      "RTS dropped with %u buffers queued",
+			      up.full.count);
+			uart.rts_stops++;
+		} else {
+			CHECK(up.full.count <= RTS_LOW_WATER,
+			      "RTS raised with %u buffers queued",
+			      up.full.count);
+		}
+	}
+	uart.dtr = dtr;
+	uart.rts = rts;
+}
+
+void uart_tx_start(const uint8_t *buf, uint16_t len)
+{
+	CHECK(!uart.tx_left && !uart.tx_done,
+	      "TX started while the channel is busy");
+	CHECK(len >= 1 && len <= BRIDGE_PKT_SIZE, "TX of %u bytes", len);
+	uart.tx_src = buf;
+	uart.tx_left = len;
+	uart_tx_feed();
+}
+
+void uart_rx_start(uint8_t *buf, uint16_t len)
+{
+	CHECK(!uart.rx_len, "RX started while a transfer is armed");
+	uart.rx_dst = buf;
+	uart.rx_len = len;
+	uart.rx_count = 0;
+	uart.rx_enabled = 1;
+	uart_rx_feed();
+}
+
+uint16_t uart_rx_count(void)
+{
+	return uart.rx_len ? uart.rx_count : 0;
+}
+
+uint16_t uart_rx_stop(void)
+{
+	uint16_t count = uart_rx_count();
+
+	uart.rx_enabled = 0;
+	uart.rx_done = 0;
+	uart.rx_len = 0;
+	return count;
+}
+
+/* --- The USB endpoints and the host --- */
+
+enum bus_op { BUS_IDLE, BUS_OUT, BUS_IN, BUS_NAK };
+
+static struct {
+	int out_holding, out_irq;
+	uint8_t out_buf[64];
+	uint16_t out_len;
+	int in_loaded, in_irq;
+	uint8_t in_buf[64];
+	uint16_t in_len;
+
+	enum bus_op op;			/* transaction on the bus */
+	uint64_t end;
+	uint8_t pkt[64];
+	uint16_t len;
+} usb;
+
+static struct {
+	uint32_t wend[MAX_MSGS];	/* where each pending write ends */
+	unsigned whead, wn;
+	uint32_t queued, sent;		/* bytes written, sent OUT */
+	int zlp;			/* a write ended on a full packet */
+	int prefer_in;
+
+	int reading;
+	uint64_t toggle;		/* next change of reading, 0 never */
+	uint64_t read_since;
+	uint32_t got, bad;		/* bytes received IN */
+	int in_open;			/* last IN packet was full size */
+	uint64_t in_last;
+	uint32_t unterminated;
+} host;
+
+uint16_t cdcacm_read_packet(uint8_t *buf)
+{
+	if (!usb.out_holding)
+		return 0;
+	memcpy(buf, usb.out_buf, usb.out_len);
+	usb.out_holding = 0;
+	return usb.out_len;
+}
+
+uint16_t cdcacm_write_packet(const uint8_t *buf, uint16_t len)
+{
+	CHECK(len <= 64, "IN packet of %u bytes", len);
+	if (usb.in_loaded || len > 64)
+		return 0;
+	if (len)
+		memcpy(usb.in_buf, buf, len);
+	usb.in_len = len;
+	usb.in_loaded = 1;
+	return len;
+}
+
+static void host_write(uint32_t len)
+{
+	CHECK(host.wn < MAX_MSGS, "too many writes pending");
+	if (host.wn == MAX_MSGS)
+		return;
+	host.queued += len;
+	host.wend[(host.whead + host.wn++) % MAX_MSGS] = host.queued;
+}
+
+static void host_receive(const uint8_t *buf, uint16_t len)
+{
+	uint16_t i;
+
+	for (i = 0; i < len; i++)
+		if (buf[i] != pattern(host.got++, UP_SALT))
+			host.bad++;
+	latency_seen(&up_lat, host.got);
+	host.in_open = (len == 64);
+	host.in_last = now;
+}
+
+static void bus_start(void)
+{
+	int want_out, want_in;
+	uint32_t n;
+
+	if (usb.op != BUS_IDLE)
+		return;
+	want_out = host.wn || host.zlp;
+	want_in = host.reading;
+	if (want_out && want_in) {
+		host.prefer_in = !host.prefer_in;
+		want_out = !host.prefer_in;
+	}
+
+	if (want_out) {
+		if (usb.out_holding) {
+			usb.op = BUS_NAK;
+			usb.end = now + NAK_NS;
+			return;
+		}
+		n = 0;
+		if (host.zlp) {
+			host.zlp = 0;
+		} else {
+			n = host.wend[host.whead] - host.sent;
+			if (n > 64)
+				n = 64;
+			for (usb.len = 0; usb.len < n; usb.len++)
+				usb.pkt[usb.len] =
+					pattern(host.sent++, DOWN_SALT);
+			if (host.sent == host.wend[host.whead]) {
+				host.whead = (host.whead + 1) % MAX_MSGS;
+				host.wn--;
+				host.zlp = (n == 64);
+			}
+		}
+		usb.len = n;
+		usb.op = BUS_OUT;
+		usb.end = now + (n ? PACKET_NS : NAK_NS);
+	} else if (want_in) {
+		if (!usb.in_loaded) {
+			usb.op = BUS_NAK;
+			usb.end = now + NAK_NS;
+			return;
+		}
+		usb.len = usb.in_len;
+		memcpy(usb.pkt, usb.in_buf, usb.len);
+		usb.op = BUS_IN;
+		usb.end = now + (usb.len ? PACKET_NS : NAK_NS);
+	}
+}
+
+static void bus_done(void)
+{
+	if (usb.op == BUS_OUT) {
+		memcpy(usb.out_buf, usb.pkt, usb.len);
+		usb.out_len = usb.len;
+		usb.out_holding = 1;
+		usb.out_irq = 1;
+	} else if (usb.op == BUS_IN) {
+		usb.in_loaded = 0;
+		usb.in_irq = 1;
+		host_receive(usb.pkt, usb.len);
+	}
+	usb.op = BUS_IDLE;
+}
+
+/* Pending interrupts, one handler at a time, as uart1_isr() for UART1. */
+static void run_irqs(void)
+{
+	int tx, rx;
+
+	for (;;) {
+		if (usb.out_irq) {
+			usb.out_irq = 0;
+			glue_usb_rx_cb();
+		} else if (usb.in_irq) {
+			usb.in_irq = 0;
+			glue_usb_tx_cb();
+		} else if (uart.tx_done || uart.rx_done) {
+			tx = uart.tx_done;
+			rx = uart.rx_done;
+			uart.tx_done = uart.rx_done = 0;
+			if (tx)
+				glue_uart_tx_done_cb();
+			if (rx) {
+				uart.rx_len = 0;
+				glue_uart_rx_done_cb();
+			}
+		} else {
+			return;
+		}
+	}
+}
+
+static void tick(void)
+{
+	next_tick += MS;
+	bridge_tick();
+	run_irqs();
+
+	/* A full IN packet owes the host a short one once the data stops. */
+	if (host.in_open && host.reading &&
+	    now - (host.in_last > host.read_since ?
+		   host.in_last : host.read_since) > 2 * MS) {
+		host.unterminated++;
+		host.in_open = 0;
+	}
+}
+
+/* --- Loads --- */
+
+static uint64_t next_down_msg, next_up_msg;
+
+static uint32_t msg_len(void)
+{
+	if (rnd() % 8 == 0)
+		return 64 * (1 + rnd() % 2);
+	return 1 + rnd() % 128;
+}
+
+static uint64_t msg_gap(void)
+{
+	return line_ns(128) + (1 + rnd() % 9) * MS;
+}
+
+static void generate(enum load load)
+{
+	uint32_t len;
+
+	if (load != LOAD_MESSAGES) {
+		if (host.queued - host.sent < 4096)
+			host_write(4096);
+	}
+	if (load == LOAD_STREAM) {
+		peer.want = peer.sent + 1;
+	} else if (load == LOAD_PAUSING) {
+		/* Bursts, so that RTS also drops with the line quiet. */
+		if (now >= next_up_msg && peer.sent == peer.want) {
+			peer.want += 1 + rnd() % 256;
+			next_up_msg = now + rnd() % (2 * MS);
+		}
+	} else {
+		if (now >= next_down_msg) {
+			len = msg_len();
+			host_write(len);
+			latency_start(&down_lat, host.queued, len);
+			next_down_msg = now + msg_gap();
+		}
+		if (now >= next_up_msg) {
+			len = msg_len();
+			peer.want += len;
+			latency_start(&up_lat, peer.want, len);
+			next_up_msg = now + msg_gap();
+		}
+	}
+
+	if (load == LOAD_PAUSING && now >= host.toggle) {
+		host.reading = !host.reading;
+		if (host.reading) {
+			host.read_since = now;
+			host.toggle = now + (rnd() % 5000) * 1000;
+		} else {
+			host.toggle = now + (rnd() % 50000) * 1000;
+		}
+	}
+}
+
+static void simulate(uint64_t end, enum load load, int generating)
+{
+	uint64_t t;
+
+	while (now < end) {
+		if (generating)
+			generate(load);
+		bus_start();
+		peer_start();
+
+		t = end;
+		if (uart.shifting && uart.shift_end < t)
+			t = uart.shift_end;
+		if (peer.sending && peer.char_end < t)
+			t = peer.char_end;
+		if (usb.op != BUS_IDLE && usb.end < t)
+			t = usb.end;
+		if (next_tick < t)
+			t = next_tick;
+		if (generating && load == LOAD_PAUSING && host.toggle < t)
+			t = host.toggle;
+		if (generating && load == LOAD_MESSAGES && next_down_msg < t)
+			t = next_down_msg;
+		if (generating && load != LOAD_STREAM &&
+		    next_up_msg > now && next_up_msg < t)
+			t = next_up_msg;
+		now = t;
+
+		if (uart.shifting && uart.shift_end == now)
+			uart_shift_done();
+		if (peer.sending && peer.char_end == now)
+			peer_char_done();
+		if (usb.op != BUS_IDLE && usb.end == now)
+			bus_done();
+		run_irqs();
+		if (next_tick == now)
+			tick();
+
+		CHECK(up.full.count < RTS_HIGH_WATER || !uart.rts,
+		      "RTS high with %u buffers queued", up.full.count);
+	}
+}
+
+static void reset(uint32_t baud)
+{
+	memset(&uart, 0, sizeof(uart));
+	memset(&peer, 0, sizeof(peer));
+	memset(&usb, 0, sizeof(usb));
+	memset(&host, 0, sizeof(host));
+	memset(&down_lat, 0, sizeof(down_lat));
+	memset(&up_lat, 0, sizeof(up_lat));
+	now = 0;
+	next_tick = MS;
+	next_down_msg = next_up_msg = 0;
+	char_ns = (10 * 1000000000ULL + baud / 2) / baud;
+	down_lat.bound = 2 * PACKET_NS + NAK_NS;
+	up_lat.bound = 2 * MS + 3 * PACKET_NS;
+
+	bridge_init();
+	glue_usb_configured_cb();
+	bridge_set_line_state(1, 1);
+	host.reading = 1;
+}
+
+static int drained(void)
+{
+	return peer.got == host.queued && host.got == peer.want &&
+	       !host.wn && !host.zlp && !uart.shifting && !peer.sending;
+}
+
+/*
+ * Runs a load for @ms, then lets everything drain with the host reading.
+ * Returns the bytes delivered each way while the load ran.
+ */
+static void run(uint32_t baud, enum load load, uint64_t ms,
+		uint32_t *down_bytes, uint32_t *up_bytes)
+{
+	uint64_t limit;
+
+	reset(baud);
+	simulate(ms * MS, load, 1);
+	*down_bytes = peer.got;
+	*up_bytes = host.got;
+
+	if (!host.reading)
+		host.read_since = now;
+	host.reading = 1;
+	limit = now + line_ns(host.queued - peer.got) + 200 * MS;
+	while (!drained() && now < limit)
+		simulate(now + MS, load, 0);
+	simulate(now + 5 * MS, load, 0);
+
+	CHECK(drained(), "%u baud load %d: stuck, down %u of %u, up %u of %u",
+	      baud, load, peer.got, host.queued, host.got, peer.want);
+	CHECK(!peer.bad && !host.bad, "%u baud load %d: %u/%u bytes wrong",
+	      baud, load, peer.bad, host.bad);
+	CHECK(!uart.overruns, "%u baud load %d: %u RX overruns",
+	      baud, load, uart.overruns);
+	CHECK(!host.unterminated && !host.in_open,
+	      "%u baud load %d: %u IN transfers left open",
+	      baud, load, host.unterminated + host.in_open);
+	CHECK(!down_lat.n && !up_lat.n, "%u baud: messages lost", baud);
+}
+
+/* The host's own RTS holds the other end off as well. */
+static void check_host_rts(void)
+{
+	reset(921600);
+	CHECK(uart.dtr && uart.rts, "DTR/RTS not raised");
+	bridge_set_line_state(1, 0);
+	CHECK(uart.dtr && !uart.rts, "RTS not dropped for the host");
+	peer.want = 100;
+	simulate(5 * MS, LOAD_STREAM, 0);
+	CHECK(peer.sent == 0, "%u bytes sent against RTS", peer.sent);
+	bridge_set_line_state(1, 1);
+	CHECK(uart.rts, "RTS not raised for the host");
+	simulate(10 * MS, LOAD_STREAM, 0);
+	CHECK(host.got == 100 && !host.bad, "%u of 100 bytes arrived",
+	      host.got);
+}
+
+static double share(uint32_t bytes, uint64_t ms)
+{
+	return 100.0 * bytes * char_ns / (ms * MS);
+}
+
+int main(void)
+{
+	static const uint32_t bauds[] = {
+		115200, 230400, 460800, 921600, 1500000, 3000000,
+	};
+	const uint64_t ms = 500;
+	uint32_t down_bytes, up_bytes, stops;
+	double s_down, s_up, p_down, p_up;
+	unsigned i;
+
+	check_host_rts();
+
+	printf("   baud  streaming        host pausing              "
+	       "messages, ms past line time\n");
+	printf("         down    up       down    up    RTS stops   "
+	       "down avg/max   up avg/max\n");
+	for (i = 0; i < sizeof(bauds) / sizeof(bauds[0]); i++) {
+		run(bauds[i], LOAD_STREAM, ms, &down_bytes, &up_bytes);
+		s_down = share(down_bytes, ms);
+		s_up = share(up_bytes, ms);
+		CHECK(s_down > 99 && s_up > 95,
+		      "%u baud: streaming at %.1f%%/%.1f%% of the line",
+		      bauds[i], s_down, s_up);
+
+		run(bauds[i], LOAD_PAUSING, ms, &down_bytes, &up_bytes);
+		p_down = share(down_bytes, ms);
+		p_up = share(up_bytes, ms);
+		stops = uart.rts_stops;
+		CHECK(p_down > 99, "%u baud: down at %.1f%% with the host "
+		      "pausing", bauds[i], p_down);
+		CHECK(stops, "%u baud: RTS never dropped", bauds[i]);
+
+		run(bauds[i], LOAD_MESSAGES, ms, &down_bytes, &up_bytes);
+		CHECK(down_lat.count > 20 && up_lat.count > 20,
+		      "%u baud: %u/%u messages", bauds[i], down_lat.count,
+		      up_lat.count);
+
+		printf("%7u  %5.1f%% %5.1f%%    %5.1f%% %5.1f%%  %6u     "
+		       "%5.2f/%5.2f    %5.2f/%5.2f\n", bauds[i], s_down, s_up,
+		       p_down, p_up, stops,
+		       down_lat.sum / 1e6 / (down_lat.count ? down_lat.count : 1),
+		       down_lat.max / 1e6,
+		       up_lat.sum / 1e6 / (up_lat.count ? up_lat.count : 1),
+		       up_lat.max / 1e6);
+	}
+
+	if (failures) {
+		printf("%d failures\n", failures);
+		return EXIT_FAILURE;
+	}
+	printf("all passed\n");
+	return EXIT_SUCCESS;
+}
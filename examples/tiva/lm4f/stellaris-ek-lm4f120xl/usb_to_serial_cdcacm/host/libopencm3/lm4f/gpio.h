@@ -0,0 +1,30 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Host stand-in, see bridge_test.c.  Only the pin names are used. */
+
+#ifndef HOST_GPIO_H
+#define HOST_GPIO_H
+
+#define GPIO2			(1 << 2)
+#define GPIO3			(1 << 3)
+#define GPIO4			(1 << 4)
+#define GPIO5			(1 << 5)
+#define GPIO6			(1 << 6)
+#define GPIO7			(1 << 7)
+
+#endif
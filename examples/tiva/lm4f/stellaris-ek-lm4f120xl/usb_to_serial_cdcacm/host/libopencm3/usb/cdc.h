@@ -0,0 +1,37 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Host stand-in, see bridge_test.c.  Laid out as in the real cdc.h. */
+
+#ifndef HOST_CDC_H
+#define HOST_CDC_H
+
+enum usb_cdc_line_coding_bCharFormat {
+	USB_CDC_1_STOP_BITS = 0,
+	USB_CDC_1_5_STOP_BITS = 1,
+	USB_CDC_2_STOP_BITS = 2,
+};
+
+enum usb_cdc_line_coding_bParityType {
+	USB_CDC_NO_PARITY = 0,
+	USB_CDC_ODD_PARITY = 1,
+	USB_CDC_EVEN_PARITY = 2,
+	USB_CDC_MARK_PARITY = 3,
+	USB_CDC_SPACE_PARITY = 4,
+};
+
+#endif
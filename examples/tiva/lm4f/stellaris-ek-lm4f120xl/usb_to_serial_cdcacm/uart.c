@@ -33,6 +33,11 @@
  * Output pins handled via commands from the host:
  * DTR <-> PA6
  * RTS <-> PA7
+ *
+ * Both directions of the data path are moved by the uDMA: channel 8 carries
+ * UART1 RX into a packet buffer, channel 9 carries a packet buffer out to
+ * UART1 TX.  The buffers belong to the bridge; this file only starts and
+ * stops the transfers and reports their completion.
  */
 
 #include "usb_to_serial_cdcacm.h"
@@ -41,6 +46,58 @@
 #include <libopencm3/lm4f/uart.h>
 #include <libopencm3/lm4f/nvic.h>
 
+/*
+ * libopencm3 has no uDMA driver for the LM4F, so the few registers used here
+ * are defined locally.  See the LM4F120H5QR datasheet, chapter 8.
+ */
+#define UDMA_BASE			0x400FF000
+#define UDMA_CFG			MMIO32(UDMA_BASE + 0x004)
+#define UDMA_CTLBASE			MMIO32(UDMA_BASE + 0x008)
+#define UDMA_USEBURSTCLR		MMIO32(UDMA_BASE + 0x01C)
+#define UDMA_REQMASKCLR			MMIO32(UDMA_BASE + 0x024)
+#define UDMA_ENASET			MMIO32(UDMA_BASE + 0x028)
+#define UDMA_ENACLR			MMIO32(UDMA_BASE + 0x02C)
+#define UDMA_ALTCLR			MMIO32(UDMA_BASE + 0x034)
+#define UDMA_PRIOCLR			MMIO32(UDMA_BASE + 0x03C)
+#define UDMA_CHIS			MMIO32(UDMA_BASE + 0x504)
+#define UDMA_CHMAP1			MMIO32(UDMA_BASE + 0x514)
+#define UDMA_CHMAP1_UART1		0x11	/* CH8SEL = CH9SEL = 1 */
+
+#define SYSCTL_RCGCDMA			MMIO32(0x400FE000 + 0x60C)
+
+#define UDMA_CFG_MASTEN			(1 << 0)
+
+/* Channel control word; byte sized items leave the size fields at 0. */
+#define UDMA_CHCTL_DSTINC_NONE		(3 << 30)
+#define UDMA_CHCTL_SRCINC_NONE		(3 << 26)
+#define UDMA_CHCTL_XFERSIZE_SHIFT	4
+#define UDMA_CHCTL_XFERSIZE_MASK	(0x3ff << UDMA_CHCTL_XFERSIZE_SHIFT)
+#define UDMA_CHCTL_XFERMODE_MASK	(7 << 0)
+#define UDMA_CHCTL_XFERMODE_STOP	(0 << 0)
+#define UDMA_CHCTL_XFERMODE_BASIC	(1 << 0)
+
+/* UART1 sits on channels 8 and 9 with encoding 1 in DMACHMAP1. */
+#define UART1_RX_CHANNEL		8
+#define UART1_TX_CHANNEL		9
+#define UART1_CHANNELS			((1 << UART1_RX_CHANNEL) | \
+					 (1 << UART1_TX_CHANNEL))
+
+struct udma_entry {
+	volatile uint32_t src_end;
+	volatile uint32_t dst_end;
+	volatile uint32_t ctl;
+	uint32_t unused;
+};
+
+/*
+ * Primary control structures.  The hardware wants the table 1024 byte
+ * aligned; the alternate half is not used, so it is not allocated.
+ */
+static struct udma_entry udma_table[32] __attribute__((aligned(1024)));
+
+/* Length of the receive transfer in flight, 0 when none is armed. */
+static uint16_t rx_len;
+
 static void uart_ctl_line_setup(void)
 {
 	uint32_t inpins, outpins;
@@ -70,11 +127,86 @@ void uart_init(void)
 	/* We don't make any other settings here. */
 	uart_enable(UART1);
 
-	/* Ping us when something comes in */
-	uart_enable_rx_interrupt(UART1);
+	uart_enable_fifo(UART1);
+	uart_enable_rx_dma(UART1);
+	uart_enable_tx_dma(UART1);
+
+	/*
+	 * uDMA setup.  Both channels are plain basic mode, single requests,
+	 * normal priority.  Their completion is signalled on the UART1
+	 * interrupt.
+	 */
+	SYSCTL_RCGCDMA |= 1;
+	__asm__("nop; nop; nop");
+	UDMA_CFG = UDMA_CFG_MASTEN;
+	UDMA_CTLBASE = (uint32_t)udma_table;
+	UDMA_CHMAP1 = (UDMA_CHMAP1 & ~0xff) | UDMA_CHMAP1_UART1;
+	UDMA_ALTCLR = UART1_CHANNELS;
+	UDMA_PRIOCLR = UART1_CHANNELS;
+	UDMA_USEBURSTCLR = UART1_CHANNELS;
+	UDMA_REQMASKCLR = UART1_CHANNELS;
+
 	nvic_enable_irq(NVIC_UART1_IRQ);
 }
 
+void uart_tx_start(const uint8_t *buf, uint16_t len)
+{
+	struct udma_entry *e = &udma_table[UART1_TX_CHANNEL];
+
+	e->src_end = (uint32_t)&buf[len - 1];
+	e->dst_end = (uint32_t)&UART_DR(UART1);
+	e->ctl = UDMA_CHCTL_DSTINC_NONE |
+		 ((len - 1) << UDMA_CHCTL_XFERSIZE_SHIFT) |
+		 UDMA_CHCTL_XFERMODE_BASIC;
+	UDMA_ENASET = 1 << UART1_TX_CHANNEL;
+}
+
+void uart_rx_start(uint8_t *buf, uint16_t len)
+{
+	struct udma_entry *e = &udma_table[UART1_RX_CHANNEL];
+
+	e->src_end = (uint32_t)&UART_DR(UART1);
+	e->dst_end = (uint32_t)&buf[len - 1];
+	e->ctl = UDMA_CHCTL_SRCINC_NONE |
+		 ((len - 1) << UDMA_CHCTL_XFERSIZE_SHIFT) |
+		 UDMA_CHCTL_XFERMODE_BASIC;
+	rx_len = len;
+	UDMA_ENASET = 1 << UART1_RX_CHANNEL;
+}
+
+/*
+ * Bytes the receive transfer has stored so far.  XFERSIZE counts the items
+ * still outstanding minus one, and the mode drops to stop once it is done.
+ */
+uint16_t uart_rx_count(void)
+{
+	uint32_t ctl = udma_table[UART1_RX_CHANNEL].ctl;
+
+	if (!rx_len)
+		return 0;
+	if ((ctl & UDMA_CHCTL_XFERMODE_MASK) == UDMA_CHCTL_XFERMODE_STOP)
+		return rx_len;
+	return rx_len - (((ctl & UDMA_CHCTL_XFERSIZE_MASK) >>
+			  UDMA_CHCTL_XFERSIZE_SHIFT) + 1);
+}
+
+/*
+ * Cut the receive transfer short and return how much it stored.  Any
+ * completion that raced with us is swallowed here, so the bridge sees
+ * each buffer exactly once.
+ */
+uint16_t uart_rx_stop(void)
+{
+	uint16_t count;
+
+	UDMA_ENACLR = 1 << UART1_RX_CHANNEL;
+	count = uart_rx_count();
+	UDMA_CHIS = 1 << UART1_RX_CHANNEL;
+	rx_len = 0;
+
+	return count;
+}
+
 uint8_t uart_get_ctl_line_state(void)
 {
 	return gpio_read(GPIOA, PIN_RI | PIN_DSR | PIN_DCD);
@@ -92,8 +224,14 @@ void uart_set_ctl_line_state(uint8_t dtr, uint8_t rts)
 
 void uart1_isr(void)
 {
-	uint8_t rx;
-	rx = uart_recv(UART1);
-	glue_data_received_cb(&rx, 1);
-	uart_clear_interrupt_flag(UART1, UART_INT_RX);
+	uint32_t done = UDMA_CHIS & UART1_CHANNELS;
+
+	UDMA_CHIS = done;
+
+	if (done & (1 << UART1_TX_CHANNEL))
+		glue_uart_tx_done_cb();
+	if (done & (1 << UART1_RX_CHANNEL)) {
+		rx_len = 0;
+		glue_uart_rx_done_cb();
+	}
 }
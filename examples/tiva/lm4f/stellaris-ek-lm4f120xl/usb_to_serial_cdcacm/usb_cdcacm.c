@@ -216,19 +216,37 @@ static enum usbd_request_return_codes cdcacm_control_request(usbd_device * usbd_
 	return USBD_REQ_NOTSUPP;
 }
 
+/*
+ * An OUT packet has arrived.  It is not read here: the bridge reads it
+ * straight into one of its buffers, and while it has none to spare the
+ * packet stays in the endpoint FIFO and the hardware NAKs the host.
+ */
 static void cdcacm_data_rx_cb(usbd_device * usbd_dev, uint8_t ep)
 {
-	uint8_t buf[64];
+	(void)usbd_dev;
+	(void)ep;
+
+	glue_usb_rx_cb();
+}
 
+static void cdcacm_data_tx_cb(usbd_device * usbd_dev, uint8_t ep)
+{
+	(void)usbd_dev;
 	(void)ep;
 
-	int len = usbd_ep_read_packet(usbd_dev, 0x01, buf, 64);
-	glue_send_data_cb(buf, len);
+	glue_usb_tx_cb();
+}
+
+/* Returns the size of the packet read, 0 if none was waiting. */
+uint16_t cdcacm_read_packet(uint8_t * buf)
+{
+	return usbd_ep_read_packet(acm_dev, 0x01, buf, 64);
 }
 
-void cdcacm_send_data(uint8_t * buf, uint16_t len)
+/* Returns len if the packet was queued, 0 if the endpoint is still busy. */
+uint16_t cdcacm_write_packet(const uint8_t * buf, uint16_t len)
 {
-	usbd_ep_write_packet(acm_dev, 0x82, buf, len);
+	return usbd_ep_write_packet(acm_dev, 0x82, buf, len);
 }
 
 static void cdcacm_set_config(usbd_device * usbd_dev, uint16_t wValue)
@@ -237,9 +255,12 @@ static void cdcacm_set_config(usbd_device * usbd_dev, uint16_t wValue)
 
 	usbd_ep_setup(usbd_dev, 0x01, USB_ENDPOINT_ATTR_BULK, 64,
 		      cdcacm_data_rx_cb);
-	usbd_ep_setup(usbd_dev, 0x82, USB_ENDPOINT_ATTR_BULK, 64, NULL);
+	usbd_ep_setup(usbd_dev, 0x82, USB_ENDPOINT_ATTR_BULK, 64,
+		      cdcacm_data_tx_cb);
 	usbd_ep_setup(usbd_dev, 0x83, USB_ENDPOINT_ATTR_INTERRUPT, 16, NULL);
 
+	glue_usb_configured_cb();
+
 	usbd_register_control_callback(usbd_dev,
 				       USB_REQ_TYPE_CLASS |
 				       USB_REQ_TYPE_INTERFACE,
@@ -36,6 +36,7 @@
 #include <libopencm3/lm4f/uart.h>
 #include <libopencm3/lm4f/nvic.h>
 #include <libopencm3/cm3/scb.h>
+#include <libopencm3/cm3/systick.h>
 
 #define PLL_DIV_80MHZ		5
 /* This is how the RGB LED is connected on the stellaris launchpad */
@@ -85,14 +86,6 @@ static void cm4f_enable_fpu(void)
 
 }
 
-void glue_data_received_cb(uint8_t * buf, uint16_t len)
-{
-	/* Blue LED indicates data coming in */
-	gpio_set(RGB_PORT, LED_B);
-	cdcacm_send_data(buf, len);
-	gpio_clear(RGB_PORT, LED_B);
-}
-
 void glue_set_line_state_cb(uint8_t dtr, uint8_t rts)
 {
 	/* Green LED indicated one of the control lines are active */
@@ -101,7 +94,7 @@ void glue_set_line_state_cb(uint8_t dtr, uint8_t rts)
 	else
 		gpio_clear(RGB_PORT, LED_G);
 
-	uart_set_ctl_line_state(dtr, rts);
+	bridge_set_line_state(dtr, rts);
 }
 
 int glue_set_line_coding_cb(uint32_t baud, uint8_t databits,
@@ -152,18 +145,20 @@ int glue_set_line_coding_cb(uint32_t baud, uint8_t databits,
 	return 1;
 }
 
-void glue_send_data_cb(uint8_t * buf, uint16_t len)
+/*
+ * SysTick at 1kHz paces the bridge's RX idle detection.
+ */
+static void systick_setup(void)
 {
-	int i;
-
-	/* Red LED indicates data going out */
-	gpio_set(RGB_PORT, LED_R);
-
-	for (i = 0; i < len; i++) {
-		uart_send_blocking(UART1, buf[i]);
-	}
+	systick_set_clocksource(STK_CSR_CLKSOURCE_AHB);
+	systick_set_reload(80000 - 1);
+	systick_interrupt_enable();
+	systick_counter_enable();
+}
 
-	gpio_clear(RGB_PORT, LED_R);
+void sys_tick_handler(void)
+{
+	bridge_tick();
 }
 
 static void mainloop(void)
@@ -171,6 +166,16 @@ static void mainloop(void)
 	uint8_t linestate, cdcacmstate;
 	static uint8_t oldlinestate = 0;
 
+	/* Red LED indicates data going out, blue LED data coming in */
+	if (bridge_uart_tx_busy())
+		gpio_set(RGB_PORT, LED_R);
+	else
+		gpio_clear(RGB_PORT, LED_R);
+	if (bridge_uart_rx_busy())
+		gpio_set(RGB_PORT, LED_B);
+	else
+		gpio_clear(RGB_PORT, LED_B);
+
 	/* See if the state of control lines has changed */
 	linestate = uart_get_ctl_line_state();
 	if (oldlinestate != linestate) {
@@ -194,8 +199,10 @@ int main(void)
 	clock_setup();
 	gpio_setup();
 
-	cdcacm_init();
 	uart_init();
+	bridge_init();
+	cdcacm_init();
+	systick_setup();
 
 	cm4f_enable_fpu();
 
@@ -41,6 +41,10 @@ enum rs232pin {
 void uart_init(void);
 uint8_t uart_get_ctl_line_state(void);
 void uart_set_ctl_line_state(uint8_t dtr, uint8_t rts);
+void uart_tx_start(const uint8_t *buf, uint16_t len);
+void uart_rx_start(uint8_t *buf, uint16_t len);
+uint16_t uart_rx_count(void);
+uint16_t uart_rx_stop(void);
 /* =============================================================================
  * CDCACM control
  * ---------------------------------------------------------------------------*/
@@ -52,16 +56,28 @@ enum cdc_serial_state_line {
 
 void cdcacm_init(void);
 void cdcacm_line_state_changed_cb(uint8_t linemask);
-void cdcacm_send_data(uint8_t *buf, uint16_t len);
+uint16_t cdcacm_read_packet(uint8_t *buf);
+uint16_t cdcacm_write_packet(const uint8_t *buf, uint16_t len);
 /* =============================================================================
  * CDCACM <-> UART glue
  * ---------------------------------------------------------------------------*/
-void glue_data_received_cb(uint8_t *buf, uint16_t len);
 void glue_set_line_state_cb(uint8_t dtr, uint8_t rts);
 int glue_set_line_coding_cb(uint32_t baud, uint8_t databits,
 			    enum usb_cdc_line_coding_bParityType cdc_parity,
 			    enum usb_cdc_line_coding_bCharFormat cdc_stopbits);
-void glue_send_data_cb(uint8_t *buf, uint16_t len);
+/* =============================================================================
+ * Data path (bridge.c)
+ * ---------------------------------------------------------------------------*/
+void bridge_init(void);
+void bridge_set_line_state(uint8_t dtr, uint8_t rts);
+void bridge_tick(void);
+uint8_t bridge_uart_tx_busy(void);
+uint8_t bridge_uart_rx_busy(void);
+void glue_usb_configured_cb(void);
+void glue_usb_rx_cb(void);
+void glue_usb_tx_cb(void);
+void glue_uart_tx_done_cb(void);
+void glue_uart_rx_done_cb(void);
 
 #endif /* __STELLARIS_EK_LM4F120XL_USB_TO_SERIAL_CDCACM_H */
 